@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
 #include "buffer/buffer_pool_manager.h"
+#include "common/exception.h"
+#include "common/logger.h"
+#include "logging/index_log.h"
 
 namespace cmudb {
 
@@ -12,8 +19,16 @@ BufferPoolManager::BufferPoolManager(size_t pool_size,
                                                  LogManager *log_manager)
     : pool_size_(pool_size), disk_manager_(disk_manager),
       log_manager_(log_manager) {
-  // a consecutive memory space for buffer pool
+  // a consecutive memory space for buffer pool, aligned for direct I/O
+  void *frames = nullptr;
+  if (posix_memalign(&frames, DIRECT_IO_ALIGN, pool_size_ * PAGE_SIZE) != 0)
+    throw std::bad_alloc();
+  frames_ = static_cast<char *>(frames);
   pages_ = new Page[pool_size_];
+  for (size_t i = 0; i < pool_size_; ++i) {
+    pages_[i].data_ = frames_ + i * PAGE_SIZE;
+    pages_[i].ResetMemory();
+  }
   page_table_ = new ExtendibleHash<page_id_t, Page *>(BUCKET_SIZE);
   replacer_ = new LRUReplacer<Page *>;
   free_list_ = new std::list<Page *>;
@@ -30,6 +45,9 @@ BufferPoolManager::BufferPoolManager(size_t pool_size,
  */
 BufferPoolManager::~BufferPoolManager() {
   delete[] pages_;
+  free(frames_);
+  for (auto page : mapped_pages_)
+    delete page;
   delete page_table_;
   delete replacer_;
   delete free_list_;
@@ -45,15 +63,28 @@ BufferPoolManager::~BufferPoolManager() {
  * entry for the new page.
  * 4. Update page metadata, read page content from disk file and return page
  * pointer
+ * A page failing its checksum gives its frame back and throws
  */
 Page *BufferPoolManager::FetchPage(page_id_t page_id) { 
     std::lock_guard<std::mutex> lock(latch_);
 
+    if (disk_manager_->IsReadOnly()) {
+      return FetchMappedPage(page_id);
+    }
+
     Page *res = nullptr;
     
-    if (page_table_->Find(page_id, res)) {
+    if (page_table_->Find(page_id, res) && !WaitForRead(res)) {
+      // the prefetch failed, read the page again below
+      DropFrame(res);
+      res = nullptr;
+    }
+
+    if (res != nullptr) {
       ++res->pin_count_;
       replacer_->Erase(res);
+      SetRecLSN(res);
+      IndexLog::Pinned(res, false);
       return res;
     }
     else {
@@ -65,11 +96,17 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id) {
         if (!replacer_->Victim(res)) {
           return nullptr;
         }
+        WaitForRead(res);
       }
     }
 
     if (res->is_dirty_) {
-      disk_manager_->WritePage(res->page_id_, res->GetData());
+      if (!WaitForLog(res->GetLSN()) ||
+          !disk_manager_->WritePage(res->page_id_, res->GetData())) {
+        // the victim can't be written, it stays
+        replacer_->Insert(res);
+        return nullptr;
+      }
     }
 
     page_table_->Remove(res->page_id_);
@@ -78,12 +115,48 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id) {
     res->page_id_ = page_id;
     res->pin_count_ = 1;
     res->is_dirty_ = false;
-
-    disk_manager_->ReadPage(res->page_id_, res->GetData());
+    res->rec_lsn_ = INVALID_LSN;
+    SetRecLSN(res);
+
+    try {
+      disk_manager_->ReadPage(res->page_id_, res->GetData());
+    } catch (Exception &e) {
+      page_table_->Remove(page_id);
+      res->page_id_ = INVALID_PAGE_ID;
+      res->pin_count_ = 0;
+      res->rec_lsn_ = INVALID_LSN;
+      free_list_->push_back(res);
+      throw;
+    }
+    IndexLog::Pinned(res, false);
 
     return res;
  }
 
+/*
+ * Zero-copy fetch from a read-only mapping: the first fetch of a page creates
+ * its descriptor over the mapped bytes, later ones only pin it
+ */
+Page *BufferPoolManager::FetchMappedPage(page_id_t page_id) {
+  Page *res = nullptr;
+  if (page_table_->Find(page_id, res)) {
+    ++res->pin_count_;
+    return res;
+  }
+  char *data = disk_manager_->GetMappedPage(page_id);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  disk_manager_->VerifyPage(page_id, data);
+  res = new Page();
+  res->data_ = data;
+  res->page_id_ = page_id;
+  res->pin_count_ = 1;
+  mapped_pages_.push_back(res);
+  page_table_->Insert(page_id, res);
+  return res;
+}
+
 /*
  * Implementation of unpin page
  * if pin_count>0, decrement it and if it becomes zero, put it back to
@@ -91,6 +164,8 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id) {
  * dirty flag of this page
  */
 bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
+  // logged while it is still pinned, outside the latch
+  IndexLog::Unpinning(page_id, is_dirty);
   std::lock_guard<std::mutex> lock(latch_);
   
   Page *res = nullptr;
@@ -101,7 +176,7 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
 
   if (res->pin_count_ > 0) {
     --res->pin_count_;
-    if (res->pin_count_ == 0) {
+    if (res->pin_count_ == 0 && !disk_manager_->IsReadOnly()) {
       replacer_->Insert(res);
     }
   }
@@ -109,9 +184,18 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
     return false;
   }
 
+  // the pin is released all the same, only the modification is rejected
+  if (is_dirty && disk_manager_->IsReadOnly()) {
+    LOG_DEBUG("modification of read-only page rejected");
+    return false;
+  }
+
   if (is_dirty) {
     res->is_dirty_ = true;
   }
+  if (res->pin_count_ == 0 && !res->is_dirty_) {
+    res->rec_lsn_ = INVALID_LSN;
+  }
 
   return true;
 }
@@ -125,33 +209,224 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
 bool BufferPoolManager::FlushPage(page_id_t page_id) { 
     std::lock_guard<std::mutex> lock(latch_);
 
-    if (page_id == INVALID_PAGE_ID) {
+    if (page_id == INVALID_PAGE_ID || disk_manager_->IsReadOnly()) {
       return false;
     }
 
     Page *res = nullptr;
 
     if (page_table_->Find(page_id, res)) {
-      disk_manager_->WritePage(res->page_id_, res->GetData());
+      if (!WaitForRead(res)) {
+        DropFrame(res);
+        return false;
+      }
+      if (!WaitForLog(res->GetLSN()) ||
+          !disk_manager_->WritePage(res->page_id_, res->GetData())) {
+        return false;
+      }
+      res->is_dirty_ = false;
+      res->rec_lsn_ = INVALID_LSN;
+      if (res->pin_count_ > 0)
+        SetRecLSN(res);
       return true;
     }
 
     return false;
  }
 
+/*
+ * Dirty pages are written as one batch of asynchronous writes, waited for
+ * together, then made durable with a single sync. If the log can't cover
+ * them, they stay dirty, as does a page whose write failed
+ */
+bool BufferPoolManager::FlushAllPages() {
+  std::lock_guard<std::mutex> lock(latch_);
+
+  lsn_t max_lsn = INVALID_LSN;
+  for (size_t i = 0; i < pool_size_; i++) {
+    Page *page = &pages_[i];
+    if (page->page_id_ != INVALID_PAGE_ID && page->is_dirty_)
+      max_lsn = std::max(max_lsn, page->GetLSN());
+  }
+  if (!WaitForLog(max_lsn))
+    return false;
+
+  std::vector<page_id_t> page_ids;
+  std::vector<const char *> page_datas;
+  std::vector<Page *> written_pages;
+  std::vector<lsn_t> rec_lsns;
+  for (size_t i = 0; i < pool_size_; i++) {
+    Page *page = &pages_[i];
+    if (page->page_id_ != INVALID_PAGE_ID && page->is_dirty_) {
+      page_ids.push_back(page->page_id_);
+      page_datas.push_back(page->GetData());
+      written_pages.push_back(page);
+      rec_lsns.push_back(page->rec_lsn_);
+      page->is_dirty_ = false;
+      // what a pinner changes from now on is not part of the write
+      page->rec_lsn_ = INVALID_LSN;
+      if (page->pin_count_ > 0)
+        SetRecLSN(page);
+    }
+  }
+  bool written = true;
+  if (!page_ids.empty()) {
+    auto dones = disk_manager_->WritePagesAsync(page_ids, page_datas);
+    for (size_t i = 0; i < dones.size(); i++) {
+      try {
+        dones[i].get();
+      } catch (Exception &) {
+        // dirty again since its first change
+        written_pages[i]->is_dirty_ = true;
+        written_pages[i]->rec_lsn_ = rec_lsns[i];
+        written = false;
+      }
+    }
+  }
+  return disk_manager_->Sync() && written;
+}
+
+/*
+ * Take a frame for every page that is not resident yet, from the free list
+ * first, then from the replacer. Frames are taken only from those that were
+ * available on entry, so one call never evicts its own pages. The reads are
+ * submitted as one batch; the frames go to the replacer unpinned, and a later
+ * FetchPage (or eviction) of such a page waits for its read to finish
+ */
+void BufferPoolManager::PrefetchPages(const std::vector<page_id_t> &page_ids) {
+  std::lock_guard<std::mutex> lock(latch_);
+
+  if (disk_manager_->IsReadOnly()) {
+    // the pages are not copied, let the kernel read them into its cache
+    disk_manager_->AdviseWillNeed(page_ids);
+    return;
+  }
+
+  size_t available = free_list_->size() + replacer_->Size();
+  std::vector<Page *> frames;
+  std::vector<page_id_t> read_ids;
+  std::vector<char *> read_datas;
+  for (auto page_id : page_ids) {
+    if (frames.size() == available)
+      break;
+    Page *res = nullptr;
+    if (page_id == INVALID_PAGE_ID || page_table_->Find(page_id, res))
+      continue;
+    if (!free_list_->empty()) {
+      res = free_list_->front();
+      free_list_->pop_front();
+    } else {
+      if (!replacer_->Victim(res))
+        break;
+      WaitForRead(res);
+      if (res->is_dirty_) {
+        if (!WaitForLog(res->GetLSN()) ||
+            !disk_manager_->WritePage(res->page_id_, res->GetData())) {
+          replacer_->Insert(res);
+          break;
+        }
+      }
+      page_table_->Remove(res->page_id_);
+    }
+    page_table_->Insert(page_id, res);
+    res->page_id_ = page_id;
+    res->pin_count_ = 0;
+    res->is_dirty_ = false;
+    res->rec_lsn_ = INVALID_LSN;
+    frames.push_back(res);
+    read_ids.push_back(page_id);
+    read_datas.push_back(res->GetData());
+  }
+  if (frames.empty())
+    return;
+
+  auto reads = disk_manager_->ReadPagesAsync(read_ids, read_datas);
+  for (size_t i = 0; i < frames.size(); i++) {
+    frames[i]->pending_read_ = std::move(reads[i]);
+    replacer_->Insert(frames[i]);
+  }
+}
+
+/*
+ * Give back the unpinned frame of a page whose prefetch failed
+ */
+void BufferPoolManager::DropFrame(Page *page) {
+  page_table_->Remove(page->page_id_);
+  replacer_->Erase(page);
+  page->page_id_ = INVALID_PAGE_ID;
+  page->is_dirty_ = false;
+  page->rec_lsn_ = INVALID_LSN;
+  free_list_->push_back(page);
+}
+
+/*
+ * Pages pinned or dirty, with their recLSN, for a checkpoint. A page pinned
+ * but not yet unpinned dirty may already hold changes, it is listed too
+ */
+std::vector<std::pair<page_id_t, lsn_t>>
+BufferPoolManager::GetDirtyPageTable() {
+  std::lock_guard<std::mutex> lock(latch_);
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+  for (size_t i = 0; i < pool_size_; i++) {
+    Page *page = &pages_[i];
+    if (page->page_id_ != INVALID_PAGE_ID && page->rec_lsn_ != INVALID_LSN)
+      dirty_pages.emplace_back(page->page_id_, page->rec_lsn_);
+  }
+  return dirty_pages;
+}
+
+/*
+ * A pinned page may be changed by the records from the next one on, the
+ * recLSN of a page already pinned or dirty stays
+ */
+void BufferPoolManager::SetRecLSN(Page *page) {
+  if (page->rec_lsn_ == INVALID_LSN && log_manager_ != nullptr)
+    page->rec_lsn_ = log_manager_->GetNextLSN();
+}
+
+/*
+ * Write-ahead rule: a page is written only once the log records up to its LSN
+ * are on disk. Also with logging off, recovery logs its undo before the flush
+ * thread runs
+ */
+bool BufferPoolManager::WaitForLog(lsn_t lsn) {
+  return log_manager_ == nullptr || lsn <= log_manager_->GetPersistentLSN() ||
+         log_manager_->WaitForFlush(lsn);
+}
+
+bool BufferPoolManager::WaitForRead(Page *page) {
+  if (!page->pending_read_.valid())
+    return true;
+  try {
+    page->pending_read_.get();
+  } catch (Exception &e) {
+    return false;
+  }
+  return true;
+}
+
 /**
  * User should call this method for deleting a page. This routine will call
  * disk manager to deallocate the page. First, if page is found within page
  * table, buffer pool manager should be reponsible for removing this entry out
  * of page table, reseting page metadata and adding back to free list. Second,
- * call disk manager's DeallocatePage() method to delete from disk file. If
- * the page is found within page table, but pin_count != 0, return false
+ * call disk manager's DeallocatePage() method to delete from disk file, an
+ * index operation does it at its end instead. If the page is found within
+ * page table, but pin_count != 0, return false
  */
 bool BufferPoolManager::DeletePage(page_id_t page_id) { 
     std::lock_guard<std::mutex> lock(latch_);
 
+    if (disk_manager_->IsReadOnly()) {
+      return false;
+    }
+
     Page *res = nullptr;
     if (!page_table_->Find(page_id, res)) {
+      // not resident, only the disk copy has to go
+      if (!IndexLog::Deleting(disk_manager_, page_id)) {
+        disk_manager_->DeallocatePage(page_id);
+      }
       return true;
     }
 
@@ -159,8 +434,10 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) {
       return false;
     }
 
+    WaitForRead(res);
     res->page_id_ = INVALID_PAGE_ID;
     res->is_dirty_ = false;
+    res->rec_lsn_ = INVALID_LSN;
 
     free_list_->push_back(res);
 
@@ -168,7 +445,9 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) {
 
     replacer_->Erase(res);
       
-    disk_manager_->DeallocatePage(page_id);
+    if (!IndexLog::Deleting(disk_manager_, page_id)) {
+      disk_manager_->DeallocatePage(page_id);
+    }
 
     return true;
  }
@@ -181,41 +460,54 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) {
  * update new page's metadata, zero out memory and add corresponding entry
  * into page table. return nullptr if all the pages in pool are pinned
  */
-Page *BufferPoolManager::NewPage(page_id_t &page_id) { 
+Page *BufferPoolManager::NewPage(page_id_t &page_id, page_id_t hint) { 
     std::lock_guard<std::mutex> lock(latch_);
 
+    if (disk_manager_->IsReadOnly()) {
+      return nullptr;
+    }
+
     Page *res = nullptr;
     
     if (!free_list_->empty()) {
       res = free_list_->front();
       free_list_->pop_front();
-      return res;
-    }
-
-    if (!replacer_->Victim(res)) {
-      return nullptr;
-    }
+    } else {
+      if (!replacer_->Victim(res)) {
+        return nullptr;
+      }
+      WaitForRead(res);
 
-    page_id = disk_manager_->AllocatePage();
+      if (res->is_dirty_) {
+        if (!WaitForLog(res->GetLSN()) ||
+            !disk_manager_->WritePage(res->page_id_, res->GetData())) {
+          replacer_->Insert(res);
+          return nullptr;
+        }
+      }
 
-    if (res->is_dirty_) {
-      disk_manager_->WritePage(res->page_id_, res->GetData());
+      page_table_->Remove(res->page_id_);
     }
 
-    page_table_->Remove(res->page_id_);
-
-    /*
-    if (page_id < 0) {
-      page_id = 0;
+    page_id = disk_manager_->AllocatePage(hint);
+    if (page_id == INVALID_PAGE_ID) {
+      // the data file is full, the frame goes back unused
+      res->page_id_ = INVALID_PAGE_ID;
+      res->is_dirty_ = false;
+      res->rec_lsn_ = INVALID_LSN;
+      free_list_->push_back(res);
+      return nullptr;
     }
-    */
 
     page_table_->Insert(page_id, res);
 
     res->pin_count_ = 1;
     res->is_dirty_ = false;
     res->page_id_ = page_id;
+    res->rec_lsn_ = INVALID_LSN;
+    SetRecLSN(res);
     res->ResetMemory();
+    IndexLog::Pinned(res, true);
 
     return res;
  }
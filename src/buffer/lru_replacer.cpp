@@ -13,7 +13,13 @@ template <typename T> LRUReplacer<T>::LRUReplacer() {
 	tail_ = head_;
 }
 
-template <typename T> LRUReplacer<T>::~LRUReplacer() {}
+template <typename T> LRUReplacer<T>::~LRUReplacer() {
+	while (head_ != nullptr) {
+		Node *next = head_->next;
+		delete head_;
+		head_ = next;
+	}
+}
 
 /*
  * Insert value into LRU
@@ -35,6 +41,7 @@ template <typename T> void LRUReplacer<T>::Insert(const T &value) {
 			pre->next->pre = pre;
 
 			cur->pre = tail_;
+			cur->next = nullptr;
 			tail_->next = std::move(cur);
 			tail_ = tail_->next;
 		}
@@ -51,11 +58,13 @@ template <typename T> bool LRUReplacer<T>::Victim(T &value) {
   		return false;
   	}
   
-	value = head_->next->value;
-	head_->next = head_->next->next;
+	Node *victim = head_->next;
+	value = victim->value;
+	head_->next = victim->next;
 	if (head_->next != nullptr) {
 		head_->next->pre = head_;
 	}
+	delete victim;
 
 	items.erase(value);
 	if (items.size() == 0) {
@@ -79,6 +88,7 @@ template <typename T> bool LRUReplacer<T>::Erase(const T &value) {
   			Node *cur = pre->next;
   			pre->next = std::move(cur->next);
   			pre->next->pre = pre;
+  			delete cur;
   		}
   		else {
   			tail_ = tail_->pre;
@@ -94,7 +104,10 @@ template <typename T> bool LRUReplacer<T>::Erase(const T &value) {
   	return false;
 }
 
-template <typename T> size_t LRUReplacer<T>::Size() { return items.size() - 1; }
+template <typename T> size_t LRUReplacer<T>::Size() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return items.size();
+}
 
 template class LRUReplacer<Page *>;
 // test only
@@ -4,4 +4,10 @@ namespace cmudb {
   std::atomic<bool> ENABLE_LOGGING(false);  // for virtual table
   std::chrono::duration<long long int> LOG_TIMEOUT =
    std::chrono::seconds(1);
+  std::chrono::duration<long long int> CHECKPOINT_TIMEOUT =
+   std::chrono::seconds(30);
+  std::chrono::milliseconds ASYNC_COMMIT_MAX_LAG =
+   std::chrono::milliseconds(10);
+  std::chrono::milliseconds STANDBY_POLL_INTERVAL =
+   std::chrono::milliseconds(10);
 }
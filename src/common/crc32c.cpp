@@ -0,0 +1,62 @@
+/**
+ * crc32c.cpp
+ */
+#include <cstring>
+
+#include "common/crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace cmudb {
+
+// reflected Castagnoli polynomial
+static const uint32_t CRC32C_POLY = 0x82f63b78;
+
+struct Crc32cTable {
+  uint32_t entries[256];
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+      entries[i] = crc;
+    }
+  }
+};
+
+static uint32_t Crc32cSoftware(uint32_t crc, const char *data, size_t size) {
+  static const Crc32cTable table;
+  for (size_t i = 0; i < size; i++)
+    crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^
+          (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+Crc32cHardware(uint32_t crc, const char *data, size_t size) {
+  uint64_t crc64 = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; size > 0; size--, data++)
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*data));
+  return crc;
+}
+#endif
+
+uint32_t Crc32c(const char *data, size_t size) {
+#if defined(__x86_64__)
+  static const bool hardware = __builtin_cpu_supports("sse4.2");
+  if (hardware)
+    return ~Crc32cHardware(~0U, data, size);
+#endif
+  return ~Crc32cSoftware(~0U, data, size);
+}
+
+} // namespace cmudb
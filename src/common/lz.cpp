@@ -0,0 +1,151 @@
+/**
+ * lz.cpp
+ *
+ * A sequence is a token (literal length in the high nibble, match length - 4
+ * in the low one, 15 meaning more length bytes follow), the literals, a two
+ * byte little endian offset and the rest of the match length. The last
+ * sequence has literals only.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "common/lz.h"
+
+namespace cmudb {
+
+static const int MIN_MATCH = 4;
+// the block ends with this many literals, and no match starts in the last
+// MATCH_LIMIT bytes, as the LZ4 format asks
+static const int LAST_LITERALS = 5;
+static const int MATCH_LIMIT = 12;
+static const int MAX_OFFSET = 65535;
+static const int HASH_BITS = 10;
+
+static inline uint32_t Read32(const char *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static inline uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// a length past its nibble: bytes of 255, then the remainder
+static bool PutLength(int length, char *dst, int &out, int capacity) {
+  for (; length >= 255; length -= 255) {
+    if (out >= capacity)
+      return false;
+    dst[out++] = static_cast<char>(255);
+  }
+  if (out >= capacity)
+    return false;
+  dst[out++] = static_cast<char>(length);
+  return true;
+}
+
+static bool GetLength(const char *src, int &in, int size, int &length) {
+  uint8_t byte;
+  do {
+    if (in >= size)
+      return false;
+    byte = static_cast<uint8_t>(src[in++]);
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/*
+ * Literals followed by a match, or by nothing when match_length is 0
+ */
+static bool PutSequence(const char *literals, int literal_length, int offset,
+                        int match_length, char *dst, int &out, int capacity) {
+  if (out >= capacity)
+    return false;
+  int token = out++;
+  int match_code = match_length == 0 ? 0 : match_length - MIN_MATCH;
+  dst[token] = static_cast<char>((std::min(literal_length, 15) << 4) |
+                                 std::min(match_code, 15));
+  if (literal_length >= 15 &&
+      !PutLength(literal_length - 15, dst, out, capacity))
+    return false;
+  if (literal_length > capacity - out)
+    return false;
+  memcpy(dst + out, literals, literal_length);
+  out += literal_length;
+  if (match_length == 0)
+    return true;
+  if (capacity - out < 2)
+    return false;
+  dst[out++] = static_cast<char>(offset & 0xff);
+  dst[out++] = static_cast<char>(offset >> 8);
+  return match_code < 15 || PutLength(match_code - 15, dst, out, capacity);
+}
+
+int LzCompress(const char *src, int size, char *dst, int capacity) {
+  // last position each hashed sequence was seen at
+  int table[1 << HASH_BITS];
+  std::fill(table, table + (1 << HASH_BITS), -1);
+
+  int out = 0, anchor = 0, pos = 0;
+  while (pos < size - MATCH_LIMIT) {
+    uint32_t sequence = Read32(src + pos);
+    uint32_t hash = Hash(sequence);
+    int candidate = table[hash];
+    table[hash] = pos;
+    if (candidate < 0 || pos - candidate > MAX_OFFSET ||
+        Read32(src + candidate) != sequence) {
+      pos++;
+      continue;
+    }
+    int length = MIN_MATCH;
+    while (pos + length < size - LAST_LITERALS &&
+           src[candidate + length] == src[pos + length])
+      length++;
+    if (!PutSequence(src + anchor, pos - anchor, pos - candidate, length, dst,
+                     out, capacity))
+      return 0;
+    pos += length;
+    anchor = pos;
+  }
+  if (!PutSequence(src + anchor, size - anchor, 0, 0, dst, out, capacity))
+    return 0;
+  return out;
+}
+
+int LzDecompress(const char *src, int size, char *dst, int capacity) {
+  int in = 0, out = 0;
+  while (in < size) {
+    uint8_t token = static_cast<uint8_t>(src[in++]);
+    int literal_length = token >> 4;
+    if (literal_length == 15 && !GetLength(src, in, size, literal_length))
+      return -1;
+    if (literal_length > size - in || literal_length > capacity - out)
+      return -1;
+    memcpy(dst + out, src + in, literal_length);
+    in += literal_length;
+    out += literal_length;
+    if (in == size)
+      break;
+
+    if (size - in < 2)
+      return -1;
+    int offset = static_cast<uint8_t>(src[in]) |
+                 (static_cast<uint8_t>(src[in + 1]) << 8);
+    in += 2;
+    int match_length = token & 15;
+    if (match_length == 15 && !GetLength(src, in, size, match_length))
+      return -1;
+    match_length += MIN_MATCH;
+    if (offset == 0 || offset > out || match_length > capacity - out)
+      return -1;
+    // byte by byte, a match may overlap the bytes it produces
+    for (int i = 0; i < match_length; i++)
+      dst[out + i] = dst[out - offset + i];
+    out += match_length;
+  }
+  return out;
+}
+
+} // namespace cmudb
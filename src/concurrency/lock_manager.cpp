@@ -2,6 +2,7 @@
  * lock_manager.cpp
  */
 
+#include <algorithm>
 #include <cassert>
 #include "concurrency/lock_manager.h"
 
@@ -163,7 +164,10 @@ bool LockManager::Unlock(Transaction *txn, const RID &rid) {
 		}
 	}
 
-	assert(lock_table_.count(rid));
+	// ApplyDelete releases the tuple lock even when locking is off
+	if (lock_table_.count(rid) == 0) {
+		return false;
+	}
 	for (auto it = lock_table_[rid].list.begin();
 		it != lock_table_[rid].list.end(); ++it) {
 		if (it->txn_id == txn->GetTransactionId()) {
@@ -181,6 +185,16 @@ bool LockManager::Unlock(Transaction *txn, const RID &rid) {
 			break;
 		}
 	}
+	// wait-die compares with the oldest waiter or holder left, a finished
+	// transaction must not make younger ones die
+	if (lock_table_[rid].list.empty()) {
+		lock_table_.erase(rid);
+	} else {
+		lock_table_[rid].oldest = lock_table_[rid].list.front().txn_id;
+		for (auto &r : lock_table_[rid].list) {
+			lock_table_[rid].oldest = std::min(lock_table_[rid].oldest, r.txn_id);
+		}
+	}
 	return true;
 }
 
@@ -10,15 +10,22 @@ namespace cmudb {
 
 Transaction *TransactionManager::Begin() {
   Transaction *txn = new Transaction(next_txn_id_++);
+  txn->SetAsyncCommit(async_commit_);
 
   if (ENABLE_LOGGING) {
-    // TODO: write log and update transaction's prev_lsn here
+    // a checkpoint sees every transaction whose begin record precedes its own
+    std::lock_guard<std::mutex> lock(active_latch_);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::BEGIN);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(log_record));
+    active_txns_.emplace(txn->GetTransactionId(),
+                         std::make_pair(txn, txn->GetPrevLSN()));
   }
 
   return txn;
 }
 
-void TransactionManager::Commit(Transaction *txn) {
+bool TransactionManager::Commit(Transaction *txn) {
   txn->SetState(TransactionState::COMMITTED);
   // truly delete before commit
   auto write_set = txn->GetWriteSet();
@@ -33,9 +40,18 @@ void TransactionManager::Commit(Transaction *txn) {
   }
   write_set->clear();
 
+  bool durable = true;
   if (ENABLE_LOGGING) {
-    // TODO: write log and update transaction's prev_lsn here
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::COMMIT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(log_record));
+    // durable once the commit record is, concurrent commits share the flush
+    if (txn->IsAsyncCommit())
+      log_manager_->RequestFlush(txn->GetPrevLSN());
+    else
+      durable = log_manager_->WaitForFlush(txn->GetPrevLSN());
   }
+  EndTransaction(txn);
 
   // release all the lock
   std::unordered_set<RID> lock_set;
@@ -47,6 +63,7 @@ void TransactionManager::Commit(Transaction *txn) {
   for (auto locked_rid : lock_set) {
     lock_manager_->Unlock(txn, locked_rid);
   }
+  return durable;
 }
 
 void TransactionManager::Abort(Transaction *txn) {
@@ -71,8 +88,11 @@ void TransactionManager::Abort(Transaction *txn) {
   write_set->clear();
 
   if (ENABLE_LOGGING) {
-    // TODO: write log and update transaction's prev_lsn here
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::ABORT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(log_record));
   }
+  EndTransaction(txn);
 
   // release all the lock
   std::unordered_set<RID> lock_set;
@@ -85,4 +105,24 @@ void TransactionManager::Abort(Transaction *txn) {
     lock_manager_->Unlock(txn, locked_rid);
   }
 }
+
+/*
+ * The owners keep appending while the table is read: the last LSN of each is
+ * an atomic load, at worst one record behind, which recovery finds by reading
+ * on from the start of the checkpoint. A transaction stays here, and its
+ * Transaction alive, until EndTransaction takes active_latch_
+ */
+std::vector<ActiveTransaction> TransactionManager::GetActiveTransactions() {
+  std::lock_guard<std::mutex> lock(active_latch_);
+  std::vector<ActiveTransaction> active_txns;
+  for (auto &txn : active_txns_)
+    active_txns.push_back(
+        {txn.first, txn.second.second, txn.second.first->GetPrevLSN()});
+  return active_txns;
+}
+
+void TransactionManager::EndTransaction(Transaction *txn) {
+  std::lock_guard<std::mutex> lock(active_latch_);
+  active_txns_.erase(txn->GetTransactionId());
+}
 } // namespace cmudb
@@ -0,0 +1,302 @@
+/**
+ * async_io.cpp
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/logger.h"
+#include "disk/async_io.h"
+
+namespace cmudb {
+
+// workers of the fallback backend
+static const size_t IO_THREADS = 4;
+
+AsyncIO *AsyncIO::Create(size_t queue_depth, bool use_uring) {
+  if (use_uring) {
+    AsyncIO *uring = UringIO::Open(queue_depth);
+    if (uring != nullptr)
+      return uring;
+    LOG_DEBUG("io_uring not available, using thread pool");
+  }
+  return new ThreadPoolIO(IO_THREADS);
+}
+
+/*****************************************************************************
+ * THREAD POOL
+ *****************************************************************************/
+ThreadPoolIO::ThreadPoolIO(size_t num_threads) {
+  for (size_t i = 0; i < num_threads; i++)
+    workers_.push_back(std::thread(&ThreadPoolIO::Work, this));
+}
+
+/*
+ * Workers drain the queue before they exit, so every submitted request still
+ * gets its callback
+ */
+ThreadPoolIO::~ThreadPoolIO() {
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+void ThreadPoolIO::Submit(std::vector<IORequest> &requests) {
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    for (auto &request : requests)
+      queue_.push_back(std::move(request));
+  }
+  cv_.notify_all();
+}
+
+void ThreadPoolIO::Work() {
+  while (true) {
+    IORequest request;
+    {
+      std::unique_lock<std::mutex> lock(latch_);
+      cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      request = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    ssize_t rc;
+    int count = static_cast<int>(request.iov.size());
+    if (request.is_write)
+      rc = pwritev(request.fd, request.iov.data(), count, request.offset);
+    else
+      rc = preadv(request.fd, request.iov.data(), count, request.offset);
+    request.callback(rc < 0 ? -errno : rc);
+  }
+}
+
+/*****************************************************************************
+ * IO_URING
+ *****************************************************************************/
+static int UringSetup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int UringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                      unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+/*
+ * Set up the ring and map its submission queue, completion queue and sqe
+ * array. Any failure (no kernel support, seccomp, memlock limit) gives nullptr
+ * so the caller can fall back to the thread pool
+ */
+UringIO *UringIO::Open(size_t queue_depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = UringSetup(queue_depth, &params);
+  if (ring_fd < 0)
+    return nullptr;
+
+  UringIO *uring = new UringIO();
+  uring->ring_fd_ = ring_fd;
+  uring->sq_ring_size_ =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  uring->cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    uring->sq_ring_size_ = uring->cq_ring_size_ =
+        std::max(uring->sq_ring_size_, uring->cq_ring_size_);
+
+  void *sq_ring = mmap(nullptr, uring->sq_ring_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    delete uring;
+    return nullptr;
+  }
+  uring->sq_ring_ = sq_ring;
+
+  void *cq_ring = sq_ring;
+  if (!single_mmap) {
+    cq_ring = mmap(nullptr, uring->cq_ring_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      delete uring;
+      return nullptr;
+    }
+  }
+  uring->cq_ring_ = cq_ring;
+
+  uring->sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = mmap(nullptr, uring->sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    delete uring;
+    return nullptr;
+  }
+  uring->sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sq_ring);
+  uring->sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  uring->sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  uring->sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  char *cq = static_cast<char *>(cq_ring);
+  uring->cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  uring->cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  uring->cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  uring->cqes_ =
+      reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // at most sq_entries requests in flight, so neither ring can overflow
+  uring->slots_.resize(params.sq_entries);
+  for (size_t i = 0; i < params.sq_entries; i++)
+    uring->free_slots_.push_back(i);
+  uring->reaper_ = std::thread(&UringIO::Reap, uring);
+  return uring;
+}
+
+/*
+ * Wait for requests in flight, then wake the reaper with a nop carrying an
+ * out of range user_data so it exits
+ */
+UringIO::~UringIO() {
+  if (reaper_.joinable()) {
+    std::unique_lock<std::mutex> lock(latch_);
+    cv_.wait(lock, [this] { return free_slots_.size() == slots_.size(); });
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = slots_.size();
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (UringEnter(ring_fd_, 1, 0, 0) < 0 && errno == EINTR)
+      ;
+    lock.unlock();
+    reaper_.join();
+  }
+  if (sqes_ != nullptr)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != nullptr)
+    munmap(sq_ring_, sq_ring_size_);
+  close(ring_fd_);
+}
+
+/*
+ * Fill one sqe per request and hand the whole batch to the kernel with a
+ * single io_uring_enter. When every slot is in flight, what is queued so far
+ * is submitted and the caller waits for the reaper to free a slot
+ */
+void UringIO::Submit(std::vector<IORequest> &requests) {
+  std::unique_lock<std::mutex> lock(latch_);
+  unsigned queued = 0;
+  std::vector<std::pair<IORequest, int>> rejected;
+  for (auto &request : requests) {
+    if (free_slots_.empty()) {
+      SubmitQueued(queued, rejected);
+      queued = 0;
+      cv_.wait(lock, [this] { return !free_slots_.empty(); });
+    }
+    size_t slot = free_slots_.back();
+    free_slots_.pop_back();
+
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request.is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = request.fd;
+    sqe->off = request.offset;
+    // the iovec array moves into slots_ with the request, its storage stays
+    sqe->addr = reinterpret_cast<uint64_t>(request.iov.data());
+    sqe->len = request.iov.size();
+    sqe->user_data = slot;
+    sq_array_[index] = index;
+    slots_[slot] = std::move(request);
+    // the kernel reads the sqe only after it sees the new tail
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+  }
+  SubmitQueued(queued, rejected);
+  lock.unlock();
+  if (!rejected.empty())
+    cv_.notify_all();
+  for (auto &request : rejected)
+    request.first.callback(-request.second);
+}
+
+/*
+ * Hand the last count sqes to the kernel. On a hard failure the sqes it did
+ * not take are pulled back off the ring and their requests move to rejected,
+ * with the errno they fail with, to be completed once latch_ is released
+ */
+void UringIO::SubmitQueued(unsigned count,
+                           std::vector<std::pair<IORequest, int>> &rejected) {
+  while (count > 0) {
+    int rc = UringEnter(ring_fd_, count, 0, 0);
+    if (rc < 0) {
+      int error = errno;
+      if (error == EINTR || error == EAGAIN || error == EBUSY)
+        continue;
+      LOG_DEBUG("io_uring_enter failed");
+      // the kernel consumes sqes in order, so the untaken ones are the newest
+      unsigned tail = *sq_tail_ - count;
+      for (unsigned i = 0; i < count; i++) {
+        size_t slot = sqes_[sq_array_[(tail + i) & *sq_mask_]].user_data;
+        rejected.push_back({std::move(slots_[slot]), error});
+        free_slots_.push_back(slot);
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return;
+    }
+    count -= rc;
+  }
+}
+
+/*
+ * Completion loop: block in io_uring_enter until at least one cqe is posted,
+ * then run the callbacks of every posted cqe and recycle their slots
+ */
+void UringIO::Reap() {
+  bool stop = false;
+  while (!stop) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      UringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+      size_t slot = cqe->user_data;
+      if (slot == slots_.size()) {
+        stop = true;
+        continue;
+      }
+      IORequest request;
+      {
+        std::lock_guard<std::mutex> lock(latch_);
+        request = std::move(slots_[slot]);
+      }
+      request.callback(cqe->res);
+      {
+        std::lock_guard<std::mutex> lock(latch_);
+        free_slots_.push_back(slot);
+      }
+      cv_.notify_all();
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+}
+
+} // namespace cmudb
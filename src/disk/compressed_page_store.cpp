@@ -0,0 +1,294 @@
+/**
+ * compressed_page_store.cpp
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/exception.h"
+#include "common/logger.h"
+#include "common/lz.h"
+#include "disk/compressed_page_store.h"
+
+namespace cmudb {
+
+// the image is the page as is
+static const uint16_t FLAG_RAW = 1;
+static const size_t TABLE_BLOCK_ENTRIES = 64;
+
+static bool PreadAll(int fd, char *data, size_t size, int64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t rc = pread(fd, data + done, size - done, offset + done);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      return false;
+    done += rc;
+  }
+  return true;
+}
+
+static bool PwriteAll(int fd, const char *data, size_t size, int64_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t rc = pwrite(fd, data + done, size - done, offset + done);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc < 0)
+      return false;
+    done += rc;
+  }
+  return true;
+}
+
+/*
+ * Load the table and rebuild the chunk bitmap from the runs it refers to
+ */
+CompressedPageStore::CompressedPageStore(int db_fd,
+                                         const std::string &table_file)
+    : db_fd_(db_fd) {
+  table_fd_ = open(table_file.c_str(), O_RDWR | O_CREAT, 0644);
+  if (table_fd_ < 0) {
+    LOG_DEBUG("can't open page table file");
+    return;
+  }
+  struct stat stat_buf;
+  if (fstat(table_fd_, &stat_buf) != 0)
+    return;
+  entries_.resize(stat_buf.st_size / sizeof(Entry));
+  if (!entries_.empty() &&
+      !PreadAll(table_fd_, reinterpret_cast<char *>(entries_.data()),
+                entries_.size() * sizeof(Entry), 0)) {
+    LOG_DEBUG("I/O error while reading page table");
+    entries_.clear();
+  }
+  flushed_entries_ = entries_;
+  dirty_blocks_.resize(
+      (entries_.size() + TABLE_BLOCK_ENTRIES - 1) / TABLE_BLOCK_ENTRIES, false);
+  for (auto &entry : entries_) {
+    if (entry.length == 0)
+      continue;
+    uint32_t end = entry.first_chunk + ChunkCount(entry.length);
+    if (used_chunks_.size() < end)
+      used_chunks_.resize(end, false);
+    for (uint32_t chunk = entry.first_chunk; chunk < end; chunk++)
+      used_chunks_[chunk] = true;
+  }
+}
+
+CompressedPageStore::~CompressedPageStore() {
+  Flush(false);
+  if (table_fd_ >= 0)
+    close(table_fd_);
+}
+
+page_id_t CompressedPageStore::GetPageCount() {
+  std::lock_guard<std::mutex> lock(latch_);
+  return static_cast<page_id_t>(entries_.size());
+}
+
+int CompressedPageStore::ReadPage(page_id_t page_id, char *page_data) {
+  Entry entry;
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    if (page_id < 0 || static_cast<size_t>(page_id) >= entries_.size())
+      return 0;
+    entry = entries_[page_id];
+  }
+  if (entry.length == 0)
+    return 0;
+  char image[PAGE_SIZE];
+  int64_t offset = static_cast<int64_t>(entry.first_chunk) *
+                   COMPRESSED_CHUNK_SIZE;
+  bool valid = entry.length <= PAGE_SIZE &&
+               PreadAll(db_fd_, image, entry.length, offset);
+  if (valid && (entry.flags & FLAG_RAW)) {
+    valid = entry.length == PAGE_SIZE;
+    memcpy(page_data, image, entry.length);
+  } else if (valid) {
+    valid = LzDecompress(image, entry.length, page_data, PAGE_SIZE) ==
+            PAGE_SIZE;
+  }
+  if (!valid)
+    throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                    "bad compressed image of page " + std::to_string(page_id));
+  return entry.length;
+}
+
+/*
+ * The image has to save at least one chunk over the raw page to be kept. It
+ * goes to a new run unless the page is in a run written since the last
+ * Flush that is large enough
+ */
+int CompressedPageStore::WritePage(page_id_t page_id, const char *page_data) {
+  char image[PAGE_SIZE];
+  Entry entry;
+  int length = LzCompress(page_data, PAGE_SIZE, image,
+                          PAGE_SIZE - COMPRESSED_CHUNK_SIZE);
+  if (length > 0) {
+    entry.flags = 0;
+  } else {
+    memcpy(image, page_data, PAGE_SIZE);
+    length = PAGE_SIZE;
+    entry.flags = FLAG_RAW;
+  }
+  entry.length = length;
+  int chunks = ChunkCount(length);
+  std::lock_guard<std::mutex> lock(latch_);
+  if (static_cast<size_t>(page_id) >= entries_.size())
+    SetEntry(page_id, {0, 0, 0});
+  Entry old = entries_[page_id];
+  int old_chunks = old.length == 0 ? 0 : ChunkCount(old.length);
+  bool in_place = chunks <= old_chunks &&
+                  !IsFlushedRun(page_id, old.first_chunk, old_chunks);
+  entry.first_chunk = in_place ? old.first_chunk : AllocateChunks(chunks);
+  int64_t offset = static_cast<int64_t>(entry.first_chunk) *
+                   COMPRESSED_CHUNK_SIZE;
+  if (!PwriteAll(db_fd_, image, length, offset)) {
+    LOG_DEBUG("I/O error while writing");
+    // the page stays where it was
+    if (!in_place)
+      ReleaseChunks(entry.first_chunk, chunks);
+    return 0;
+  }
+  // the tail it no longer needs goes, or the whole run it left
+  if (in_place && chunks < old_chunks)
+    FreeChunks(page_id, old.first_chunk + chunks, old_chunks - chunks);
+  else if (!in_place && old_chunks > 0)
+    FreeChunks(page_id, old.first_chunk, old_chunks);
+  SetEntry(page_id, entry);
+  return length;
+}
+
+void CompressedPageStore::Discard(page_id_t page_id) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (page_id < 0 || static_cast<size_t>(page_id) >= entries_.size())
+    return;
+  Entry old = entries_[page_id];
+  if (old.length == 0)
+    return;
+  FreeChunks(page_id, old.first_chunk, ChunkCount(old.length));
+  SetEntry(page_id, {0, 0, 0});
+}
+
+/*
+ * The images the table points to are made durable first
+ */
+bool CompressedPageStore::Flush(bool sync) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (table_fd_ < 0)
+    return true;
+  if (sync && fdatasync(db_fd_) != 0) {
+    LOG_DEBUG("I/O error while syncing db file");
+    return false;
+  }
+  for (size_t block = 0; block < dirty_blocks_.size(); block++) {
+    if (!dirty_blocks_[block])
+      continue;
+    size_t first = block * TABLE_BLOCK_ENTRIES;
+    size_t count = std::min(TABLE_BLOCK_ENTRIES, entries_.size() - first);
+    if (!PwriteAll(table_fd_, reinterpret_cast<char *>(&entries_[first]),
+                   count * sizeof(Entry), first * sizeof(Entry))) {
+      LOG_DEBUG("I/O error while writing page table");
+      return false;
+    }
+    dirty_blocks_[block] = false;
+  }
+  if (sync && fdatasync(table_fd_) != 0) {
+    LOG_DEBUG("I/O error while syncing page table");
+    return false;
+  }
+  flushed_entries_ = entries_;
+  for (auto &run : pending_free_)
+    ReleaseChunks(run.first, run.second);
+  pending_free_.clear();
+
+  // free chunks at the end of the file are given back
+  size_t size = used_chunks_.size();
+  while (size > 0 && !used_chunks_[size - 1])
+    size--;
+  if (size < used_chunks_.size()) {
+    used_chunks_.resize(size);
+    rover_ = std::min<uint32_t>(rover_, size);
+    off_t length = static_cast<off_t>(size) * COMPRESSED_CHUNK_SIZE;
+    if (ftruncate(db_fd_, length) != 0) {
+      LOG_DEBUG("can't shrink db file");
+    }
+  }
+  return true;
+}
+
+/*
+ * Next fit: the first run of free chunks from the rover on, then from the
+ * start of the file, else new chunks at its end
+ */
+uint32_t CompressedPageStore::AllocateChunks(int count) {
+  uint32_t size = used_chunks_.size();
+  uint32_t starts[2] = {rover_, 0};
+  uint32_t ends[2] = {size, std::min<uint32_t>(rover_ + count - 1, size)};
+  for (int pass = 0; pass < 2; pass++) {
+    int run = 0;
+    for (uint32_t chunk = starts[pass]; chunk < ends[pass]; chunk++) {
+      run = used_chunks_[chunk] ? 0 : run + 1;
+      if (run == count) {
+        uint32_t first = chunk + 1 - count;
+        for (uint32_t i = first; i <= chunk; i++)
+          used_chunks_[i] = true;
+        rover_ = chunk + 1;
+        return first;
+      }
+    }
+  }
+  used_chunks_.resize(size + count, true);
+  rover_ = size + count;
+  return size;
+}
+
+/*
+ * Chunks a page no longer uses are free right away, unless the table on disk
+ * still has them as that page's
+ */
+void CompressedPageStore::FreeChunks(page_id_t page_id, uint32_t first_chunk,
+                                     int count) {
+  if (IsFlushedRun(page_id, first_chunk, count))
+    pending_free_.push_back({first_chunk, count});
+  else
+    ReleaseChunks(first_chunk, count);
+}
+
+/*
+ * True if the chunks overlap the run the table on disk has for the page
+ */
+bool CompressedPageStore::IsFlushedRun(page_id_t page_id, uint32_t first_chunk,
+                                       int count) {
+  if (static_cast<size_t>(page_id) >= flushed_entries_.size())
+    return false;
+  const Entry &flushed = flushed_entries_[page_id];
+  uint32_t flushed_end = flushed.first_chunk + ChunkCount(flushed.length);
+  return flushed.length != 0 && flushed.first_chunk < first_chunk + count &&
+         first_chunk < flushed_end;
+}
+
+void CompressedPageStore::ReleaseChunks(uint32_t first_chunk, int count) {
+  for (uint32_t chunk = first_chunk; chunk < first_chunk + count; chunk++) {
+    if (chunk < used_chunks_.size())
+      used_chunks_[chunk] = false;
+  }
+}
+
+void CompressedPageStore::SetEntry(page_id_t page_id, const Entry &entry) {
+  if (static_cast<size_t>(page_id) >= entries_.size()) {
+    entries_.resize(page_id + 1, {0, 0, 0});
+    dirty_blocks_.resize(
+        (entries_.size() + TABLE_BLOCK_ENTRIES - 1) / TABLE_BLOCK_ENTRIES,
+        true);
+  }
+  entries_[page_id] = entry;
+  dirty_blocks_[page_id / TABLE_BLOCK_ENTRIES] = true;
+}
+
+} // namespace cmudb
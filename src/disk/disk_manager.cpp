@@ -1,116 +1,813 @@
 /**
  * disk_manager.cpp
  */
+#include <algorithm>
 #include <assert.h>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
 #include <iostream>
+#include <new>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 
+#include "common/crc32c.h"
+#include "common/exception.h"
 #include "common/logger.h"
 #include "disk/disk_manager.h"
 
 namespace cmudb {
 
-static char *buffer_used = nullptr;
+static inline uint32_t PageChecksum(const char *page_data) {
+  return Crc32c(page_data, PAGE_USABLE_SIZE);
+}
+
+static inline void StampChecksum(char *page_data) {
+  uint32_t checksum = PageChecksum(page_data);
+  memcpy(page_data + PAGE_USABLE_SIZE, &checksum, sizeof(checksum));
+}
+
+/*
+ * A page of zeros was never written (a hole in the file), anything else has
+ * to carry the checksum of its contents
+ */
+static bool ChecksumMatches(const char *page_data) {
+  uint32_t stored;
+  memcpy(&stored, page_data + PAGE_USABLE_SIZE, sizeof(stored));
+  if (stored == PageChecksum(page_data))
+    return true;
+  if (stored != 0)
+    return false;
+  for (int i = 0; i < PAGE_USABLE_SIZE; i++) {
+    if (page_data[i] != 0)
+      return false;
+  }
+  return true;
+}
 
 /**
- * Constructor: open/create a single database file & log file
+ * Constructor: open/create the database file, the data files added to it & log
+ * file
  * @input db_file: database file name
+ * @input io_mode: buffered, direct (bypass the OS page cache), read-only
+ * mapping or compressed pages of the database file
+ * @input sync_policy: how Sync() makes page writes durable
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0), num_flushes_(0), flush_log_(false),
-      flush_log_f_(nullptr) {
+DiskManager::DiskManager(const std::string &db_file, IOMode io_mode,
+                         SyncPolicy sync_policy)
+    : log_fd_(-1), log_start_(0), log_end_(0), durable_end_(0),
+      file_name_(db_file), io_mode_(io_mode),
+      direct_io_(io_mode == IOMode::DIRECT), sync_policy_(sync_policy),
+      read_only_(io_mode == IOMode::MMAP_READ_ONLY), num_files_(0),
+      write_count_(0), synced_count_(0), syncing_(false), sync_failed_(false),
+      num_syncs_(0), async_io_(nullptr), buffer_used_(nullptr), num_flushes_(0),
+      flush_log_(false), flush_log_f_(nullptr) {
   std::string::size_type n = file_name_.find(".");
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
     return;
   }
-  log_name_ = file_name_.substr(0, n) + ".log";
+  log_name_ = GetLogName(file_name_);
+  files_list_name_ = file_name_.substr(0, n) + ".files";
 
-  log_io_.open(log_name_,
-               std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app |
-                                std::ios::out);
-    log_io_.close();
-    // reopen with original mode
-    log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app |
-                                std::ios::out);
+  // read-only mode neither creates the file nor its log
+  if (!read_only_) {
+    struct stat stat_buf;
+    OpenLog(stat(file_name_.c_str(), &stat_buf) != 0);
   }
 
-  db_io_.open(db_file,
-              std::ios::binary | std::ios::in | std::ios::out | std::ios::out);
-  // directory or file does not exist
-  if (!db_io_.is_open()) {
-    db_io_.clear();
-    // create a new file
-    db_io_.open(db_file, std::ios::binary | std::ios::trunc | std::ios::out);
-    db_io_.close();
-    // reopen with original mode
-    db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
+  files_[0].reset(new DataFile());
+  files_[0]->number = 0;
+  files_[0]->name = file_name_;
+  if (!OpenDataFile(files_[0].get()))
+    return;
+  num_files_ = 1;
+  // a file that can not be opened keeps its number, its pages fail to read
+  std::ifstream files_list(files_list_name_);
+  std::string name;
+  while (num_files_ < MAX_DATA_FILES && std::getline(files_list, name)) {
+    if (name.empty())
+      continue;
+    int number = num_files_;
+    files_[number].reset(new DataFile());
+    files_[number]->number = number;
+    files_[number]->name = name;
+    OpenDataFile(files_[number].get());
+    num_files_ = number + 1;
   }
 }
 
 DiskManager::~DiskManager() {
-  db_io_.close();
-  log_io_.close();
+  // waits for requests in flight
+  delete async_io_;
+  for (int i = 0; i < num_files_; i++)
+    CloseDataFile(files_[i].get());
+  for (auto &segment : log_segments_)
+    close(segment.second);
+  if (log_fd_ >= 0)
+    close(log_fd_);
+}
+
+DiskManager::DataFile *DiskManager::GetDataFile(page_id_t page_id) {
+  int number = GetFileNumber(page_id);
+  if (page_id < 0 || number >= num_files_)
+    return nullptr;
+  return files_[number].get();
+}
+
+/*
+ * Open the file as set by the I/O mode and load its free space map. In
+ * read-only mode an existing file is opened and mapped whole; it is not
+ * expected to change while it is mapped
+ */
+bool DiskManager::OpenDataFile(DataFile *file) {
+  if (read_only_) {
+    file->fd = open(file->name.c_str(), O_RDONLY);
+    if (file->fd < 0) {
+      LOG_DEBUG("can't open db file");
+      return false;
+    }
+    struct stat stat_buf;
+    if (fstat(file->fd, &stat_buf) != 0 || stat_buf.st_size == 0)
+      return true;
+    file->size = stat_buf.st_size;
+    void *mapping = mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_SHARED,
+                         file->fd, 0);
+    if (mapping == MAP_FAILED) {
+      LOG_DEBUG("can't map db file");
+      return true;
+    }
+    file->mapping = static_cast<char *>(mapping);
+    file->mapping_size = stat_buf.st_size;
+    return true;
+  }
+
+  file->fd = open(file->name.c_str(),
+                  O_RDWR | O_CREAT | (direct_io_ ? O_DIRECT : 0), 0644);
+  if (file->fd < 0 && direct_io_ && errno == EINVAL) {
+    // file system without O_DIRECT support, e.g. tmpfs
+    LOG_DEBUG("O_DIRECT not supported, using buffered I/O");
+    DisableDirectIO();
+    file->fd = open(file->name.c_str(), O_RDWR | O_CREAT, 0644);
+  }
+  if (file->fd < 0) {
+    LOG_DEBUG("can't open db file");
+    return false;
+  }
+  // the only stat of the file, from now on its size is tracked here
+  struct stat stat_buf;
+  if (fstat(file->fd, &stat_buf) == 0)
+    file->size = stat_buf.st_size;
+  if (io_mode_ == IOMode::COMPRESSED) {
+    std::string::size_type n = file->name.rfind(".");
+    file->compressed =
+        new CompressedPageStore(file->fd, file->name.substr(0, n) + ".ptab");
+    // the file holds chunks, the table knows how many pages there are
+    file->size =
+        static_cast<int64_t>(file->compressed->GetPageCount()) * PAGE_SIZE;
+  }
+  // an existing file keeps its pages, freed ones are found in its maps. A map
+  // failing its checksum is taken as lost
+  file->free_space_map.Load(
+      [this, file](page_id_t page_id, char *data) {
+        try {
+          ReadFilePage(file, MakePageId(file->number, page_id), data);
+        } catch (Exception &e) {
+          memset(data, 0, PAGE_SIZE);
+        }
+      },
+      static_cast<page_id_t>(file->size / PAGE_SIZE));
+  return true;
+}
+
+void DiskManager::CloseDataFile(DataFile *file) {
+  if (file->mapping != nullptr)
+    munmap(file->mapping, file->mapping_size);
+  if (file->fd >= 0 && !read_only_) {
+    file->free_space_map.Flush([this, file](page_id_t page_id, char *data) {
+      WriteFilePage(file, MakePageId(file->number, page_id), data);
+    });
+  }
+  // writes back its table
+  delete file->compressed;
+  if (file->fd >= 0)
+    close(file->fd);
+}
+
+char *DiskManager::GetMappedPage(page_id_t page_id) {
+  DataFile *file = GetDataFile(page_id);
+  if (file == nullptr || file->mapping == nullptr)
+    return nullptr;
+  size_t offset = static_cast<size_t>(GetLocalPageId(page_id)) * PAGE_SIZE;
+  if (offset + PAGE_SIZE > file->mapping_size)
+    return nullptr;
+  return file->mapping + offset;
+}
+
+/*
+ * Runs of consecutive pages of one file become one madvise each, widened to
+ * the OS pages that hold them
+ */
+void DiskManager::AdviseWillNeed(const std::vector<page_id_t> &page_ids) {
+  std::vector<page_id_t> sorted;
+  for (auto page_id : page_ids) {
+    if (GetMappedPage(page_id) != nullptr)
+      sorted.push_back(page_id);
+  }
+  std::sort(sorted.begin(), sorted.end());
+  static const size_t os_page = sysconf(_SC_PAGESIZE);
+  size_t begin = 0;
+  while (begin < sorted.size()) {
+    size_t end = begin + 1;
+    while (end < sorted.size() && sorted[end] <= sorted[end - 1] + 1 &&
+           GetFileNumber(sorted[end]) == GetFileNumber(sorted[begin]))
+      end++;
+    DataFile *file = GetDataFile(sorted[begin]);
+    size_t low = static_cast<size_t>(GetLocalPageId(sorted[begin])) * PAGE_SIZE;
+    size_t high =
+        static_cast<size_t>(GetLocalPageId(sorted[end - 1]) + 1) * PAGE_SIZE;
+    low -= low % os_page;
+    madvise(file->mapping + low, high - low, MADV_WILLNEED);
+    begin = end;
+  }
 }
 
 /**
  * Write the contents of the specified page into disk file
  */
-void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
-  size_t offset = page_id * PAGE_SIZE;
-  // set write cursor to offset
-  db_io_.seekp(offset);
-  db_io_.write(page_data, PAGE_SIZE);
-  // check for I/O error
-  if (db_io_.bad()) {
+bool DiskManager::WritePage(page_id_t page_id, const char *page_data) {
+  if (read_only_) {
+    LOG_DEBUG("write to read-only database rejected");
+    return false;
+  }
+  DataFile *file = GetDataFile(page_id);
+  if (file == nullptr) {
     LOG_DEBUG("I/O error while writing");
-    return;
+    return false;
   }
-  // needs to flush to keep disk file in sync
-  db_io_.flush();
+  return WriteFilePage(file, page_id, page_data);
+}
+
+/*
+ * The checksum is filled in on a copy, which is also aligned for O_DIRECT.
+ * A failed write is not counted for Sync, which fails from now on: the file
+ * may hold part of the page, or an older image the caller no longer keeps
+ */
+bool DiskManager::WriteFilePage(DataFile *file, page_id_t page_id,
+                                const char *page_data) {
+  alignas(DIRECT_IO_ALIGN) char buffer[PAGE_SIZE];
+  memcpy(buffer, page_data, PAGE_USABLE_SIZE);
+  StampChecksum(buffer);
+  page_id_t local_page_id = GetLocalPageId(page_id);
+  int64_t offset = static_cast<int64_t>(local_page_id) * PAGE_SIZE;
+  if (file->compressed != nullptr) {
+    int length = file->compressed->WritePage(local_page_id, buffer);
+    if (length == 0) {
+      sync_failed_ = true;
+      return false;
+    }
+    bytes_written_ += length;
+    FinishWrite(file, offset + PAGE_SIZE);
+    return true;
+  }
+  size_t written = 0;
+  while (written < PAGE_SIZE) {
+    ssize_t rc = pwrite(file->fd, buffer + written, PAGE_SIZE - written,
+                        offset + written);
+    // check for I/O error
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EINVAL && direct_io_) {
+        DisableDirectIO();
+        continue;
+      }
+      LOG_DEBUG("I/O error while writing");
+      sync_failed_ = true;
+      return false;
+    }
+    written += rc;
+  }
+  bytes_written_ += PAGE_SIZE;
+  FinishWrite(file, offset + PAGE_SIZE);
+  return true;
 }
 
 /**
  * Read the contents of the specified page into the given memory area
  */
 void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
-  int offset = page_id * PAGE_SIZE;
+  DataFile *file = GetDataFile(page_id);
+  if (file == nullptr) {
+    LOG_DEBUG("I/O error while reading");
+    return;
+  }
+  ReadFilePage(file, page_id, page_data);
+}
+
+void DiskManager::ReadFilePage(DataFile *file, page_id_t page_id,
+                               char *page_data) {
+  if (direct_io_ && !IsAligned(page_data)) {
+    alignas(DIRECT_IO_ALIGN) char bounce[PAGE_SIZE];
+    memcpy(bounce, page_data, PAGE_SIZE);
+    ReadFilePage(file, page_id, bounce);
+    memcpy(page_data, bounce, PAGE_SIZE);
+    return;
+  }
+  if (read_only_) {
+    char *mapped = GetMappedPage(page_id);
+    if (mapped == nullptr) {
+      LOG_DEBUG("I/O error while reading");
+      return;
+    }
+    memcpy(page_data, mapped, PAGE_SIZE);
+    VerifyPage(page_id, page_data);
+    return;
+  }
+  page_id_t local_page_id = GetLocalPageId(page_id);
+  int64_t offset = static_cast<int64_t>(local_page_id) * PAGE_SIZE;
   // check if read beyond file length
-  if (offset > GetFileSize(file_name_)) {
+  if (offset > file->size) {
     LOG_DEBUG("I/O error while reading");
     // std::cerr << "I/O error while reading" << std::endl;
-  } else {
-    // set read cursor to offset
-    db_io_.seekp(offset);
-    db_io_.read(page_data, PAGE_SIZE);
-    // if file ends before reading PAGE_SIZE
-    int read_count = db_io_.gcount();
-    if (read_count < PAGE_SIZE) {
-      LOG_DEBUG("Read less than a page");
-      // std::cerr << "Read less than a page" << std::endl;
-      memset(page_data + read_count, 0, PAGE_SIZE - read_count);
+    return;
+  }
+  if (file->compressed != nullptr) {
+    int length = file->compressed->ReadPage(local_page_id, page_data);
+    // a page never written reads as zeros, as a hole would
+    if (length == 0)
+      memset(page_data, 0, PAGE_SIZE);
+    bytes_read_ += length;
+    VerifyPage(page_id, page_data);
+    return;
+  }
+  size_t read_count = 0;
+  while (read_count < PAGE_SIZE) {
+    ssize_t rc = pread(file->fd, page_data + read_count,
+                       PAGE_SIZE - read_count, offset + read_count);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EINVAL && direct_io_) {
+        DisableDirectIO();
+        continue;
+      }
+      LOG_DEBUG("I/O error while reading");
+      break;
     }
+    // file ends before reading PAGE_SIZE
+    if (rc == 0)
+      break;
+    read_count += rc;
   }
+  if (read_count < PAGE_SIZE) {
+    LOG_DEBUG("Read less than a page");
+    // std::cerr << "Read less than a page" << std::endl;
+    memset(page_data + read_count, 0, PAGE_SIZE - read_count);
+  }
+  bytes_read_ += read_count;
+  VerifyPage(page_id, page_data);
+}
+
+void DiskManager::VerifyPage(page_id_t page_id, const char *page_data) {
+  ChecksumMode mode = checksum_mode_;
+  if (mode == ChecksumMode::OFF)
+    return;
+  if (mode == ChecksumMode::SAMPLED &&
+      checksum_reads_++ % CHECKSUM_SAMPLE_RATE != 0)
+    return;
+  checksums_verified_++;
+  if (ChecksumMatches(page_data))
+    return;
+  checksum_failures_++;
+  throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                  "checksum mismatch on page " + std::to_string(page_id));
+}
+
+std::future<void> DiskManager::WritePageAsync(page_id_t page_id,
+                                              const char *page_data) {
+  return std::move(WritePagesAsync({page_id}, {page_data})[0]);
+}
+
+std::future<void> DiskManager::ReadPageAsync(page_id_t page_id,
+                                             char *page_data) {
+  return std::move(ReadPagesAsync({page_id}, {page_data})[0]);
+}
+
+std::vector<std::future<void>>
+DiskManager::WritePagesAsync(const std::vector<page_id_t> &page_ids,
+                             const std::vector<const char *> &page_datas) {
+  // the backend only reads from a write buffer
+  std::vector<char *> datas;
+  for (auto page_data : page_datas)
+    datas.push_back(const_cast<char *>(page_data));
+  return SubmitPages(true, page_ids, datas);
+}
+
+std::vector<std::future<void>>
+DiskManager::ReadPagesAsync(const std::vector<page_id_t> &page_ids,
+                            const std::vector<char *> &page_datas) {
+  return SubmitPages(false, page_ids, page_datas);
+}
+
+/*
+ * Pages are sorted and every run of consecutive page ids of one file, up to an
+ * extent, becomes one vectored request, so pages that are contiguous on disk
+ * move in one transfer. Pages to write are staged in one aligned buffer per
+ * run, where their checksums are filled in. All requests are submitted as a
+ * single batch, so the files are accessed in parallel. A transfer that comes
+ * back short or failed (end of file, EINTR, an unaligned buffer under
+ * O_DIRECT) is redone page by page with the synchronous path on the completion
+ * thread, so callers see the same results as ReadPage/WritePage, checksum
+ * errors included
+ */
+std::vector<std::future<void>>
+DiskManager::SubmitPages(bool is_write, const std::vector<page_id_t> &page_ids,
+                         const std::vector<char *> &page_datas) {
+  assert(page_ids.size() == page_datas.size());
+  std::vector<std::future<void>> futures(page_ids.size());
+  auto serve = [&](size_t i) {
+    std::promise<void> done;
+    try {
+      if (!is_write)
+        ReadPage(page_ids[i], page_datas[i]);
+      else if (!WritePage(page_ids[i], page_datas[i]))
+        throw Exception(EXCEPTION_TYPE_IO,
+                        "can't write page " + std::to_string(page_ids[i]));
+      done.set_value();
+    } catch (...) {
+      done.set_exception(std::current_exception());
+    }
+    futures[i] = done.get_future();
+  };
+  if (read_only_ || io_mode_ == IOMode::COMPRESSED) {
+    // served right away, from the mapping or the compressed pages
+    for (size_t i = 0; i < page_ids.size(); i++)
+      serve(i);
+    return futures;
+  }
+  std::call_once(async_io_flag_, [this] {
+    async_io_ = AsyncIO::Create(ASYNC_IO_DEPTH);
+  });
+
+  std::vector<size_t> order;
+  for (size_t i = 0; i < page_ids.size(); i++) {
+    // a page of no file fails as the synchronous path does
+    if (GetDataFile(page_ids[i]) == nullptr)
+      serve(i);
+    else
+      order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [&page_ids](size_t a, size_t b) {
+    return page_ids[a] < page_ids[b];
+  });
+
+  std::vector<IORequest> requests;
+  size_t begin = 0;
+  while (begin < order.size()) {
+    size_t end = begin + 1;
+    while (end < order.size() && end - begin < EXTENT_SIZE &&
+           page_ids[order[end]] == page_ids[order[end - 1]] + 1 &&
+           GetFileNumber(page_ids[order[end]]) ==
+               GetFileNumber(page_ids[order[begin]]))
+      end++;
+
+    // one run: pages, their buffers and their completions
+    std::vector<std::pair<page_id_t, char *>> pages;
+    std::vector<std::shared_ptr<std::promise<void>>> dones;
+    std::vector<struct iovec> iov;
+    for (size_t i = begin; i < end; i++) {
+      pages.push_back({page_ids[order[i]], page_datas[order[i]]});
+      dones.push_back(std::make_shared<std::promise<void>>());
+      futures[order[i]] = dones.back()->get_future();
+      iov.push_back({page_datas[order[i]], PAGE_SIZE});
+    }
+    DataFile *file = GetDataFile(pages[0].first);
+    int64_t offset =
+        static_cast<int64_t>(GetLocalPageId(pages[0].first)) * PAGE_SIZE;
+    ssize_t size = static_cast<ssize_t>(pages.size()) * PAGE_SIZE;
+    // kept alive by the callback until the transfer is done
+    std::shared_ptr<char> staging;
+    if (is_write) {
+      void *buffer = nullptr;
+      if (posix_memalign(&buffer, DIRECT_IO_ALIGN, size) != 0)
+        throw std::bad_alloc();
+      staging.reset(static_cast<char *>(buffer), free);
+      for (size_t i = 0; i < pages.size(); i++) {
+        char *staged = staging.get() + i * PAGE_SIZE;
+        memcpy(staged, pages[i].second, PAGE_USABLE_SIZE);
+        StampChecksum(staged);
+      }
+      iov = {{staging.get(), static_cast<size_t>(size)}};
+    }
+    requests.push_back(
+        {is_write, file->fd, offset, iov,
+         [this, is_write, file, pages, dones, offset, size,
+          staging](ssize_t rc) {
+           if (rc == size && is_write) {
+             bytes_written_ += size;
+             FinishWrite(file, offset + size);
+           } else if (rc == size) {
+             bytes_read_ += size;
+           }
+           for (size_t i = 0; i < pages.size(); i++) {
+             try {
+               if (rc == size && !is_write)
+                 VerifyPage(pages[i].first, pages[i].second);
+               else if (rc != size && !is_write)
+                 ReadFilePage(file, pages[i].first, pages[i].second);
+               else if (rc != size &&
+                        !WriteFilePage(file, pages[i].first, pages[i].second))
+                 throw Exception(EXCEPTION_TYPE_IO,
+                                 "can't write page " +
+                                     std::to_string(pages[i].first));
+               dones[i]->set_value();
+             } catch (...) {
+               dones[i]->set_exception(std::current_exception());
+             }
+           }
+         }});
+    begin = end;
+  }
+  async_io_->Submit(requests);
+  return futures;
+}
+
+/*
+ * Raise the tracked file size, writers of distinct pages may race here, and
+ * count the write for the next Sync
+ */
+void DiskManager::FinishWrite(DataFile *file, int64_t end) {
+  int64_t size = file->size.load();
+  while (size < end && !file->size.compare_exchange_weak(size, end))
+    ;
+  write_count_++;
+}
+
+/*
+ * Group sync: a caller whose writes are not yet covered either starts a sync
+ * of everything written so far, or waits for the sync in progress and checks
+ * again. Writes finished before a sync starts are covered by it, so callers
+ * arriving together are served by one sync. Files past the first are synced
+ * on threads of their own, as they may sit on different devices. The table of
+ * a compressed file is written after the pages it points to are durable.
+ * A failed sync is final: the kernel may have dropped the pages it could not
+ * write, a later sync that succeeds would not bring them back
+ */
+bool DiskManager::Sync() {
+  if (read_only_)
+    return true;
+  FlushFreeSpaceMap();
+  uint64_t target = write_count_.load();
+  std::unique_lock<std::mutex> lock(sync_latch_);
+  while (!sync_failed_ && synced_count_ < target) {
+    if (syncing_) {
+      sync_cv_.wait(lock);
+      continue;
+    }
+    syncing_ = true;
+    uint64_t covered = write_count_.load();
+    lock.unlock();
+    int num_files = num_files_;
+    // one flag per file, written by its own syncer
+    std::vector<char> synced(num_files, true);
+    std::vector<std::thread> syncers;
+    for (int i = 1; i < num_files; i++)
+      syncers.push_back(std::thread(
+          [this, &synced, i] { synced[i] = SyncFile(files_[i].get()); }));
+    if (num_files > 0)
+      synced[0] = SyncFile(files_[0].get());
+    for (auto &syncer : syncers)
+      syncer.join();
+    lock.lock();
+    if (std::find(synced.begin(), synced.end(), false) != synced.end()) {
+      LOG_DEBUG("I/O error while syncing data files");
+      sync_failed_ = true;
+    } else {
+      synced_count_ = std::max(synced_count_, covered);
+    }
+    syncing_ = false;
+    num_syncs_++;
+    sync_cv_.notify_all();
+  }
+  if (sync_failed_)
+    return false;
+  lock.unlock();
+  bool flushed = true;
+  for (int i = 0; i < num_files_; i++) {
+    if (files_[i]->compressed != nullptr &&
+        !files_[i]->compressed->Flush(sync_policy_ != SyncPolicy::NONE))
+      flushed = false;
+  }
+  return flushed;
+}
+
+bool DiskManager::SyncFile(DataFile *file) {
+  if (file->fd < 0)
+    return true;
+  if (sync_policy_ == SyncPolicy::FDATASYNC)
+    return fdatasync(file->fd) == 0;
+  if (sync_policy_ == SyncPolicy::FSYNC)
+    return fsync(file->fd) == 0;
+  return true;
+}
+
+void DiskManager::FlushFreeSpaceMap() {
+  for (int i = 0; i < num_files_; i++) {
+    DataFile *file = files_[i].get();
+    if (file->fd < 0)
+      continue;
+    file->free_space_map.Flush([this, file](page_id_t page_id, char *data) {
+      WriteFilePage(file, MakePageId(file->number, page_id), data);
+    });
+  }
+}
+
+bool DiskManager::IsAligned(const char *page_data) {
+  return reinterpret_cast<uintptr_t>(page_data) % DIRECT_IO_ALIGN == 0;
+}
+
+/*
+ * The device rejected an aligned O_DIRECT transfer (its block size is larger
+ * than a page), fall back to buffered I/O on the descriptors of every file
+ */
+void DiskManager::DisableDirectIO() {
+  LOG_DEBUG("O_DIRECT transfer rejected, using buffered I/O");
+  for (int i = 0; i < num_files_; i++) {
+    int fd = files_[i]->fd;
+    if (fd >= 0)
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+  }
+  direct_io_ = false;
+}
+
+// control file: magic, segment size, first segment in use, durable end
+static const uint32_t LOG_CONTROL_MAGIC = 0x4c4f4753;
+static const int LOG_CONTROL_SIZE = 24;
+static const int LOG_CONTROL_END_OFFSET = 16;
+
+/*
+ * Open the log named by the control file, its segments are the ones that
+ * exist from the first in use on. Without a control file (or with one of
+ * another segment size), or for a database file about to be created, the log
+ * is new and leftover segments are removed: their LSNs would follow on from
+ * the new log's, recovery would replay them onto the new database
+ */
+void DiskManager::OpenLog(bool new_database) {
+  log_fd_ = open(log_name_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (log_fd_ < 0) {
+    LOG_DEBUG("can't open log file");
+    return;
+  }
+  int64_t first = new_database ? -1 : ReadLogControl(log_fd_, durable_end_);
+  if (first < 0) {
+    struct stat stat_buf;
+    if (fstat(log_fd_, &stat_buf) == 0 && stat_buf.st_size > 0) {
+      LOG_DEBUG("log of another database, starting a new one");
+    }
+    RemoveLogSegments();
+    durable_end_ = 0;
+    if (ftruncate(log_fd_, LOG_CONTROL_SIZE) != 0) {
+      LOG_DEBUG("I/O error while truncating log control file");
+    }
+    WriteLogControl();
+    return;
+  }
+  // segments left by a discard interrupted after the control file was written
+  for (int64_t segment = first - 1;
+       segment >= 0 && unlink(GetLogSegmentName(segment).c_str()) == 0;
+       segment--)
+    ;
+  log_start_ = first * LOG_SEGMENT_SIZE;
+  log_end_ = log_start_;
+  for (int64_t segment = first;; segment++) {
+    int fd = open(GetLogSegmentName(segment).c_str(), O_RDWR);
+    if (fd < 0)
+      break;
+    log_segments_[segment] = fd;
+    log_end_ = (segment + 1) * LOG_SEGMENT_SIZE;
+  }
+}
+
+/*
+ * Remove every segment file of the log's name, whatever its number
+ */
+void DiskManager::RemoveLogSegments() {
+  std::string::size_type n = log_name_.rfind('/');
+  std::string dir_name = n == std::string::npos ? "." : log_name_.substr(0, n);
+  std::string prefix =
+      (n == std::string::npos ? log_name_ : log_name_.substr(n + 1)) + ".";
+  DIR *dir = opendir(dir_name.c_str());
+  if (dir == nullptr)
+    return;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() > prefix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.find_first_not_of("0123456789", prefix.size()) ==
+            std::string::npos)
+      unlink((dir_name + "/" + name).c_str());
+  }
+  closedir(dir);
+}
+
+std::string DiskManager::GetLogSegmentName(int64_t segment) {
+  return GetLogSegmentName(log_name_, segment);
+}
+
+std::string DiskManager::GetLogName(const std::string &db_file) {
+  std::string::size_type n = db_file.find(".");
+  return db_file.substr(0, n) + ".log";
+}
+
+std::string DiskManager::GetLogSegmentName(const std::string &log_name,
+                                           int64_t segment) {
+  return log_name + "." + std::to_string(segment);
+}
+
+int64_t DiskManager::ReadLogControl(int fd, int64_t &durable_end) {
+  char control[LOG_CONTROL_SIZE];
+  uint32_t magic = 0, segment_size = 0;
+  int64_t first = -1;
+  if (pread(fd, control, LOG_CONTROL_SIZE, 0) != LOG_CONTROL_SIZE)
+    return -1;
+  memcpy(&magic, control, sizeof(uint32_t));
+  memcpy(&segment_size, control + 4, sizeof(uint32_t));
+  memcpy(&first, control + 8, sizeof(int64_t));
+  memcpy(&durable_end, control + LOG_CONTROL_END_OFFSET, sizeof(int64_t));
+  if (magic != LOG_CONTROL_MAGIC || segment_size != LOG_SEGMENT_SIZE)
+    return -1;
+  return first;
+}
+
+/*
+ * Descriptor of a segment, a spare one or a new one filled with zeros if it
+ * does not exist yet. -1 on I/O error. The caller holds log_latch_
+ */
+int DiskManager::GetLogSegment(int64_t segment) {
+  auto it = log_segments_.find(segment);
+  if (it != log_segments_.end())
+    return it->second;
+  std::string name = GetLogSegmentName(segment);
+  int fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG_DEBUG("can't create log segment");
+    return -1;
+  }
+  std::vector<char> zeros(LOG_READ_SIZE, 0);
+  for (int64_t offset = 0; offset < LOG_SEGMENT_SIZE;) {
+    ssize_t rc = pwrite(fd, zeros.data(),
+                        std::min<int64_t>(zeros.size(),
+                                          LOG_SEGMENT_SIZE - offset),
+                        offset);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0) {
+      LOG_DEBUG("I/O error while creating log segment");
+      close(fd);
+      unlink(name.c_str());
+      return -1;
+    }
+    offset += rc;
+  }
+  log_segments_[segment] = fd;
+  return fd;
+}
+
+void DiskManager::WriteLogControl() {
+  char control[LOG_CONTROL_SIZE];
+  uint32_t segment_size = LOG_SEGMENT_SIZE;
+  int64_t first = log_start_ / LOG_SEGMENT_SIZE;
+  memcpy(control, &LOG_CONTROL_MAGIC, sizeof(uint32_t));
+  memcpy(control + 4, &segment_size, sizeof(uint32_t));
+  memcpy(control + 8, &first, sizeof(int64_t));
+  memcpy(control + LOG_CONTROL_END_OFFSET, &durable_end_, sizeof(int64_t));
+  if (pwrite(log_fd_, control, LOG_CONTROL_SIZE, 0) != LOG_CONTROL_SIZE) {
+    LOG_DEBUG("I/O error while writing log control file");
+    return;
+  }
+  if (sync_policy_ != SyncPolicy::NONE)
+    fsync(log_fd_);
 }
 
 /**
  * Write the contents of the log into disk file
  * Only return when sync is done, and only perform sequence write
+ * The log is written at its end, into as many segments as it spans; every
+ * segment written is synced
+ * @return: false if a write or a sync failed, the end of the log is not moved
  */
-void DiskManager::WriteLog(char *log_data, int size) {
+bool DiskManager::WriteLog(char *log_data, int size) {
   // enforce swap log buffer
-  assert(log_data != buffer_used);
-  buffer_used = log_data;
+  assert(log_data != buffer_used_);
+  buffer_used_ = log_data;
 
   if (size == 0) // no effect on num_flushes_ if log buffer is empty
-    return;
+    return true;
 
   flush_log_ = true;
 
@@ -121,16 +818,67 @@ void DiskManager::WriteLog(char *log_data, int size) {
 
   num_flushes_ += 1;
   // sequence write
-  log_io_.write(log_data, size);
-
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+  int64_t offset = log_end_;
+  int written = 0;
+  std::vector<int> fds;
+  while (written < size) {
+    int fd;
+    {
+      std::lock_guard<std::mutex> lock(log_latch_);
+      fd = GetLogSegment(offset / LOG_SEGMENT_SIZE);
+    }
+    if (fd < 0) {
+      flush_log_ = false;
+      return false;
+    }
+    if (fds.empty() || fds.back() != fd)
+      fds.push_back(fd);
+    int64_t length = std::min<int64_t>(
+        size - written, LOG_SEGMENT_SIZE - offset % LOG_SEGMENT_SIZE);
+    ssize_t rc =
+        pwrite(fd, log_data + written, length, offset % LOG_SEGMENT_SIZE);
+    // check for I/O error
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG_DEBUG("I/O error while writing log");
+      flush_log_ = false;
+      return false;
+    }
+    written += rc;
+    offset += rc;
   }
-  // needs to flush to keep disk file in sync
-  log_io_.flush();
+  // one sync makes every commit of the buffer durable
+  for (int fd : fds) {
+    int rc = 0;
+    if (sync_policy_ == SyncPolicy::FDATASYNC)
+      rc = fdatasync(fd);
+    else if (sync_policy_ == SyncPolicy::FSYNC)
+      rc = fsync(fd);
+    if (rc != 0) {
+      LOG_DEBUG("I/O error while syncing log");
+      flush_log_ = false;
+      return false;
+    }
+  }
+  log_end_ = offset;
+  PublishLogEnd(offset);
   flush_log_ = false;
+  return true;
+}
+
+/*
+ * Standbys read the log up to the durable end in the control file, published
+ * once the records before it are synced. The value is not synced itself:
+ * after a crash it may lag behind, a standby then waits for the next flush
+ */
+void DiskManager::PublishLogEnd(int64_t end) {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  durable_end_ = end;
+  if (pwrite(log_fd_, &end, sizeof(int64_t), LOG_CONTROL_END_OFFSET) !=
+      sizeof(int64_t)) {
+    LOG_DEBUG("I/O error while publishing the end of the log");
+  }
 }
 
 /**
@@ -138,36 +886,197 @@ void DiskManager::WriteLog(char *log_data, int size) {
  * Always read from the beginning and perform sequence read
  * @return: false means already reach the end
  */
-bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-  if (offset >= GetFileSize(log_name_)) {
+bool DiskManager::ReadLog(char *log_data, int size, int64_t offset) {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  if (offset >= log_end_ || offset < log_start_) {
     // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
+  int read_count = 0;
+  while (read_count < size && offset + read_count < log_end_) {
+    int64_t position = offset + read_count;
+    auto segment = log_segments_.find(position / LOG_SEGMENT_SIZE);
+    if (segment == log_segments_.end())
+      break;
+    int64_t length = std::min<int64_t>(
+        {size - read_count, LOG_SEGMENT_SIZE - position % LOG_SEGMENT_SIZE,
+         log_end_ - position});
+    ssize_t rc = pread(segment->second, log_data + read_count, length,
+                       position % LOG_SEGMENT_SIZE);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      break;
+    read_count += rc;
+  }
   // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
-  if (read_count < size) {
-    log_io_.clear();
+  if (read_count < size)
     memset(log_data + read_count, 0, size - read_count);
-  }
 
   return true;
 }
 
+int64_t DiskManager::GetLogSize() { return log_end_; }
+
+int64_t DiskManager::GetLogStart() {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  return log_start_;
+}
+
+int DiskManager::GetNumLogSegments() {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  return log_segments_.size();
+}
+
+/**
+ * Drop the log past size, a record torn by a crash would otherwise sit between
+ * the records before it and those appended after recovery
+ * The rest of the last segment is zeroed and the segments after it removed,
+ * so no part of the torn write is read after the records appended next
+ */
+void DiskManager::TruncateLog(int64_t size) {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  if (size < log_start_ || size >= log_end_)
+    return;
+  int64_t last = size / LOG_SEGMENT_SIZE;
+  for (auto it = log_segments_.upper_bound(last); it != log_segments_.end();) {
+    close(it->second);
+    unlink(GetLogSegmentName(it->first).c_str());
+    it = log_segments_.erase(it);
+  }
+  auto segment = log_segments_.find(last);
+  if (segment != log_segments_.end()) {
+    std::vector<char> zeros(LOG_SEGMENT_SIZE - size % LOG_SEGMENT_SIZE, 0);
+    if (pwrite(segment->second, zeros.data(), zeros.size(),
+               size % LOG_SEGMENT_SIZE) != static_cast<ssize_t>(zeros.size())) {
+      LOG_DEBUG("I/O error while truncating log");
+    }
+    if (sync_policy_ != SyncPolicy::NONE)
+      fsync(segment->second);
+  }
+  log_end_ = size;
+  durable_end_ = std::min(durable_end_, size);
+}
+
+/**
+ * The segments before the one holding offset are no longer read: the control
+ * file is moved past them first, then each is renamed to follow the last
+ * segment, or removed once LOG_SPARE_SEGMENTS are waiting to be written
+ */
+void DiskManager::DiscardLog(int64_t offset) {
+  std::lock_guard<std::mutex> lock(log_latch_);
+  int64_t first = log_start_ / LOG_SEGMENT_SIZE;
+  int64_t end = std::min<int64_t>(offset, log_end_) / LOG_SEGMENT_SIZE;
+  if (end <= first)
+    return;
+  log_start_ = end * LOG_SEGMENT_SIZE;
+  WriteLogControl();
+  int64_t current = log_end_ / LOG_SEGMENT_SIZE;
+  for (int64_t segment = first; segment < end; segment++) {
+    auto it = log_segments_.find(segment);
+    if (it == log_segments_.end())
+      continue;
+    int fd = it->second;
+    log_segments_.erase(it);
+    std::string name = GetLogSegmentName(segment);
+    int64_t next = current + 1;
+    if (!log_segments_.empty())
+      next = std::max(next, log_segments_.rbegin()->first + 1);
+    if (next - current <= LOG_SPARE_SEGMENTS &&
+        rename(name.c_str(), GetLogSegmentName(next).c_str()) == 0) {
+      log_segments_[next] = fd;
+      continue;
+    }
+    close(fd);
+    unlink(name.c_str());
+  }
+}
+
 /**
  * Allocate new page (operations like create index/table)
- * For now just keep an increasing counter
+ * The page goes to the file of hint, the first file without one. A freed page
+ * near hint is reused before the file grows
  */
-page_id_t DiskManager::AllocatePage() { return next_page_id_++; }
+page_id_t DiskManager::AllocatePage(page_id_t hint) {
+  if (read_only_) {
+    LOG_DEBUG("allocation in read-only database rejected");
+    return INVALID_PAGE_ID;
+  }
+  DataFile *file = GetDataFile(hint);
+  if (file == nullptr || file->fd < 0) {
+    file = files_[0].get();
+    hint = INVALID_PAGE_ID;
+  }
+  if (file == nullptr || file->fd < 0)
+    return INVALID_PAGE_ID;
+  page_id_t local_hint =
+      hint == INVALID_PAGE_ID ? INVALID_PAGE_ID : GetLocalPageId(hint);
+  page_id_t local_page_id = file->free_space_map.Allocate(local_hint);
+  if (local_page_id == INVALID_PAGE_ID) {
+    LOG_DEBUG("data file %d full", file->number);
+    return INVALID_PAGE_ID;
+  }
+  return MakePageId(file->number, local_page_id);
+}
 
 /**
  * Deallocate page (operations like drop index/table)
- * Need bitmap in header page for tracking pages
+ * The page is marked free in the free space map of its file, ready for reuse
  */
-void DiskManager::DeallocatePage(__attribute__((unused)) page_id_t page_id) {
-  return;
+void DiskManager::DeallocatePage(page_id_t page_id) {
+  if (read_only_)
+    return;
+  DataFile *file = GetDataFile(page_id);
+  if (file == nullptr)
+    return;
+  page_id_t local_page_id = GetLocalPageId(page_id);
+  if (file->free_space_map.Free(local_page_id) && file->compressed != nullptr)
+    file->compressed->Discard(local_page_id);
+}
+
+void DiskManager::MarkAllocated(page_id_t page_id) {
+  if (read_only_)
+    return;
+  DataFile *file = GetDataFile(page_id);
+  if (file != nullptr)
+    file->free_space_map.MarkAllocated(GetLocalPageId(page_id));
+}
+
+/**
+ * Add a data file to the database, e.g. on another device, and record it in
+ * the files list so it is opened with the database from now on
+ * @return: number of the file, pages of it are MakePageId(number, ...)
+ */
+int DiskManager::AddDataFile(const std::string &file_name) {
+  if (read_only_ || num_files_ == 0) {
+    LOG_DEBUG("can't add data file");
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(files_latch_);
+  for (int i = 0; i < num_files_; i++) {
+    if (files_[i]->name == file_name)
+      return i;
+  }
+  int number = num_files_;
+  if (number >= MAX_DATA_FILES) {
+    LOG_DEBUG("too many data files");
+    return -1;
+  }
+  std::unique_ptr<DataFile> file(new DataFile());
+  file->number = number;
+  file->name = file_name;
+  if (!OpenDataFile(file.get()))
+    return -1;
+  std::ofstream files_list(files_list_name_, std::ios::app);
+  files_list << file_name << std::endl;
+  if (!files_list) {
+    LOG_DEBUG("can't record data file");
+    CloseDataFile(file.get());
+    return -1;
+  }
+  files_[number] = std::move(file);
+  num_files_ = number + 1;
+  return number;
 }
 
 /**
@@ -175,6 +1084,36 @@ void DiskManager::DeallocatePage(__attribute__((unused)) page_id_t page_id) {
  */
 int DiskManager::GetNumFlushes() const { return num_flushes_; }
 
+/**
+ * Returns number of syncs of the db file made so far
+ */
+int DiskManager::GetNumSyncs() const { return num_syncs_; }
+
+/**
+ * Returns number of page checksums verified on read so far
+ */
+uint64_t DiskManager::GetNumChecksumsVerified() const {
+  return checksums_verified_;
+}
+
+/**
+ * Returns number of pages read so far that failed their checksum
+ */
+uint64_t DiskManager::GetNumChecksumFailures() const {
+  return checksum_failures_;
+}
+
+/**
+ * Returns number of bytes read from the db file so far, compressed size for a
+ * compressed file
+ */
+uint64_t DiskManager::GetNumBytesRead() const { return bytes_read_; }
+
+/**
+ * Returns number of bytes written to the db file so far
+ */
+uint64_t DiskManager::GetNumBytesWritten() const { return bytes_written_; }
+
 /**
  * Returns true if the log is currently being flushed
  */
@@ -0,0 +1,217 @@
+/**
+ * free_space_map.cpp
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "disk/free_space_map.h"
+
+namespace cmudb {
+
+// marks a page that holds an initialized map
+static const uint32_t MAP_MAGIC = 0x464d4150;
+
+static inline page_id_t MapPageId(size_t map_index) {
+  return static_cast<page_id_t>(map_index) * FreeSpaceMap::PAGES_PER_MAP +
+         FreeSpaceMap::PAGES_PER_MAP - 1;
+}
+
+static inline bool HasMagic(const std::vector<char> &map) {
+  uint32_t magic;
+  memcpy(&magic, map.data(), sizeof(magic));
+  return magic == MAP_MAGIC;
+}
+
+/*
+ * The first map keeps the high water mark; the other maps are read up to it.
+ * A file without maps predates them (or never allocated through the map), so
+ * every page it holds is taken as allocated. Pages found past the high water
+ * mark were allocated after the maps were last written, they are in use too
+ */
+void FreeSpaceMap::Load(const PageIO &read_page, page_id_t file_pages) {
+  std::lock_guard<std::mutex> lock(latch_);
+  maps_.clear();
+  dirty_.clear();
+  next_page_id_ = 0;
+
+  std::vector<char> first(PAGE_SIZE, 0);
+  if (file_pages > MapPageId(0))
+    read_page(MapPageId(0), first.data());
+  if (HasMagic(first)) {
+    memcpy(&next_page_id_, first.data() + 4, sizeof(page_id_t));
+    maps_.push_back(first);
+    dirty_.push_back(false);
+    size_t map_count =
+        next_page_id_ == 0 ? 1 : (next_page_id_ - 1) / PAGES_PER_MAP + 1;
+    for (size_t i = 1; i < map_count; i++) {
+      std::vector<char> map(PAGE_SIZE, 0);
+      if (MapPageId(i) < file_pages)
+        read_page(MapPageId(i), map.data());
+      bool lost = !HasMagic(map);
+      maps_.push_back(map);
+      dirty_.push_back(lost);
+      if (lost) {
+        // never written, assume everything in its range is allocated
+        memset(maps_[i].data() + MAP_HEADER_SIZE, 0xff,
+               PAGE_USABLE_SIZE - MAP_HEADER_SIZE);
+        memcpy(maps_[i].data(), &MAP_MAGIC, sizeof(MAP_MAGIC));
+      }
+    }
+  }
+
+  page_id_t end = file_pages;
+  if (end > next_page_id_ && !IsMapPage(end - 1)) {
+    for (page_id_t page_id = next_page_id_; page_id < end; page_id++)
+      SetBit(page_id, true);
+    next_page_id_ = end;
+  }
+  shared_extent_ = next_page_id_ == 0 ? 0 : (next_page_id_ - 1) / EXTENT_SIZE;
+}
+
+/*
+ * With a hint, take the free page of its extent closest to it, else open an
+ * empty extent. Without one, fill the shared extent page by page. Taking a
+ * page past the high water mark moves the mark, the pages skipped over stay
+ * free for the extent they belong to
+ */
+page_id_t FreeSpaceMap::Allocate(page_id_t hint) {
+  std::lock_guard<std::mutex> lock(latch_);
+  page_id_t page_id;
+  if (hint >= 0 && hint < next_page_id_) {
+    page_id_t extent = hint / EXTENT_SIZE;
+    page_id = FindFreeInExtent(extent, hint);
+    if (page_id == INVALID_PAGE_ID)
+      page_id = FindFreeExtent(extent) * EXTENT_SIZE;
+  } else {
+    page_id = FindFreeInExtent(shared_extent_, shared_extent_ * EXTENT_SIZE);
+    if (page_id == INVALID_PAGE_ID) {
+      shared_extent_ = FindFreeExtent(shared_extent_);
+      page_id = shared_extent_ * EXTENT_SIZE;
+    }
+  }
+  // local page ids must fit below the file number in a page id
+  if (page_id >= (1 << PAGE_FILE_SHIFT))
+    return INVALID_PAGE_ID;
+  SetBit(page_id, true);
+  if (page_id >= next_page_id_) {
+    next_page_id_ = page_id + 1;
+    // the high water mark lives in the first map
+    dirty_[0] = true;
+  }
+  return page_id;
+}
+
+bool FreeSpaceMap::Free(page_id_t page_id) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (page_id < 0 || page_id >= next_page_id_ || IsMapPage(page_id) ||
+      !GetBit(page_id))
+    return false;
+  SetBit(page_id, false);
+  return true;
+}
+
+bool FreeSpaceMap::IsAllocated(page_id_t page_id) {
+  std::lock_guard<std::mutex> lock(latch_);
+  return page_id >= 0 && page_id < next_page_id_ && GetBit(page_id);
+}
+
+void FreeSpaceMap::MarkAllocated(page_id_t page_id) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (page_id < 0 || IsMapPage(page_id))
+    return;
+  SetBit(page_id, true);
+  if (page_id >= next_page_id_) {
+    next_page_id_ = page_id + 1;
+    dirty_[0] = true;
+  }
+}
+
+void FreeSpaceMap::Flush(const PageIO &write_page) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (!maps_.empty())
+    memcpy(maps_[0].data() + 4, &next_page_id_, sizeof(page_id_t));
+  for (size_t i = 0; i < maps_.size(); i++) {
+    if (dirty_[i]) {
+      write_page(MapPageId(i), maps_[i].data());
+      dirty_[i] = false;
+    }
+  }
+}
+
+bool FreeSpaceMap::GetBit(page_id_t page_id) {
+  size_t map_index = page_id / PAGES_PER_MAP;
+  if (map_index >= maps_.size())
+    return false;
+  int bit = page_id % PAGES_PER_MAP;
+  return maps_[map_index][MAP_HEADER_SIZE + bit / 8] & (1 << (bit % 8));
+}
+
+/*
+ * Maps are created on demand, a new map marks its own page as allocated
+ */
+void FreeSpaceMap::SetBit(page_id_t page_id, bool allocated) {
+  size_t map_index = page_id / PAGES_PER_MAP;
+  while (maps_.size() <= map_index) {
+    std::vector<char> map(PAGE_SIZE, 0);
+    memcpy(map.data(), &MAP_MAGIC, sizeof(MAP_MAGIC));
+    int own_bit = PAGES_PER_MAP - 1;
+    map[MAP_HEADER_SIZE + own_bit / 8] |= 1 << (own_bit % 8);
+    maps_.push_back(map);
+    dirty_.push_back(true);
+  }
+  int bit = page_id % PAGES_PER_MAP;
+  char &byte = maps_[map_index][MAP_HEADER_SIZE + bit / 8];
+  if (allocated)
+    byte |= 1 << (bit % 8);
+  else
+    byte &= ~(1 << (bit % 8));
+  dirty_[map_index] = true;
+}
+
+/*
+ * Free page of the extent nearest to from, searching both directions. Pages
+ * past the high water mark are free
+ */
+page_id_t FreeSpaceMap::FindFreeInExtent(page_id_t extent, page_id_t from) {
+  page_id_t low = extent * EXTENT_SIZE, high = low + EXTENT_SIZE;
+  for (page_id_t distance = 0; distance < EXTENT_SIZE; distance++) {
+    page_id_t candidates[2] = {from + distance, from - distance};
+    for (page_id_t page_id : candidates) {
+      if (page_id < low || page_id >= high || IsMapPage(page_id))
+        continue;
+      if (page_id >= next_page_id_ || !GetBit(page_id))
+        return page_id;
+    }
+  }
+  return INVALID_PAGE_ID;
+}
+
+bool FreeSpaceMap::IsExtentFree(page_id_t extent) {
+  page_id_t low = extent * EXTENT_SIZE;
+  page_id_t high = std::min(low + EXTENT_SIZE, next_page_id_);
+  for (page_id_t page_id = low; page_id < high; page_id++) {
+    if (!IsMapPage(page_id) && GetBit(page_id))
+      return false;
+  }
+  return true;
+}
+
+/*
+ * An extent without allocated pages: the closest one after from_extent, then
+ * one before it, then the first extent past the high water mark
+ */
+page_id_t FreeSpaceMap::FindFreeExtent(page_id_t from_extent) {
+  page_id_t extent_count = (next_page_id_ + EXTENT_SIZE - 1) / EXTENT_SIZE;
+  for (page_id_t extent = from_extent + 1; extent < extent_count; extent++) {
+    if (IsExtentFree(extent))
+      return extent;
+  }
+  for (page_id_t extent = 0; extent < from_extent && extent < extent_count;
+       extent++) {
+    if (IsExtentFree(extent))
+      return extent;
+  }
+  return std::max(extent_count, from_extent + 1);
+}
+
+} // namespace cmudb
@@ -14,7 +14,7 @@ namespace cmudb {
  */
 template <typename K, typename V>
 ExtendibleHash<K, V>::ExtendibleHash(size_t size): 
-bucket_size(size), depth(0), bucket_number(0) {
+bucket_size(size), depth(0), pair_cnt(0), bucket_number(0) {
 	buckets.emplace_back(new Bucket(0, 0));
 	bucket_number = 1;
 }
@@ -24,7 +24,6 @@ bucket_size(size), depth(0), bucket_number(0) {
  */
 template <typename K, typename V>
 size_t ExtendibleHash<K, V>::HashKey(const K &key) {
-  	std::lock_guard<std::mutex> lock(mutex_);
   	return std::hash<K>()(key);
 }
 
@@ -90,26 +89,24 @@ bool ExtendibleHash<K, V>::Remove(const K &key) {
 	return cnt != 0;
 }
 
+/*
+ * split an overflowing bucket on its next hash bit; the returned bucket takes
+ * the entries whose bit is set
+ */
 template <typename K, typename V>
-std::unique_ptr<typename ExtendibleHash<K, V>::Bucket> 
+std::unique_ptr<typename ExtendibleHash<K, V>::Bucket>
 ExtendibleHash<K, V>::split(std::shared_ptr<Bucket> &b) {
-	auto res = std::make_unique<Bucket>(0, b->depth);
-	while (res->items.empty()) {
-		++b->depth;
-		++res->depth;
-		for (auto it = b->items.begin(); it != b->items.end(); ) {
-			if (HashKey(it->first) & (1 << (b->depth - 1))) {  //????????????
-				res->items.insert(*it);
-				res->id = HashKey(it->first) & ((1 << b->depth) - 1);
-				it = b->items.erase(it);
-			}
-			else {
-				++it;
-			}
+	auto res = std::make_unique<Bucket>(0, b->depth + 1);
+	size_t bit = static_cast<size_t>(1) << b->depth;
+	res->id = b->id | bit;
+	++b->depth;
+	for (auto it = b->items.begin(); it != b->items.end(); ) {
+		if (HashKey(it->first) & bit) {
+			res->items.insert(*it);
+			it = b->items.erase(it);
 		}
-		if (b->items.empty()) { //????????????
-			b->items.swap(res->items);
-			b->id = res->id;
+		else {
+			++it;
 		}
 	}
 	++bucket_number;
@@ -125,72 +122,33 @@ template <typename K, typename V>
 void ExtendibleHash<K, V>::Insert(const K &key, const V &value) {
 	std::lock_guard<std::mutex> lock(mutex_);
 	size_t id = HashKey(key) & ((1 << depth) - 1);
-	if (buckets[id] == nullptr) {
-		buckets[id] = std::make_shared<Bucket>(id, depth);
-		++bucket_number;
-	}
 	auto bucket = buckets[id];
 	if (bucket->items.find(key) != bucket->items.end()) {
 		bucket->items[key] = value;
 		return;
 	}
-	else {   //not found
-		bucket->items.insert({key, value});
-		++pair_cnt;
-
-		if (bucket->items.size() < bucket_size) {
-			auto old_id = bucket->id;
-			auto old_depth = bucket->depth;
-			
-			std::shared_ptr<Bucket> new_bucket = split(bucket);
-			
-			if (new_bucket == nullptr) {
-				bucket->depth = old_depth;
-				return;
-			}
-			if (bucket->depth > depth) {
-				auto size = buckets.size();
-				auto factor = (1 << (bucket->depth - depth));
-				depth = bucket->depth;
-				buckets.resize(buckets.size() * factor);
-				
-				buckets[bucket->id] = bucket;
-				buckets[new_bucket->id] =  new_bucket;
-				
-				for (size_t i = 0; i < size; ++i) {
-					if (buckets[i]) {
-						if (i < buckets[i]->id || ((i & ((1 << buckets[i]->depth) - 1)) != buckets[i]->id)) {
-							buckets[i].reset();
-						}
-						else {
-							auto step = 1 << buckets[i]->depth;
-							for (size_t j = i + step; j < buckets.size(); j += step) {
-								buckets[j] = buckets[i];
-							}
-						}
-					}
-				}
-			}
-			else {
-				for (size_t i = old_id; i < buckets.size(); i += (1 << old_depth)) {
-					buckets[i].reset();
-				}
-
-				buckets[bucket->id] = bucket;
-				buckets[new_bucket->id] = new_bucket;
-
-				auto step = 1 << bucket->depth;
-				for (size_t i = bucket->id + step; i < buckets.size(); i += step) {
-					buckets[i] = bucket;
-				}
-				for (size_t i = new_bucket->id + step; i < buckets.size(); i += step) {
-					buckets[i] = new_bucket;
-				}
+	bucket->items.insert({key, value});
+	++pair_cnt;
+
+	while (bucket->items.size() > bucket_size) {
+		if (bucket->depth == depth) {
+			// double the directory, the upper half mirrors the lower half
+			size_t size = buckets.size();
+			buckets.resize(size * 2);
+			for (size_t i = 0; i < size; ++i) {
+				buckets[i + size] = buckets[i];
 			}
+			++depth;
+		}
+		std::shared_ptr<Bucket> new_bucket = split(bucket);
+		size_t step = static_cast<size_t>(1) << new_bucket->depth;
+		for (size_t i = new_bucket->id; i < buckets.size(); i += step) {
+			buckets[i] = new_bucket;
 		}
+		// keep splitting whichever half still holds the new key
+		id = HashKey(key) & ((1 << depth) - 1);
+		bucket = buckets[id];
 	}
-
-	//dump(key);
 }
 
 /*
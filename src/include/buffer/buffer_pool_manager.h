@@ -4,11 +4,19 @@
  * Functionality: The simplified Buffer Manager interface allows a client to
  * new/delete pages on disk, to read a disk page into the buffer pool and pin
  * it, also to unpin a page in the buffer pool.
+ *
+ * Over a read-only mapped database (IOMode::MMAP_READ_ONLY) fetched pages point
+ * straight into the mapping: nothing is copied or replaced, the kernel page
+ * cache does the caching, and every modification is rejected.
+ *
+ * Pages pinned and unpinned during a B+ tree structure modification are
+ * reported to the IndexLog operation of the thread, see logging/index_log.h.
  */
 
 #pragma once
 #include <list>
 #include <mutex>
+#include <vector>
 
 #include "buffer/lru_replacer.h"
 #include "disk/disk_manager.h"
@@ -30,13 +38,38 @@ public:
 
   bool FlushPage(page_id_t page_id);
 
-  Page *NewPage(page_id_t &page_id);
+  // write every dirty page back, e.g. before the database is closed. False
+  // if they could not be made durable
+  bool FlushAllPages();
+
+  // start reading pages that are about to be fetched, without pinning them
+  void PrefetchPages(const std::vector<page_id_t> &page_ids);
+
+  // hint: a page the new one should be placed near, e.g. its predecessor
+  Page *NewPage(page_id_t &page_id, page_id_t hint = INVALID_PAGE_ID);
 
   bool DeletePage(page_id_t page_id);
 
+  // over a read-only mapping: callers must not modify a fetched page
+  inline bool IsReadOnly() const { return disk_manager_->IsReadOnly(); }
+
+  // pages that may differ from their disk copy, each with its recLSN
+  std::vector<std::pair<page_id_t, lsn_t>> GetDirtyPageTable();
+
 private:
+  // false if the prefetch of the page failed, its frame holds no valid data
+  bool WaitForRead(Page *page);
+  // false if the log failed before lsn, the page must not be written
+  bool WaitForLog(lsn_t lsn);
+  void SetRecLSN(Page *page);
+  void DropFrame(Page *page);
+  Page *FetchMappedPage(page_id_t page_id);
+
   size_t pool_size_; // number of pages in buffer pool
   Page *pages_;      // array of pages
+  char *frames_;     // their data, one aligned block
+  // pages handed out from the mapping, they are never evicted
+  std::vector<Page *> mapped_pages_;
   DiskManager *disk_manager_;
   LogManager *log_manager_;
   HashTable<page_id_t, Page *> *page_table_; // to keep track of pages
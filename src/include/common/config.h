@@ -13,6 +13,11 @@
 namespace cmudb {
 
 extern std::chrono::duration<long long int> LOG_TIMEOUT;
+extern std::chrono::duration<long long int> CHECKPOINT_TIMEOUT;
+// longest an asynchronous commit may stay in the log buffer
+extern std::chrono::milliseconds ASYNC_COMMIT_MAX_LAG;
+// how often a standby looks for new records in the primary's log
+extern std::chrono::milliseconds STANDBY_POLL_INTERVAL;
 
 extern std::atomic<bool> ENABLE_LOGGING;
 
@@ -21,10 +26,25 @@ extern std::atomic<bool> ENABLE_LOGGING;
 #define INVALID_LSN -1     // representing an invalid lsn
 #define HEADER_PAGE_ID 0   // the header page id
 #define PAGE_SIZE 512     // size of a data page in byte
+#define PAGE_TRAILER_SIZE 4 // CRC32C of the page, in its last bytes
+#define PAGE_USABLE_SIZE (PAGE_SIZE - PAGE_TRAILER_SIZE) // bytes left for data
 #define LOG_BUFFER_SIZE                                                            \
   ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE) // size of a log buffer in byte
 #define BUCKET_SIZE 50                 // size of extendible hash bucket
 #define BUFFER_POOL_SIZE 10            // size of buffer pool
+#define INDEX_BATCH_SIZE 1024          // queued index entries applied at once
+#define ASYNC_IO_DEPTH 64              // page requests in flight per db file
+#define SCAN_PREFETCH_PAGES 4          // leaves read ahead by a full index scan
+#define DIRECT_IO_ALIGN 512            // buffer alignment for O_DIRECT I/O
+#define EXTENT_SIZE 64                 // contiguous pages allocated per owner
+#define CHECKSUM_SAMPLE_RATE 16        // one read in this many verified, sampled
+#define COMPRESSED_CHUNK_SIZE 64       // allocation unit of compressed pages
+#define PAGE_FILE_SHIFT 24             // page id bits of a page in its data file
+#define MAX_DATA_FILES 128             // data files of one database
+#define LOG_READ_SIZE (1 << 20)        // log read ahead at once by recovery
+#define LOG_SEGMENT_SIZE (1 << 20)     // size of a log file segment
+#define LOG_SPARE_SEGMENTS 4           // discarded log segments kept for reuse
+#define FORMAT_VERSION 1               // on-disk format of the database file
 
 typedef int32_t page_id_t; // page id type
 typedef int32_t txn_id_t;  // transaction id type
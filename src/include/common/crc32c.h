@@ -0,0 +1,17 @@
+/**
+ * crc32c.h
+ *
+ * CRC32C (Castagnoli) checksum, computed with the SSE4.2 crc32 instruction
+ * when the CPU has it and with a lookup table otherwise.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cmudb {
+
+uint32_t Crc32c(const char *data, size_t size);
+
+} // namespace cmudb
@@ -41,6 +41,8 @@ enum ExceptionType {
   EXCEPTION_TYPE_STAT = 20,             // stat related
   EXCEPTION_TYPE_CONNECTION = 21,       // connection related
   EXCEPTION_TYPE_SYNTAX = 22,           // syntax related
+  EXCEPTION_TYPE_CORRUPTION = 23,       // page failed its checksum, bad log
+  EXCEPTION_TYPE_IO = 24,               // page could not be written
 };
 
 class Exception : public std::runtime_error {
@@ -107,6 +109,10 @@ public:
       return "Connection";
     case EXCEPTION_TYPE_SYNTAX:
       return "Syntax";
+    case EXCEPTION_TYPE_CORRUPTION:
+      return "Corruption";
+    case EXCEPTION_TYPE_IO:
+      return "I/O";
     default:
       return "Unknown";
     }
@@ -0,0 +1,20 @@
+/**
+ * lz.h
+ *
+ * Byte oriented LZ77 compression in the LZ4 block format: runs of literals
+ * and back references of at least four bytes into the last 64KB, found
+ * through a hash table of four byte sequences. Meant for small buffers such
+ * as pages, it favours speed over ratio.
+ */
+
+#pragma once
+
+namespace cmudb {
+
+// size of the compressed data, 0 if it does not fit in capacity bytes
+int LzCompress(const char *src, int size, char *dst, int capacity);
+
+// size of the decompressed data, -1 if src is malformed or does not fit
+int LzDecompress(const char *src, int size, char *dst, int capacity);
+
+} // namespace cmudb
@@ -52,7 +52,8 @@ public:
   Transaction(txn_id_t txn_id)
       : state_(TransactionState::GROWING),
         thread_id_(std::this_thread::get_id()),
-        txn_id_(txn_id), prev_lsn_(INVALID_LSN), shared_lock_set_{new std::unordered_set<RID>},
+        txn_id_(txn_id), prev_lsn_(INVALID_LSN), async_commit_(false),
+        shared_lock_set_{new std::unordered_set<RID>},
         exclusive_lock_set_{new std::unordered_set<RID>} {
     // initialize sets
     write_set_.reset(new std::deque<WriteRecord>);
@@ -97,9 +98,22 @@ public:
 
   inline void SetState(TransactionState state) { state_ = state; }
 
-  inline lsn_t GetPrevLSN() { return prev_lsn_; }
+  // written by the owner thread only, read by a checkpoint as well
+  inline lsn_t GetPrevLSN() {
+    return prev_lsn_.load(std::memory_order_acquire);
+  }
+
+  inline void SetPrevLSN(lsn_t prev_lsn) {
+    prev_lsn_.store(prev_lsn, std::memory_order_release);
+  }
 
-  inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
+  // commit returns once the commit record is appended, see
+  // TransactionManager::Commit
+  inline bool IsAsyncCommit() { return async_commit_; }
+
+  inline void SetAsyncCommit(bool async_commit) {
+    async_commit_ = async_commit;
+  }
 
 private:
   TransactionState state_;
@@ -109,8 +123,9 @@ private:
   txn_id_t txn_id_;
   // Below are used by transaction, undo set
   std::shared_ptr<std::deque<WriteRecord>> write_set_;
-  // prev lsn
-  lsn_t prev_lsn_;
+  // prev lsn, read by a checkpoint while the transaction runs
+  std::atomic<lsn_t> prev_lsn_;
+  bool async_commit_;
 
   // Below are used by concurrent index
   // this deque contains page pointer that was latche during index operation
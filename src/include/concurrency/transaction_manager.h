@@ -5,27 +5,57 @@
 
 #pragma once
 #include <atomic>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "logging/log_manager.h"
 
 namespace cmudb {
+// a transaction that has not committed or aborted yet, with its first and
+// last log records
+struct ActiveTransaction {
+  txn_id_t txn_id;
+  lsn_t first_lsn;
+  lsn_t last_lsn;
+};
+
 class TransactionManager {
 public:
   explicit TransactionManager(LockManager *lock_manager,
                            LogManager *log_manager = nullptr)
-      : next_txn_id_(0), lock_manager_(lock_manager),
+      : next_txn_id_(0), async_commit_(false), lock_manager_(lock_manager),
         log_manager_(log_manager) {}
   TransactionManager(TransactionManager const&) = delete;
   TransactionManager &operator=(TransactionManager const&) = delete;
   Transaction *Begin();
-  void Commit(Transaction *txn);
+  // an asynchronous commit returns before its commit record is durable, it
+  // is flushed within ASYNC_COMMIT_MAX_LAG. The commit LSN is the prev LSN of
+  // the transaction afterwards, LogManager::WaitForFlush waits for it.
+  // False if the log failed before the commit record was durable
+  bool Commit(Transaction *txn);
   void Abort(Transaction *txn);
 
+  // default commit mode of the transactions begun from now on, the vtable
+  // sets it per connection on each transaction instead
+  inline void SetAsyncCommit(bool async_commit) {
+    async_commit_ = async_commit;
+  }
+
+  // active transaction table for a checkpoint, kept while logging
+  std::vector<ActiveTransaction> GetActiveTransactions();
+
 private:
+  void EndTransaction(Transaction *txn);
+
   std::atomic<txn_id_t> next_txn_id_;
+  std::atomic<bool> async_commit_;
+  // running transactions and the LSN of their begin record
+  std::unordered_map<txn_id_t, std::pair<Transaction *, lsn_t>> active_txns_;
+  std::mutex active_latch_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
 };
@@ -0,0 +1,107 @@
+/**
+ * async_io.h
+ *
+ * Asynchronous page transfers for the disk manager. Requests are handed over
+ * in batches and completed on a backend thread, which calls the callback of
+ * each request with the syscall result. A request covers a run of contiguous
+ * bytes of the file, gathered from or scattered to several buffers, so
+ * neighbouring pages move in one transfer. Two backends exist: io_uring, driven
+ * through raw syscalls, and a thread pool doing pread/pwrite for kernels or
+ * sandboxes where io_uring is not available.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cmudb {
+
+struct IORequest {
+  bool is_write;
+  int fd;
+  int64_t offset;
+  // buffers in file order, starting at offset
+  std::vector<struct iovec> iov;
+  // called once on a backend thread, with bytes transferred or -errno; a
+  // request the backend could not start completes on the submitting thread
+  std::function<void(ssize_t)> callback;
+};
+
+class AsyncIO {
+public:
+  virtual ~AsyncIO() {}
+
+  // start every request of the batch, completion is reported via callbacks
+  virtual void Submit(std::vector<IORequest> &requests) = 0;
+
+  // io_uring backend when the kernel allows it, thread pool otherwise
+  static AsyncIO *Create(size_t queue_depth, bool use_uring = true);
+};
+
+class ThreadPoolIO : public AsyncIO {
+public:
+  ThreadPoolIO(size_t num_threads);
+  ~ThreadPoolIO();
+
+  void Submit(std::vector<IORequest> &requests) override;
+
+private:
+  void Work();
+
+  std::vector<std::thread> workers_;
+  std::deque<IORequest> queue_;
+  std::mutex latch_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+class UringIO : public AsyncIO {
+public:
+  ~UringIO();
+
+  // nullptr when io_uring can not be set up
+  static UringIO *Open(size_t queue_depth);
+
+  void Submit(std::vector<IORequest> &requests) override;
+
+private:
+  UringIO() = default;
+  void SubmitQueued(unsigned count,
+                    std::vector<std::pair<IORequest, int>> &rejected);
+  void Reap();
+
+  int ring_fd_ = -1;
+  // submission ring
+  void *sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  struct io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  // completion ring, may share the mapping of the submission ring
+  void *cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  struct io_uring_cqe *cqes_;
+
+  // in flight requests, indexed by sqe user_data
+  std::vector<IORequest> slots_;
+  std::vector<size_t> free_slots_;
+  std::mutex latch_;
+  std::condition_variable cv_;
+  std::thread reaper_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,87 @@
+/**
+ * compressed_page_store.h
+ *
+ * Pages of a compressed database file. Each page image is compressed on its
+ * own and stored in a run of COMPRESSED_CHUNK_SIZE byte chunks of the db
+ * file; an indirection table maps the logical page id to its run. A page that
+ * does not shrink by at least one chunk is stored raw.
+ *
+ * The table is kept in a side file, one entry per logical page (size in byte):
+ *  ------------------------------------------
+ * | FirstChunk (4) | Length (2) | Flags (2) |
+ *  ------------------------------------------
+ * A length of 0 marks a page that was never written. The run the table on
+ * disk has for a page is never written over: the first rewrite after a Flush
+ * moves the page to a new run, later ones stay in it while they fit. Chunks
+ * left behind that the table on disk still points to are reused only after
+ * the table has been written back by Flush, so after a crash the table on
+ * disk reads every page as of the last Flush. Flush syncs the db file before
+ * the table, and page writes hold the latch, so the table written never
+ * points to a run whose image is not on disk.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+class CompressedPageStore {
+public:
+  CompressedPageStore(int db_fd, const std::string &table_file);
+  ~CompressedPageStore();
+
+  // pages [0, count) have an entry, written or not
+  page_id_t GetPageCount();
+
+  // bytes read from the db file, 0 if the page was never written. Throws if
+  // the image does not decompress to a page
+  int ReadPage(page_id_t page_id, char *page_data);
+
+  // bytes written to the db file, 0 on an I/O error
+  int WritePage(page_id_t page_id, const char *page_data);
+
+  // the page was deallocated, its chunks can go
+  void Discard(page_id_t page_id);
+
+  // write the changed entries of the table, then release moved away chunks.
+  // False on an I/O error, the table on disk is still the last one flushed
+  bool Flush(bool sync);
+
+private:
+  struct Entry {
+    uint32_t first_chunk;
+    uint16_t length;
+    uint16_t flags;
+  };
+
+  static inline int ChunkCount(int length) {
+    return (length + COMPRESSED_CHUNK_SIZE - 1) / COMPRESSED_CHUNK_SIZE;
+  }
+  uint32_t AllocateChunks(int count);
+  bool IsFlushedRun(page_id_t page_id, uint32_t first_chunk, int count);
+  void FreeChunks(page_id_t page_id, uint32_t first_chunk, int count);
+  void ReleaseChunks(uint32_t first_chunk, int count);
+  void SetEntry(page_id_t page_id, const Entry &entry);
+
+  int db_fd_;
+  int table_fd_;
+  std::vector<Entry> entries_;
+  // the table as last written to its file
+  std::vector<Entry> flushed_entries_;
+  // table blocks, of TABLE_BLOCK_ENTRIES entries, changed since the last flush
+  std::vector<bool> dirty_blocks_;
+  // chunks of the db file in use, and where the next search starts
+  std::vector<bool> used_chunks_;
+  uint32_t rover_ = 0;
+  // runs free once the table no longer refers to them
+  std::vector<std::pair<uint32_t, int>> pending_free_;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
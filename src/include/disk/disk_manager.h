@@ -5,49 +5,267 @@
  * database. It also performs read and write of pages to and from disk, and
  * provides a logical file layer within the context of a database management
  * system.
+ *
+ * Pages are read and written with pread/pwrite at explicit offsets on one file
+ * descriptor, and the file size is tracked in memory, so threads can access
+ * distinct pages concurrently without a shared file cursor.
+ *
+ * In direct I/O mode the database file is opened with O_DIRECT, so pages are
+ * cached only by the buffer pool and not a second time by the kernel.
+ *
+ * Every page written carries a CRC32C of its contents in its last
+ * PAGE_TRAILER_SIZE bytes. Reads check it, as set by the checksum mode, and a
+ * mismatch (a torn write, a corrupted sector) is thrown as a corruption
+ * exception instead of reaching the caller as page contents.
+ *
+ * In read-only mmap mode the database file is mapped into memory, pages are
+ * served as pointers into the mapping and every modification is rejected.
+ *
+ * In compressed mode every page is stored compressed, see CompressedPageStore.
+ * Page ids stay the same, pages are compressed on write and decompressed on
+ * read, so the buffer pool only ever sees whole pages.
+ *
+ * A database may span several data files, e.g. indexes and tables on different
+ * devices. The high bits of a page id (above PAGE_FILE_SHIFT) are the number
+ * of its file, the low bits the page within that file. File 0 is the database
+ * file itself, so a single file database keeps its page ids. Every file has
+ * its own descriptor, free space map and, in compressed mode, page table, and
+ * the files added are listed in <db>.files so they are opened again. A page
+ * allocated with a hint goes to the hint's file, MakePageId(file, 0) places
+ * the first page of a table or an index in a given file.
+ *
+ * The log is split into segments of LOG_SEGMENT_SIZE bytes, <db>.log.<n>
+ * holding the log from offset n * LOG_SEGMENT_SIZE. A segment is filled with
+ * zeros when it is created, so appends never change the file size and a sync
+ * of the log has no metadata to write. <db>.log only records the first
+ * segment still needed; segments before it are renamed to follow the last one
+ * and overwritten, up to LOG_SPARE_SEGMENTS of them, the others deleted. Log
+ * offsets do not depend on the segments, they count bytes from the start of
+ * the log. Stale bytes of a recycled segment belong to older records, which
+ * recovery tells from the records following the last one by their LSN. A
+ * database file created by the disk manager starts a new log, the one found
+ * under its name belongs to an earlier database.
  */
 
 #pragma once
 #include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "common/config.h"
+#include "disk/async_io.h"
+#include "disk/compressed_page_store.h"
+#include "disk/free_space_map.h"
 
 namespace cmudb {
 
+// how Sync() makes page writes durable: none leaves it to the kernel,
+// fdatasync skips metadata that is not needed to read the data back, fsync
+// flushes all of it
+enum class SyncPolicy { NONE = 0, FDATASYNC, FSYNC };
+
+// how the db file is accessed: through the kernel page cache, with O_DIRECT,
+// mapped read-only into memory, or through the page cache with every page
+// compressed
+enum class IOMode { BUFFERED = 0, DIRECT, MMAP_READ_ONLY, COMPRESSED };
+
+// which reads check the page checksum: none, one in CHECKSUM_SAMPLE_RATE, or
+// all of them. Writes always fill it in
+enum class ChecksumMode { OFF = 0, SAMPLED, ALWAYS };
+
 class DiskManager {
 public:
-  DiskManager(const std::string &db_file);
+  DiskManager(const std::string &db_file, IOMode io_mode = IOMode::BUFFERED,
+              SyncPolicy sync_policy = SyncPolicy::FDATASYNC);
   ~DiskManager();
 
-  void WritePage(page_id_t page_id, const char *page_data);
+  // false on an I/O error, every later Sync fails then
+  bool WritePage(page_id_t page_id, const char *page_data);
+  // throws if the page fails its checksum
   void ReadPage(page_id_t page_id, char *page_data);
 
-  void WriteLog(char *log_data, int size);
-  bool ReadLog(char *log_data, int size, int offset);
+  // asynchronous page I/O, the buffer must stay valid until the future is
+  // ready. The batch versions hand all pages to the backend at once. A page
+  // failing its checksum, or a write failing, makes its future throw
+  std::future<void> WritePageAsync(page_id_t page_id, const char *page_data);
+  std::future<void> ReadPageAsync(page_id_t page_id, char *page_data);
+  std::vector<std::future<void>>
+  WritePagesAsync(const std::vector<page_id_t> &page_ids,
+                  const std::vector<const char *> &page_datas);
+  std::vector<std::future<void>>
+  ReadPagesAsync(const std::vector<page_id_t> &page_ids,
+                 const std::vector<char *> &page_datas);
+
+  // make every page write completed so far durable, see SyncPolicy.
+  // Concurrent callers share one sync. False on an I/O error, and for every
+  // sync after it
+  bool Sync();
+
+  // false on an I/O error, the end of the log stays where it was
+  bool WriteLog(char *log_data, int size);
+  // false past the end of the log or before its discarded part
+  bool ReadLog(char *log_data, int size, int64_t offset);
+  // end of the log. When the log is opened, until recovery finds the last
+  // record and truncates after it, the end of its last segment
+  int64_t GetLogSize();
+  // cut a torn record off the end of the log, found by recovery
+  void TruncateLog(int64_t size);
+  // the records before offset are no longer needed, the segments holding only
+  // such records are recycled. Offsets of the records after it stay the same
+  void DiscardLog(int64_t offset);
+  // offset of the first byte of the log that is kept
+  int64_t GetLogStart();
+  // segment files of the log, in use and spare
+  int GetNumLogSegments();
+
+  // files of the log of a database, see above
+  static std::string GetLogName(const std::string &db_file);
+  static std::string GetLogSegmentName(const std::string &log_name,
+                                       int64_t segment);
+  // first segment in use, read from the log control file open as fd. -1 if
+  // it is not a control file of this segment size
+  static inline int64_t ReadLogControl(int fd) {
+    int64_t durable_end;
+    return ReadLogControl(fd, durable_end);
+  }
+  // also the end of the log known durable, published after every log sync
+  // for standbys to read up to
+  static int64_t ReadLogControl(int fd, int64_t &durable_end);
 
-  page_id_t AllocatePage();
+  page_id_t AllocatePage(page_id_t hint = INVALID_PAGE_ID);
   void DeallocatePage(page_id_t page_id);
+  // recovery: take a page allocated before a crash the free space map lost
+  void MarkAllocated(page_id_t page_id);
+
+  // open or create a data file and remember it with the database, returns its
+  // number (the one it already has if added before), -1 on failure
+  int AddDataFile(const std::string &file_name);
+  inline int GetNumDataFiles() const { return num_files_; }
+  inline static page_id_t MakePageId(int file_number, page_id_t page_id) {
+    return (file_number << PAGE_FILE_SHIFT) | page_id;
+  }
+  inline static int GetFileNumber(page_id_t page_id) {
+    return page_id >> PAGE_FILE_SHIFT;
+  }
+  inline static page_id_t GetLocalPageId(page_id_t page_id) {
+    return page_id & ((1 << PAGE_FILE_SHIFT) - 1);
+  }
+
+  // read-only mmap mode: address of the page inside the mapping, nullptr if
+  // the page is past the end of the file
+  char *GetMappedPage(page_id_t page_id);
+  // read-only mmap mode: ask the kernel to read the pages ahead
+  void AdviseWillNeed(const std::vector<page_id_t> &page_ids);
+
+  // check the checksum of a page read from disk, as set by the checksum
+  // mode, throw on a mismatch
+  void VerifyPage(page_id_t page_id, const char *page_data);
+  inline void SetChecksumMode(ChecksumMode mode) { checksum_mode_ = mode; }
+  inline ChecksumMode GetChecksumMode() const { return checksum_mode_; }
 
   int GetNumFlushes() const;
+  int GetNumSyncs() const;
+  uint64_t GetNumChecksumsVerified() const;
+  uint64_t GetNumChecksumFailures() const;
+  // bytes of page data moved to and from the db file
+  uint64_t GetNumBytesRead() const;
+  uint64_t GetNumBytesWritten() const;
   bool GetFlushState() const;
   inline void SetFlushLogFuture(std::future<void> *f) { flush_log_f_ = f; }
   inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
+  inline bool IsDirectIO() const { return direct_io_; }
+  inline bool IsReadOnly() const { return read_only_; }
 
 private:
+  // one file of the database, page ids inside it are local
+  struct DataFile {
+    int number;
+    std::string name;
+    // descriptor, only used with pread/pwrite
+    int fd = -1;
+    // bytes in the file, grows with writes past the end
+    std::atomic<int64_t> size{0};
+    // allocation state of every page, persisted in reserved map pages
+    FreeSpaceMap free_space_map;
+    // compressed images and their table, nullptr unless in compressed mode
+    CompressedPageStore *compressed = nullptr;
+    // mapping of the whole file in read-only mode, nullptr for an empty file
+    char *mapping = nullptr;
+    size_t mapping_size = 0;
+  };
+
   int GetFileSize(const std::string &name);
-  // stream to write log file
-  std::fstream log_io_;
+  DataFile *GetDataFile(page_id_t page_id);
+  bool OpenDataFile(DataFile *file);
+  void CloseDataFile(DataFile *file);
+  bool WriteFilePage(DataFile *file, page_id_t page_id, const char *page_data);
+  void ReadFilePage(DataFile *file, page_id_t page_id, char *page_data);
+  bool SyncFile(DataFile *file);
+  void FinishWrite(DataFile *file, int64_t end);
+  bool IsAligned(const char *page_data);
+  void DisableDirectIO();
+  void FlushFreeSpaceMap();
+  void OpenLog(bool new_database);
+  void RemoveLogSegments();
+  std::string GetLogSegmentName(int64_t segment);
+  int GetLogSegment(int64_t segment);
+  void WriteLogControl();
+  void PublishLogEnd(int64_t end);
+  std::vector<std::future<void>>
+  SubmitPages(bool is_write, const std::vector<page_id_t> &page_ids,
+              const std::vector<char *> &page_datas);
+  // descriptor of the log control file, holding the first segment in use and
+  // the durable end
+  int log_fd_;
   std::string log_name_;
-  // stream to write db file
-  std::fstream db_io_;
+  // descriptors of the log segments, in use and spare, by number
+  std::map<int64_t, int> log_segments_;
+  // log offsets [log_start_, log_end_) are kept
+  int64_t log_start_;
+  std::atomic<int64_t> log_end_;
+  // end of the log as last published in the control file
+  int64_t durable_end_;
+  std::mutex log_latch_;
   std::string file_name_;
-  std::atomic<page_id_t> next_page_id_;
+  // names of the data files added after the first, one per line
+  std::string files_list_name_;
+  IOMode io_mode_;
+  std::atomic<bool> direct_io_;
+  SyncPolicy sync_policy_;
+  bool read_only_;
+  // files [0, num_files_) are open, a file is only added under files_latch_
+  std::unique_ptr<DataFile> files_[MAX_DATA_FILES];
+  std::atomic<int> num_files_;
+  std::mutex files_latch_;
+  // group sync: writes completed vs writes known durable
+  std::atomic<uint64_t> write_count_;
+  uint64_t synced_count_;
+  bool syncing_;
+  // set by a failed write or sync, writes since the last sync may be lost
+  std::atomic<bool> sync_failed_;
+  int num_syncs_;
+  std::mutex sync_latch_;
+  std::condition_variable sync_cv_;
+  // started on first asynchronous request
+  AsyncIO *async_io_;
+  std::once_flag async_io_flag_;
+  // log buffer written last, the log manager alternates between two
+  char *buffer_used_;
   int num_flushes_;
   bool flush_log_;
   std::future<void> *flush_log_f_;
+  std::atomic<ChecksumMode> checksum_mode_{ChecksumMode::ALWAYS};
+  std::atomic<uint64_t> checksum_reads_{0};
+  std::atomic<uint64_t> checksums_verified_{0};
+  std::atomic<uint64_t> checksum_failures_{0};
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> bytes_written_{0};
 };
 
 } // namespace cmudb
\ No newline at end of file
@@ -0,0 +1,81 @@
+/**
+ * free_space_map.h
+ *
+ * Allocation state of every page of the database file, one bit per page. The
+ * bits live in reserved map pages: the map of pages [g * PAGES_PER_MAP,
+ * (g + 1) * PAGES_PER_MAP) is the last page of that range, so the header page
+ * and the first pages of a new file keep their usual ids.
+ *
+ * Map page format (size in byte):
+ *  ----------------------------------------------------------------
+ * | Magic (4) | NextPageId (4) | Bitmap (PAGE_USABLE_SIZE - 8) ... |
+ *  ----------------------------------------------------------------
+ * NextPageId, the first page id never allocated, is only kept in the first map.
+ * Maps are written back by DiskManager::Sync and when the file is closed.
+ *
+ * Pages are handed out in extents of EXTENT_SIZE contiguous pages. A page
+ * allocated with a hint (a page of the same table heap or B+ tree) comes from
+ * the hint's extent, or from an empty extent once that one is full, so each
+ * owner's pages stay contiguous. Pages without a hint share one extent.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+class FreeSpaceMap {
+public:
+  static const int MAP_HEADER_SIZE = 8;
+  static const page_id_t PAGES_PER_MAP =
+      (PAGE_USABLE_SIZE - MAP_HEADER_SIZE) * 8;
+
+  // read or write one map page of the database file
+  typedef std::function<void(page_id_t, char *)> PageIO;
+
+  inline static bool IsMapPage(page_id_t page_id) {
+    return page_id % PAGES_PER_MAP == PAGES_PER_MAP - 1;
+  }
+
+  // rebuild the bitmap of a file holding file_pages pages
+  void Load(const PageIO &read_page, page_id_t file_pages);
+
+  // a free page of the hint's extent, as close as possible to hint.
+  // INVALID_PAGE_ID once the file holds 2^PAGE_FILE_SHIFT pages
+  page_id_t Allocate(page_id_t hint = INVALID_PAGE_ID);
+
+  // return false if the page was not allocated
+  bool Free(page_id_t page_id);
+
+  bool IsAllocated(page_id_t page_id);
+
+  // allocate a given page, e.g. one redone from the log
+  void MarkAllocated(page_id_t page_id);
+
+  // write the map pages changed since the last flush
+  void Flush(const PageIO &write_page);
+
+  inline page_id_t GetNextPageId() { return next_page_id_; }
+
+private:
+  bool GetBit(page_id_t page_id);
+  void SetBit(page_id_t page_id, bool allocated);
+  page_id_t FindFreeInExtent(page_id_t extent, page_id_t from);
+  bool IsExtentFree(page_id_t extent);
+  page_id_t FindFreeExtent(page_id_t from_extent);
+
+  // one PAGE_SIZE image per map page
+  std::vector<std::vector<char>> maps_;
+  std::vector<bool> dirty_;
+  page_id_t next_page_id_ = 0;
+  // extent serving allocations without a hint
+  page_id_t shared_extent_ = 0;
+  std::mutex latch_;
+};
+
+} // namespace cmudb
@@ -3,14 +3,18 @@
  *
  * Implementation of simple b+ tree data structure where internal pages direct
  * the search and leaf pages contain actual data.
- * (1) We only support unique key
+ * (1) Unique by default, a non-unique tree keeps duplicate rids of one key in
+ *     a posting list referenced from the leaf entry
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
- * (4) Implement index iterator for range scan
+ * (4) Implement index iterator for range scan, forward and backward
+ * (5) With a log manager, changes are logged ahead of the pages, see
+ *     logging/index_log.h
  */
 
 #pragma once
 
+#include <mutex>
 #include <queue>
 #include <vector>
 
@@ -30,18 +34,35 @@ public:
   explicit BPlusTree(const std::string &name,
                      BufferPoolManager *buffer_pool_manager,
                      const KeyComparator &comparator,
-                     page_id_t root_page_id = INVALID_PAGE_ID);
+                     page_id_t root_page_id = INVALID_PAGE_ID,
+                     bool unique = true, LogManager *log_manager = nullptr,
+                     page_id_t file_hint = INVALID_PAGE_ID);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
 
-  // Insert a key-value pair into this B+ tree.
+  bool IsUnique() const { return unique_; }
+
+  // Insert a key-value pair into this B+ tree. Over a read-only database
+  // inserts return false and removes do nothing.
   bool Insert(const KeyType &key, const ValueType &value,
               Transaction *transaction = nullptr);
 
   // Remove a key and its value from this B+ tree.
   void Remove(const KeyType &key, Transaction *transaction = nullptr);
 
+  // Remove a single key-value pair, other values of the key are kept.
+  void Remove(const KeyType &key, const ValueType &value,
+              Transaction *transaction = nullptr);
+
+  // Insert/remove key-value pairs sorted by key. A run of keys that falls
+  // inside one leaf is applied under a single descent. InsertBatch returns
+  // false if a key of a unique tree was already there, like Insert.
+  bool InsertBatch(const std::vector<MappingType> &entries,
+                   Transaction *transaction = nullptr);
+  void RemoveBatch(const std::vector<MappingType> &entries,
+                   Transaction *transaction = nullptr);
+
   // return the value associated with a given key
   bool GetValue(const KeyType &key, std::vector<ValueType> &result,
                 Transaction *transaction = nullptr);
@@ -49,6 +70,9 @@ public:
   // index iterator
   IndexIterator<KeyType, ValueType, KeyComparator> Begin();
   IndexIterator<KeyType, ValueType, KeyComparator> Begin(const KeyType &key);
+  // reverse index iterator, walk with operator-- for descending scans
+  IndexIterator<KeyType, ValueType, KeyComparator> RBegin();
+  IndexIterator<KeyType, ValueType, KeyComparator> RBegin(const KeyType &key);
 
   // Print this B+ tree to stdout using a simple command-line
   std::string ToString(bool verbose = false);
@@ -63,7 +87,8 @@ public:
 
   // expose for test purpose
   BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *
-  FindLeafPage(const KeyType &key, bool leftMost = false);
+  FindLeafPage(const KeyType &key, bool leftMost = false,
+               bool rightMost = false);
 
 private:
   class Checker {
@@ -76,11 +101,33 @@ private:
     BufferPoolManager *buffer;
   };
 
-  void StartNewTree(const KeyType &key, const ValueType &value);
+  void StartNewTree(const KeyType &key, const ValueType &value,
+                    Transaction *transaction = nullptr);
 
   bool InsertIntoLeaf(const KeyType &key, const ValueType &value,
                       Transaction *transaction = nullptr);
 
+  bool InsertDuplicate(
+      BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+      const KeyType &key, const ValueType &old_value, const ValueType &value,
+      Transaction *transaction = nullptr);
+
+  bool RemoveFromEntry(
+      BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+      const KeyType &key, const ValueType &value,
+      Transaction *transaction = nullptr);
+
+  void RemoveFromLeaf(
+      BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+      const KeyType &key, Transaction *transaction = nullptr);
+
+  bool LeafCovers(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+                  const KeyType &key);
+
+  void PrefetchSiblings(
+      BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+      bool reverse);
+
   void InsertIntoParent(BPlusTreePage *old_node, const KeyType &key,
                         BPlusTreePage *new_node,
                         Transaction *transaction = nullptr);
@@ -107,11 +154,25 @@ private:
 
   void UpdateRootPageId(bool insert_record = false);
 
+  void LogEntry(LogRecordType type,
+                BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+                int slot, const MappingType &entry, Transaction *transaction);
+
   // member variable
   std::string index_name_;
   page_id_t root_page_id_;
   BufferPoolManager *buffer_pool_manager_;
   KeyComparator comparator_;
+  bool unique_;
+  // pages are logged through it, see logging/index_log.h
+  LogManager *log_manager_;
+  // of the key columns, for entry records
+  std::vector<TypeId> key_types_;
+  // a new root leaf goes to the data file of this page, see
+  // DiskManager::AllocatePage
+  page_id_t file_hint_;
+  // serializes structure modifications
+  std::mutex mutex_;
 };
 
 } // namespace cmudb
\ No newline at end of file
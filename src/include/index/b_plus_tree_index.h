@@ -15,28 +15,103 @@ namespace cmudb {
 
 #define BPLUSTREE_INDEX_TYPE BPlusTreeIndex<KeyType, ValueType, KeyComparator>
 
+// wraps an index iterator, walking it forward or backward. A bounded scan
+// stops at the first entry whose key differs from the bound
+INDEX_TEMPLATE_ARGUMENTS
+class BPlusTreeIndexScan : public IndexScan {
+public:
+  BPlusTreeIndexScan(IndexIterator<KeyType, ValueType, KeyComparator> &&iter,
+                     bool descending, Schema *entry_schema,
+                     const KeyComparator &comparator,
+                     const KeyType *bound = nullptr)
+      : iter_(std::move(iter)), descending_(descending),
+        entry_schema_(entry_schema), comparator_(comparator),
+        bounded_(bound != nullptr) {
+    if (bounded_)
+      bound_ = *bound;
+  }
+
+  bool IsEnd() override {
+    return iter_.isEnd() ||
+           (bounded_ && comparator_((*iter_).first, bound_) != 0);
+  }
+
+  RID GetRID() override { return (*iter_).second; }
+
+  Value GetValue(int column) override {
+    return (*iter_).first.ToValue(entry_schema_, column);
+  }
+
+  void Next() override {
+    if (descending_)
+      --iter_;
+    else
+      ++iter_;
+  }
+
+private:
+  IndexIterator<KeyType, ValueType, KeyComparator> iter_;
+  bool descending_;
+  Schema *entry_schema_;
+  KeyComparator comparator_;
+  bool bounded_;
+  KeyType bound_;
+};
+
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
 
 public:
   BPlusTreeIndex(IndexMetadata *metadata,
                  BufferPoolManager *buffer_pool_manager,
-                 page_id_t root_page_id = INVALID_PAGE_ID);
+                 page_id_t root_page_id = INVALID_PAGE_ID,
+                 LogManager *log_manager = nullptr,
+                 page_id_t file_hint = INVALID_PAGE_ID);
 
   ~BPlusTreeIndex() {}
 
   void InsertEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
-  void DeleteEntry(const Tuple &key,
+  void DeleteEntry(const Tuple &key, RID rid,
                    Transaction *transaction = nullptr) override;
 
+  void QueueInsertEntry(const Tuple &tuple, Schema *tuple_schema, RID rid,
+                        Transaction *transaction = nullptr) override;
+
+  void QueueDeleteEntry(const Tuple &tuple, Schema *tuple_schema, RID rid,
+                        Transaction *transaction = nullptr) override;
+
+  bool ApplyQueuedEntries(Transaction *transaction = nullptr) override;
+
+  bool IsKeyTaken(const Tuple &tuple, Schema *tuple_schema, RID rid,
+                  Transaction *transaction = nullptr) override;
+
   void ScanKey(const Tuple &key, std::vector<RID> &result,
                Transaction *transaction = nullptr) override;
 
+  IndexScan *ScanEqual(const Tuple &key,
+                       Transaction *transaction = nullptr) override;
+
+  IndexScan *ScanOrdered(bool descending,
+                         Transaction *transaction = nullptr) override;
+
 protected:
+  struct QueuedEntry {
+    KeyType key;
+    RID rid;
+    bool insert;
+  };
+
+  void QueueEntry(const Tuple &tuple, Schema *tuple_schema, RID rid,
+                  bool insert, Transaction *transaction);
+
   // comparator for key
   KeyComparator comparator_;
+  // entry changes not applied to the container yet, in arrival order
+  std::vector<QueuedEntry> queue_;
+  // a batch applied as the queue filled up lost an entry of a taken key
+  bool collided_ = false;
   // container
   BPlusTree<KeyType, ValueType, KeyComparator> container_;
 };
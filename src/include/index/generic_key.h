@@ -9,7 +9,9 @@
  */
 #pragma once
 
+#include <cassert>
 #include <cstring>
+#include <vector>
 
 #include "table/tuple.h"
 #include "type/value.h"
@@ -23,6 +25,25 @@ public:
     memcpy(data, tuple.GetData(), tuple.GetLength());
   }
 
+  // build the key from some columns of a table tuple, laid out like a tuple
+  // of the key schema but without materializing that tuple
+  inline void SetFromTuple(const Tuple &tuple, Schema *schema,
+                           const std::vector<int> &attrs, Schema *key_schema) {
+    memset(data, 0, KeySize);
+    int32_t offset = key_schema->GetLength();
+    for (int i = 0; i < (int)attrs.size(); i++) {
+      Value value = tuple.GetValue(schema, attrs[i]);
+      if (!key_schema->IsInlined(i)) {
+        assert(offset + value.GetLength() + sizeof(uint32_t) <= KeySize);
+        *reinterpret_cast<int32_t *>(data + key_schema->GetOffset(i)) = offset;
+        value.SerializeTo(data + offset);
+        offset += (value.GetLength() + sizeof(uint32_t));
+      } else {
+        value.SerializeTo(data + key_schema->GetOffset(i));
+      }
+    }
+  }
+
   // NOTE: for test purpose only
   inline void SetFromInteger(int64_t key) {
     memset(data, 0, KeySize);
@@ -90,6 +111,8 @@ public:
   // constructor
   GenericComparator(Schema *key_schema) : key_schema_(key_schema) {}
 
+  inline Schema *GetKeySchema() const { return key_schema_; }
+
 private:
   Schema *key_schema_;
 };
@@ -28,12 +28,23 @@ class IndexMetadata {
 
 public:
   IndexMetadata(std::string index_name, std::string table_name,
-                const Schema *tuple_schema, const std::vector<int> &key_attrs)
-      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs) {
+                const Schema *tuple_schema, const std::vector<int> &key_attrs,
+                const std::vector<int> &include_attrs = std::vector<int>(),
+                bool unique = true, std::string data_file = "")
+      : name_(index_name), table_name_(table_name), key_attrs_(key_attrs),
+        include_attrs_(include_attrs), unique_(unique), data_file_(data_file) {
     key_schema_ = Schema::CopySchema(tuple_schema, key_attrs_);
+    // an index entry stores the key columns followed by the included ones
+    entry_attrs_ = key_attrs_;
+    entry_attrs_.insert(entry_attrs_.end(), include_attrs_.begin(),
+                        include_attrs_.end());
+    entry_schema_ = Schema::CopySchema(tuple_schema, entry_attrs_);
   }
 
-  ~IndexMetadata() { delete key_schema_; };
+  ~IndexMetadata() {
+    delete key_schema_;
+    delete entry_schema_;
+  };
 
   inline const std::string &GetName() const { return name_; }
 
@@ -51,6 +62,24 @@ public:
   //  columns
   inline const std::vector<int> &GetKeyAttrs() const { return key_attrs_; }
 
+  // Returns the non-key columns carried along in every index entry
+  inline const std::vector<int> &GetIncludeAttrs() const {
+    return include_attrs_;
+  }
+
+  // Returns the base table columns stored in an index entry, key first
+  inline const std::vector<int> &GetEntryAttrs() const { return entry_attrs_; }
+
+  // Returns a schema object pointer that represents a whole index entry, its
+  // key columns are laid out exactly as in the key schema
+  inline Schema *GetEntrySchema() const { return entry_schema_; }
+
+  // false if several tuples may share one key
+  inline bool IsUnique() const { return unique_; }
+
+  // data file holding the index, empty for the database file
+  inline const std::string &GetDataFile() const { return data_file_; }
+
   // Get a string representation for debugging
   const std::string ToString() const {
     std::stringstream os;
@@ -58,6 +87,7 @@ public:
     os << "IndexMetadata["
        << "Name = " << name_ << ", "
        << "Type = B+Tree, "
+       << "Unique = " << unique_ << ", "
        << "Table name = " << table_name_ << "] :: ";
     os << key_schema_->ToString();
 
@@ -69,8 +99,40 @@ private:
   std::string table_name_;
   // The mapping relation between key schema and tuple schema
   const std::vector<int> key_attrs_;
+  // non-key columns stored in the index (covering index)
+  const std::vector<int> include_attrs_;
+  const bool unique_;
+  const std::string data_file_;
+  // key_attrs_ followed by include_attrs_
+  std::vector<int> entry_attrs_;
   // schema of the indexed key
   Schema *key_schema_;
+  // schema of the key plus included columns
+  Schema *entry_schema_;
+};
+
+/**
+ * class IndexScan - Key ordered cursor over an index
+ *
+ * Hides the key type of the underlying iterator, so callers like the virtual
+ * table can walk an index without knowing its template arguments. Entries are
+ * produced lazily, a scan stopped after k entries only touches k entries.
+ */
+class IndexScan {
+public:
+  virtual ~IndexScan() {}
+
+  // true once the scan has run past the last entry
+  virtual bool IsEnd() = 0;
+
+  // rid of the entry the scan currently points at
+  virtual RID GetRID() = 0;
+
+  // value of the given entry schema column, read from the index itself
+  virtual Value GetValue(int column) = 0;
+
+  // step to the next entry in scan order
+  virtual void Next() = 0;
 };
 
 /////////////////////////////////////////////////////////////////////
@@ -110,6 +172,14 @@ public:
     return metadata_->GetKeyAttrs();
   }
 
+  Schema *GetEntrySchema() const { return metadata_->GetEntrySchema(); }
+
+  const std::vector<int> &GetEntryAttrs() const {
+    return metadata_->GetEntryAttrs();
+  }
+
+  bool IsUnique() const { return metadata_->IsUnique(); }
+
   // Get a string representation for debugging
   const std::string ToString() const {
     std::stringstream os;
@@ -122,17 +192,50 @@ public:
   ///////////////////////////////////////////////////////////////////
   // Point Modification
   ///////////////////////////////////////////////////////////////////
-  // designed for secondary indexes.
+  // designed for secondary indexes. key is laid out by the entry schema, so
+  // included columns travel along with the key
   virtual void InsertEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
-  // delete the index entry linked to given tuple
-  virtual void DeleteEntry(const Tuple &key,
+  // delete the index entry linked to given tuple, other tuples sharing the
+  // key stay in a non-unique index
+  virtual void DeleteEntry(const Tuple &key, RID rid,
                            Transaction *transaction = nullptr) = 0;
 
+  ///////////////////////////////////////////////////////////////////
+  // Batch Modification
+  ///////////////////////////////////////////////////////////////////
+  // queue the entry of a table tuple, the key is taken from the tuple
+  // directly. Queued entries reach the index in key order when applied
+  virtual void QueueInsertEntry(const Tuple &tuple, Schema *tuple_schema,
+                                RID rid,
+                                Transaction *transaction = nullptr) = 0;
+
+  virtual void QueueDeleteEntry(const Tuple &tuple, Schema *tuple_schema,
+                                RID rid,
+                                Transaction *transaction = nullptr) = 0;
+
+  // apply all queued entries, must run before the index is read. False if a
+  // key of a unique index was taken, that entry is not inserted, also by a
+  // batch applied since the last call as the queue filled up
+  virtual bool ApplyQueuedEntries(Transaction *transaction = nullptr) = 0;
+
+  // whether a unique index holds the key of a table tuple for a row other
+  // than rid, queued entries included
+  virtual bool IsKeyTaken(const Tuple &tuple, Schema *tuple_schema, RID rid,
+                          Transaction *transaction = nullptr) = 0;
+
   virtual void ScanKey(const Tuple &key, std::vector<RID> &result,
                        Transaction *transaction = nullptr) = 0;
 
+  // scan entries whose key equals the given key, caller owns the scan
+  virtual IndexScan *ScanEqual(const Tuple &key,
+                               Transaction *transaction = nullptr) = 0;
+
+  // scan all entries ordered by key, caller owns the returned scan
+  virtual IndexScan *ScanOrdered(bool descending,
+                                 Transaction *transaction = nullptr) = 0;
+
 private:
   //===--------------------------------------------------------------------===//
   //  Data members
@@ -1,11 +1,12 @@
 /**
  * index_iterator.h
- * For range scan of b+ tree
+ * For range scan of b+ tree, in either direction
  */
 
 #pragma once
 
 #include "page/b_plus_tree_leaf_page.h"
+#include "page/posting_page.h"
 #include "buffer/buffer_pool_manager.h"
 
 namespace cmudb {
@@ -17,22 +18,43 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 class IndexIterator {
 public:
   // you may define your own constructor based on your member variables
+  // reverse tells from which end a posting list under the start entry is read
   IndexIterator(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *,
-                int, BufferPoolManager *);
+                int, BufferPoolManager *, bool reverse = false);
+  // the iterator owns a pin on its current leaf (and posting page), so it
+  // can only be moved
+  IndexIterator(IndexIterator &&other);
+  IndexIterator(const IndexIterator &) = delete;
+  IndexIterator &operator=(const IndexIterator &) = delete;
 
   ~IndexIterator();
 
+  // true once the iterator has stepped past either end of the leaf chain
   bool isEnd();
 
   const MappingType &operator*();
 
   IndexIterator &operator++();
 
+  IndexIterator &operator--();
+
 private:
+  // unpin current leaf and pin the leaf with the given page id
+  void MoveToLeaf(page_id_t page_id);
+
+  // a leaf entry of a non-unique index may point to a posting list, yield
+  // its rids one by one starting from the head (or the tail if reverse)
+  void EnterEntry(bool reverse);
+  void MoveToPostingPage(page_id_t page_id);
+  void ReleasePostingPage();
+
   // add your own private member variables here
   BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf_;
   int index_;
   BufferPoolManager *buff_pool_manager_;
+  PostingPage *posting_page_;
+  int posting_index_;
+  MappingType current_;
 };
 
-} // namespace cmudb
\ No newline at end of file
+} // namespace cmudb
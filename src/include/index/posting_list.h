@@ -0,0 +1,63 @@
+/**
+ * posting_list.h
+ *
+ * RIDs of one duplicate key in a non-unique B+ tree index. The leaf keeps a
+ * single entry per key, whose value is either the only RID of that key or a
+ * marker RID pointing at the head of a posting page chain.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "page/posting_page.h"
+
+namespace cmudb {
+
+// slot number that marks a leaf value as a posting list head
+static const int POSTING_LIST_SLOT = -1;
+
+inline bool IsPostingList(const RID &rid) {
+  return rid.GetPageId() != INVALID_PAGE_ID &&
+         rid.GetSlotNum() == POSTING_LIST_SLOT;
+}
+
+inline RID PostingListRID(page_id_t head_page_id) {
+  return RID(head_page_id, POSTING_LIST_SLOT);
+}
+
+class PostingList {
+public:
+  // open an existing chain
+  PostingList(BufferPoolManager *buffer_pool_manager, page_id_t head_page_id);
+
+  // start a new chain holding two rids
+  PostingList(BufferPoolManager *buffer_pool_manager, const RID &first,
+              const RID &second);
+
+  inline page_id_t GetHeadPageId() const { return head_page_id_; }
+
+  // return false if the rid is already present
+  bool Insert(const RID &rid);
+
+  // return false if the rid is absent. Head page id may change
+  bool Remove(const RID &rid);
+
+  // when a single rid is left, free the chain and hand back that rid
+  bool ReleaseIfSingle(RID &rid);
+
+  void GetRIDs(std::vector<RID> &result);
+
+  // free every page of the chain
+  void Destroy();
+
+private:
+  PostingPage *FetchPostingPage(page_id_t page_id);
+  PostingPage *NewPostingPage(page_id_t prev_page_id);
+
+  BufferPoolManager *buffer_pool_manager_;
+  page_id_t head_page_id_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,62 @@
+/**
+ * checkpoint_manager.h
+ * Fuzzy checkpoints bound the log recovery has to read.
+ *
+ * A checkpoint writes a begin record, then the active transaction table and
+ * the dirty page table (each page with its recLSN, the first record that may
+ * not be on disk yet) in an end record, while transactions keep running and
+ * no page is flushed. Recovery has to start at the oldest of the begin record,
+ * the first record of every active transaction and every recLSN; that record
+ * and its offset go to the master record in the header page, and the log
+ * space before it is given back.
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "logging/log_manager.h"
+
+namespace cmudb {
+
+class CheckpointManager {
+public:
+  CheckpointManager(TransactionManager *transaction_manager,
+                    LogManager *log_manager,
+                    BufferPoolManager *buffer_pool_manager,
+                    DiskManager *disk_manager)
+      : transaction_manager_(transaction_manager), log_manager_(log_manager),
+        buffer_pool_manager_(buffer_pool_manager), disk_manager_(disk_manager),
+        running_(false), checkpoint_thread_(nullptr) {}
+
+  ~CheckpointManager() { StopCheckpointThread(); }
+
+  // take a checkpoint now, nothing is done while logging is off
+  // @return: the LSN recovery starts from, INVALID_LSN if none was taken
+  lsn_t Checkpoint();
+
+  // spawn a separate thread to take a checkpoint every interval
+  void RunCheckpointThread(std::chrono::milliseconds interval);
+  void StopCheckpointThread();
+
+private:
+  void CheckpointThread(std::chrono::milliseconds interval);
+
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  DiskManager *disk_manager_;
+  // one checkpoint at a time
+  std::mutex checkpoint_latch_;
+  // checkpoint thread
+  bool running_;
+  std::thread *checkpoint_thread_;
+  std::mutex latch_;
+  std::condition_variable cv_;
+};
+
+} // namespace cmudb
@@ -0,0 +1,105 @@
+/**
+ * index_log.h
+ * Write-ahead logging of B+ tree pages, so an index survives a crash without
+ * being rebuilt.
+ *
+ * An entry added to or removed from a leaf that needs no split or merge is
+ * logged by its slot (INDEXINSERT/INDEXDELETE), and redone on a leaf whose
+ * LSN is older. Any other change is a structure modification: an IndexLog
+ * operation is bound to the thread meanwhile, the buffer pool hands it every
+ * page the thread pins, and the page is logged as the delta from its image
+ * at pin time when it is unpinned dirty (INDEXPAGE, INDEXNEWPAGE for a page
+ * created by the operation). A new root is logged by the index name
+ * (INDEXROOT), the header page has no LSN. The records of an operation are
+ * chained by their prevLSN and closed by INDEXEND; recovery redoes them, then
+ * reverses the ones of an operation without an end, so a split or merge is
+ * either whole or gone. The pages an operation deletes stay allocated until
+ * its end record is durable, so a reversed operation finds them unused.
+ *
+ * Entry records belong to the transaction of the table row and are chained
+ * to its other records; recovery undoes the ones of a transaction left
+ * without commit by key, as the rows. An entry changed by a structure
+ * modification is logged inside the operation without a page, for undo
+ * alone: once the operation is reversed its undo finds nothing to do. The
+ * records of an operation carry no transaction. Nothing is logged while
+ * ENABLE_LOGGING is false or without a log manager.
+ */
+
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "concurrency/transaction.h"
+#include "logging/log_manager.h"
+#include "page/page.h"
+
+namespace cmudb {
+
+class IndexLog {
+public:
+  // a structure modification, logging starts here if logging is on
+  explicit IndexLog(LogManager *log_manager);
+  // logs the pages still pinned and ends the operation
+  ~IndexLog();
+
+  // a page pinned before the operation began, its image now is the base
+  void Track(page_id_t page_id, char *data);
+  // the root of index name changed, the log is flushed through the record
+  // before the header page may be written
+  void LogRoot(const std::string &name, page_id_t old_root,
+               page_id_t new_root);
+
+  // whether changes are logged through log_manager
+  static inline bool IsLogging(LogManager *log_manager) {
+    return log_manager != nullptr && ENABLE_LOGGING;
+  }
+  // an entry record, the last record of txn if any. data is the leaf of the
+  // record's slot and gets its LSN, nullptr for a record without a page
+  static void LogEntry(LogManager *log_manager, LogRecord &log_record,
+                       Transaction *txn, char *data);
+  // the operation of this thread, nullptr if none
+  static inline IndexLog *Current() { return current_; }
+
+  // unbinds the operation of this thread while in scope, the pages pinned
+  // meanwhile are not its own
+  class Pause {
+  public:
+    Pause() : log_(current_) { current_ = nullptr; }
+    ~Pause() { current_ = log_; }
+
+  private:
+    IndexLog *log_;
+  };
+
+  // buffer pool hooks, no-ops without an operation on this thread
+  static void Pinned(Page *page, bool fresh);
+  static void Unpinning(page_id_t page_id, bool is_dirty);
+  // true if the operation releases the deleted page itself, once its end
+  // record is durable
+  static bool Deleting(DiskManager *disk_manager, page_id_t page_id);
+
+private:
+  struct TrackedPage {
+    char *data;
+    // content as of the last record of the page, zeros for a new page
+    std::vector<char> image;
+    bool fresh;
+    // pins of this operation
+    int pins;
+  };
+
+  void LogPage(page_id_t page_id, TrackedPage &page);
+
+  LogManager *log_manager_;
+  bool active_;
+  // last record of the operation
+  lsn_t last_lsn_;
+  std::unordered_map<page_id_t, TrackedPage> pages_;
+  // deleted pages recovery may still bring back
+  DiskManager *disk_manager_;
+  std::vector<page_id_t> deleted_pages_;
+  static thread_local IndexLog *current_;
+};
+
+} // namespace cmudb
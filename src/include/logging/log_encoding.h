@@ -0,0 +1,75 @@
+/**
+ * log_encoding.h
+ * Compact encoding of log records: variable length integers, and the byte
+ * ranges that differ between two images of a tuple.
+ *
+ * A varint holds 7 bits per byte, low bits first, the high bit set on every
+ * byte but the last. Signed values are zigzag encoded first, so INVALID_* ids
+ * take one byte.
+ *
+ * A tuple delta lists the ranges where the new image of a tuple differs from
+ * the old one:
+ *-----------------------------------------------------------------------------
+ * | old_size | new_size | gap | old_count | new_count | old bytes | new bytes |
+ * | gap | ... |
+ *-----------------------------------------------------------------------------
+ * gap counts the unchanged bytes since the previous range, the same in both
+ * images, so either image is rebuilt from the other: redo turns the old image
+ * into the new one, undo the new into the old. Log records carry no schema,
+ * a changed column is the range of bytes it occupies.
+ */
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace cmudb {
+
+// longest varint of a 32-bit value
+static const int MAX_VARINT32_SIZE = 5;
+
+inline int VarintSize(uint64_t value) {
+  int size = 1;
+  for (; value >= 0x80; value >>= 7)
+    size++;
+  return size;
+}
+
+inline char *PutVarint(char *data, uint64_t value) {
+  for (; value >= 0x80; value >>= 7)
+    *data++ = static_cast<char>(value | 0x80);
+  *data++ = static_cast<char>(value);
+  return data;
+}
+
+// false if the varint does not end before end or is longer than 64 bits
+inline bool GetVarint(const char *&data, const char *end, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && data < end; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*data++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// delta turning the old image into the new one
+void MakeTupleDelta(const char *old_data, int old_size, const char *new_data,
+                    int new_size, std::vector<char> &delta);
+
+// rebuild the new image from the old one (forward), or the old image from
+// the new one. false if data is not the image the delta starts from
+bool ApplyTupleDelta(const char *delta, int delta_size, const char *data,
+                     int size, bool forward, std::vector<char> &result);
+
+} // namespace cmudb
@@ -3,13 +3,37 @@
  * log manager maintain a separate thread that is awaken when the log buffer is
  * full or time out(every X second) to write log buffer's content into disk log
  * file.
+ *
+ * Records are appended to one log buffer while the flush thread writes out
+ * the other; a flush swaps the two and syncs the log once for everything
+ * appended since the last one. A committing transaction asks for a flush and
+ * waits until persistent_lsn_ covers its commit record, so commits arriving
+ * during a flush are made durable together by the next one (group commit).
+ *
+ * Appenders do not take the latch: a compare-and-swap on one word holding the
+ * next LSN, the buffer being filled and the bytes reserved in it hands out an
+ * LSN and the space of the record together, so log order is LSN order. Each
+ * appender then serializes its record in parallel with the others and adds its
+ * size to the bytes filled of that buffer. A flush swaps buffers the same way
+ * and waits only until the bytes filled catch up with the bytes reserved.
+ * Only an appender finding the buffer full waits, on the latch, for the swap.
+ *
+ * An asynchronous commit does not wait: it sets a deadline max_commit_lag_
+ * ahead, unless an earlier one is pending, and the flush thread flushes by
+ * then. A crash loses at most the commits of the last max_commit_lag_.
+ *
+ * A failed write leaves a hole in the log, nothing after it can be written:
+ * persistent_lsn_ stops where it was and every wait for a later record fails.
  */
 
 #pragma once
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <future>
 #include <mutex>
+#include <thread>
 
 #include "disk/disk_manager.h"
 #include "logging/log_record.h"
@@ -19,18 +43,26 @@ namespace cmudb {
 class LogManager {
 public:
   LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN),
+      : reservation_(0), persistent_lsn_(INVALID_LSN), flush_requested_(false),
+        flushing_(false), running_(false), failed_(false),
+        flush_thread_(nullptr),
+        flush_interval_(LOG_TIMEOUT), flush_threshold_(LOG_BUFFER_SIZE),
+        max_commit_lag_(ASYNC_COMMIT_MAX_LAG),
+        commit_deadline_(std::chrono::steady_clock::time_point::max()),
+        buffer_first_lsn_(0), log_size_(disk_manager->GetLogSize()),
         disk_manager_(disk_manager) {
-    // TODO: you may intialize your own defined memeber variables here
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
-    flush_buffer_ = new char[LOG_BUFFER_SIZE];
+    for (int i = 0; i < 2; i++) {
+      buffers_[i] = new char[LOG_BUFFER_SIZE];
+      filled_[i] = 0;
+    }
   }
 
   ~LogManager() {
-    delete[] log_buffer_;
-    delete[] flush_buffer_;
-    log_buffer_ = nullptr;
-    flush_buffer_ = nullptr;
+    StopFlushThread();
+    for (int i = 0; i < 2; i++) {
+      delete[] buffers_[i];
+      buffers_[i] = nullptr;
+    }
   }
   // spawn a separate thread to wake up periodically to flush
   void RunFlushThread();
@@ -39,28 +71,91 @@ public:
   // append a log record into log buffer
   lsn_t AppendLogRecord(LogRecord &log_record);
 
+  // flush now and block until every record up to lsn is on disk. False if
+  // the log can no longer be written
+  bool WaitForFlush(lsn_t lsn);
+  // have every record up to lsn on disk within the max commit lag, without
+  // waiting for it
+  void RequestFlush(lsn_t lsn);
+
+  // the flush thread wakes up at least every interval, and as soon as
+  // threshold bytes are waiting in the log buffer
+  inline void SetFlushInterval(std::chrono::microseconds interval) {
+    std::lock_guard<std::mutex> lock(latch_);
+    flush_interval_ = interval;
+  }
+  inline void SetMaxCommitLag(std::chrono::microseconds lag) {
+    std::lock_guard<std::mutex> lock(latch_);
+    max_commit_lag_ = lag;
+  }
+  inline void SetFlushThreshold(int threshold) {
+    flush_threshold_ = std::min(std::max(threshold, 1), LOG_BUFFER_SIZE);
+  }
+
+  // recovery: number records after the last one found in the log, before
+  // anything is appended
+  void SetNextLSN(lsn_t lsn);
+  // recovery: the first record it read, nothing before it is needed
+  void SetLogStart(lsn_t lsn, int64_t offset);
+
+  // offset in the log file of a record at or before lsn, where reading the
+  // log for lsn can start. Exact for the first record of every flush
+  int64_t GetLogOffset(lsn_t lsn);
+  // checkpoint: the records before lsn are no longer needed, give back the
+  // log file space they hold
+  void DiscardLogBefore(lsn_t lsn);
+
   // get/set helper functions
   inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
+  // the LSN the next record will get
+  inline lsn_t GetNextLSN() {
+    return static_cast<lsn_t>(reservation_.load() >> 32);
+  }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
-  inline char *GetLogBuffer() { return log_buffer_; }
+  inline char *GetLogBuffer() {
+    return buffers_[(reservation_.load() >> 31) & 1];
+  }
 
 private:
-  // TODO: you may add your own member variables
-  // also remember to change constructor accordingly
+  void FlushThread();
+  void Flush(std::unique_lock<std::mutex> &lock);
+  static void SerializeLogRecord(LogRecord &log_record, char *data);
 
-  // atomic counter, record the next log sequence number
-  std::atomic<lsn_t> next_lsn_;
+  // next log sequence number (high 32 bits), buffer being filled (bit 31)
+  // and bytes reserved in it (low 31 bits)
+  std::atomic<uint64_t> reservation_;
   // log records before & include persistent_lsn_ have been written to disk
   std::atomic<lsn_t> persistent_lsn_;
-  // log buffer related
-  char *log_buffer_;
-  char *flush_buffer_;
+  // log buffer related, bytes of each buffer holding complete records
+  char *buffers_[2];
+  std::atomic<int> filled_[2];
+  // a committing transaction is waiting
+  bool flush_requested_;
+  // the other buffer is being written
+  bool flushing_;
+  bool running_;
+  // a write of the log failed
+  bool failed_;
   // latch to protect shared member variables
   std::mutex latch_;
   // flush thread
   std::thread *flush_thread_;
   // for notifying flush thread
   std::condition_variable cv_;
+  // for notifying appenders waiting for room and transactions waiting for
+  // their records to be flushed
+  std::condition_variable flushed_cv_;
+  std::chrono::microseconds flush_interval_;
+  std::atomic<int> flush_threshold_;
+  std::chrono::microseconds max_commit_lag_;
+  // when the oldest asynchronous commit not flushed yet has to be
+  std::chrono::steady_clock::time_point commit_deadline_;
+  // first LSN of every flush since the oldest record still needed, with its
+  // offset in the log file. The buffer being filled starts at
+  // buffer_first_lsn_, at offset log_size_
+  std::deque<std::pair<lsn_t, int64_t>> flush_points_;
+  lsn_t buffer_first_lsn_;
+  int64_t log_size_;
   // disk manager
   DiskManager *disk_manager_;
 };
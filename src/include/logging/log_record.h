@@ -2,32 +2,67 @@
  * log_record.h
  * For every write opeartion on table page, you should write ahead a
  * corresponding log record.
- * For EACH log record, HEADER is like (5 fields in common, 20 bytes in totoal)
- *-------------------------------------------------------------
- * | size | LSN | transID | prevLSN | LogType |
- *-------------------------------------------------------------
- * For insert type log record
- *-------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
- *-------------------------------------------------------------
- * For delete type(including markdelete, rollbackdelete, applydelete)
+ * Numbers are varints, signed ones zigzag encoded, see log_encoding.h. For
+ * EACH log record, HEADER is like (5 fields in common, 5 to 21 bytes)
+ *-----------------------------------------------------------------------
+ * | size | LSN | LogType (1 byte) | transID | LSN - prevLSN (0: none) |
+ *-----------------------------------------------------------------------
+ * For insert type log record, and markdelete with the tuple it deletes
+ *-----------------------------------------------------------------
+ * | HEADER | page_id | slot_num | tuple_size | tuple_data(char[]) |
+ *-----------------------------------------------------------------
+ * For applydelete and rollbackdelete the tuple is not logged: undo of an
+ * applydelete takes it from the transaction's insert or markdelete record of
+ * the rid, with its updates since then
+ *-------------------------------
+ * | HEADER | page_id | slot_num |
+ *-------------------------------
+ * For update type log record, the delta between the old and the new tuple
+ *--------------------------------------------------------
+ * | HEADER | page_id | slot_num | delta_size | delta |
+ *--------------------------------------------------------
+ * For new page type log record
  *-------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
+ * | HEADER | prev_page_id | page_id |
  *-------------------------------------------------------------
- * For update type log record
+ * For index entry records, an entry of a transaction inserted at or removed
+ * from a slot of a B+ tree leaf page, see logging/index_log.h. page_id is
+ * INVALID_PAGE_ID when a structure modification made the change. Undo finds
+ * the entry again by key in the index named, with the key column types
+ *----------------------------------------------------------------------------
+ * | HEADER | page_id | slot | entry_size | entry(char[]) | name_size |
+ * | name(char[]) | unique (1 byte) | type_count | type (1 byte) ... |
+ *----------------------------------------------------------------------------
+ * For index page records, the delta between two images of an index page, a
+ * new page from zeros
+ *--------------------------------------------
+ * | HEADER | page_id | delta_size | delta |
+ *--------------------------------------------
+ * For index root record, the root page of an index changed in the header page
+ *--------------------------------------------------------------
+ * | HEADER | name_size | name(char[]) | old_root | new_root |
+ *--------------------------------------------------------------
+ * For end checkpoint log record, prevLSN is the begin checkpoint record
  *------------------------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size |
- * | new_tuple_data |
+ * | HEADER | txn_count | (txn_id, last_lsn) ... | page_count |
+ * | (page_id, rec_lsn) ... |
  *------------------------------------------------------------------------------
- * For new page type log record
- *-------------------------------------------------------------
- * | HEADER | prev_page_id |
- *-------------------------------------------------------------
+ * Every record ends with the CRC32C of its other bytes (4 bytes), a record
+ * torn or overwritten in part is not taken for one
+ *--------------------------------
+ * | HEADER | body | CRC32C (4) |
+ *--------------------------------
+ * The size of a record depends on its LSN, it is known once the record is
+ * appended
  */
 #pragma once
 #include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
+#include "logging/log_encoding.h"
 #include "table/tuple.h"
 
 namespace cmudb {
@@ -44,8 +79,37 @@ enum class LogRecordType {
   ABORT,
   // when create a new page in heap table
   NEWPAGE,
+  // fuzzy checkpoint, the tables are taken between the two
+  CHECKPOINT_BEGIN,
+  CHECKPOINT_END,
+  // B+ tree. An entry added to or removed from a leaf, by a transaction, and
+  // the steps of a structure modification, no transaction, ended by INDEXEND
+  INDEXINSERT,
+  INDEXDELETE,
+  INDEXPAGE,
+  INDEXNEWPAGE,
+  INDEXROOT,
+  INDEXEND,
 };
 
+// name of a record type, for debugging and tools
+inline const char *LogRecordTypeName(LogRecordType type) {
+  static const char *names[] = {"INVALID",        "INSERT",
+                                 "MARKDELETE",     "APPLYDELETE",
+                                 "ROLLBACKDELETE", "UPDATE",
+                                 "BEGIN",          "COMMIT",
+                                 "ABORT",          "NEWPAGE",
+                                 "CHECKPOINT_BEGIN", "CHECKPOINT_END",
+                                 "INDEXINSERT",    "INDEXDELETE",
+                                 "INDEXPAGE",      "INDEXNEWPAGE",
+                                 "INDEXROOT",      "INDEXEND"};
+  static_assert(sizeof(names) / sizeof(names[0]) ==
+                    static_cast<size_t>(LogRecordType::INDEXEND) + 1,
+                "a name per type");
+  size_t index = static_cast<size_t>(type);
+  return index < sizeof(names) / sizeof(names[0]) ? names[index] : "UNKNOWN";
+}
+
 class LogRecord {
   friend class LogManager;
   friend class LogRecovery;
@@ -57,8 +121,8 @@ public:
 
   // constructor for Transaction type(BEGIN/COMMIT/ABORT)
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type)
-      : size_(HEADER_SIZE), lsn_(INVALID_LSN), txn_id_(txn_id),
-        prev_lsn_(prev_lsn), log_record_type_(log_record_type) {}
+      : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type) {}
 
   // constructor for INSERT/DELETE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
@@ -73,10 +137,14 @@ public:
              log_record_type == LogRecordType::MARKDELETE ||
              log_record_type == LogRecordType::ROLLBACKDELETE);
       delete_rid_ = rid;
-      delete_tuple_ = tuple;
+      if (log_record_type == LogRecordType::MARKDELETE)
+        delete_tuple_ = tuple;
     }
     // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
+    body_size_ = RIDSize(rid);
+    if (log_record_type == LogRecordType::INSERT ||
+        log_record_type == LogRecordType::MARKDELETE)
+      body_size_ += VarintSize(tuple.GetLength()) + tuple.GetLength();
   }
 
   // constructor for UPDATE type
@@ -84,21 +152,80 @@ public:
             const RID &update_rid, const Tuple &old_tuple,
             const Tuple &new_tuple)
       : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
-        log_record_type_(log_record_type), update_rid_(update_rid),
-        old_tuple_(old_tuple), new_tuple_(new_tuple) {
+        log_record_type_(log_record_type), update_rid_(update_rid) {
+    MakeTupleDelta(old_tuple.GetData(), old_tuple.GetLength(),
+                   new_tuple.GetData(), new_tuple.GetLength(), update_delta_);
     // calculate log record size
-    size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() +
-            new_tuple.GetLength() + 2 * sizeof(int32_t);
+    body_size_ = RIDSize(update_rid) + VarintSize(update_delta_.size()) +
+                 update_delta_.size();
   }
 
   // constructor for NEWPAGE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
-            page_id_t page_id)
-      : size_(HEADER_SIZE), lsn_(INVALID_LSN), txn_id_(txn_id),
-        prev_lsn_(prev_lsn), log_record_type_(log_record_type),
-        prev_page_id_(page_id) {
+            page_id_t prev_page_id, page_id_t page_id)
+      : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), prev_page_id_(prev_page_id),
+        page_id_(page_id) {
+    // calculate log record size
+    body_size_ = VarintSize(ZigZagEncode(prev_page_id)) +
+                 VarintSize(ZigZagEncode(page_id));
+  }
+
+  // constructor for CHECKPOINT_END type
+  LogRecord(lsn_t begin_lsn,
+            const std::vector<std::pair<txn_id_t, lsn_t>> &active_txns,
+            const std::vector<std::pair<page_id_t, lsn_t>> &dirty_pages)
+      : lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID), prev_lsn_(begin_lsn),
+        log_record_type_(LogRecordType::CHECKPOINT_END),
+        active_txns_(active_txns), dirty_pages_(dirty_pages) {
+    // calculate log record size
+    body_size_ = VarintSize(active_txns.size()) + VarintSize(dirty_pages.size());
+    for (auto &txn : active_txns)
+      body_size_ += VarintSize(ZigZagEncode(txn.first)) +
+                    VarintSize(ZigZagEncode(txn.second));
+    for (auto &page : dirty_pages)
+      body_size_ += VarintSize(ZigZagEncode(page.first)) +
+                    VarintSize(ZigZagEncode(page.second));
+  }
+
+  // constructor for INDEXINSERT/INDEXDELETE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+            page_id_t page_id, int slot, const char *entry, int entry_size,
+            const std::string &index_name, bool unique,
+            const std::vector<TypeId> &key_types)
+      : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), page_id_(page_id), slot_(slot),
+        entry_size_(entry_size), entry_(entry, entry + entry_size),
+        index_name_(index_name), unique_(unique), key_types_(key_types) {
+    // calculate log record size
+    body_size_ = VarintSize(ZigZagEncode(page_id)) + VarintSize(slot) +
+                 VarintSize(entry_size) + entry_size +
+                 VarintSize(index_name.size()) + index_name.size() + 1 +
+                 VarintSize(key_types.size()) + key_types.size();
+  }
+
+  // constructor for INDEXPAGE/INDEXNEWPAGE type, images of PAGE_USABLE_SIZE
+  LogRecord(lsn_t prev_lsn, LogRecordType log_record_type, page_id_t page_id,
+            const char *old_data, const char *new_data)
+      : lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID), prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type), page_id_(page_id) {
+    MakeTupleDelta(old_data, PAGE_USABLE_SIZE, new_data, PAGE_USABLE_SIZE,
+                   page_delta_);
     // calculate log record size
-    size_ = HEADER_SIZE + sizeof(page_id_t);
+    body_size_ = VarintSize(ZigZagEncode(page_id)) +
+                 VarintSize(page_delta_.size()) + page_delta_.size();
+  }
+
+  // constructor for INDEXROOT type
+  LogRecord(lsn_t prev_lsn, const std::string &index_name, page_id_t old_root,
+            page_id_t new_root)
+      : lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID), prev_lsn_(prev_lsn),
+        log_record_type_(LogRecordType::INDEXROOT), prev_page_id_(old_root),
+        page_id_(new_root), index_name_(index_name) {
+    // calculate log record size
+    body_size_ = VarintSize(index_name.size()) + index_name.size() +
+                 VarintSize(ZigZagEncode(old_root)) +
+                 VarintSize(ZigZagEncode(new_root));
   }
 
   ~LogRecord() {}
@@ -109,10 +236,38 @@ public:
 
   inline RID &GetInsertRID() { return insert_rid_; }
 
+  inline RID &GetUpdateRID() { return update_rid_; }
+
   inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+  inline std::vector<std::pair<txn_id_t, lsn_t>> &GetActiveTxns() {
+    return active_txns_;
+  }
+
+  inline std::vector<std::pair<page_id_t, lsn_t>> &GetDirtyPages() {
+    return dirty_pages_;
+  }
+
+  // 0 until the record is appended or read from the log
   inline int32_t GetSize() { return size_; }
 
+  // bytes the record takes in the log at most, whatever its LSN
+  inline int32_t GetMaxSize() {
+    return MAX_HEADER_SIZE + body_size_ + CRC_SIZE;
+  }
+
+  // delta of an update record, see log_encoding.h
+  inline std::vector<char> &GetUpdateDelta() { return update_delta_; }
+
+  // page of an index record, the new root of INDEXROOT
+  inline page_id_t GetPageId() { return page_id_; }
+
+  // index of an INDEXROOT or entry record
+  inline std::string &GetIndexName() { return index_name_; }
+
+  // delta of an index page record, see log_encoding.h
+  inline std::vector<char> &GetPageDelta() { return page_delta_; }
+
   inline lsn_t GetLSN() { return lsn_; }
 
   inline txn_id_t GetTxnId() { return txn_id_; }
@@ -129,7 +284,7 @@ public:
        << "LSN:" << lsn_ << ", "
        << "transID:" << txn_id_ << ", "
        << "prevLSN:" << prev_lsn_ << ", "
-       << "LogType:" << (int)log_record_type_ << "]";
+       << "LogType:" << LogRecordTypeName(log_record_type_) << "]";
 
     return os.str();
   }
@@ -143,7 +298,11 @@ private:
   lsn_t prev_lsn_ = INVALID_LSN;
   LogRecordType log_record_type_ = LogRecordType::INVALID;
 
-  // case1: for delete opeartion, delete_tuple_ for UNDO opeartion
+  // the length of log record after the header
+  int32_t body_size_ = 0;
+
+  // case1: for delete opeartion, delete_tuple_ of markdelete for UNDO
+  // opeartion
   RID delete_rid_;
   Tuple delete_tuple_;
 
@@ -153,12 +312,46 @@ private:
 
   // case3: for update opeartion
   RID update_rid_;
-  Tuple old_tuple_;
-  Tuple new_tuple_;
+  std::vector<char> update_delta_;
 
-  // case4: for new page opeartion
+  // case4: for new page opeartion, redo links the new page after the previous
   page_id_t prev_page_id_ = INVALID_PAGE_ID;
-  const static int HEADER_SIZE = 20;
+  page_id_t page_id_ = INVALID_PAGE_ID;
+
+  // case5: for index records, the page is page_id_. INDEXROOT holds the old
+  // root in prev_page_id_ and the new one in page_id_
+  int slot_ = 0;
+  int entry_size_ = 0;
+  std::vector<char> entry_;
+  std::vector<char> page_delta_;
+  std::string index_name_;
+  // entry records, how undo compares the keys of the index
+  bool unique_ = true;
+  std::vector<TypeId> key_types_;
+
+  // case6: for end checkpoint, the active transaction table (last LSN of
+  // each) and the dirty page table (recLSN of each)
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+  // size, LSN and transID at most 5 bytes each, LSN - prevLSN as well
+  const static int MAX_HEADER_SIZE = 4 * MAX_VARINT32_SIZE + 1;
+  // the checksum closing every record
+  const static int CRC_SIZE = 4;
+
+  static inline int RIDSize(const RID &rid) {
+    return VarintSize(static_cast<uint32_t>(rid.GetPageId())) +
+           VarintSize(rid.GetSlotNum());
+  }
+
+  // size of the record once it gets lsn
+  inline int32_t GetSerializedSize(lsn_t lsn) const {
+    int32_t size =
+        VarintSize(lsn) + 1 + VarintSize(ZigZagEncode(txn_id_)) +
+        VarintSize(prev_lsn_ == INVALID_LSN ? 0 : lsn - prev_lsn_) + body_size_ +
+        CRC_SIZE;
+    int size_bytes = VarintSize(size + 1);
+    return size + VarintSize(size + size_bytes);
+  }
 }; // namespace cmudb
 
 } // namespace cmudb
@@ -1,25 +1,46 @@
 /**
  * recovery_manager.h
  * Read log file from disk, redo and undo
+ *
+ * Redo reads the log front to back LOG_READ_SIZE bytes at a time, the next
+ * chunk being read while the current one is parsed, and hands every record
+ * on a page to the worker owning that page (page id modulo the number of
+ * workers). Each worker replays its pages in log order; a record is applied
+ * only to a page whose LSN is older. Undo then rolls back the transactions
+ * left without commit or abort, newest record first, logging each step as a
+ * runtime abort would, and ends them with an abort record; their index
+ * entries are undone by key. B+ tree structure modifications left without an
+ * end are reversed before, see logging/index_log.h.
+ * Both run before the flush thread starts, while ENABLE_LOGGING is false.
+ * After a checkpoint, redo starts at the record the master record in the
+ * header page points to, see checkpoint_manager.h.
  */
 
 #pragma once
 #include <algorithm>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "logging/log_manager.h"
 #include "logging/log_record.h"
 
 namespace cmudb {
 
 class LogRecovery {
+  friend class Standby;
+
 public:
   LogRecovery(DiskManager *disk_manager,
-                    BufferPoolManager *buffer_pool_manager)
+              BufferPoolManager *buffer_pool_manager, LogManager *log_manager)
       : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager),
-        offset_(0) {
+        log_manager_(log_manager), offset_(0),
+        redo_threads_(std::min<int>(
+            std::max(1u, std::thread::hardware_concurrency()),
+            BUFFER_POOL_SIZE)) {
     // global transaction through recovery phase
     log_buffer_ = new char[LOG_BUFFER_SIZE];
   }
@@ -29,22 +50,59 @@ public:
     log_buffer_ = nullptr;
   }
 
+  // both throw a corruption exception on a record that does not match the
+  // pages, or can't be read back, the database can't be recovered
   void Redo();
   void Undo();
   bool DeserializeLogRecord(const char *data, LogRecord &log_record);
 
+  // workers replaying pages during redo, each holds one page of the buffer
+  // pool at a time
+  inline void SetRedoThreads(int threads) {
+    redo_threads_ = std::max(threads, 1);
+  }
+
 private:
-  // TODO: you can add whatever member variable here
-  // Don't forget to initialize newly added variable in constructor
+  struct RedoWorker;
+
+  void ReplayPages(RedoWorker *worker, int index);
+  void RedoRecord(LogRecord &log_record, int index);
+  void UndoRecord(LogRecord &log_record);
+  void RedoIndexRecord(LogRecord &log_record);
+  void UndoIndexEntry(LogRecord &log_record);
+  template <size_t KeySize>
+  void UndoEntry(LogRecord &log_record, Schema *key_schema,
+                 page_id_t root_page_id, Transaction *txn);
+  lsn_t UndoIndexOperation(lsn_t last_lsn,
+                           std::vector<std::pair<lsn_t, int64_t>> &records);
+  void TrackIndexOperation(LogRecord &header, int64_t offset);
+  bool RebuildDeletedTuple(LogRecord &log_record, Tuple &tuple);
+  bool ReadLogRecord(int64_t offset, LogRecord &log_record);
+  static bool DeserializeHeader(const char *data, int size,
+                                LogRecord &log_record, const char *&body);
+  int64_t ReadCheckpoint();
+  void EndTransaction(txn_id_t txn_id);
+  Page *FetchPage(page_id_t page_id);
+
   DiskManager *disk_manager_;
   BufferPoolManager *buffer_pool_manager_;
+  // numbers the records of undo after the log
+  LogManager *log_manager_;
   // maintain active transactions and its corresponds latest lsn
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
-  // mapping log sequence number to log file offset, for undo purpose
-  std::unordered_map<lsn_t, int> lsn_mapping_;
-  // log buffer related
-  int offset_;
+  // mapping log sequence number to log file offset, for undo purpose. Only
+  // records of active transactions are kept
+  std::unordered_map<lsn_t, int64_t> lsn_mapping_;
+  // records of each active transaction, to drop from lsn_mapping_ when it ends
+  std::unordered_map<txn_id_t, std::vector<lsn_t>> txn_lsns_;
+  // records (LSN, offset) of each structure modification not ended, by the
+  // LSN of its last record
+  std::unordered_map<lsn_t, std::vector<std::pair<lsn_t, int64_t>>>
+      index_ops_;
+  // log buffer related, offset_ is the end of the last complete record
+  int64_t offset_;
   char *log_buffer_;
+  int redo_threads_;
 };
 
 } // namespace cmudb
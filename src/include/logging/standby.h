@@ -0,0 +1,87 @@
+/**
+ * standby.h
+ * A physical replica of another database, kept up to date from its log.
+ *
+ * The standby's database file starts as a copy of the primary's, taken while
+ * the primary is shut down or idle since its last checkpoint, so the master
+ * record of the copy tells where its log is to be read from. The standby
+ * tails the primary's log files where the primary writes them (a local path
+ * stands in for the network) and redoes every record synced there on its own
+ * pages, as recovery does: the primary publishes the durable end of its log
+ * in the log control file after each sync, a record the primary could still
+ * lose in a crash is not replayed. Replay goes through the buffer pool the
+ * queries read from, the pages they use stay cached.
+ *
+ * Records are applied in log order, one page latch at a time: a query sees
+ * the database as of the replay LSN, the last record applied, including
+ * changes of transactions still running on the primary. Nothing is undone.
+ *
+ * A restart point writes the pages and records the replay position in the
+ * master record of the standby, a restarted standby resumes from there. The
+ * primary does not wait for its standbys: one that falls behind the log the
+ * primary keeps stops replaying and needs a new copy.
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "logging/log_manager.h"
+#include "logging/log_recovery.h"
+
+namespace cmudb {
+
+class Standby {
+public:
+  Standby(const std::string &primary_db_file, DiskManager *disk_manager,
+          BufferPoolManager *buffer_pool_manager, LogManager *log_manager);
+  ~Standby();
+
+  // apply the records the primary has synced since the last call
+  // @return: records applied, -1 once the log read next is gone or does not
+  // match the pages
+  int Replay();
+  // write the pages, a restarted standby resumes after the last record
+  // applied
+  void Restartpoint();
+
+  // spawn a separate thread to replay every poll interval, with a restart
+  // point every CHECKPOINT_TIMEOUT and when it stops
+  void RunReplayThread(std::chrono::milliseconds poll_interval);
+  void StopReplayThread();
+
+  // the last record applied, INVALID_LSN before the first
+  inline lsn_t GetReplayLSN() { return next_lsn_ - 1; }
+
+private:
+  void ReplayThread(std::chrono::milliseconds poll_interval);
+  int ReadPrimaryLog(char *data, int size, int64_t offset);
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+  LogRecovery log_recovery_;
+  // the primary's log control file and the segment being read
+  std::string primary_log_name_;
+  int control_fd_;
+  int64_t segment_;
+  int segment_fd_;
+  // offset in the primary's log of the record with LSN next_lsn_
+  int64_t offset_;
+  std::atomic<lsn_t> next_lsn_;
+  bool broken_;
+  std::vector<char> buffer_;
+  // one replay or restart point at a time
+  std::mutex replay_latch_;
+  // replay thread
+  bool running_;
+  std::thread *replay_thread_;
+  std::mutex latch_;
+  std::condition_variable cv_;
+};
+
+} // namespace cmudb
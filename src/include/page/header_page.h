@@ -6,9 +6,21 @@
  * 32 bytes) and their corresponding root_id
  *
  * Format (size in byte):
- *  -----------------------------------------------------------------
- * | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
- *  -----------------------------------------------------------------
+ *  ---------------------------------------------------------------------
+ * | RecordCount (4) | LSN (4) | NextPageId (4) | Entry_1 name (32) |
+ *  ---------------------------------------------------------------------
+ * | Entry_1 root_id (4) | ... |
+ *  -----------------------------
+ *
+ * Once the header page is full the records go on in pages of the same format
+ * chained by NextPageId. The LSN is unused, the pages are logged by INDEXROOT
+ *
+ * The last bytes hold the master record of the log, where recovery begins:
+ *  -------------------------------------------------------------------------
+ * | Magic (4) | CheckpointLSN (4) | StartLSN (4) | Version (4) | Offset (8) |
+ *  -------------------------------------------------------------------------
+ * Version is the FORMAT_VERSION the file was created with, stamped before any
+ * checkpoint and left alone by them. Files older than the stamp read 0
  */
 
 #pragma once
@@ -16,14 +28,20 @@
 #include "page/page.h"
 
 #include <cstring>
+#include <functional>
 
 namespace cmudb {
 
+class BufferPoolManager;
+
 class HeaderPage : public Page {
 public:
-  void Init() { SetRecordCount(0); }
+  void Init() {
+    SetRecordCount(0);
+    SetNextPageId(INVALID_PAGE_ID);
+  }
   /**
-   * Record related
+   * Record related, in this page alone
    */
   bool InsertRecord(const std::string &name, const page_id_t root_id);
   bool DeleteRecord(const std::string &name);
@@ -33,12 +51,48 @@ public:
   bool GetRootId(const std::string &name, page_id_t &root_id);
   int GetRecordCount();
 
+  /**
+   * The same through the pages chained from this one, fetched from
+   * buffer_pool_manager and covered by the latch of this page. InsertRecord
+   * chains a new page when all are full; false if the name is taken, or a
+   * page can't be fetched or allocated
+   */
+  bool InsertRecord(BufferPoolManager *buffer_pool_manager,
+                    const std::string &name, const page_id_t root_id);
+  bool DeleteRecord(BufferPoolManager *buffer_pool_manager,
+                    const std::string &name);
+  bool UpdateRecord(BufferPoolManager *buffer_pool_manager,
+                    const std::string &name, const page_id_t root_id);
+  bool GetRootId(BufferPoolManager *buffer_pool_manager,
+                 const std::string &name, page_id_t &root_id);
+
+  page_id_t GetNextPageId();
+
+  /**
+   * Master record, begin LSN of the last checkpoint and the first record
+   * recovery reads with its offset in the log
+   */
+  void SetCheckpoint(lsn_t checkpoint_lsn, lsn_t start_lsn,
+                     int64_t start_offset);
+  // false if no checkpoint was taken
+  bool GetCheckpoint(lsn_t &checkpoint_lsn, lsn_t &start_lsn,
+                     int64_t &start_offset);
+
+  // on-disk format of the file, in the master record
+  void SetFormatVersion(uint32_t version);
+  uint32_t GetFormatVersion();
+
 private:
   /**
    * helper functions
    */
   int FindRecord(const std::string &name);
+  // calls visit on this page and the ones chained from it until it returns
+  // true, the page is unpinned dirty if visit sets dirty
+  bool VisitPages(BufferPoolManager *buffer_pool_manager,
+                  const std::function<bool(HeaderPage *, bool &)> &visit);
 
   void SetRecordCount(int record_count);
+  void SetNextPageId(page_id_t next_page_id);
 };
 } // namespace cmudb
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <cstring>
+#include <future>
 #include <iostream>
 
 #include "common/config.h"
@@ -20,7 +21,7 @@ class Page {
   friend class BufferPoolManager;
 
 public:
-  Page() { ResetMemory(); }
+  Page() {}
   ~Page(){};
   // get actual data page content
   inline char *GetData() { return data_; }
@@ -41,10 +42,17 @@ private:
   // method used by buffer pool manager
   inline void ResetMemory() { memset(data_, 0, PAGE_SIZE); }
   // members
-  char data_[PAGE_SIZE]; // actual data
+  // a frame of the buffer pool, aligned so O_DIRECT can transfer straight
+  // from it, or the page itself inside a read-only mapping of the db file
+  char *data_ = nullptr; // actual data
   page_id_t page_id_ = INVALID_PAGE_ID;
   int pin_count_ = 0;
   bool is_dirty_ = false;
+  // recLSN: no record older than it changed the page since it was last
+  // written, INVALID_LSN while the page is clean and unpinned
+  lsn_t rec_lsn_ = INVALID_LSN;
+  // set while a prefetch is reading the page into this frame
+  std::future<void> pending_read_;
   RWMutex rwlatch_;
 };
 
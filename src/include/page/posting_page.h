@@ -0,0 +1,54 @@
+/**
+ * posting_page.h
+ *
+ * Overflow page of a non-unique B+ tree index. It holds RIDs of tuples that
+ * share one key. Pages of the same key form a doubly-linked chain, RIDs are
+ * kept sorted inside each page and across the chain.
+ *
+ * Format (size in byte):
+ *  ---------------------------------------------------------------------
+ * | PageId (4) | LSN (4) | PrevPageId (4) | NextPageId (4) | Count (4) |
+ *  ---------------------------------------------------------------------
+ *  ------------------------------------
+ * | RID_1 (8) | RID_2 (8) | ... | RID_n (8) |
+ *  ------------------------------------
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include "common/rid.h"
+#include "page/page.h"
+
+namespace cmudb {
+
+class PostingPage : public Page {
+public:
+  void Init(page_id_t page_id, page_id_t prev_page_id);
+
+  page_id_t GetPageId();
+  page_id_t GetPrevPageId();
+  page_id_t GetNextPageId();
+  void SetPrevPageId(page_id_t prev_page_id);
+  void SetNextPageId(page_id_t next_page_id);
+
+  int GetCount();
+  int GetMaxCount();
+  RID GetRID(int index);
+
+  // first index whose rid is not less than the given one
+  int RIDIndex(const RID &rid);
+  // keep rids sorted, return false if full or already present
+  bool Insert(const RID &rid);
+  bool Remove(const RID &rid);
+  // move the upper half of the rids into an empty page
+  void MoveHalfTo(PostingPage *recipient);
+
+private:
+  static constexpr size_t HEADER_SIZE = 20;
+  void SetCount(int count);
+  int64_t *Array();
+};
+
+} // namespace cmudb
@@ -61,6 +61,9 @@ public:
   void RollbackDelete(const RID &rid, Transaction *txn,
                       LogManager *log_manager); // when commit abort
 
+  // recovery: put the tuple back into the free slot of rid
+  bool InsertTupleAt(const Tuple &tuple, const RID &rid);
+
   // return tuple (with data pointing to heap) if success
   bool GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
                 LockManager *lock_manager);
@@ -85,5 +88,6 @@ private:
                            // actual tuples because some slots may be empty
   void SetTupleCount(int32_t tuple_count);
   int32_t GetFreeSpaceSize();
+  void CopyTuple(int slot_num, const RID &rid, Tuple &tuple);
 };
 } // namespace cmudb
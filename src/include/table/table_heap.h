@@ -24,11 +24,13 @@ public:
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager,
             LogManager *log_manager, page_id_t first_page_id);
 
-  // create table heap
+  // create table heap, its pages go to the data file of hint
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager,
-            LogManager *log_manager, Transaction *txn);
+            LogManager *log_manager, Transaction *txn,
+            page_id_t hint = INVALID_PAGE_ID);
 
-  // for insert, if tuple is too large (>~page_size), return false
+  // for insert, if tuple is too large (>~page_size), return false. Insert,
+  // delete and update all return false over a read-only database
   bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn);
 
   bool MarkDelete(const RID &rid, Transaction *txn); // for delete
@@ -8,7 +8,9 @@
 #include "catalog/schema.h"
 #include "concurrency/transaction_manager.h"
 #include "index/b_plus_tree_index.h"
+#include "logging/checkpoint_manager.h"
 #include "logging/log_manager.h"
+#include "logging/standby.h"
 #include "sqlite/sqlite3ext.h"
 #include "table/table_heap.h"
 #include "table/tuple.h"
@@ -26,7 +28,9 @@ Tuple ConstructTuple(Schema *schema, sqlite3_value **argv);
 
 Index *ConstructIndex(IndexMetadata *metadata,
                       BufferPoolManager *buffer_pool_manager,
-                      page_id_t root_id = INVALID_PAGE_ID);
+                      page_id_t root_id = INVALID_PAGE_ID,
+                      LogManager *log_manager = nullptr,
+                      page_id_t file_hint = INVALID_PAGE_ID);
 Transaction *GetTransaction();
 
 /* API declaration */
@@ -59,14 +63,22 @@ int VtabCommit(sqlite3_vtab *pVTab);
 
 int VtabBegin(sqlite3_vtab *pVTab);
 
+// SELECT vtable_async_commit(on): commit mode of the transactions the
+// connection begins from now on
+void AsyncCommitFunction(sqlite3_context *ctx, int argc, sqlite3_value **argv);
+
+// SELECT vtable_replay_lsn(): last record of the primary a standby applied,
+// NULL on a primary
+void ReplayLSNFunction(sqlite3_context *ctx, int argc, sqlite3_value **argv);
+
 // storage engine
 class StorageEngine {
 public:
-  StorageEngine(std::string db_file_name) {
+  StorageEngine(std::string db_file_name, IOMode io_mode = IOMode::BUFFERED) {
     ENABLE_LOGGING = false;
 
     // storage related
-    disk_manager_ = new DiskManager(db_file_name);
+    disk_manager_ = new DiskManager(db_file_name, io_mode);
 
     // log related
     log_manager_ = new LogManager(disk_manager_);
@@ -77,9 +89,14 @@ public:
     // txn related
     lock_manager_ = new LockManager(true); // S2PL
     transaction_manager_ = new TransactionManager(lock_manager_, log_manager_);
+    checkpoint_manager_ =
+        new CheckpointManager(transaction_manager_, log_manager_,
+                              buffer_pool_manager_, disk_manager_);
   }
 
   ~StorageEngine() {
+    delete standby_;
+    delete checkpoint_manager_;
     if (ENABLE_LOGGING)
       log_manager_->StopFlushThread();
     delete disk_manager_;
@@ -94,6 +111,21 @@ public:
   LockManager *lock_manager_;
   TransactionManager *transaction_manager_;
   LogManager *log_manager_;
+  CheckpointManager *checkpoint_manager_;
+  // replays the log of the primary, nullptr unless a standby
+  Standby *standby_ = nullptr;
+
+  // a standby or a database mapped read-only takes no writes
+  inline bool IsReadOnly() const {
+    return standby_ != nullptr || disk_manager_->IsReadOnly();
+  }
+};
+
+// settings of one sqlite3 connection, the user data of the module and of the
+// functions registered on it
+struct ConnectionOptions {
+  // commit mode of the transactions begun on the connection
+  bool async_commit = false;
 };
 
 StorageEngine *storage_engine_;
@@ -105,9 +137,11 @@ class VirtualTable {
 
 public:
   VirtualTable(Schema *schema, BufferPoolManager *buffer_pool_manager,
-               LockManager *lock_manager, LogManager *log_manager, Index *index,
-               page_id_t first_page_id = INVALID_PAGE_ID)
-      : schema_(schema), index_(index) {
+               LockManager *lock_manager, LogManager *log_manager,
+               const std::vector<Index *> &indexes,
+               page_id_t first_page_id = INVALID_PAGE_ID,
+               page_id_t hint = INVALID_PAGE_ID)
+      : schema_(schema), indexes_(indexes) {
     if (first_page_id != INVALID_PAGE_ID) {
       // reopen an exist table
       table_heap_ = new TableHeap(buffer_pool_manager, lock_manager,
@@ -115,8 +149,8 @@ public:
     } else {
       // create table for the first time
       Transaction *txn = storage_engine_->transaction_manager_->Begin();
-      table_heap_ =
-          new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn);
+      table_heap_ = new TableHeap(buffer_pool_manager, lock_manager,
+                                  log_manager, txn, hint);
       storage_engine_->transaction_manager_->Commit(txn);
     }
   }
@@ -124,7 +158,8 @@ public:
   ~VirtualTable() {
     delete schema_;
     delete table_heap_;
-    delete index_;
+    for (auto index : indexes_)
+      delete index;
   }
 
   // insert into table heap
@@ -132,17 +167,10 @@ public:
     return table_heap_->InsertTuple(tuple, rid, GetTransaction());
   }
 
-  // insert into index
+  // insert into every index, entries are queued until ApplyIndexEntries
   inline void InsertEntry(const Tuple &tuple, const RID &rid) {
-    if (index_ == nullptr)
-      return;
-    // construct indexed key tuple
-    std::vector<Value> key_values;
-
-    for (auto &i : index_->GetKeyAttrs())
-      key_values.push_back(tuple.GetValue(schema_, i));
-    Tuple key(key_values, index_->GetKeySchema());
-    index_->InsertEntry(key, rid, GetTransaction());
+    for (auto index : indexes_)
+      index->QueueInsertEntry(tuple, schema_, rid, GetTransaction());
   }
 
   // delete from table heap
@@ -151,19 +179,77 @@ public:
     return table_heap_->MarkDelete(rid, GetTransaction());
   }
 
-  // delete from index
+  // delete from every index, entries are queued until ApplyIndexEntries
   inline void DeleteEntry(const RID &rid) {
-    if (index_ == nullptr)
+    if (indexes_.empty())
       return;
     Tuple deleted_tuple(rid);
     table_heap_->GetTuple(rid, deleted_tuple, GetTransaction());
-    // construct indexed key tuple
-    std::vector<Value> key_values;
+    for (auto index : indexes_)
+      index->QueueDeleteEntry(deleted_tuple, schema_, rid, GetTransaction());
+  }
+
+  // move index entries of an updated tuple, an index whose entry columns
+  // kept their values (and the tuple its rid) is left alone
+  inline void UpdateEntry(const Tuple &old_tuple, const RID &old_rid,
+                          const Tuple &new_tuple, const RID &new_rid) {
+    for (auto index : indexes_) {
+      bool changed = !(old_rid == new_rid);
+      for (auto &i : index->GetEntryAttrs()) {
+        if (changed)
+          break;
+        changed = old_tuple.GetValue(schema_, i)
+                      .CompareEquals(new_tuple.GetValue(schema_, i)) !=
+                  CMP_TRUE;
+      }
+      if (!changed)
+        continue;
+      index->QueueDeleteEntry(old_tuple, schema_, old_rid, GetTransaction());
+      index->QueueInsertEntry(new_tuple, schema_, new_rid, GetTransaction());
+    }
+  }
+
+  // false if a unique index holds a key of tuple for a row other than rid,
+  // the row is rejected before anything is queued
+  inline bool IsKeyFree(const Tuple &tuple, const RID &rid) {
+    for (auto index : indexes_) {
+      if (index->IsKeyTaken(tuple, schema_, rid, GetTransaction()))
+        return false;
+    }
+    return true;
+  }
+
+  // bring every index up to date, before it is read and at commit. False if
+  // a key of a unique index was taken
+  inline bool ApplyIndexEntries() {
+    bool applied = true;
+    for (auto index : indexes_)
+      applied = index->ApplyQueuedEntries(GetTransaction()) && applied;
+    return applied;
+  }
+
+  // varchars no wider than declared, index entries are sized by that width
+  inline bool FitsColumns(const Tuple &tuple, Schema *schema) {
+    for (int i = 0; i < schema->GetColumnCount(); i++) {
+      if (!FitsColumn(tuple, schema, i))
+        return false;
+    }
+    return true;
+  }
 
-    for (auto &i : index_->GetKeyAttrs())
-      key_values.push_back(deleted_tuple.GetValue(schema_, i));
-    Tuple key(key_values, index_->GetKeySchema());
-    index_->DeleteEntry(key, GetTransaction());
+  // a row whose entry columns fit every index
+  inline bool FitsIndexes(const Tuple &tuple) {
+    for (auto index : indexes_) {
+      for (auto &i : index->GetEntryAttrs()) {
+        if (!FitsColumn(tuple, schema_, i))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  inline bool GetTuple(const RID &rid, Tuple &tuple) {
+    return table_heap_->GetTuple(rid, tuple, GetTransaction());
   }
 
   // update table heap tuple
@@ -178,20 +264,33 @@ public:
 
   inline Schema *GetSchema() { return schema_; }
 
-  inline Index *GetIndex() { return index_; }
+  inline int GetIndexCount() { return static_cast<int>(indexes_.size()); }
+
+  inline Index *GetIndex(int index_id) { return indexes_[index_id]; }
 
   inline TableHeap *GetTableHeap() { return table_heap_; }
 
   inline page_id_t GetFirstPageId() { return table_heap_->GetFirstPageId(); }
 
+  // options of the connection the table was opened on, may be nullptr
+  inline ConnectionOptions *GetOptions() { return options_; }
+  inline void SetOptions(ConnectionOptions *options) { options_ = options; }
+
 private:
+  static inline bool FitsColumn(const Tuple &tuple, Schema *schema, int i) {
+    return schema->IsInlined(i) ||
+           tuple.GetValue(schema, i).GetLength() <=
+               static_cast<uint32_t>(schema->GetColumn(i).GetLength()) + 1;
+  }
+
   sqlite3_vtab base_;
   // virtual table schema
   Schema *schema_;
   // to read/write actual data in table
   TableHeap *table_heap_;
-  // to insert/delete index entry
-  Index *index_ = nullptr;
+  // to insert/delete index entry, all indexes defined on this table
+  std::vector<Index *> indexes_;
+  ConnectionOptions *options_ = nullptr;
 };
 
 class Cursor {
@@ -200,21 +299,38 @@ public:
       : table_iterator_(virtual_table->begin()), virtual_table_(virtual_table) {
   }
 
+  ~Cursor() { delete index_scan_; }
+
+  // index picked by VtabBestIndex for the following scan
+  inline void SetIndex(int index_id) {
+    index_ = virtual_table_->GetIndex(index_id);
+  }
+
+  // covering scan: every column the query reads lives in the index entry,
+  // so values are served from the leaf without touching the table heap
+  inline void SetCovering(bool is_covering) {
+    entry_column_.assign(virtual_table_->schema_->GetColumnCount(), -1);
+    if (is_covering) {
+      const std::vector<int> &entry_attrs = index_->GetEntryAttrs();
+      for (size_t i = 0; i < entry_attrs.size(); i++)
+        entry_column_[entry_attrs[i]] = static_cast<int>(i);
+    }
+  }
+
   inline void SetScanFlag(bool is_index_scan) {
     is_index_scan_ = is_index_scan;
+    is_empty_ = false;
   }
 
   inline bool IsIndexScan() { return is_index_scan_; }
 
   inline VirtualTable *GetVirtualTable() { return virtual_table_; }
 
-  inline Schema *GetKeySchema() {
-    return virtual_table_->index_->GetKeySchema();
-  }
+  inline Schema *GetKeySchema() { return index_->GetKeySchema(); }
   // return rid at which cursor is currently pointed
   inline int64_t GetCurrentRid() {
     if (is_index_scan_)
-      return results[offset_].Get();
+      return index_scan_->GetRID().Get();
     else
       return (*table_iterator_).GetRid().Get();
   }
@@ -222,10 +338,13 @@ public:
   // return tuple at which cursor is currently pointed
   inline Value GetCurrentValue(Schema *schema, int column) {
     if (is_index_scan_) {
-      RID rid = results[offset_];
-      Tuple tuple(rid);
-      virtual_table_->table_heap_->GetTuple(rid, tuple, GetTransaction());
-      return tuple.GetValue(schema, column);
+      if (!entry_column_.empty() && entry_column_[column] != -1)
+        return index_scan_->GetValue(entry_column_[column]);
+      // fetch the heap tuple once per row, not once per column
+      RID rid = index_scan_->GetRID();
+      if (!(tuple_.GetRid() == rid))
+        virtual_table_->table_heap_->GetTuple(rid, tuple_, GetTransaction());
+      return tuple_.GetValue(schema, column);
     } else {
       return table_iterator_->GetValue(schema, column);
     }
@@ -234,33 +353,53 @@ public:
   // move cursor up to next
   Cursor &operator++() {
     if (is_index_scan_)
-      ++offset_;
+      index_scan_->Next();
     else
       ++table_iterator_;
     return *this;
   }
   // is end of cursor(no more tuple)
   inline bool isEof() {
+    if (is_empty_)
+      return true;
     if (is_index_scan_)
-      return offset_ == static_cast<int>(results.size());
+      return index_scan_->IsEnd();
     else
       return table_iterator_ == virtual_table_->end();
   }
 
   // wrapper around poit scan methods
   inline void ScanKey(const Tuple &key) {
-    virtual_table_->index_->ScanKey(key, results);
+    delete index_scan_;
+    index_scan_ = index_->ScanEqual(key, GetTransaction());
+    tuple_ = Tuple();
+  }
+
+  // empty result, for a key that can't be in the index
+  inline void ScanNothing() { is_empty_ = true; }
+
+  // walk the whole index in key order, used for ORDER BY on the index key
+  inline void ScanOrdered(bool descending) {
+    delete index_scan_;
+    index_scan_ = index_->ScanOrdered(descending, GetTransaction());
+    tuple_ = Tuple();
   }
 
 private:
   sqlite3_vtab_cursor base_; /* Base class - must be first */
   // for index scan
-  std::vector<RID> results;
-  int offset_ = 0;
+  Index *index_ = nullptr;
+  IndexScan *index_scan_ = nullptr;
+  // table column -> index entry column, -1 when it must come from the heap
+  std::vector<int> entry_column_;
+  // heap tuple of the current row for non-covering index scans
+  Tuple tuple_;
   // for sequential scan
   TableIterator table_iterator_;
   // flag to indicate which scan method is currently used
   bool is_index_scan_ = false;
+  // the scan matches no row, see ScanNothing
+  bool is_empty_ = false;
   VirtualTable *virtual_table_;
 }; // namespace cmudb
 
@@ -9,6 +9,8 @@
 #include "common/logger.h"
 #include "common/rid.h"
 #include "index/b_plus_tree.h"
+#include "index/posting_list.h"
+#include "logging/index_log.h"
 #include "page/header_page.h"
 
 namespace cmudb {
@@ -18,12 +20,17 @@ BPlusTree<KeyType, ValueType, KeyComparator>::
 BPlusTree(const std::string &name,
           BufferPoolManager *buffer_pool_manager,
           const KeyComparator &comparator,
-          page_id_t root_page_id)
+          page_id_t root_page_id, bool unique, LogManager *log_manager,
+          page_id_t file_hint)
     : index_name_(name), root_page_id_(root_page_id),
-      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) {}
+      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+      unique_(unique), log_manager_(log_manager), file_hint_(file_hint) {
+  Schema *key_schema = comparator_.GetKeySchema();
+  for (int i = 0; key_schema != nullptr && i < key_schema->GetColumnCount();
+       i++)
+    key_types_.push_back(key_schema->GetType(i));
+}
 
-template <typename KeyType, typename ValueType, typename KeyComparator>
-thread_local bool BPlusTree<KeyType, ValueType, KeyComparator>::root_is_locked = false;
 /*
  * Helper function to decide whether current b+tree is empty
  */
@@ -37,7 +44,8 @@ IsEmpty() const {
  * SEARCH
  *****************************************************************************/
 /*
- * Return the only value that associated with input key
+ * Return all values that associated with input key, a non-unique key expands
+ * its posting list
  * This method is used for point query
  * @return : true means key exists
  */
@@ -47,27 +55,21 @@ GetValue(const KeyType &key, std::vector<ValueType> &result,
          Transaction *transaction) {
   // for debug
   //__attribute__((unused)) auto checker = Checker{buffer_pool_manager_};
-  
 
-  auto *leaf = FindLeafPage(key, false, Operation::READONLY, transaction);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto *leaf = FindLeafPage(key, false);
   bool ret = false;
   if (leaf != nullptr) {
     ValueType value;
     if (leaf->Lookup(key, value, comparator_)) {
-      result.push_back(value);
+      if (IsPostingList(value)) {
+        PostingList(buffer_pool_manager_, value.GetPageId()).GetRIDs(result);
+      } else {
+        result.push_back(value);
+      }
       ret = true;
     }
-    UnlockUnpinPages(Operation::READONLY, transaction);
-
-    //in case of `transaction` is nullptr
-    if (transaction == nullptr) {
-      auto page_id = leaf->GetPageId();
-      //unlock and unpin
-      buffer_pool_manager_->FetchPage(page_id)->RUnlatch();
-      buffer_pool_manager_->UnpinPage(page_id, false);
-      //unpin again
-      buffer_pool_manager_->UnpinPage(page_id, false);
-    }
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
   }
   return ret;
 }
@@ -79,8 +81,9 @@ GetValue(const KeyType &key, std::vector<ValueType> &result,
  * Insert constant key & value pair into b+ tree
  * if current tree is empty, start new tree, update root page id and insert
  * entry, otherwise insert into leaf page.
- * @return: since we only support unique key, if user try to insert duplicate
- * keys return false, otherwise return true.
+ * @return: in a unique tree, if user try to insert duplicate keys return
+ * false, otherwise return true. A non-unique tree only rejects an existing
+ * key-value pair.
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 bool BPlusTree<KeyType, ValueType, KeyComparator>::
@@ -89,11 +92,13 @@ Insert(const KeyType &key, const ValueType &value, Transaction *transaction)
   // for debug
   //__attribute__((unused)) auto checker = Checker{buffer_pool_manager_};
 
-
-
+  // the pages of a read-only database must not be touched
+  if (buffer_pool_manager_->IsReadOnly()) {
+    return false;
+  }
   std::lock_guard<std::mutex> lock(mutex_);
   if (IsEmpty()) {
-    StartNewTree(key, value);
+    StartNewTree(key, value, transaction);
     return true;
   }
   return InsertIntoLeaf(key, value, transaction);
@@ -107,8 +112,10 @@ Insert(const KeyType &key, const ValueType &value, Transaction *transaction)
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void BPlusTree<KeyType, ValueType, KeyComparator>::
-StartNewTree(const KeyType &key, const ValueType &value) {
-  auto *page = buffer_pool_manager_->NewPage(root_page_id_);
+StartNewTree(const KeyType &key, const ValueType &value,
+             Transaction *transaction) {
+  IndexLog log(log_manager_);
+  auto *page = buffer_pool_manager_->NewPage(root_page_id_, file_hint_);
   if (page == nullptr) {
     throw Exception(EXCEPTION_TYPE_INDEX,
                     "all page are pinned while StartNewTree");
@@ -119,6 +126,8 @@ StartNewTree(const KeyType &key, const ValueType &value) {
   UpdateRootPageId(true);
   root->Init(root_page_id_, INVALID_PAGE_ID);
   root->Insert(key, value, comparator_);
+  LogEntry(LogRecordType::INDEXINSERT, nullptr, 0, MappingType(key, value),
+           transaction);
 
   // unpin root
   buffer_pool_manager_->UnpinPage(root->GetPageId(), true);
@@ -129,35 +138,34 @@ StartNewTree(const KeyType &key, const ValueType &value) {
  * User needs to first find the right leaf page as insertion target, then look
  * through leaf page to see whether insert key exist or not. If exist, return
  * immediately, otherwise insert entry. Remember to deal with split if necessary.
- * @return: since we only support unique key, if user try to insert duplicate
- * keys return false, otherwise return true.
+ * @return: in a unique tree, if user try to insert duplicate keys return
+ * false, otherwise return true.
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 bool BPlusTree<KeyType, ValueType, KeyComparator>::
 InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction) {
   // find the leaf node
-  auto *leaf = FindLeafPage(key, false, Operation::INSERT, transaction);
+  auto *leaf = FindLeafPage(key, false);
   if (leaf == nullptr) {
     return false;
   }
 
-
-
-  // if already in the tree, return false
+  // if already in the tree, return false unless duplicates are allowed
   ValueType v;
   if (leaf->Lookup(key, v, comparator_)) {
-    
-    UnlockUnpinPages(Operation::INSERT, transaction);
-    return false;
+    bool ret = !unique_ && InsertDuplicate(leaf, key, v, value, transaction);
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), ret);
+    return ret;
   }
 
-
-
-
   if (leaf->GetSize() < leaf->GetMaxSize()) {
+    int index = leaf->KeyIndex(key, comparator_);
     leaf->Insert(key, value, comparator_);
-    
+    LogEntry(LogRecordType::INDEXINSERT, leaf, index, leaf->GetItem(index),
+             transaction);
   } else {
+    IndexLog log(log_manager_);
+    log.Track(leaf->GetPageId(), reinterpret_cast<char *>(leaf));
     // when leaf node can hold even number of key-value pairs
     // the following method is ok, but if the leaf node can hold
     // odd number of pairs, the following split method may uneven
@@ -170,18 +178,60 @@ InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transact
       leaf2->Insert(key, value, comparator_);
     }
 
-    // chain together
-    if (comparator_(leaf->KeyAt(0), leaf2->KeyAt(0)) < 0) {
-      leaf2->SetNextPageId(leaf->GetNextPageId());
-      leaf->SetNextPageId(leaf2->GetPageId());
-    } else {
-      leaf2->SetNextPageId(leaf->GetPageId());
+    // chain together: leaf2 always holds the upper half, so it goes right
+    // after leaf in both directions
+    leaf2->SetNextPageId(leaf->GetNextPageId());
+    leaf2->SetPrevPageId(leaf->GetPageId());
+    if (leaf->GetNextPageId() != INVALID_PAGE_ID) {
+      auto *page = buffer_pool_manager_->FetchPage(leaf->GetNextPageId());
+      if (page == nullptr) {
+        throw Exception(EXCEPTION_TYPE_INDEX,
+                        "all page are pinned while InsertIntoLeaf");
+      }
+      auto next_leaf =
+          reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,
+                                             KeyComparator> *>(page->GetData());
+      next_leaf->SetPrevPageId(leaf2->GetPageId());
+      buffer_pool_manager_->UnpinPage(next_leaf->GetPageId(), true);
     }
+    leaf->SetNextPageId(leaf2->GetPageId());
 
     // insert the split key into parent
     InsertIntoParent(leaf, leaf2->KeyAt(0), leaf2, transaction);
+    LogEntry(LogRecordType::INDEXINSERT, nullptr, 0, MappingType(key, value),
+             transaction);
   }
-  UnlockUnpinPages(Operation::INSERT, transaction);
+  buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+  return true;
+}
+
+/*
+ * Add another value to a key that already has a leaf entry. The first
+ * duplicate turns the inline value into a posting list, later ones go into
+ * that list. The leaf entry itself never moves, so no split happens here.
+ * @return: false if the key-value pair already exists
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::
+InsertDuplicate(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+                const KeyType &key, const ValueType &old_value,
+                const ValueType &value, Transaction *transaction) {
+  IndexLog log(log_manager_);
+  log.Track(leaf->GetPageId(), reinterpret_cast<char *>(leaf));
+  if (IsPostingList(old_value)) {
+    if (!PostingList(buffer_pool_manager_, old_value.GetPageId())
+             .Insert(value)) {
+      return false;
+    }
+  } else if (old_value == value) {
+    return false;
+  } else {
+    PostingList list(buffer_pool_manager_, old_value, value);
+    leaf->SetValueAt(leaf->KeyIndex(key, comparator_),
+                     PostingListRID(list.GetHeadPageId()));
+  }
+  LogEntry(LogRecordType::INDEXINSERT, nullptr, 0, MappingType(key, value),
+           transaction);
   return true;
 }
 
@@ -196,7 +246,8 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 template <typename N> N *BPlusTree<KeyType, ValueType, KeyComparator>::
 Split(N *node) {
   page_id_t page_id;
-  auto *page = buffer_pool_manager_->NewPage(page_id);
+  // keep siblings close on disk
+  auto *page = buffer_pool_manager_->NewPage(page_id, node->GetPageId());
   if (page == nullptr) {
     throw Exception(EXCEPTION_TYPE_INDEX,
                     "all page are pinned while Split");
@@ -222,7 +273,8 @@ void BPlusTree<KeyType, ValueType, KeyComparator>::
 InsertIntoParent(BPlusTreePage *old_node, const KeyType &key,
                  BPlusTreePage *new_node, Transaction *transaction) {
   if (old_node->IsRootPage()) {
-    auto *page = buffer_pool_manager_->NewPage(root_page_id_);
+    auto *page =
+        buffer_pool_manager_->NewPage(root_page_id_, old_node->GetPageId());
     if (page == nullptr) {
       throw Exception(EXCEPTION_TYPE_INDEX,
                       "all page are pinned while InsertIntoParent");
@@ -266,7 +318,8 @@ InsertIntoParent(BPlusTreePage *old_node, const KeyType &key,
       // internal have no space and have to split
       // first make a copy of internal node, simplify split process
       page_id_t page_id;
-      auto *page = buffer_pool_manager_->NewPage(page_id);
+      auto *page =
+          buffer_pool_manager_->NewPage(page_id, internal->GetPageId());
       if (page == nullptr) {
         throw Exception(EXCEPTION_TYPE_INDEX,
                         "all page are pinned while InsertIntoParent");
@@ -345,21 +398,125 @@ Remove(const KeyType &key, Transaction *transaction) {
   // for debug
   //__attribute__((unused)) auto checker = Checker{buffer_pool_manager_};
 
-  if (IsEmpty()) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (IsEmpty() || buffer_pool_manager_->IsReadOnly()) {
     return;
   }
 
   // find the leaf node
   auto *leaf = FindLeafPage(key, false);
   if (leaf != nullptr) {
-    leaf->RemoveAndDeleteRecord(key, comparator_);
+    ValueType v;
+    if (leaf->Lookup(key, v, comparator_) && IsPostingList(v)) {
+      // one value at a time, each removal is undone by itself
+      std::vector<RID> rids;
+      PostingList(buffer_pool_manager_, v.GetPageId()).GetRIDs(rids);
+      for (auto &rid : rids) {
+        if (RemoveFromEntry(leaf, key, rid, transaction)) {
+          break;
+        }
+      }
+    }
+    RemoveFromLeaf(leaf, key, transaction);
+  }
+}
 
-    if (CoalesceOrRedistribute(leaf, transaction)) {
-      buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
-      buffer_pool_manager_->DeletePage(leaf->GetPageId());
+/*
+ * Delete only the given key-value pair. When the key has a posting list the
+ * value is taken out of the list, and the list is folded back into an inline
+ * value once a single one is left. The leaf entry goes away with its last
+ * value.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::
+Remove(const KeyType &key, const ValueType &value, Transaction *transaction) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (IsEmpty() || buffer_pool_manager_->IsReadOnly()) {
+    return;
+  }
+
+  auto *leaf = FindLeafPage(key, false);
+  if (leaf == nullptr) {
+    return;
+  }
+  if (RemoveFromEntry(leaf, key, value, transaction)) {
+    RemoveFromLeaf(leaf, key, transaction);
+  } else {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+  }
+}
+
+/*
+ * Take the value out of the key's entry in a pinned leaf, the leaf stays
+ * pinned.
+ * @return: true means the value was the last one of the key, so the caller
+ * has to delete the leaf entry itself
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::
+RemoveFromEntry(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+                const KeyType &key, const ValueType &value,
+                Transaction *transaction) {
+  ValueType v;
+  if (!leaf->Lookup(key, v, comparator_)) {
+    return false;
+  }
+
+  if (IsPostingList(v)) {
+    IndexLog log(log_manager_);
+    log.Track(leaf->GetPageId(), reinterpret_cast<char *>(leaf));
+    PostingList list(buffer_pool_manager_, v.GetPageId());
+    if (!list.Remove(value)) {
+      return false;
+    }
+    ValueType single;
+    int index = leaf->KeyIndex(key, comparator_);
+    if (list.ReleaseIfSingle(single)) {
+      leaf->SetValueAt(index, single);
     } else {
-      buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+      leaf->SetValueAt(index, PostingListRID(list.GetHeadPageId()));
     }
+    LogEntry(LogRecordType::INDEXDELETE, nullptr, 0, MappingType(key, value),
+             transaction);
+    return false;
+  }
+  return v == value;
+}
+
+/*
+ * Delete the leaf entry of the key, rebalance and release the pinned leaf.
+ * A leaf left at least half full is logged by the slot of the entry
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::
+RemoveFromLeaf(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+               const KeyType &key, Transaction *transaction) {
+  int size = leaf->GetSize();
+  bool underflow =
+      leaf->IsRootPage() ? size <= 1 : size <= leaf->GetMinSize();
+  int index = leaf->KeyIndex(key, comparator_);
+  if (index >= size || comparator_(leaf->KeyAt(index), key) != 0) {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
+    return;
+  }
+  MappingType entry = leaf->GetItem(index);
+  if (!underflow) {
+    leaf->RemoveAndDeleteRecord(key, comparator_);
+    LogEntry(LogRecordType::INDEXDELETE, leaf, index, entry, transaction);
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+    return;
+  }
+
+  IndexLog log(log_manager_);
+  log.Track(leaf->GetPageId(), reinterpret_cast<char *>(leaf));
+  leaf->RemoveAndDeleteRecord(key, comparator_);
+  LogEntry(LogRecordType::INDEXDELETE, nullptr, 0, entry, transaction);
+
+  if (CoalesceOrRedistribute(leaf, transaction)) {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
+    buffer_pool_manager_->DeletePage(leaf->GetPageId());
+  } else {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
   }
 }
 
@@ -574,6 +731,155 @@ AdjustRoot(BPlusTreePage *old_root_node) {
   return false;
 }
 
+/*****************************************************************************
+ * BATCH
+ *****************************************************************************/
+/*
+ * Insert key & value pairs sorted by key. The leaf of the previous pair stays
+ * pinned, and the next pair goes straight into it while its key lies within
+ * the leaf's key range and no split is needed. Otherwise it takes the normal
+ * path from the root.
+ * @return: false if a key of a unique tree was already there, as Insert. The
+ * other pairs are inserted
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::
+InsertBatch(const std::vector<MappingType> &entries, Transaction *transaction) {
+  if (buffer_pool_manager_->IsReadOnly()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf = nullptr;
+  bool inserted = true;
+  for (auto &entry : entries) {
+    const KeyType &key = entry.first;
+    ValueType v;
+    if (leaf != nullptr && !LeafCovers(leaf, key)) {
+      buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+      leaf = nullptr;
+    }
+    if (leaf == nullptr) {
+      if (IsEmpty()) {
+        StartNewTree(key, entry.second, transaction);
+        continue;
+      }
+      leaf = FindLeafPage(key, false);
+    }
+
+    if (leaf->Lookup(key, v, comparator_)) {
+      if (unique_) {
+        inserted = false;
+      } else {
+        InsertDuplicate(leaf, key, v, entry.second, transaction);
+      }
+    } else if (leaf->GetSize() < leaf->GetMaxSize()) {
+      int index = leaf->KeyIndex(key, comparator_);
+      leaf->Insert(key, entry.second, comparator_);
+      LogEntry(LogRecordType::INDEXINSERT, leaf, index, leaf->GetItem(index),
+               transaction);
+    } else {
+      // split, the structure changes around this leaf
+      buffer_pool_manager_->UnpinPage(leaf->GetPageId(), false);
+      leaf = nullptr;
+      InsertIntoLeaf(key, entry.second, transaction);
+    }
+  }
+  if (leaf != nullptr) {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+  }
+  return inserted;
+}
+
+/*
+ * Remove key & value pairs sorted by key, reusing the pinned leaf like
+ * InsertBatch. Entries are deleted in place as long as the leaf stays at
+ * least half full, only an underflow takes the rebalancing path.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::
+RemoveBatch(const std::vector<MappingType> &entries, Transaction *transaction) {
+  if (buffer_pool_manager_->IsReadOnly()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf = nullptr;
+  for (auto &entry : entries) {
+    const KeyType &key = entry.first;
+    if (leaf != nullptr && !LeafCovers(leaf, key)) {
+      buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+      leaf = nullptr;
+    }
+    if (leaf == nullptr) {
+      if (IsEmpty()) {
+        return;
+      }
+      leaf = FindLeafPage(key, false);
+    }
+
+    if (!RemoveFromEntry(leaf, key, entry.second, transaction)) {
+      continue;
+    }
+    bool underflow = leaf->IsRootPage()
+                         ? leaf->GetSize() == 1
+                         : leaf->GetSize() <= leaf->GetMinSize();
+    if (underflow) {
+      RemoveFromLeaf(leaf, key, transaction);
+      leaf = nullptr;
+    } else {
+      int index = leaf->KeyIndex(key, comparator_);
+      MappingType removed = leaf->GetItem(index);
+      leaf->RemoveAndDeleteRecord(key, comparator_);
+      LogEntry(LogRecordType::INDEXDELETE, leaf, index, removed, transaction);
+    }
+  }
+  if (leaf != nullptr) {
+    buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+  }
+}
+
+/*
+ * True if the key lies between the first and the last key of the leaf, such
+ * a key can only belong to this leaf
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+bool BPlusTree<KeyType, ValueType, KeyComparator>::
+LeafCovers(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+           const KeyType &key) {
+  return leaf->GetSize() > 0 && comparator_(leaf->KeyAt(0), key) <= 0 &&
+         comparator_(key, leaf->KeyAt(leaf->GetSize() - 1)) <= 0;
+}
+
+/*
+ * A full scan walks the leaves in sibling order, so the leaves that follow
+ * the first one under the same parent are read ahead as one batch
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::
+PrefetchSiblings(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
+                 bool reverse) {
+  if (leaf->IsRootPage()) {
+    return;
+  }
+  auto *page = buffer_pool_manager_->FetchPage(leaf->GetParentPageId());
+  if (page == nullptr) {
+    // read ahead is only a hint
+    return;
+  }
+  auto *parent = reinterpret_cast<
+      BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(
+      page->GetData());
+  std::vector<page_id_t> page_ids;
+  int step = reverse ? -1 : 1;
+  for (int i = parent->ValueIndex(leaf->GetPageId()) + step;
+       i >= 0 && i < parent->GetSize() &&
+       page_ids.size() < SCAN_PREFETCH_PAGES;
+       i += step) {
+    page_ids.push_back(parent->ValueAt(i));
+  }
+  buffer_pool_manager_->UnpinPage(parent->GetPageId(), false);
+  buffer_pool_manager_->PrefetchPages(page_ids);
+}
+
 /*****************************************************************************
  * INDEX ITERATOR
  *****************************************************************************/
@@ -586,8 +892,12 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator> BPlusTree<KeyType, ValueType, KeyComparator>::
 Begin() {
   KeyType key{};
+  auto *leaf = FindLeafPage(key, true);
+  if (leaf != nullptr) {
+    PrefetchSiblings(leaf, false);
+  }
   return IndexIterator<KeyType, ValueType, KeyComparator>(
-      FindLeafPage(key, true), 0, buffer_pool_manager_);
+      leaf, 0, buffer_pool_manager_);
 }
 
 /*
@@ -607,17 +917,60 @@ Begin(const KeyType &key) {
       leaf, index, buffer_pool_manager_);
 }
 
+/*
+ * Input parameter is void, find the rightmost leaf page first, then construct
+ * an iterator on its last entry
+ * @return : index iterator, move it with operator--
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+IndexIterator<KeyType, ValueType, KeyComparator> BPlusTree<KeyType, ValueType, KeyComparator>::
+RBegin() {
+  KeyType key{};
+  auto *leaf = FindLeafPage(key, false, true);
+  int index = 0;
+  if (leaf != nullptr) {
+    index = leaf->GetSize() - 1;
+    PrefetchSiblings(leaf, true);
+  }
+  return IndexIterator<KeyType, ValueType, KeyComparator>(
+      leaf, index, buffer_pool_manager_, true);
+}
+
+/*
+ * Input parameter is high key, find the leaf page that contains the input key
+ * first, then construct an iterator on the last entry whose key <= input key
+ * @return : index iterator, move it with operator--
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+IndexIterator<KeyType, ValueType, KeyComparator> BPlusTree<KeyType, ValueType, KeyComparator>::
+RBegin(const KeyType &key) {
+  auto *leaf = FindLeafPage(key, false);
+  int index = 0;
+  if (leaf != nullptr) {
+    index = leaf->KeyIndex(key, comparator_);
+    if (index == leaf->GetSize() ||
+        comparator_(leaf->KeyAt(index), key) != 0) {
+      // first key > input key, the entry before it is the answer (possibly
+      // the last entry of the previous leaf)
+      --index;
+    }
+  }
+  return IndexIterator<KeyType, ValueType, KeyComparator>(
+      leaf, index, buffer_pool_manager_, true);
+}
+
 /*****************************************************************************
  * UTILITIES AND DEBUG
  *****************************************************************************/
 /*
  * Find leaf page containing particular key, if leftMost flag == true, find
- * the left most leaf page
+ * the left most leaf page, if rightMost flag == true, find the right most
+ * leaf page
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *
 BPlusTree<KeyType, ValueType, KeyComparator>::
-FindLeafPage(const KeyType &key, bool leftMost) {
+FindLeafPage(const KeyType &key, bool leftMost, bool rightMost) {
   // empty?
   if (IsEmpty()) {
     return nullptr;
@@ -627,7 +980,6 @@ FindLeafPage(const KeyType &key, bool leftMost) {
     throw Exception(EXCEPTION_TYPE_INDEX,
                     "all page are pinned while FindLeafPage");
   }
-  assert(page->GetPinCount() == 1);
   auto *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
 
   // find the leaf node
@@ -638,6 +990,8 @@ FindLeafPage(const KeyType &key, bool leftMost) {
     page_id_t parent_page_id = node->GetPageId(), child_page_id;
     if (leftMost) {
       child_page_id = internal->ValueAt(0);
+    } else if (rightMost) {
+      child_page_id = internal->ValueAt(internal->GetSize() - 1);
     } else {
       child_page_id = internal->Lookup(key, comparator_);
     }
@@ -658,6 +1012,30 @@ FindLeafPage(const KeyType &key, bool leftMost) {
                                             ValueType, KeyComparator> *>(node);
 }
 
+/*
+ * Log an entry of the transaction inserted into / removed from the slot of
+ * the leaf, see logging/index_log.h. Without a leaf the entry moved with a
+ * structure modification of this thread, whose records redo it
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void BPlusTree<KeyType, ValueType, KeyComparator>::
+LogEntry(LogRecordType type,
+         BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf, int slot,
+         const MappingType &entry, Transaction *transaction) {
+  if (!IndexLog::IsLogging(log_manager_)) {
+    return;
+  }
+  LogRecord log_record(
+      transaction == nullptr ? INVALID_TXN_ID
+                             : transaction->GetTransactionId(),
+      transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(), type,
+      leaf == nullptr ? INVALID_PAGE_ID : leaf->GetPageId(), slot,
+      reinterpret_cast<const char *>(&entry), sizeof(MappingType),
+      index_name_, unique_, key_types_);
+  IndexLog::LogEntry(log_manager_, log_record, transaction,
+                     reinterpret_cast<char *>(leaf));
+}
+
 /*
  * Update/Insert root page id in header page(where page_id = 0, header_page is
  * defined under include/page/header_page.h)
@@ -674,16 +1052,33 @@ UpdateRootPageId(bool insert_record) {
     throw Exception(EXCEPTION_TYPE_INDEX,
                     "all page are pinned while UpdateRootPageId");
   }
-  auto *header_page = reinterpret_cast<HeaderPage *>(page->GetData());
-
+  auto *header_page = static_cast<HeaderPage *>(page);
+  header_page->WLatch();
+  page_id_t old_root = INVALID_PAGE_ID;
+  header_page->GetRootId(buffer_pool_manager_, index_name_, old_root);
+  // a structure modification is going on
+  if (IndexLog::Current() != nullptr)
+    IndexLog::Current()->LogRoot(index_name_, old_root, root_page_id_);
+
+  bool recorded;
   if (insert_record) {
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
+    // create a new record<index_name + root_page_id> in header_page, a tree
+    // that was emptied before still has its record
+    recorded =
+        header_page->InsertRecord(buffer_pool_manager_, index_name_,
+                                  root_page_id_) ||
+        header_page->UpdateRecord(buffer_pool_manager_, index_name_,
+                                  root_page_id_);
   } else {
     // update root_page_id in header_page
-    header_page->UpdateRecord(index_name_, root_page_id_);
+    recorded = header_page->UpdateRecord(buffer_pool_manager_, index_name_,
+                                         root_page_id_);
   }
+  header_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+  if (!recorded)
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "can't record the root of index " + index_name_);
 }
 
 /*
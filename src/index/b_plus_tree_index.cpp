@@ -2,6 +2,8 @@
  * b_plus_tree_index.cpp
  */
 
+#include <algorithm>
+
 #include "index/b_plus_tree_index.h"
 
 namespace cmudb {
@@ -11,10 +13,12 @@ namespace cmudb {
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_INDEX_TYPE::BPlusTreeIndex(IndexMetadata *metadata,
                                      BufferPoolManager *buffer_pool_manager,
-                                     page_id_t root_page_id)
+                                     page_id_t root_page_id,
+                                     LogManager *log_manager,
+                                     page_id_t file_hint)
     : Index(metadata), comparator_(metadata->GetKeySchema()),
       container_(metadata->GetName(), buffer_pool_manager, comparator_,
-                 root_page_id) {}
+                 root_page_id, metadata->IsUnique(), log_manager, file_hint) {}
 
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
@@ -27,13 +31,112 @@ void BPLUSTREE_INDEX_TYPE::InsertEntry(const Tuple &key, RID rid,
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key,
+void BPLUSTREE_INDEX_TYPE::DeleteEntry(const Tuple &key, RID rid,
                                        Transaction *transaction) {
   // construct delete index key
   KeyType index_key;
   index_key.SetFromKey(key);
 
-  container_.Remove(index_key, transaction);
+  container_.Remove(index_key, rid, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::QueueInsertEntry(const Tuple &tuple,
+                                            Schema *tuple_schema, RID rid,
+                                            Transaction *transaction) {
+  QueueEntry(tuple, tuple_schema, rid, true, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::QueueDeleteEntry(const Tuple &tuple,
+                                            Schema *tuple_schema, RID rid,
+                                            Transaction *transaction) {
+  QueueEntry(tuple, tuple_schema, rid, false, transaction);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_INDEX_TYPE::QueueEntry(const Tuple &tuple, Schema *tuple_schema,
+                                      RID rid, bool insert,
+                                      Transaction *transaction) {
+  // the whole entry is kept, comparisons only look at the key columns
+  QueuedEntry entry;
+  entry.key.SetFromTuple(tuple, tuple_schema, GetEntryAttrs(),
+                         GetEntrySchema());
+  entry.rid = rid;
+  entry.insert = insert;
+  queue_.push_back(entry);
+  if (queue_.size() >= INDEX_BATCH_SIZE)
+    collided_ = !ApplyQueuedEntries(transaction);
+}
+
+/*
+ * Sort queued entries by key and rid, keeping arrival order among changes
+ * of the same pair, so only the net change of each pair is applied. A pair
+ * present before and after is still rewritten, its included columns may
+ * differ. All removals go first, a unique key may be freed and taken again
+ * in a batch.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::ApplyQueuedEntries(Transaction *transaction) {
+  bool applied = !collided_;
+  collided_ = false;
+  if (queue_.empty())
+    return applied;
+  std::stable_sort(queue_.begin(), queue_.end(),
+                   [this](const QueuedEntry &a, const QueuedEntry &b) {
+                     int cmp = comparator_(a.key, b.key);
+                     if (cmp != 0)
+                       return cmp < 0;
+                     return a.rid.Get() < b.rid.Get();
+                   });
+
+  std::vector<MappingType> inserts, removes;
+  for (size_t i = 0, j; i < queue_.size(); i = j) {
+    j = i + 1;
+    while (j < queue_.size() && queue_[j].rid == queue_[i].rid &&
+           comparator_(queue_[j].key, queue_[i].key) == 0)
+      j++;
+    // a pair first inserted was absent before, first deleted was present
+    bool present_before = !queue_[i].insert;
+    bool present_after = queue_[j - 1].insert;
+    if (present_before)
+      removes.emplace_back(queue_[i].key, queue_[i].rid);
+    if (present_after && (!present_before || j - i > 1))
+      inserts.emplace_back(queue_[j - 1].key, queue_[j - 1].rid);
+  }
+  queue_.clear();
+
+  container_.RemoveBatch(removes, transaction);
+  return container_.InsertBatch(inserts, transaction) && applied;
+}
+
+/*
+ * The rows holding the key in the tree, with the queued changes of the key
+ * replayed on top in arrival order
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_INDEX_TYPE::IsKeyTaken(const Tuple &tuple, Schema *tuple_schema,
+                                      RID rid, Transaction *transaction) {
+  if (!IsUnique())
+    return false;
+  KeyType key;
+  key.SetFromTuple(tuple, tuple_schema, GetEntryAttrs(), GetEntrySchema());
+  std::vector<RID> holders;
+  container_.GetValue(key, holders, transaction);
+  for (auto &entry : queue_) {
+    if (comparator_(entry.key, key) != 0)
+      continue;
+    auto holder = std::find(holders.begin(), holders.end(), entry.rid);
+    if (entry.insert && holder == holders.end())
+      holders.push_back(entry.rid);
+    else if (!entry.insert && holder != holders.end())
+      holders.erase(holder);
+  }
+  for (auto &holder : holders) {
+    if (!(holder == rid))
+      return true;
+  }
+  return false;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
@@ -45,6 +148,29 @@ void BPLUSTREE_INDEX_TYPE::ScanKey(const Tuple &key, std::vector<RID> &result,
 
   container_.GetValue(index_key, result, transaction);
 }
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScan *BPLUSTREE_INDEX_TYPE::ScanEqual(const Tuple &key,
+                                           Transaction *transaction) {
+  // construct scan index key
+  KeyType index_key;
+  index_key.SetFromKey(key);
+
+  return new BPlusTreeIndexScan<KeyType, ValueType, KeyComparator>(
+      container_.Begin(index_key), false, GetEntrySchema(), comparator_,
+      &index_key);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+IndexScan *BPLUSTREE_INDEX_TYPE::ScanOrdered(bool descending,
+                                             Transaction *transaction) {
+  if (descending)
+    return new BPlusTreeIndexScan<KeyType, ValueType, KeyComparator>(
+        container_.RBegin(), true, GetEntrySchema(), comparator_);
+  return new BPlusTreeIndexScan<KeyType, ValueType, KeyComparator>(
+      container_.Begin(), false, GetEntrySchema(), comparator_);
+}
+
 template class BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>;
 template class BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>;
 template class BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>;
@@ -4,6 +4,7 @@
 #include <cassert>
 
 #include "index/index_iterator.h"
+#include "index/posting_list.h"
 
 namespace cmudb {
 
@@ -14,20 +15,54 @@ namespace cmudb {
 template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator>::
 IndexIterator(BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> *leaf,
-              int index_, BufferPoolManager *buff_pool_manager):
-    leaf_(leaf), index_(index_), buff_pool_manager_(buff_pool_manager) {}
+              int index_, BufferPoolManager *buff_pool_manager, bool reverse):
+    leaf_(leaf), index_(index_), buff_pool_manager_(buff_pool_manager),
+    posting_page_(nullptr), posting_index_(0) {
+  if (leaf_ == nullptr) {
+    return;
+  }
+  // a position just past either end of a leaf really denotes the first/last
+  // entry of its sibling
+  if (this->index_ == leaf_->GetSize() &&
+      leaf_->GetNextPageId() != INVALID_PAGE_ID) {
+    MoveToLeaf(leaf_->GetNextPageId());
+    this->index_ = 0;
+  } else if (this->index_ == -1 &&
+             leaf_->GetPrevPageId() != INVALID_PAGE_ID) {
+    MoveToLeaf(leaf_->GetPrevPageId());
+    this->index_ = leaf_->GetSize() - 1;
+  }
+  EnterEntry(reverse);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+IndexIterator<KeyType, ValueType, KeyComparator>::
+IndexIterator(IndexIterator &&other)
+    : leaf_(other.leaf_), index_(other.index_),
+      buff_pool_manager_(other.buff_pool_manager_),
+      posting_page_(other.posting_page_), posting_index_(other.posting_index_),
+      current_(other.current_) {
+  // the pins now belong to this iterator
+  other.leaf_ = nullptr;
+  other.posting_page_ = nullptr;
+}
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator>::
 ~IndexIterator() {
-  buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
+  ReleasePostingPage();
+  if (leaf_ != nullptr) {
+    buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
+  }
 };
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 bool IndexIterator<KeyType, ValueType, KeyComparator>::
 isEnd() {
-  return (leaf_ == nullptr || (index_ == leaf_->GetSize() &&
-      leaf_->GetNextPageId() == INVALID_PAGE_ID));
+  return (leaf_ == nullptr ||
+          (index_ == leaf_->GetSize() &&
+           leaf_->GetNextPageId() == INVALID_PAGE_ID) ||
+          (index_ == -1 && leaf_->GetPrevPageId() == INVALID_PAGE_ID));
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
@@ -36,38 +71,126 @@ operator*() {
   if (isEnd()) {
     throw std::out_of_range("IndexIterator: out of range");
   }
+  if (posting_page_ != nullptr) {
+    current_ = std::make_pair(leaf_->KeyAt(index_),
+                              posting_page_->GetRID(posting_index_));
+    return current_;
+  }
   return leaf_->GetItem(index_);
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 IndexIterator<KeyType, ValueType, KeyComparator> &IndexIterator<KeyType, ValueType, KeyComparator>::
 operator++() {
+  if (posting_page_ != nullptr) {
+    if (++posting_index_ < posting_page_->GetCount()) {
+      return *this;
+    }
+    if (posting_page_->GetNextPageId() != INVALID_PAGE_ID) {
+      MoveToPostingPage(posting_page_->GetNextPageId());
+      posting_index_ = 0;
+      return *this;
+    }
+    ReleasePostingPage();
+  }
   ++index_;
   if (index_ == leaf_->GetSize() && leaf_->GetNextPageId() != INVALID_PAGE_ID) {
-    // first unpin leaf_, then get the next leaf
-    page_id_t next_page_id = leaf_->GetNextPageId();
-    buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
+    MoveToLeaf(leaf_->GetNextPageId());
+    index_ = 0;
+  }
+  EnterEntry(false);
+  return *this;
+};
 
-    auto *page = buff_pool_manager_->FetchPage(next_page_id);
-    if (page == nullptr) {
-      throw Exception(EXCEPTION_TYPE_INDEX,
-                      "all page are pinned while IndexIterator(operator++)");
+/*
+ * Step back one entry, following the prev link when we fall off the front of
+ * the current leaf. Only the leaves actually visited are pinned, so a
+ * descending scan that stops after k entries touches O(k) entries.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+IndexIterator<KeyType, ValueType, KeyComparator> &IndexIterator<KeyType, ValueType, KeyComparator>::
+operator--() {
+  if (posting_page_ != nullptr) {
+    if (--posting_index_ >= 0) {
+      return *this;
     }
-    auto next_leaf =
-        reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,
-                                           KeyComparator> *>(page->GetData());
-
-    assert(next_leaf->IsLeafPage());
-    index_ = 0;
-    leaf_ = next_leaf;
+    if (posting_page_->GetPrevPageId() != INVALID_PAGE_ID) {
+      MoveToPostingPage(posting_page_->GetPrevPageId());
+      posting_index_ = posting_page_->GetCount() - 1;
+      return *this;
+    }
+    ReleasePostingPage();
+  }
+  --index_;
+  if (index_ == -1 && leaf_->GetPrevPageId() != INVALID_PAGE_ID) {
+    MoveToLeaf(leaf_->GetPrevPageId());
+    index_ = leaf_->GetSize() - 1;
   }
+  EnterEntry(true);
   return *this;
 };
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+MoveToLeaf(page_id_t page_id) {
+  // first unpin leaf_, then get the sibling leaf
+  buff_pool_manager_->UnpinPage(leaf_->GetPageId(), false);
+
+  auto *page = buff_pool_manager_->FetchPage(page_id);
+  if (page == nullptr) {
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "all page are pinned while IndexIterator(MoveToLeaf)");
+  }
+  auto sibling =
+      reinterpret_cast<BPlusTreeLeafPage<KeyType, ValueType,
+                                         KeyComparator> *>(page->GetData());
+
+  assert(sibling->IsLeafPage());
+  leaf_ = sibling;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+EnterEntry(bool reverse) {
+  if (isEnd() || !IsPostingList(leaf_->ValueAt(index_))) {
+    return;
+  }
+  MoveToPostingPage(leaf_->ValueAt(index_).GetPageId());
+  if (reverse) {
+    while (posting_page_->GetNextPageId() != INVALID_PAGE_ID) {
+      MoveToPostingPage(posting_page_->GetNextPageId());
+    }
+    posting_index_ = posting_page_->GetCount() - 1;
+  } else {
+    posting_index_ = 0;
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+MoveToPostingPage(page_id_t page_id) {
+  ReleasePostingPage();
+  auto *page = buff_pool_manager_->FetchPage(page_id);
+  if (page == nullptr) {
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "all page are pinned while IndexIterator(MoveToPostingPage)");
+  }
+  posting_page_ = static_cast<PostingPage *>(page);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void IndexIterator<KeyType, ValueType, KeyComparator>::
+ReleasePostingPage() {
+  if (posting_page_ != nullptr) {
+    buff_pool_manager_->UnpinPage(posting_page_->GetPageId(), false);
+    posting_page_ = nullptr;
+  }
+}
+
 template class IndexIterator<GenericKey<4>, RID, GenericComparator<4>>;
 template class IndexIterator<GenericKey<8>, RID, GenericComparator<8>>;
 template class IndexIterator<GenericKey<16>, RID, GenericComparator<16>>;
 template class IndexIterator<GenericKey<32>, RID, GenericComparator<32>>;
 template class IndexIterator<GenericKey<64>, RID, GenericComparator<64>>;
 
-} // namespace cmudb
\ No newline at end of file
+} // namespace cmudb
@@ -0,0 +1,168 @@
+/**
+ * posting_list.cpp
+ */
+
+#include <cassert>
+
+#include "common/exception.h"
+#include "index/posting_list.h"
+
+namespace cmudb {
+
+PostingList::PostingList(BufferPoolManager *buffer_pool_manager,
+                         page_id_t head_page_id)
+    : buffer_pool_manager_(buffer_pool_manager),
+      head_page_id_(head_page_id) {}
+
+PostingList::PostingList(BufferPoolManager *buffer_pool_manager,
+                         const RID &first, const RID &second)
+    : buffer_pool_manager_(buffer_pool_manager) {
+  auto *page = NewPostingPage(INVALID_PAGE_ID);
+  page->Insert(first);
+  page->Insert(second);
+  head_page_id_ = page->GetPageId();
+  buffer_pool_manager_->UnpinPage(head_page_id_, true);
+}
+
+/*
+ * Walk the chain to the first page whose last rid is not less than the input
+ * rid (or the tail page), then insert there. A full page is split in half and
+ * the new page is linked right after it.
+ */
+bool PostingList::Insert(const RID &rid) {
+  auto *page = FetchPostingPage(head_page_id_);
+  while (page->GetNextPageId() != INVALID_PAGE_ID &&
+         page->GetRID(page->GetCount() - 1).Get() < rid.Get()) {
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    page = FetchPostingPage(next_page_id);
+  }
+
+  int index = page->RIDIndex(rid);
+  if (index < page->GetCount() && page->GetRID(index) == rid) {
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    return false;
+  }
+
+  if (!page->Insert(rid)) {
+    // page is full, split it
+    auto *new_page = NewPostingPage(page->GetPageId());
+    new_page->SetNextPageId(page->GetNextPageId());
+    if (page->GetNextPageId() != INVALID_PAGE_ID) {
+      auto *next_page = FetchPostingPage(page->GetNextPageId());
+      next_page->SetPrevPageId(new_page->GetPageId());
+      buffer_pool_manager_->UnpinPage(next_page->GetPageId(), true);
+    }
+    page->SetNextPageId(new_page->GetPageId());
+    page->MoveHalfTo(new_page);
+
+    if (rid.Get() < new_page->GetRID(0).Get())
+      page->Insert(rid);
+    else
+      new_page->Insert(rid);
+    buffer_pool_manager_->UnpinPage(new_page->GetPageId(), true);
+  }
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+  return true;
+}
+
+/*
+ * Remove the rid from the page that would hold it. An emptied page is
+ * unlinked from the chain and deleted.
+ */
+bool PostingList::Remove(const RID &rid) {
+  auto *page = FetchPostingPage(head_page_id_);
+  while (page->GetNextPageId() != INVALID_PAGE_ID &&
+         page->GetRID(page->GetCount() - 1).Get() < rid.Get()) {
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    page = FetchPostingPage(next_page_id);
+  }
+
+  if (!page->Remove(rid)) {
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    return false;
+  }
+
+  if (page->GetCount() > 0) {
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+    return true;
+  }
+
+  page_id_t page_id = page->GetPageId();
+  page_id_t prev_page_id = page->GetPrevPageId();
+  page_id_t next_page_id = page->GetNextPageId();
+  if (prev_page_id != INVALID_PAGE_ID) {
+    auto *prev_page = FetchPostingPage(prev_page_id);
+    prev_page->SetNextPageId(next_page_id);
+    buffer_pool_manager_->UnpinPage(prev_page_id, true);
+  } else {
+    head_page_id_ = next_page_id;
+  }
+  if (next_page_id != INVALID_PAGE_ID) {
+    auto *next_page = FetchPostingPage(next_page_id);
+    next_page->SetPrevPageId(prev_page_id);
+    buffer_pool_manager_->UnpinPage(next_page_id, true);
+  }
+  buffer_pool_manager_->UnpinPage(page_id, false);
+  buffer_pool_manager_->DeletePage(page_id);
+  return true;
+}
+
+bool PostingList::ReleaseIfSingle(RID &rid) {
+  auto *page = FetchPostingPage(head_page_id_);
+  bool single =
+      page->GetCount() == 1 && page->GetNextPageId() == INVALID_PAGE_ID;
+  if (single)
+    rid = page->GetRID(0);
+  buffer_pool_manager_->UnpinPage(head_page_id_, false);
+  if (single) {
+    buffer_pool_manager_->DeletePage(head_page_id_);
+    head_page_id_ = INVALID_PAGE_ID;
+  }
+  return single;
+}
+
+void PostingList::GetRIDs(std::vector<RID> &result) {
+  page_id_t page_id = head_page_id_;
+  while (page_id != INVALID_PAGE_ID) {
+    auto *page = FetchPostingPage(page_id);
+    for (int i = 0; i < page->GetCount(); i++)
+      result.push_back(page->GetRID(i));
+    page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+  }
+}
+
+void PostingList::Destroy() {
+  while (head_page_id_ != INVALID_PAGE_ID) {
+    auto *page = FetchPostingPage(head_page_id_);
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(head_page_id_, false);
+    buffer_pool_manager_->DeletePage(head_page_id_);
+    head_page_id_ = next_page_id;
+  }
+}
+
+PostingPage *PostingList::FetchPostingPage(page_id_t page_id) {
+  auto *page = buffer_pool_manager_->FetchPage(page_id);
+  if (page == nullptr) {
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "all page are pinned while fetching posting page");
+  }
+  return static_cast<PostingPage *>(page);
+}
+
+PostingPage *PostingList::NewPostingPage(page_id_t prev_page_id) {
+  page_id_t page_id;
+  auto *page = buffer_pool_manager_->NewPage(page_id, prev_page_id);
+  if (page == nullptr) {
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "all page are pinned while creating posting page");
+  }
+  auto *posting_page = static_cast<PostingPage *>(page);
+  posting_page->Init(page_id, prev_page_id);
+  return posting_page;
+}
+
+} // namespace cmudb
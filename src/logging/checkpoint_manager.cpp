@@ -0,0 +1,112 @@
+/**
+ * checkpoint_manager.cpp
+ */
+
+#include "logging/checkpoint_manager.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+/*
+ * The tables are read after the begin record is appended: a transaction
+ * missing from them has appended its commit or abort record by then, a page
+ * missing from them was written before. Entries that do not fit one log
+ * record are left out of the end record only, the start of recovery still
+ * accounts for them. The free space maps are synced ahead of the master
+ * record, allocations before its start are not redone
+ */
+lsn_t CheckpointManager::Checkpoint() {
+  std::lock_guard<std::mutex> checkpoint_lock(checkpoint_latch_);
+  if (!ENABLE_LOGGING)
+    return INVALID_LSN;
+
+  LogRecord begin_record(INVALID_TXN_ID, INVALID_LSN,
+                         LogRecordType::CHECKPOINT_BEGIN);
+  lsn_t begin_lsn = log_manager_->AppendLogRecord(begin_record);
+
+  lsn_t start_lsn = begin_lsn;
+  // an entry is two varints of 32-bit values, the counts grow as well
+  size_t capacity =
+      (LOG_BUFFER_SIZE - LogRecord(begin_lsn, {}, {}).GetMaxSize() -
+       2 * MAX_VARINT32_SIZE) /
+      (2 * MAX_VARINT32_SIZE);
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns;
+  for (auto &txn : transaction_manager_->GetActiveTransactions()) {
+    start_lsn = std::min(start_lsn, txn.first_lsn);
+    if (active_txns.size() < capacity)
+      active_txns.emplace_back(txn.txn_id, txn.last_lsn);
+  }
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+  for (auto &page : buffer_pool_manager_->GetDirtyPageTable()) {
+    start_lsn = std::min(start_lsn, page.second);
+    if (active_txns.size() + dirty_pages.size() < capacity)
+      dirty_pages.push_back(page);
+  }
+  LogRecord end_record(begin_lsn, active_txns, dirty_pages);
+  if (!log_manager_->WaitForFlush(log_manager_->AppendLogRecord(end_record))) {
+    LOG_DEBUG("can't flush checkpoint end record");
+    return INVALID_LSN;
+  }
+
+  int64_t start_offset = log_manager_->GetLogOffset(start_lsn);
+  // the free space maps are durable before the master record
+  if (!disk_manager_->Sync()) {
+    LOG_DEBUG("can't sync data files for checkpoint");
+    return INVALID_LSN;
+  }
+  auto header_page =
+      static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr) {
+    LOG_DEBUG("can't fetch header page for checkpoint");
+    return INVALID_LSN;
+  }
+  header_page->WLatch();
+  header_page->SetCheckpoint(begin_lsn, start_lsn, start_offset);
+  header_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+  buffer_pool_manager_->FlushPage(HEADER_PAGE_ID);
+  if (!disk_manager_->Sync()) {
+    LOG_DEBUG("can't sync master record");
+    return INVALID_LSN;
+  }
+
+  // the master record is durable, the log before its start is not needed
+  log_manager_->DiscardLogBefore(start_lsn);
+  return start_lsn;
+}
+
+void CheckpointManager::RunCheckpointThread(
+    std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (running_)
+    return;
+  running_ = true;
+  checkpoint_thread_ =
+      new std::thread(&CheckpointManager::CheckpointThread, this, interval);
+}
+
+void CheckpointManager::StopCheckpointThread() {
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    if (!running_)
+      return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  checkpoint_thread_->join();
+  delete checkpoint_thread_;
+  checkpoint_thread_ = nullptr;
+}
+
+void CheckpointManager::CheckpointThread(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (running_) {
+    if (cv_.wait_for(lock, interval, [this] { return !running_; }))
+      break;
+    lock.unlock();
+    Checkpoint();
+    lock.lock();
+  }
+}
+
+} // namespace cmudb
@@ -0,0 +1,149 @@
+/**
+ * index_log.cpp
+ */
+
+#include <cstring>
+
+#include "common/logger.h"
+#include "logging/index_log.h"
+#include "page/b_plus_tree_leaf_page.h"
+
+namespace cmudb {
+
+thread_local IndexLog *IndexLog::current_ = nullptr;
+
+/*
+ * Operations do not nest: a B+ tree modifies one at a time, under its mutex
+ */
+IndexLog::IndexLog(LogManager *log_manager)
+    : log_manager_(log_manager),
+      active_(IsLogging(log_manager) && current_ == nullptr),
+      last_lsn_(INVALID_LSN), disk_manager_(nullptr) {
+  if (active_)
+    current_ = this;
+}
+
+/*
+ * Pages the caller keeps pinned are logged here, their later changes belong
+ * to the next operation or entry record. Pages unpinned clean before are
+ * deleted ones, or were only read
+ */
+IndexLog::~IndexLog() {
+  if (!active_)
+    return;
+  current_ = nullptr;
+  for (auto &page : pages_) {
+    if (page.second.pins > 0)
+      LogPage(page.first, page.second);
+  }
+  if (last_lsn_ != INVALID_LSN) {
+    LogRecord end_record(INVALID_TXN_ID, last_lsn_, LogRecordType::INDEXEND);
+    lsn_t end_lsn = log_manager_->AppendLogRecord(end_record);
+    if (!deleted_pages_.empty() && !log_manager_->WaitForFlush(end_lsn)) {
+      // the operation may still be reversed, its pages are leaked instead
+      LOG_DEBUG("can't flush index operation, deleted pages kept");
+      deleted_pages_.clear();
+    }
+  }
+  for (page_id_t page_id : deleted_pages_)
+    disk_manager_->DeallocatePage(page_id);
+}
+
+void IndexLog::Track(page_id_t page_id, char *data) {
+  if (!active_)
+    return;
+  TrackedPage &page = pages_[page_id];
+  page.data = data;
+  page.image.assign(data, data + PAGE_USABLE_SIZE);
+  page.fresh = false;
+  page.pins = 1;
+}
+
+void IndexLog::LogRoot(const std::string &name, page_id_t old_root,
+                       page_id_t new_root) {
+  if (!active_)
+    return;
+  LogRecord log_record(last_lsn_, name, old_root, new_root);
+  last_lsn_ = log_manager_->AppendLogRecord(log_record);
+  log_manager_->WaitForFlush(last_lsn_);
+}
+
+void IndexLog::LogEntry(LogManager *log_manager, LogRecord &log_record,
+                        Transaction *txn, char *data) {
+  lsn_t lsn = log_manager->AppendLogRecord(log_record);
+  if (txn != nullptr)
+    txn->SetPrevLSN(lsn);
+  if (data != nullptr)
+    reinterpret_cast<BPlusTreePage *>(data)->SetLSN(lsn);
+}
+
+/*
+ * A page pinned again keeps the image of its last record: it may have changed
+ * since, or been read back into another frame. The header page is logged by
+ * INDEXROOT
+ */
+void IndexLog::Pinned(Page *page, bool fresh) {
+  IndexLog *log = current_;
+  if (log == nullptr || page->GetPageId() == HEADER_PAGE_ID)
+    return;
+  auto it = log->pages_.find(page->GetPageId());
+  if (it != log->pages_.end() && !fresh) {
+    it->second.data = page->GetData();
+    it->second.pins++;
+    return;
+  }
+  TrackedPage &tracked = log->pages_[page->GetPageId()];
+  tracked.data = page->GetData();
+  if (fresh)
+    tracked.image.assign(PAGE_USABLE_SIZE, 0);
+  else
+    tracked.image.assign(page->GetData(), page->GetData() + PAGE_USABLE_SIZE);
+  tracked.fresh = fresh;
+  tracked.pins = 1;
+}
+
+/*
+ * Called while the page is still pinned, the record is written ahead of it
+ */
+void IndexLog::Unpinning(page_id_t page_id, bool is_dirty) {
+  IndexLog *log = current_;
+  if (log == nullptr)
+    return;
+  auto it = log->pages_.find(page_id);
+  if (it == log->pages_.end() || it->second.pins == 0)
+    return;
+  if (is_dirty)
+    log->LogPage(page_id, it->second);
+  it->second.pins--;
+}
+
+/*
+ * A page created by the operation and never logged is unknown to recovery, it
+ * is released right away
+ */
+bool IndexLog::Deleting(DiskManager *disk_manager, page_id_t page_id) {
+  IndexLog *log = current_;
+  if (log == nullptr)
+    return false;
+  auto it = log->pages_.find(page_id);
+  if (it != log->pages_.end() && it->second.fresh)
+    return false;
+  log->disk_manager_ = disk_manager;
+  log->deleted_pages_.push_back(page_id);
+  return true;
+}
+
+void IndexLog::LogPage(page_id_t page_id, TrackedPage &page) {
+  if (memcmp(page.image.data(), page.data, PAGE_USABLE_SIZE) == 0)
+    return;
+  LogRecord log_record(last_lsn_,
+                       page.fresh ? LogRecordType::INDEXNEWPAGE
+                                  : LogRecordType::INDEXPAGE,
+                       page_id, page.image.data(), page.data);
+  last_lsn_ = log_manager_->AppendLogRecord(log_record);
+  reinterpret_cast<BPlusTreePage *>(page.data)->SetLSN(last_lsn_);
+  page.image.assign(page.data, page.data + PAGE_USABLE_SIZE);
+  page.fresh = false;
+}
+
+} // namespace cmudb
@@ -0,0 +1,106 @@
+/**
+ * log_encoding.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "logging/log_encoding.h"
+
+namespace cmudb {
+
+// changed ranges closer than this are logged as one, a range costs three
+// lengths
+static const int DELTA_MERGE_GAP = 4;
+
+static void PutRange(std::vector<char> &delta, int gap, const char *old_data,
+                     int old_count, const char *new_data, int new_count) {
+  char lengths[3 * MAX_VARINT32_SIZE];
+  char *end = PutVarint(lengths, gap);
+  end = PutVarint(end, old_count);
+  end = PutVarint(end, new_count);
+  delta.insert(delta.end(), lengths, end);
+  delta.insert(delta.end(), old_data, old_data + old_count);
+  delta.insert(delta.end(), new_data, new_data + new_count);
+}
+
+/*
+ * Images of the same size are compared byte by byte, every changed run is a
+ * range. Otherwise the bytes between the common prefix and suffix are
+ */
+void MakeTupleDelta(const char *old_data, int old_size, const char *new_data,
+                    int new_size, std::vector<char> &delta) {
+  char sizes[2 * MAX_VARINT32_SIZE];
+  char *end = PutVarint(sizes, old_size);
+  end = PutVarint(end, new_size);
+  delta.assign(sizes, end);
+
+  if (old_size != new_size) {
+    int prefix = 0;
+    while (prefix < std::min(old_size, new_size) &&
+           old_data[prefix] == new_data[prefix])
+      prefix++;
+    int suffix = 0;
+    while (suffix < std::min(old_size, new_size) - prefix &&
+           old_data[old_size - 1 - suffix] == new_data[new_size - 1 - suffix])
+      suffix++;
+    PutRange(delta, prefix, old_data + prefix, old_size - prefix - suffix,
+             new_data + prefix, new_size - prefix - suffix);
+    return;
+  }
+
+  int done = 0;
+  for (int pos = 0; pos < old_size;) {
+    if (old_data[pos] == new_data[pos]) {
+      pos++;
+      continue;
+    }
+    int range_end = pos + 1;
+    for (int same = 0; range_end + same < old_size && same < DELTA_MERGE_GAP;) {
+      if (old_data[range_end + same] == new_data[range_end + same]) {
+        same++;
+      } else {
+        range_end += same + 1;
+        same = 0;
+      }
+    }
+    PutRange(delta, pos - done, old_data + pos, range_end - pos,
+             new_data + pos, range_end - pos);
+    done = range_end;
+    pos = range_end;
+  }
+}
+
+bool ApplyTupleDelta(const char *delta, int delta_size, const char *data,
+                     int size, bool forward, std::vector<char> &result) {
+  const char *end = delta + delta_size;
+  uint64_t old_size, new_size;
+  if (!GetVarint(delta, end, old_size) || !GetVarint(delta, end, new_size) ||
+      size != static_cast<int64_t>(forward ? old_size : new_size))
+    return false;
+  result.clear();
+  result.reserve(forward ? new_size : old_size);
+  uint64_t pos = 0;
+  while (delta < end) {
+    uint64_t gap, old_count, new_count;
+    if (!GetVarint(delta, end, gap) || !GetVarint(delta, end, old_count) ||
+        !GetVarint(delta, end, new_count) ||
+        static_cast<uint64_t>(end - delta) < old_count + new_count)
+      return false;
+    const char *from = forward ? delta : delta + old_count;
+    const char *to = forward ? delta + old_count : delta;
+    uint64_t from_count = forward ? old_count : new_count;
+    uint64_t to_count = forward ? new_count : old_count;
+    if (pos + gap + from_count > static_cast<uint64_t>(size) ||
+        memcmp(data + pos + gap, from, from_count) != 0)
+      return false;
+    result.insert(result.end(), data + pos, data + pos + gap);
+    result.insert(result.end(), to, to + to_count);
+    pos += gap + from_count;
+    delta += old_count + new_count;
+  }
+  result.insert(result.end(), data + pos, data + size);
+  return result.size() == (forward ? new_size : old_size);
+}
+
+} // namespace cmudb
@@ -2,6 +2,10 @@
  * log_manager.cpp
  */
 
+#include <cassert>
+
+#include "common/crc32c.h"
+#include "common/logger.h"
 #include "logging/log_manager.h"
 
 namespace cmudb {
@@ -12,35 +16,374 @@ namespace cmudb {
  * manager wants to force flush (it only happens when the flushed page has a
  * larger LSN than persistent LSN)
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (running_)
+    return;
+  running_ = true;
+  ENABLE_LOGGING = true;
+  flush_thread_ = new std::thread(&LogManager::FlushThread, this);
+}
+
 /*
  * Stop and join the flush thread, set ENABLE_LOGGING = false
+ * Records appended before the stop are flushed by the thread on its way out
+ */
+void LogManager::StopFlushThread() {
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    if (!running_)
+      return;
+    ENABLE_LOGGING = false;
+    running_ = false;
+  }
+  cv_.notify_all();
+  flush_thread_->join();
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+}
+
+/*
+ * Reservation word, see log_manager.h
+ */
+static inline uint64_t MakeReservation(lsn_t lsn, int index, int offset) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(lsn)) << 32 |
+         static_cast<uint64_t>(index) << 31 | static_cast<uint64_t>(offset);
+}
+
+static inline lsn_t ReservedLSN(uint64_t reservation) {
+  return static_cast<lsn_t>(reservation >> 32);
+}
+
+static inline int ReservedIndex(uint64_t reservation) {
+  return (reservation >> 31) & 1;
+}
+
+static inline int ReservedOffset(uint64_t reservation) {
+  return reservation & 0x7fffffff;
+}
+
+/*
+ * Flush when asked by a committing transaction or an appender out of room,
+ * when the log buffer reaches the threshold, or when the interval or the
+ * deadline of an asynchronous commit expires
+ */
+void LogManager::FlushThread() {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (running_) {
+    auto deadline = std::min(std::chrono::steady_clock::now() + flush_interval_,
+                             commit_deadline_);
+    bool woken = cv_.wait_until(lock, deadline, [this, deadline] {
+      return !running_ || flush_requested_ ||
+             ReservedOffset(reservation_) >= flush_threshold_ ||
+             commit_deadline_ < deadline;
+    });
+    // an earlier deadline only, wait for it
+    if (woken && running_ && !flush_requested_ &&
+        ReservedOffset(reservation_) < flush_threshold_)
+      continue;
+    Flush(lock);
+  }
+  Flush(lock);
+}
+
+/*
+ * Swap the buffers and write out what was appended, the latch is released
+ * during the write so appenders fill the other buffer meanwhile. Appenders
+ * still copying into the old buffer are waited for, its bytes filled reach
+ * its bytes reserved once they are done. One flush at a time, the caller
+ * holds the latch. After a failed write the buffers are only emptied
+ */
+void LogManager::Flush(std::unique_lock<std::mutex> &lock) {
+  flushed_cv_.wait(lock, [this] { return !flushing_; });
+  flush_requested_ = false;
+  // every asynchronous commit so far is in the buffer swapped out
+  commit_deadline_ = std::chrono::steady_clock::time_point::max();
+  uint64_t reservation = reservation_.load();
+  while (ReservedOffset(reservation) > 0 &&
+         !reservation_.compare_exchange_weak(
+             reservation, MakeReservation(ReservedLSN(reservation),
+                                          1 - ReservedIndex(reservation), 0)))
+    ;
+  if (ReservedOffset(reservation) == 0)
+    return;
+  int index = ReservedIndex(reservation);
+  int size = ReservedOffset(reservation);
+  lsn_t lsn = ReservedLSN(reservation) - 1;
+  flush_points_.emplace_back(buffer_first_lsn_, log_size_);
+  buffer_first_lsn_ = ReservedLSN(reservation);
+  log_size_ += size;
+  flushing_ = true;
+  // appenders waiting for room go on in the empty buffer
+  flushed_cv_.notify_all();
+  lock.unlock();
+  while (filled_[index] < size)
+    std::this_thread::yield();
+  bool written = !failed_ && disk_manager_->WriteLog(buffers_[index], size);
+  filled_[index] = 0;
+  lock.lock();
+  flushing_ = false;
+  if (written) {
+    persistent_lsn_ = lsn;
+  } else if (!failed_) {
+    LOG_DEBUG("log write failed, the log is closed for writes");
+    failed_ = true;
+  }
+  flushed_cv_.notify_all();
+}
+
+/*
+ * Block until persistent_lsn_ reaches lsn. The flush thread is woken at once;
+ * if it is busy writing, the records appended meanwhile (other commits) go out
+ * together in the next flush. Without a flush thread the caller flushes
+ * @return: false if the log failed before reaching lsn
  */
-void LogManager::StopFlushThread() {}
+bool LogManager::WaitForFlush(lsn_t lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  // nothing past the last record appended, e.g. the LSN field of a page that
+  // is not a table page, can be waited for
+  lsn = std::min(lsn, ReservedLSN(reservation_) - 1);
+  while (persistent_lsn_ < lsn) {
+    if (failed_)
+      return false;
+    if (!running_) {
+      Flush(lock);
+      continue;
+    }
+    if (!flush_requested_) {
+      flush_requested_ = true;
+      cv_.notify_one();
+    }
+    flushed_cv_.wait(lock);
+  }
+  return true;
+}
+
+/*
+ * The first request after a flush sets the deadline, the ones after it are
+ * covered by the same flush. Without a flush thread the caller flushes
+ */
+void LogManager::RequestFlush(lsn_t lsn) {
+  if (persistent_lsn_ >= lsn)
+    return;
+  std::unique_lock<std::mutex> lock(latch_);
+  if (!running_) {
+    Flush(lock);
+    return;
+  }
+  auto deadline = std::chrono::steady_clock::now() + max_commit_lag_;
+  if (deadline < commit_deadline_) {
+    commit_deadline_ = deadline;
+    cv_.notify_one();
+  }
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
- *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The LSN and the space of the record are reserved together without the
+ * latch. A full log buffer is handed to the flush thread, the appender waits
+ * for the swap and reserves again in the other buffer
  */
 lsn_t LogManager::AppendLogRecord(LogRecord &log_record) {
+  assert(log_record.GetMaxSize() <= LOG_BUFFER_SIZE);
+  uint64_t reservation = reservation_.load();
+  int size;
+  while (true) {
+    int offset = ReservedOffset(reservation);
+    // the size of the record depends on the LSN it would get
+    size = log_record.GetSerializedSize(ReservedLSN(reservation));
+    if (offset + size <= LOG_BUFFER_SIZE) {
+      if (reservation_.compare_exchange_weak(
+              reservation,
+              MakeReservation(ReservedLSN(reservation) + 1,
+                              ReservedIndex(reservation), offset + size)))
+        break;
+      continue;
+    }
+    {
+      std::unique_lock<std::mutex> lock(latch_);
+      // the swap is done under the latch, check again before waiting for it
+      uint64_t current = reservation_;
+      if (ReservedOffset(current) +
+              log_record.GetSerializedSize(ReservedLSN(current)) >
+          LOG_BUFFER_SIZE) {
+        if (!running_) {
+          Flush(lock);
+        } else {
+          flush_requested_ = true;
+          cv_.notify_one();
+          flushed_cv_.wait(lock);
+        }
+      }
+    }
+    reservation = reservation_.load();
+  }
+
+  int index = ReservedIndex(reservation);
+  int offset = ReservedOffset(reservation);
+  log_record.lsn_ = ReservedLSN(reservation);
+  log_record.size_ = size;
+  SerializeLogRecord(log_record, buffers_[index] + offset);
+  filled_[index] += size;
+  // the appender crossing the threshold wakes the flush thread
+  int threshold = flush_threshold_;
+  if (offset < threshold && offset + size >= threshold) {
+    std::lock_guard<std::mutex> lock(latch_);
+    cv_.notify_one();
+  }
+  return log_record.lsn_;
+}
 
-  return INVALID_LSN;
+void LogManager::SetNextLSN(lsn_t lsn) {
+  std::lock_guard<std::mutex> lock(latch_);
+  uint64_t reservation = reservation_;
+  assert(ReservedOffset(reservation) == 0);
+  reservation_ = MakeReservation(lsn, ReservedIndex(reservation), 0);
+  buffer_first_lsn_ = lsn;
+  log_size_ = disk_manager_->GetLogSize();
+}
+
+void LogManager::SetLogStart(lsn_t lsn, int64_t offset) {
+  std::lock_guard<std::mutex> lock(latch_);
+  flush_points_.clear();
+  if (offset < log_size_)
+    flush_points_.emplace_back(lsn, offset);
+}
+
+/*
+ * The flush point before lsn. An lsn older than every flush point was written
+ * before the oldest record still needed (e.g. the recLSN of a page pinned
+ * during recovery), the oldest point is returned
+ */
+int64_t LogManager::GetLogOffset(lsn_t lsn) {
+  std::lock_guard<std::mutex> lock(latch_);
+  // in the buffer being filled
+  if (lsn >= buffer_first_lsn_ || flush_points_.empty())
+    return log_size_;
+  auto point = std::upper_bound(
+      flush_points_.begin(), flush_points_.end(), lsn,
+      [](lsn_t lsn, const std::pair<lsn_t, int64_t> &point) {
+        return lsn < point.first;
+      });
+  if (point != flush_points_.begin())
+    --point;
+  return point->second;
+}
+
+/*
+ * Flush points before the one holding lsn are dropped, the file space before
+ * it is given back
+ */
+void LogManager::DiscardLogBefore(lsn_t lsn) {
+  int64_t offset;
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    while (flush_points_.size() > 1 && flush_points_[1].first <= lsn)
+      flush_points_.pop_front();
+    if (flush_points_.empty() || flush_points_.front().first > lsn)
+      return;
+    offset = flush_points_.front().second;
+  }
+  disk_manager_->DiscardLog(offset);
+}
+
+static inline char *PutRID(char *data, const RID &rid) {
+  data = PutVarint(data, static_cast<uint32_t>(rid.GetPageId()));
+  return PutVarint(data, rid.GetSlotNum());
+}
+
+static inline char *PutTuple(char *data, const Tuple &tuple) {
+  data = PutVarint(data, tuple.GetLength());
+  memcpy(data, tuple.GetData(), tuple.GetLength());
+  return data + tuple.GetLength();
+}
+
+/*
+ * Header fields in order, then the body of the record type, see log_record.h
+ */
+void LogManager::SerializeLogRecord(LogRecord &log_record, char *data) {
+  char *pos = PutVarint(data, log_record.size_);
+  pos = PutVarint(pos, log_record.lsn_);
+  *pos++ = static_cast<char>(log_record.log_record_type_);
+  pos = PutVarint(pos, ZigZagEncode(log_record.txn_id_));
+  pos = PutVarint(pos, log_record.prev_lsn_ == INVALID_LSN
+                           ? 0
+                           : log_record.lsn_ - log_record.prev_lsn_);
+  switch (log_record.log_record_type_) {
+  case LogRecordType::INSERT:
+    pos = PutRID(pos, log_record.insert_rid_);
+    pos = PutTuple(pos, log_record.insert_tuple_);
+    break;
+  case LogRecordType::MARKDELETE:
+    pos = PutRID(pos, log_record.delete_rid_);
+    pos = PutTuple(pos, log_record.delete_tuple_);
+    break;
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    pos = PutRID(pos, log_record.delete_rid_);
+    break;
+  case LogRecordType::UPDATE:
+    pos = PutRID(pos, log_record.update_rid_);
+    pos = PutVarint(pos, log_record.update_delta_.size());
+    memcpy(pos, log_record.update_delta_.data(),
+           log_record.update_delta_.size());
+    pos += log_record.update_delta_.size();
+    break;
+  case LogRecordType::NEWPAGE:
+    pos = PutVarint(pos, ZigZagEncode(log_record.prev_page_id_));
+    pos = PutVarint(pos, ZigZagEncode(log_record.page_id_));
+    break;
+  case LogRecordType::CHECKPOINT_END:
+    pos = PutVarint(pos, log_record.active_txns_.size());
+    for (auto &txn : log_record.active_txns_) {
+      pos = PutVarint(pos, ZigZagEncode(txn.first));
+      pos = PutVarint(pos, ZigZagEncode(txn.second));
+    }
+    pos = PutVarint(pos, log_record.dirty_pages_.size());
+    for (auto &page : log_record.dirty_pages_) {
+      pos = PutVarint(pos, ZigZagEncode(page.first));
+      pos = PutVarint(pos, ZigZagEncode(page.second));
+    }
+    break;
+  case LogRecordType::INDEXINSERT:
+  case LogRecordType::INDEXDELETE:
+    pos = PutVarint(pos, ZigZagEncode(log_record.page_id_));
+    pos = PutVarint(pos, log_record.slot_);
+    pos = PutVarint(pos, log_record.entry_size_);
+    memcpy(pos, log_record.entry_.data(), log_record.entry_.size());
+    pos += log_record.entry_.size();
+    pos = PutVarint(pos, log_record.index_name_.size());
+    memcpy(pos, log_record.index_name_.data(), log_record.index_name_.size());
+    pos += log_record.index_name_.size();
+    *pos++ = log_record.unique_ ? 1 : 0;
+    pos = PutVarint(pos, log_record.key_types_.size());
+    for (TypeId type : log_record.key_types_)
+      *pos++ = static_cast<char>(type);
+    break;
+  case LogRecordType::INDEXPAGE:
+  case LogRecordType::INDEXNEWPAGE:
+    pos = PutVarint(pos, ZigZagEncode(log_record.page_id_));
+    pos = PutVarint(pos, log_record.page_delta_.size());
+    memcpy(pos, log_record.page_delta_.data(), log_record.page_delta_.size());
+    pos += log_record.page_delta_.size();
+    break;
+  case LogRecordType::INDEXROOT:
+    pos = PutVarint(pos, log_record.index_name_.size());
+    memcpy(pos, log_record.index_name_.data(), log_record.index_name_.size());
+    pos += log_record.index_name_.size();
+    pos = PutVarint(pos, ZigZagEncode(log_record.prev_page_id_));
+    pos = PutVarint(pos, ZigZagEncode(log_record.page_id_));
+    break;
+  default:
+    // BEGIN/COMMIT/ABORT/CHECKPOINT_BEGIN/INDEXEND are the header alone
+    break;
+  }
+  uint32_t crc = Crc32c(data, pos - data);
+  memcpy(pos, &crc, LogRecord::CRC_SIZE);
+  pos += LogRecord::CRC_SIZE;
+  assert(pos - data == log_record.size_);
 }
 
 } // namespace cmudb
@@ -2,18 +2,306 @@
  * log_recovey.cpp
  */
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+
+#include "common/crc32c.h"
+#include "index/b_plus_tree.h"
+#include "index/generic_key.h"
 #include "logging/log_recovery.h"
+#include "page/b_plus_tree_leaf_page.h"
+#include "page/header_page.h"
 #include "page/table_page.h"
 
 namespace cmudb {
+
+// bytes of records handed to a redo worker at once, and batches it may have
+// waiting before the reader blocks
+static const size_t REDO_BATCH_SIZE = 64 * 1024;
+static const size_t REDO_QUEUE_DEPTH = 4;
+
+struct LogRecovery::RedoWorker {
+  std::mutex latch;
+  std::condition_variable cv;
+  // serialized records, in log order
+  std::deque<std::vector<char>> batches;
+  bool done = false;
+  // first failure, the worker drains its queue without applying after it
+  std::exception_ptr error;
+  std::thread thread;
+};
+
+/*
+ * A tuple from its bytes, through the storage format of Tuple::SerializeTo
+ */
+static void MakeTuple(const char *data, int32_t size, Tuple &tuple) {
+  std::vector<char> storage(sizeof(int32_t) + size);
+  memcpy(storage.data(), &size, sizeof(int32_t));
+  memcpy(storage.data() + sizeof(int32_t), data, size);
+  tuple.DeserializeFrom(storage.data());
+}
+
+static bool GetRID(const char *&data, const char *end, RID &rid) {
+  uint64_t page_id, slot_num;
+  if (!GetVarint(data, end, page_id) || !GetVarint(data, end, slot_num) ||
+      page_id > UINT32_MAX || slot_num > INT32_MAX)
+    return false;
+  rid.Set(static_cast<page_id_t>(page_id), static_cast<int>(slot_num));
+  return true;
+}
+
+static bool GetTuple(const char *&data, const char *end, Tuple &tuple) {
+  uint64_t length;
+  if (!GetVarint(data, end, length) || length == 0 ||
+      length > static_cast<uint64_t>(end - data))
+    return false;
+  MakeTuple(data, length, tuple);
+  data += length;
+  return true;
+}
+
+static bool GetPageId(const char *&data, const char *end, page_id_t &page_id) {
+  uint64_t value;
+  if (!GetVarint(data, end, value))
+    return false;
+  page_id = static_cast<page_id_t>(ZigZagDecode(value));
+  return true;
+}
+
+static bool GetBytes(const char *&data, const char *end,
+                     std::vector<char> &bytes) {
+  uint64_t length;
+  if (!GetVarint(data, end, length) ||
+      length > static_cast<uint64_t>(end - data))
+    return false;
+  bytes.assign(data, data + length);
+  data += length;
+  return true;
+}
+
+static bool IsIndexOperation(LogRecordType type) {
+  return type == LogRecordType::INDEXPAGE ||
+         type == LogRecordType::INDEXNEWPAGE ||
+         type == LogRecordType::INDEXROOT || type == LogRecordType::INDEXEND;
+}
+
+/*
+ * An entry of entry_size bytes into / out of slot of a leaf, see
+ * page/b_plus_tree_leaf_page.h
+ * @return: false if the slot is not on the page
+ */
+static bool InsertLeafEntry(char *data, int slot, const char *entry,
+                            int entry_size) {
+  auto node = reinterpret_cast<BPlusTreePage *>(data);
+  int size = node->GetSize();
+  if (slot < 0 || slot > size ||
+      LEAF_PAGE_HEADER_SIZE + (size + 1) * entry_size > PAGE_USABLE_SIZE)
+    return false;
+  char *array = data + LEAF_PAGE_HEADER_SIZE;
+  memmove(array + (slot + 1) * entry_size, array + slot * entry_size,
+          (size - slot) * entry_size);
+  memcpy(array + slot * entry_size, entry, entry_size);
+  node->IncreaseSize(1);
+  return true;
+}
+
+static bool RemoveLeafEntry(char *data, int slot, int entry_size) {
+  auto node = reinterpret_cast<BPlusTreePage *>(data);
+  int size = node->GetSize();
+  if (slot < 0 || slot >= size ||
+      LEAF_PAGE_HEADER_SIZE + size * entry_size > PAGE_USABLE_SIZE)
+    return false;
+  char *array = data + LEAF_PAGE_HEADER_SIZE;
+  memmove(array + slot * entry_size, array + (slot + 1) * entry_size,
+          (size - slot - 1) * entry_size);
+  node->IncreaseSize(-1);
+  return true;
+}
+
+/*
+ * Page a record changes, read from the rid in its body, or the new page of
+ * NEWPAGE with its previous page. The header page for INDEXROOT,
+ * INVALID_PAGE_ID for records of no page
+ */
+static void RecordPageId(const char *body, const char *end, LogRecordType type,
+                         page_id_t &page_id, page_id_t &prev_page_id) {
+  page_id = prev_page_id = INVALID_PAGE_ID;
+  RID rid;
+  switch (type) {
+  case LogRecordType::NEWPAGE:
+    if (!GetPageId(body, end, prev_page_id) || !GetPageId(body, end, page_id))
+      page_id = prev_page_id = INVALID_PAGE_ID;
+    break;
+  case LogRecordType::INSERT:
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+  case LogRecordType::UPDATE:
+    if (GetRID(body, end, rid))
+      page_id = rid.GetPageId();
+    break;
+  case LogRecordType::INDEXINSERT:
+  case LogRecordType::INDEXDELETE:
+  case LogRecordType::INDEXPAGE:
+  case LogRecordType::INDEXNEWPAGE:
+    if (!GetPageId(body, end, page_id))
+      page_id = INVALID_PAGE_ID;
+    break;
+  case LogRecordType::INDEXROOT:
+    page_id = HEADER_PAGE_ID;
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * The header of a record of size bytes, see log_record.h. body is set to the
+ * first byte after it. False if the checksum of the record does not match
+ */
+bool LogRecovery::DeserializeHeader(const char *data, int size,
+                                    LogRecord &log_record, const char *&body) {
+  if (size <= LogRecord::CRC_SIZE)
+    return false;
+  const char *end = data + size - LogRecord::CRC_SIZE;
+  uint32_t crc;
+  memcpy(&crc, end, LogRecord::CRC_SIZE);
+  if (crc != Crc32c(data, end - data))
+    return false;
+  uint64_t value, lsn, txn_id, prev_lsn;
+  if (!GetVarint(data, end, value) || value != static_cast<uint64_t>(size) ||
+      !GetVarint(data, end, lsn) || lsn > INT32_MAX || data == end)
+    return false;
+  auto type = static_cast<LogRecordType>(static_cast<uint8_t>(*data++));
+  if (type <= LogRecordType::INVALID || type > LogRecordType::INDEXEND ||
+      !GetVarint(data, end, txn_id) || !GetVarint(data, end, prev_lsn) ||
+      prev_lsn > lsn)
+    return false;
+  log_record.size_ = size;
+  log_record.lsn_ = lsn;
+  log_record.log_record_type_ = type;
+  log_record.txn_id_ = static_cast<txn_id_t>(ZigZagDecode(txn_id));
+  log_record.prev_lsn_ = prev_lsn == 0 ? INVALID_LSN : lsn - prev_lsn;
+  body = data;
+  return true;
+}
+
 /*
  * deserialize a log record from log buffer
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
+ * The caller makes sure the size bytes of the record are in the buffer; a
+ * record whose body disagrees with its size is rejected
  */
 bool LogRecovery::DeserializeLogRecord(const char *data,
-                                             LogRecord &log_record) {
-  return false;
+                                       LogRecord &log_record) {
+  const char *pos = data;
+  uint64_t size;
+  if (!GetVarint(pos, data + MAX_VARINT32_SIZE, size) ||
+      size > LOG_BUFFER_SIZE ||
+      !DeserializeHeader(data, size, log_record, pos))
+    return false;
+  const char *end = data + size - LogRecord::CRC_SIZE;
+  uint64_t count;
+  switch (log_record.log_record_type_) {
+  case LogRecordType::INSERT:
+    if (!GetRID(pos, end, log_record.insert_rid_) ||
+        !GetTuple(pos, end, log_record.insert_tuple_))
+      return false;
+    break;
+  case LogRecordType::MARKDELETE:
+    if (!GetRID(pos, end, log_record.delete_rid_) ||
+        !GetTuple(pos, end, log_record.delete_tuple_))
+      return false;
+    break;
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    if (!GetRID(pos, end, log_record.delete_rid_))
+      return false;
+    break;
+  case LogRecordType::UPDATE:
+    if (!GetRID(pos, end, log_record.update_rid_) ||
+        !GetVarint(pos, end, count) ||
+        count > static_cast<uint64_t>(end - pos))
+      return false;
+    log_record.update_delta_.assign(pos, pos + count);
+    pos += count;
+    break;
+  case LogRecordType::NEWPAGE:
+    if (!GetPageId(pos, end, log_record.prev_page_id_) ||
+        !GetPageId(pos, end, log_record.page_id_))
+      return false;
+    break;
+  case LogRecordType::CHECKPOINT_END:
+    for (int i = 0; i < 2; i++) {
+      // a pair takes two bytes at least
+      if (!GetVarint(pos, end, count) ||
+          count > static_cast<uint64_t>(end - pos) / 2)
+        return false;
+      for (uint64_t j = 0; j < count; j++) {
+        uint64_t id, lsn;
+        if (!GetVarint(pos, end, id) || !GetVarint(pos, end, lsn))
+          return false;
+        if (i == 0)
+          log_record.active_txns_.emplace_back(ZigZagDecode(id),
+                                               ZigZagDecode(lsn));
+        else
+          log_record.dirty_pages_.emplace_back(ZigZagDecode(id),
+                                               ZigZagDecode(lsn));
+      }
+    }
+    break;
+  case LogRecordType::INDEXINSERT:
+  case LogRecordType::INDEXDELETE: {
+    uint64_t slot, entry_size;
+    if (!GetPageId(pos, end, log_record.page_id_) ||
+        !GetVarint(pos, end, slot) || !GetVarint(pos, end, entry_size) ||
+        slot > PAGE_SIZE || entry_size == 0 || entry_size > PAGE_SIZE)
+      return false;
+    log_record.slot_ = slot;
+    log_record.entry_size_ = entry_size;
+    std::vector<char> name;
+    if (entry_size > static_cast<uint64_t>(end - pos))
+      return false;
+    log_record.entry_.assign(pos, pos + entry_size);
+    pos += entry_size;
+    if (!GetBytes(pos, end, name) || pos == end)
+      return false;
+    log_record.index_name_.assign(name.begin(), name.end());
+    log_record.unique_ = *pos++ != 0;
+    if (!GetVarint(pos, end, count) ||
+        count > static_cast<uint64_t>(end - pos))
+      return false;
+    for (uint64_t i = 0; i < count; i++) {
+      auto type = static_cast<TypeId>(static_cast<uint8_t>(*pos++));
+      if (type <= TypeId::INVALID || type > TypeId::TIMESTAMP)
+        return false;
+      log_record.key_types_.push_back(type);
+    }
+    break;
+  }
+  case LogRecordType::INDEXPAGE:
+  case LogRecordType::INDEXNEWPAGE:
+    if (!GetPageId(pos, end, log_record.page_id_) ||
+        !GetBytes(pos, end, log_record.page_delta_))
+      return false;
+    break;
+  case LogRecordType::INDEXROOT: {
+    std::vector<char> name;
+    if (!GetBytes(pos, end, name) ||
+        !GetPageId(pos, end, log_record.prev_page_id_) ||
+        !GetPageId(pos, end, log_record.page_id_))
+      return false;
+    log_record.index_name_.assign(name.begin(), name.end());
+    break;
+  }
+  default:
+    // BEGIN/COMMIT/ABORT/CHECKPOINT_BEGIN/INDEXEND are the header alone
+    break;
+  }
+  return pos == end;
 }
 
 /*
@@ -22,13 +310,735 @@ bool LogRecovery::DeserializeLogRecord(const char *data,
  *log buffer to reduce unnecessary I/O operations), remember to compare page's
  *LSN with log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
+ * Only headers are parsed here, the workers deserialize the bodies. The log
+ * ends at the first record that is zero, torn or out of LSN order; what
+ * follows it is cut off so appends continue right after the last record.
+ * Reading starts where the master record of the last checkpoint points to
+ */
+void LogRecovery::Redo() {
+  assert(!ENABLE_LOGGING);
+  active_txn_.clear();
+  lsn_mapping_.clear();
+  txn_lsns_.clear();
+  index_ops_.clear();
+  offset_ = ReadCheckpoint();
+  const int64_t start_offset = offset_;
+
+  const int num_workers = redo_threads_;
+  std::vector<std::unique_ptr<RedoWorker>> workers;
+  for (int i = 0; i < num_workers; i++) {
+    workers.emplace_back(new RedoWorker());
+    workers[i]->thread =
+        std::thread(&LogRecovery::ReplayPages, this, workers[i].get(), i);
+  }
+  std::vector<std::vector<char>> pending(num_workers);
+  auto dispatch = [&](int index) {
+    RedoWorker *worker = workers[index].get();
+    {
+      std::unique_lock<std::mutex> lock(worker->latch);
+      worker->cv.wait(lock, [worker] {
+        return worker->batches.size() < REDO_QUEUE_DEPTH;
+      });
+      worker->batches.push_back(std::move(pending[index]));
+    }
+    worker->cv.notify_all();
+    pending[index] = std::vector<char>();
+    pending[index].reserve(REDO_BATCH_SIZE + LOG_BUFFER_SIZE);
+  };
+  auto add = [&](int index, const char *data, int size) {
+    pending[index].insert(pending[index].end(), data, data + size);
+    if (pending[index].size() >= REDO_BATCH_SIZE)
+      dispatch(index);
+  };
+
+  // a chunk is read behind LOG_BUFFER_SIZE bytes of room, where the
+  // incomplete record at the end of the previous chunk is copied
+  std::vector<char> buffers[2];
+  for (auto &buffer : buffers)
+    buffer.resize(LOG_BUFFER_SIZE + LOG_READ_SIZE);
+  auto read_chunk = [this, &buffers](int index, int64_t offset) {
+    return std::async(std::launch::async, [this, &buffers, index, offset] {
+      return disk_manager_->ReadLog(buffers[index].data() + LOG_BUFFER_SIZE,
+                                    LOG_READ_SIZE, offset);
+    });
+  };
+
+  lsn_t last_lsn = INVALID_LSN;
+  int leftover = 0;
+  bool end = false;
+  lsn_t first_lsn = INVALID_LSN;
+  std::future<bool> reading = read_chunk(0, start_offset);
+  for (int64_t chunk_offset = start_offset, i = 0; !end && reading.get();
+       chunk_offset += LOG_READ_SIZE, i = 1 - i) {
+    char *data = buffers[i].data() + LOG_BUFFER_SIZE - leftover;
+    memcpy(data, buffers[1 - i].data() + LOG_BUFFER_SIZE + LOG_READ_SIZE -
+                     leftover, leftover);
+    reading = read_chunk(1 - i, chunk_offset + LOG_READ_SIZE);
+
+    int available = leftover + LOG_READ_SIZE;
+    int pos = 0;
+    while (pos < available) {
+      const char *record = data + pos;
+      const char *cursor = record;
+      uint64_t size;
+      if (!GetVarint(cursor, data + available, size)) {
+        // the size continues in the next chunk, or is garbage
+        end = available - pos >= MAX_VARINT32_SIZE;
+        break;
+      }
+      LogRecord header;
+      const char *body;
+      if (size > LOG_BUFFER_SIZE ||
+          (pos + static_cast<int>(size) <= available &&
+           !DeserializeHeader(record, size, header, body))) {
+        end = true;
+        break;
+      }
+      // continues in the next chunk
+      if (pos + static_cast<int>(size) > available)
+        break;
+      lsn_t lsn = header.lsn_;
+      txn_id_t txn_id = header.txn_id_;
+      LogRecordType type = header.log_record_type_;
+      if (last_lsn != INVALID_LSN && lsn != last_lsn + 1) {
+        end = true;
+        break;
+      }
+
+      if (type == LogRecordType::CHECKPOINT_BEGIN ||
+          type == LogRecordType::CHECKPOINT_END) {
+        // the tables are rebuilt from the records read
+      } else if (type == LogRecordType::COMMIT ||
+                 type == LogRecordType::ABORT) {
+        EndTransaction(txn_id);
+      } else if (IsIndexOperation(type)) {
+        TrackIndexOperation(header, offset_ + pos);
+      } else if ((type == LogRecordType::INDEXINSERT ||
+                  type == LogRecordType::INDEXDELETE) &&
+                 txn_id == INVALID_TXN_ID) {
+        // an entry changed outside any transaction, nothing to undo
+      } else {
+        active_txn_[txn_id] = lsn;
+        if (type != LogRecordType::BEGIN) {
+          lsn_mapping_[lsn] = offset_ + pos;
+          txn_lsns_[txn_id].push_back(lsn);
+        }
+      }
+      page_id_t page_id, prev_page_id;
+      RecordPageId(body, record + size, type, page_id, prev_page_id);
+      if (page_id != INVALID_PAGE_ID) {
+        add(page_id % num_workers, record, size);
+        // the previous page of a new one is linked by its own worker
+        if (prev_page_id != INVALID_PAGE_ID &&
+            prev_page_id % num_workers != page_id % num_workers)
+          add(prev_page_id % num_workers, record, size);
+      }
+      if (first_lsn == INVALID_LSN)
+        first_lsn = lsn;
+      last_lsn = lsn;
+      pos += size;
+    }
+    offset_ += pos;
+    leftover = available - pos;
+  }
+  if (reading.valid())
+    reading.wait();
+
+  for (int i = 0; i < num_workers; i++) {
+    if (!pending[i].empty())
+      dispatch(i);
+    {
+      std::lock_guard<std::mutex> lock(workers[i]->latch);
+      workers[i]->done = true;
+    }
+    workers[i]->cv.notify_all();
+  }
+  std::exception_ptr error;
+  for (auto &worker : workers) {
+    worker->thread.join();
+    if (error == nullptr)
+      error = worker->error;
+  }
+  if (error != nullptr)
+    std::rethrow_exception(error);
+
+  if (disk_manager_->GetLogSize() > offset_)
+    disk_manager_->TruncateLog(offset_);
+  log_manager_->SetNextLSN(last_lsn + 1);
+  log_manager_->SetPersistentLSN(last_lsn);
+  if (first_lsn != INVALID_LSN)
+    log_manager_->SetLogStart(first_lsn, start_offset);
+}
+
+/*
+ * Offset of the first record to read, from the master record in the header
+ * page. 0 without a checkpoint
+ */
+int64_t LogRecovery::ReadCheckpoint() {
+  auto header_page =
+      static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr)
+    return 0;
+  lsn_t checkpoint_lsn, start_lsn;
+  int64_t start_offset;
+  if (!header_page->GetCheckpoint(checkpoint_lsn, start_lsn, start_offset) ||
+      start_offset < 0)
+    start_offset = 0;
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  return start_offset;
+}
+
+/*
+ * Redo worker: apply the batches handed over by Redo in order
+ */
+void LogRecovery::ReplayPages(RedoWorker *worker, int index) {
+  while (true) {
+    std::vector<char> batch;
+    {
+      std::unique_lock<std::mutex> lock(worker->latch);
+      worker->cv.wait(lock, [worker] {
+        return worker->done || !worker->batches.empty();
+      });
+      if (worker->batches.empty())
+        return;
+      batch = std::move(worker->batches.front());
+      worker->batches.pop_front();
+    }
+    worker->cv.notify_all();
+    if (worker->error != nullptr)
+      continue;
+    try {
+      for (size_t pos = 0; pos < batch.size();) {
+        LogRecord log_record;
+        if (!DeserializeLogRecord(batch.data() + pos, log_record))
+          throw Exception(EXCEPTION_TYPE_CORRUPTION, "malformed log record");
+        RedoRecord(log_record, index);
+        // the size was checked when the record was handed over
+        const char *cursor = batch.data() + pos;
+        uint64_t size;
+        GetVarint(cursor, batch.data() + batch.size(), size);
+        pos += size;
+      }
+    } catch (...) {
+      worker->error = std::current_exception();
+    }
+  }
+}
+
+/*
+ * Replay one record on the pages of worker index, unless the page already
+ * holds it. A new page is initialized again and linked after its previous
+ * page, the link is idempotent and not tied to an LSN
  */
-void LogRecovery::Redo() {}
+void LogRecovery::RedoRecord(LogRecord &log_record, int index) {
+  lsn_t lsn = log_record.lsn_;
+  if (log_record.log_record_type_ >= LogRecordType::INDEXINSERT) {
+    RedoIndexRecord(log_record);
+    return;
+  }
+  if (log_record.log_record_type_ == LogRecordType::NEWPAGE) {
+    page_id_t page_id = log_record.page_id_;
+    page_id_t prev_page_id = log_record.prev_page_id_;
+    if (page_id % redo_threads_ == index) {
+      disk_manager_->MarkAllocated(page_id);
+      auto page = static_cast<TablePage *>(FetchPage(page_id));
+      page->WLatch();
+      // a page past the end of the db file reads as whatever its frame held
+      bool redo = page->GetLSN() < lsn || page->GetPageId() != page_id;
+      if (redo) {
+        page->Init(page_id, PAGE_USABLE_SIZE, prev_page_id, nullptr, nullptr);
+        page->SetLSN(lsn);
+      }
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(page_id, redo);
+    }
+    if (prev_page_id != INVALID_PAGE_ID &&
+        prev_page_id % redo_threads_ == index) {
+      auto page = static_cast<TablePage *>(FetchPage(prev_page_id));
+      page->WLatch();
+      bool redo = page->GetNextPageId() != page_id;
+      if (redo)
+        page->SetNextPageId(page_id);
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(prev_page_id, redo);
+    }
+    return;
+  }
+
+  RID rid;
+  switch (log_record.log_record_type_) {
+  case LogRecordType::INSERT:
+    rid = log_record.insert_rid_;
+    break;
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    rid = log_record.delete_rid_;
+    break;
+  case LogRecordType::UPDATE:
+    rid = log_record.update_rid_;
+    break;
+  default:
+    return;
+  }
+  auto page = static_cast<TablePage *>(FetchPage(rid.GetPageId()));
+  page->WLatch();
+  bool redo = page->GetLSN() < lsn;
+  if (redo && log_record.log_record_type_ == LogRecordType::UPDATE) {
+    // the page holds the image the delta starts from
+    Tuple old_tuple, new_tuple;
+    std::vector<char> image;
+    auto &delta = log_record.update_delta_;
+    if (page->GetTuple(rid, old_tuple, nullptr, nullptr) &&
+        ApplyTupleDelta(delta.data(), delta.size(), old_tuple.GetData(),
+                        old_tuple.GetLength(), true, image)) {
+      MakeTuple(image.data(), image.size(), new_tuple);
+      page->UpdateTuple(new_tuple, old_tuple, rid, nullptr, nullptr, nullptr);
+    } else {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "update to redo does not match the tuple");
+    }
+  } else if (redo) {
+    switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      page->InsertTupleAt(log_record.insert_tuple_, rid);
+      break;
+    case LogRecordType::MARKDELETE:
+      page->MarkDelete(rid, nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->ApplyDelete(rid, nullptr, nullptr);
+      break;
+    default:
+      page->RollbackDelete(rid, nullptr, nullptr);
+      break;
+    }
+  }
+  if (redo)
+    page->SetLSN(lsn);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), redo);
+}
+
+/*
+ * The header page has no LSN: roots are set again in log order, the record
+ * of an index is created by the first one. A page created by a record starts
+ * over from zeros, the later records of the page follow it in the log
+ */
+void LogRecovery::RedoIndexRecord(LogRecord &log_record) {
+  lsn_t lsn = log_record.lsn_;
+  LogRecordType type = log_record.log_record_type_;
+  // an entry record without a page is redone by its structure modification
+  if (type == LogRecordType::INDEXEND ||
+      log_record.page_id_ == INVALID_PAGE_ID)
+    return;
+  if (type == LogRecordType::INDEXROOT) {
+    auto header_page = static_cast<HeaderPage *>(FetchPage(HEADER_PAGE_ID));
+    header_page->WLatch();
+    if (!header_page->UpdateRecord(buffer_pool_manager_,
+                                   log_record.index_name_,
+                                   log_record.page_id_) &&
+        log_record.prev_page_id_ == INVALID_PAGE_ID)
+      header_page->InsertRecord(buffer_pool_manager_, log_record.index_name_,
+                                log_record.page_id_);
+    header_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+    return;
+  }
+
+  page_id_t page_id = log_record.page_id_;
+  if (type == LogRecordType::INDEXNEWPAGE)
+    disk_manager_->MarkAllocated(page_id);
+  Page *page = FetchPage(page_id);
+  page->WLatch();
+  bool redo = type == LogRecordType::INDEXNEWPAGE || page->GetLSN() < lsn;
+  if (redo) {
+    switch (type) {
+    case LogRecordType::INDEXINSERT:
+      redo = InsertLeafEntry(page->GetData(), log_record.slot_,
+                             log_record.entry_.data(), log_record.entry_size_);
+      break;
+    case LogRecordType::INDEXDELETE:
+      redo = RemoveLeafEntry(page->GetData(), log_record.slot_,
+                             log_record.entry_size_);
+      break;
+    default: {
+      std::vector<char> zeros, image;
+      const char *data = page->GetData();
+      if (type == LogRecordType::INDEXNEWPAGE) {
+        zeros.assign(PAGE_USABLE_SIZE, 0);
+        data = zeros.data();
+      }
+      auto &delta = log_record.page_delta_;
+      redo = ApplyTupleDelta(delta.data(), delta.size(), data,
+                             PAGE_USABLE_SIZE, true, image);
+      if (redo)
+        memcpy(page->GetData(), image.data(), PAGE_USABLE_SIZE);
+      break;
+    }
+    }
+    if (!redo) {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(page_id, false);
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "index record to redo does not match the page");
+    }
+  }
+  if (redo)
+    page->SetLSN(lsn);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page_id, redo);
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
+ * Records of all the active transactions are undone newest first. Each undo
+ * is logged like the rollback of a runtime abort, so a crash during undo is
+ * redone and undone again consistently, and every such transaction ends with
+ * an abort record
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  assert(!ENABLE_LOGGING);
+  lsn_t lsn = INVALID_LSN;
+  for (auto &operation : index_ops_)
+    lsn = UndoIndexOperation(operation.first, operation.second);
+  index_ops_.clear();
+
+  std::vector<std::pair<lsn_t, int64_t>> records(lsn_mapping_.begin(),
+                                                 lsn_mapping_.end());
+  std::sort(records.begin(), records.end(),
+            [](const std::pair<lsn_t, int64_t> &a,
+               const std::pair<lsn_t, int64_t> &b) { return a.first > b.first; });
+  for (auto &record : records) {
+    LogRecord log_record;
+    if (!ReadLogRecord(record.second, log_record))
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "can't read log record to undo");
+    UndoRecord(log_record);
+  }
+
+  for (auto &txn : active_txn_) {
+    LogRecord log_record(txn.first, txn.second, LogRecordType::ABORT);
+    lsn = log_manager_->AppendLogRecord(log_record);
+  }
+  if (lsn != INVALID_LSN)
+    log_manager_->WaitForFlush(lsn);
+  active_txn_.clear();
+  lsn_mapping_.clear();
+  txn_lsns_.clear();
+}
+
+/*
+ * Apply the inverse of a record and log it as the record of that inverse,
+ * chained to the transaction. A new page is left to the table, empty
+ */
+void LogRecovery::UndoRecord(LogRecord &log_record) {
+  txn_id_t txn_id = log_record.txn_id_;
+  LogRecordType type = log_record.log_record_type_;
+  if (type == LogRecordType::INDEXINSERT ||
+      type == LogRecordType::INDEXDELETE) {
+    UndoIndexEntry(log_record);
+    return;
+  }
+  RID rid;
+  switch (type) {
+  case LogRecordType::INSERT:
+    rid = log_record.insert_rid_;
+    break;
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    rid = log_record.delete_rid_;
+    break;
+  case LogRecordType::UPDATE:
+    rid = log_record.update_rid_;
+    break;
+  default:
+    return;
+  }
+  Tuple tuple;
+  if (type == LogRecordType::APPLYDELETE &&
+      !RebuildDeletedTuple(log_record, tuple))
+    throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                    "can't rebuild the tuple of an applied delete");
+
+  auto page = static_cast<TablePage *>(FetchPage(rid.GetPageId()));
+  page->WLatch();
+  lsn_t prev_lsn = active_txn_[txn_id];
+  LogRecord compensation;
+  switch (type) {
+  case LogRecordType::INSERT:
+    page->ApplyDelete(rid, nullptr, nullptr);
+    compensation = LogRecord(txn_id, prev_lsn, LogRecordType::APPLYDELETE, rid,
+                             tuple);
+    break;
+  case LogRecordType::MARKDELETE:
+    page->RollbackDelete(rid, nullptr, nullptr);
+    compensation = LogRecord(txn_id, prev_lsn, LogRecordType::ROLLBACKDELETE,
+                             rid, tuple);
+    break;
+  case LogRecordType::APPLYDELETE:
+    page->InsertTupleAt(tuple, rid);
+    compensation =
+        LogRecord(txn_id, prev_lsn, LogRecordType::INSERT, rid, tuple);
+    break;
+  case LogRecordType::ROLLBACKDELETE:
+    // the compensating markdelete logs the tuple it deletes
+    page->GetTuple(rid, tuple, nullptr, nullptr);
+    page->MarkDelete(rid, nullptr, nullptr, nullptr);
+    compensation =
+        LogRecord(txn_id, prev_lsn, LogRecordType::MARKDELETE, rid, tuple);
+    break;
+  default: {
+    Tuple old_tuple, new_tuple;
+    std::vector<char> image;
+    auto &delta = log_record.update_delta_;
+    if (!page->GetTuple(rid, tuple, nullptr, nullptr) ||
+        !ApplyTupleDelta(delta.data(), delta.size(), tuple.GetData(),
+                         tuple.GetLength(), false, image)) {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "update to undo does not match the tuple");
+    }
+    MakeTuple(image.data(), image.size(), old_tuple);
+    page->UpdateTuple(old_tuple, new_tuple, rid, nullptr, nullptr, nullptr);
+    compensation = LogRecord(txn_id, prev_lsn, LogRecordType::UPDATE, rid,
+                             tuple, old_tuple);
+    break;
+  }
+  }
+  lsn_t lsn = log_manager_->AppendLogRecord(compensation);
+  active_txn_[txn_id] = lsn;
+  page->SetLSN(lsn);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+}
+
+/*
+ * Take an entry of the transaction out of its index / put it back, by key:
+ * it may have moved to another leaf since. The tree logs the change as one
+ * of the transaction, a change already undone finds nothing to do
+ */
+template <size_t KeySize>
+void LogRecovery::UndoEntry(LogRecord &log_record, Schema *key_schema,
+                            page_id_t root_page_id, Transaction *txn) {
+  GenericComparator<KeySize> comparator(key_schema);
+  BPlusTree<GenericKey<KeySize>, RID, GenericComparator<KeySize>> tree(
+      log_record.index_name_, buffer_pool_manager_, comparator, root_page_id,
+      log_record.unique_, log_manager_);
+  // the entry is the key bytes followed by the rid
+  GenericKey<KeySize> key;
+  RID rid;
+  memcpy(key.data, log_record.entry_.data(), KeySize);
+  memcpy(&rid, log_record.entry_.data() + KeySize, sizeof(RID));
+  if (log_record.log_record_type_ == LogRecordType::INDEXINSERT)
+    tree.Remove(key, rid, txn);
+  else
+    tree.Insert(key, rid, txn);
+}
+
+void LogRecovery::UndoIndexEntry(LogRecord &log_record) {
+  txn_id_t txn_id = log_record.txn_id_;
+  auto header_page = static_cast<HeaderPage *>(FetchPage(HEADER_PAGE_ID));
+  page_id_t root_page_id = INVALID_PAGE_ID;
+  header_page->RLatch();
+  bool found = header_page->GetRootId(buffer_pool_manager_,
+                                      log_record.index_name_, root_page_id);
+  header_page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  if (!found)
+    throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                    "index of an entry to undo is gone");
+
+  std::vector<Column> columns;
+  for (TypeId type : log_record.key_types_)
+    columns.emplace_back(
+        type,
+        type == TypeId::VARCHAR ? 1 : static_cast<int>(Type::GetTypeSize(type)),
+        "");
+  Schema key_schema(columns);
+  Transaction txn(txn_id);
+  txn.SetPrevLSN(active_txn_[txn_id]);
+  // the tree logs through IndexLog, which is off until the flush thread runs
+  ENABLE_LOGGING = true;
+  switch (log_record.entry_.size() - sizeof(RID)) {
+  case 4:
+    UndoEntry<4>(log_record, &key_schema, root_page_id, &txn);
+    break;
+  case 8:
+    UndoEntry<8>(log_record, &key_schema, root_page_id, &txn);
+    break;
+  case 16:
+    UndoEntry<16>(log_record, &key_schema, root_page_id, &txn);
+    break;
+  case 32:
+    UndoEntry<32>(log_record, &key_schema, root_page_id, &txn);
+    break;
+  case 64:
+    UndoEntry<64>(log_record, &key_schema, root_page_id, &txn);
+    break;
+  default:
+    ENABLE_LOGGING = false;
+    throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                    "index entry to undo has an unknown key size");
+  }
+  ENABLE_LOGGING = false;
+  active_txn_[txn_id] = txn.GetPrevLSN();
+}
+
+/*
+ * Reverse the records of a structure modification left without an end,
+ * newest first, and end it. Each step is logged as an index record chained
+ * to the operation; the pages a new one gets are left unused
+ * @return: LSN of the end record
+ */
+lsn_t LogRecovery::UndoIndexOperation(
+    lsn_t last_lsn, std::vector<std::pair<lsn_t, int64_t>> &records) {
+  lsn_t prev_lsn = last_lsn;
+  for (auto record = records.rbegin(); record != records.rend(); ++record) {
+    LogRecord log_record;
+    if (!ReadLogRecord(record->second, log_record))
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "can't read index record to undo");
+    LogRecordType type = log_record.log_record_type_;
+    if (type == LogRecordType::INDEXROOT) {
+      auto header_page = static_cast<HeaderPage *>(FetchPage(HEADER_PAGE_ID));
+      header_page->WLatch();
+      header_page->UpdateRecord(buffer_pool_manager_, log_record.index_name_,
+                                log_record.prev_page_id_);
+      LogRecord compensation(prev_lsn, log_record.index_name_,
+                             log_record.page_id_, log_record.prev_page_id_);
+      prev_lsn = log_manager_->AppendLogRecord(compensation);
+      header_page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+      continue;
+    }
+    if (type != LogRecordType::INDEXPAGE)
+      continue;
+
+    page_id_t page_id = log_record.page_id_;
+    Page *page = FetchPage(page_id);
+    page->WLatch();
+    std::vector<char> image;
+    auto &delta = log_record.page_delta_;
+    if (!ApplyTupleDelta(delta.data(), delta.size(), page->GetData(),
+                         PAGE_USABLE_SIZE, false, image)) {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(page_id, false);
+      throw Exception(EXCEPTION_TYPE_CORRUPTION,
+                      "index record to undo does not match the page");
+    }
+    LogRecord compensation(prev_lsn, LogRecordType::INDEXPAGE, page_id,
+                           page->GetData(), image.data());
+    memcpy(page->GetData(), image.data(), PAGE_USABLE_SIZE);
+    prev_lsn = log_manager_->AppendLogRecord(compensation);
+    page->SetLSN(prev_lsn);
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+  }
+  LogRecord end_record(INVALID_TXN_ID, prev_lsn, LogRecordType::INDEXEND);
+  return log_manager_->AppendLogRecord(end_record);
+}
+
+/*
+ * The records of a structure modification are chained, one goes on the
+ * operation its previous record belongs to; INDEXEND closes it
+ */
+void LogRecovery::TrackIndexOperation(LogRecord &header, int64_t offset) {
+  std::vector<std::pair<lsn_t, int64_t>> records;
+  auto operation = index_ops_.find(header.prev_lsn_);
+  if (header.prev_lsn_ != INVALID_LSN && operation != index_ops_.end()) {
+    records = std::move(operation->second);
+    index_ops_.erase(operation);
+  }
+  if (header.log_record_type_ == LogRecordType::INDEXEND)
+    return;
+  records.emplace_back(header.lsn_, offset);
+  index_ops_[header.lsn_] = std::move(records);
+}
+
+/*
+ * An applied delete does not log the tuple it removes. The transaction
+ * inserted or markdeleted it before: that image, with the updates the
+ * transaction logged on the rid after it, is the tuple
+ */
+bool LogRecovery::RebuildDeletedTuple(LogRecord &log_record, Tuple &tuple) {
+  const RID &rid = log_record.delete_rid_;
+  auto &lsns = txn_lsns_[log_record.txn_id_];
+  std::vector<std::vector<char>> deltas;
+  std::vector<char> image;
+  for (auto it = std::lower_bound(lsns.begin(), lsns.end(), log_record.lsn_);
+       it != lsns.begin() && image.empty();) {
+    LogRecord earlier;
+    if (!ReadLogRecord(lsn_mapping_[*--it], earlier))
+      return false;
+    Tuple *base = nullptr;
+    switch (earlier.log_record_type_) {
+    case LogRecordType::INSERT:
+      if (earlier.insert_rid_ == rid)
+        base = &earlier.insert_tuple_;
+      break;
+    case LogRecordType::MARKDELETE:
+      if (earlier.delete_rid_ == rid)
+        base = &earlier.delete_tuple_;
+      break;
+    case LogRecordType::UPDATE:
+      if (earlier.update_rid_ == rid)
+        deltas.push_back(std::move(earlier.update_delta_));
+      break;
+    default:
+      break;
+    }
+    if (base != nullptr)
+      image.assign(base->GetData(), base->GetData() + base->GetLength());
+  }
+  if (image.empty())
+    return false;
+  for (auto delta = deltas.rbegin(); delta != deltas.rend(); ++delta) {
+    std::vector<char> next;
+    if (!ApplyTupleDelta(delta->data(), delta->size(), image.data(),
+                         image.size(), true, next))
+      return false;
+    image.swap(next);
+  }
+  MakeTuple(image.data(), image.size(), tuple);
+  return true;
+}
+
+/*
+ * The record at offset of the log file
+ */
+bool LogRecovery::ReadLogRecord(int64_t offset, LogRecord &log_record) {
+  return disk_manager_->ReadLog(log_buffer_, LOG_BUFFER_SIZE, offset) &&
+         DeserializeLogRecord(log_buffer_, log_record);
+}
+
+/*
+ * The transaction committed or aborted, nothing of it is undone
+ */
+void LogRecovery::EndTransaction(txn_id_t txn_id) {
+  auto lsns = txn_lsns_.find(txn_id);
+  if (lsns != txn_lsns_.end()) {
+    for (lsn_t lsn : lsns->second)
+      lsn_mapping_.erase(lsn);
+    txn_lsns_.erase(lsns);
+  }
+  active_txn_.erase(txn_id);
+}
+
+/*
+ * Every other worker holds at most one page, one of them is unpinned soon
+ * when the buffer pool is full
+ */
+Page *LogRecovery::FetchPage(page_id_t page_id) {
+  Page *page;
+  while ((page = buffer_pool_manager_->FetchPage(page_id)) == nullptr)
+    std::this_thread::yield();
+  return page;
+}
 
 } // namespace cmudb
@@ -0,0 +1,218 @@
+/**
+ * standby.cpp
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logging/standby.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+// bytes of the primary's log read at once, room for the longest record
+static const int STANDBY_READ_SIZE = 64 * 1024;
+
+/*
+ * Replay starts where the master record of the standby points to: the
+ * checkpoint of the copy, or the last restart point. The log of a standby
+ * without one is read from its start
+ */
+Standby::Standby(const std::string &primary_db_file, DiskManager *disk_manager,
+                 BufferPoolManager *buffer_pool_manager,
+                 LogManager *log_manager)
+    : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager),
+      log_recovery_(disk_manager, buffer_pool_manager, log_manager),
+      primary_log_name_(DiskManager::GetLogName(primary_db_file)),
+      control_fd_(-1), segment_(-1), segment_fd_(-1), offset_(0),
+      next_lsn_(0), broken_(false), buffer_(STANDBY_READ_SIZE),
+      running_(false), replay_thread_(nullptr) {
+  static_assert(STANDBY_READ_SIZE >= LOG_BUFFER_SIZE, "a record must fit");
+  log_recovery_.SetRedoThreads(1);
+  auto header_page =
+      static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr)
+    return;
+  lsn_t checkpoint_lsn, start_lsn;
+  int64_t start_offset;
+  if (header_page->GetCheckpoint(checkpoint_lsn, start_lsn, start_offset) &&
+      start_offset >= 0) {
+    offset_ = start_offset;
+    next_lsn_ = start_lsn;
+  }
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+}
+
+Standby::~Standby() {
+  StopReplayThread();
+  if (segment_fd_ >= 0)
+    close(segment_fd_);
+  if (control_fd_ >= 0)
+    close(control_fd_);
+}
+
+/*
+ * Records are applied up to the durable end the primary published, while
+ * they follow the last one and their checksums match
+ */
+int Standby::Replay() {
+  std::lock_guard<std::mutex> lock(replay_latch_);
+  if (broken_)
+    return -1;
+  int applied = 0;
+  while (true) {
+    int available = ReadPrimaryLog(buffer_.data(), buffer_.size(), offset_);
+    if (available < 0) {
+      LOG_DEBUG("standby fell behind the primary's log");
+      broken_ = true;
+      return -1;
+    }
+    const char *data = buffer_.data();
+    int pos = 0;
+    while (pos < available) {
+      const char *cursor = data + pos;
+      uint64_t size;
+      if (!GetVarint(cursor, data + available, size) ||
+          size > static_cast<uint64_t>(available - pos))
+        break;
+      LogRecord log_record;
+      if (!log_recovery_.DeserializeLogRecord(data + pos, log_record) ||
+          log_record.GetLSN() != next_lsn_)
+        break;
+      try {
+        log_recovery_.RedoRecord(log_record, 0);
+      } catch (Exception &e) {
+        LOG_DEBUG("standby can't replay record %d", next_lsn_.load());
+        offset_ += pos;
+        broken_ = true;
+        return -1;
+      }
+      next_lsn_++;
+      pos += size;
+      applied++;
+    }
+    if (pos == 0)
+      break;
+    offset_ += pos;
+  }
+  return applied;
+}
+
+/*
+ * Nothing is applied meanwhile: with every page written, replay resumes at
+ * the next record
+ */
+void Standby::Restartpoint() {
+  std::lock_guard<std::mutex> lock(replay_latch_);
+  if (!buffer_pool_manager_->FlushAllPages()) {
+    LOG_DEBUG("can't write pages for restart point");
+    return;
+  }
+  auto header_page =
+      static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr) {
+    LOG_DEBUG("can't fetch header page for restart point");
+    return;
+  }
+  header_page->WLatch();
+  header_page->SetCheckpoint(next_lsn_ - 1, next_lsn_, offset_);
+  header_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+  buffer_pool_manager_->FlushPage(HEADER_PAGE_ID);
+  if (!disk_manager_->Sync()) {
+    LOG_DEBUG("can't sync restart point");
+  }
+}
+
+void Standby::RunReplayThread(std::chrono::milliseconds poll_interval) {
+  std::lock_guard<std::mutex> lock(latch_);
+  if (running_)
+    return;
+  running_ = true;
+  replay_thread_ = new std::thread(&Standby::ReplayThread, this, poll_interval);
+}
+
+void Standby::StopReplayThread() {
+  {
+    std::lock_guard<std::mutex> lock(latch_);
+    if (!running_)
+      return;
+    running_ = false;
+  }
+  cv_.notify_all();
+  replay_thread_->join();
+  delete replay_thread_;
+  replay_thread_ = nullptr;
+  Restartpoint();
+}
+
+void Standby::ReplayThread(std::chrono::milliseconds poll_interval) {
+  auto restartpoint = std::chrono::steady_clock::now() + CHECKPOINT_TIMEOUT;
+  std::unique_lock<std::mutex> lock(latch_);
+  while (running_) {
+    lock.unlock();
+    Replay();
+    if (std::chrono::steady_clock::now() >= restartpoint) {
+      Restartpoint();
+      restartpoint = std::chrono::steady_clock::now() + CHECKPOINT_TIMEOUT;
+    }
+    lock.lock();
+    cv_.wait_for(lock, poll_interval, [this] { return !running_; });
+  }
+}
+
+/*
+ * Read the primary's log at offset as DiskManager::ReadLog would, up to the
+ * durable end in the control file. The control file is read again after the
+ * data: if the segments read are still in use then, the primary did not
+ * recycle them while they were read
+ * @return: bytes read, -1 if the log at offset is discarded
+ */
+int Standby::ReadPrimaryLog(char *data, int size, int64_t offset) {
+  if (control_fd_ < 0) {
+    control_fd_ = open(primary_log_name_.c_str(), O_RDONLY);
+    if (control_fd_ < 0)
+      return 0;
+  }
+  int64_t durable_end;
+  // a log being created
+  if (DiskManager::ReadLogControl(control_fd_, durable_end) < 0)
+    return 0;
+  size = std::max<int64_t>(0, std::min<int64_t>(size, durable_end - offset));
+  int read_count = 0;
+  while (read_count < size) {
+    int64_t position = offset + read_count;
+    if (position / LOG_SEGMENT_SIZE != segment_) {
+      if (segment_fd_ >= 0)
+        close(segment_fd_);
+      segment_ = position / LOG_SEGMENT_SIZE;
+      segment_fd_ = open(
+          DiskManager::GetLogSegmentName(primary_log_name_, segment_).c_str(),
+          O_RDONLY);
+      if (segment_fd_ < 0) {
+        segment_ = -1;
+        break;
+      }
+    }
+    ssize_t rc = pread(segment_fd_, data + read_count,
+                       std::min<int64_t>(size - read_count,
+                                         LOG_SEGMENT_SIZE -
+                                             position % LOG_SEGMENT_SIZE),
+                       position % LOG_SEGMENT_SIZE);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    // a segment being created is shorter
+    if (rc <= 0)
+      break;
+    read_count += rc;
+  }
+  int64_t first = DiskManager::ReadLogControl(control_fd_, durable_end);
+  if (first > offset / LOG_SEGMENT_SIZE)
+    return -1;
+  // a log being created
+  return first < 0 ? 0 : read_count;
+}
+
+} // namespace cmudb
@@ -23,7 +23,7 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id,
   SetPageId(page_id);
   SetParentPageId(parent_id);
   SetSize(1);
-  int size = (PAGE_SIZE - sizeof(BPlusTreeInternalPage)) /
+  int size = (PAGE_USABLE_SIZE - sizeof(BPlusTreeInternalPage)) /
             (sizeof(KeyType) + sizeof(ValueType));
   SetMaxSize(size);
 }
@@ -137,7 +137,7 @@ int B_PLUS_TREE_INTERNAL_PAGE_TYPE::InsertNodeAfter(
     const ValueType &new_value) {
   for (int i = 0; i < GetSize(); i++) {           //easier way: scan from back to front
     if (array[i].second == old_value) {
-      for (int j = GetSize(); j > i; j--) {
+      for (int j = GetSize() - 1; j > i; j--) {
         array[j+1] = array[j];
       }
       array[i+1] = {new_key, new_value};
@@ -195,8 +195,8 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Remove(int index) {
-  for (int i = GetSize() - 1; i > index; --i) {
-    array[i - 1] = array[i];
+  for (int i = index; i < GetSize() - 1; ++i) {
+    array[i] = array[i + 1];
   }
   IncreaseSize(-1);
 }
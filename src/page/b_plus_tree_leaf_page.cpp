@@ -18,15 +18,20 @@ namespace cmudb {
 /**
  * Init method after creating a new leaf page
  * Including set page type, set current size to zero, set page id/parent id, set
- * next page id and set max size
+ * next/prev page id and set max size
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id) {
+  // entries are logged by their slot, see logging/index_log.h
+  static_assert(sizeof(BPlusTreeLeafPage) == LEAF_PAGE_HEADER_SIZE,
+                "leaf header layout");
   SetPageType(IndexPageType::LEAF_PAGE);
   SetPageId(page_id);
   SetParentPageId(parent_id);
+  SetNextPageId(INVALID_PAGE_ID);
+  SetPrevPageId(INVALID_PAGE_ID);
   SetSize(0);
-  int size = (PAGE_SIZE - sizeof(BPlusTreeLeafPage)) /
+  int size = (PAGE_USABLE_SIZE - sizeof(BPlusTreeLeafPage)) /
             (sizeof(KeyType) + sizeof(ValueType));
   SetMaxSize(size);
 }
@@ -44,6 +49,19 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::SetNextPageId(page_id_t next_page_id) {
   next_page_id_ = next_page_id;
 }
 
+/**
+ * Helper methods to set/get prev page id
+ */
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t B_PLUS_TREE_LEAF_PAGE_TYPE::GetPrevPageId() const {
+  return prev_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetPrevPageId(page_id_t prev_page_id) {
+  prev_page_id_ = prev_page_id;
+}
+
 /**
  * Helper method to find the first index i so that array[i].first >= key
  * NOTE: This method is only used when generating index iterator
@@ -52,7 +70,7 @@ INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::KeyIndex(
     const KeyType &key, const KeyComparator &comparator) const {
   for (int i = 0; i < GetSize(); ++i) {
-    if (comparator(array[i].first, key) > 0) {
+    if (comparator(array[i].first, key) >= 0) {
       return i;
     }
   }
@@ -75,6 +93,12 @@ ValueType B_PLUS_TREE_LEAF_PAGE_TYPE::ValueAt(int index) const {
   return array[index].second;
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_LEAF_PAGE_TYPE::SetValueAt(int index, const ValueType &value) {
+  assert(0 <= index && index < GetSize());
+  array[index].second = value;
+}
+
 /*
  * Helper method to find and return the key & value pair associated with input
  * "index"(a.k.a array offset)
@@ -226,13 +250,26 @@ int B_PLUS_TREE_LEAF_PAGE_TYPE::RemoveAndDeleteRecord(
  *****************************************************************************/
 /*
  * Remove all of key & value pairs from this page to "recipient" page, then
- * update next page id
+ * update next page id (and the prev page id of the page after this one, so
+ * the sibling chain skips this page in both directions)
  */
 INDEX_TEMPLATE_ARGUMENTS
-void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveAllTo(BPlusTreeLeafPage *recipient,
-                                           int, BufferPoolManager *) {
+void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveAllTo(
+    BPlusTreeLeafPage *recipient, int,
+    BufferPoolManager *buffer_pool_manager) {
   recipient->CopyAllFrom(array, GetSize());
   recipient->SetNextPageId(GetNextPageId());
+
+  if (GetNextPageId() != INVALID_PAGE_ID) {
+    auto *page = buffer_pool_manager->FetchPage(GetNextPageId());
+    if (page == nullptr) {
+      throw Exception(EXCEPTION_TYPE_INDEX,
+                      "all page are pinned while MoveAllTo");
+    }
+    auto next_leaf = reinterpret_cast<BPlusTreeLeafPage *>(page->GetData());
+    next_leaf->SetPrevPageId(recipient->GetPageId());
+    buffer_pool_manager->UnpinPage(next_leaf->GetPageId(), true);
+  }
 }
 
 INDEX_TEMPLATE_ARGUMENTS
@@ -272,7 +309,7 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::MoveFirstToEndOf(
                                              KeyComparator> *>(page->GetData());
 
   
-  parent->SetKeyAt(parent->ValueIndex(GetPageId()), pair.first);
+  parent->SetKeyAt(parent->ValueIndex(GetPageId()), array[0].first);
 
   buffer_pool_manager->UnpinPage(GetParentPageId(), true);
 }
@@ -4,9 +4,14 @@
 #include <cassert>
 #include <iostream>
 
+#include "buffer/buffer_pool_manager.h"
+#include "logging/index_log.h"
 #include "page/header_page.h"
 
 namespace cmudb {
+static constexpr int RECORDS_OFFSET = 12;
+static constexpr int MASTER_RECORD_OFFSET = PAGE_USABLE_SIZE - 24;
+static constexpr uint32_t MASTER_RECORD_MAGIC = 0x43484b50;
 
 /**
  * Record related
@@ -17,10 +22,13 @@ bool HeaderPage::InsertRecord(const std::string &name,
   assert(root_id > INVALID_PAGE_ID);
 
   int record_num = GetRecordCount();
-  int offset = 4 + record_num * 36;
+  int offset = RECORDS_OFFSET + record_num * 36;
   // check for duplicate name
   if (FindRecord(name) != -1)
     return false;
+  // records stop before the master record
+  if (offset + 36 > MASTER_RECORD_OFFSET)
+    return false;
   // copy record content
   memcpy(GetData() + offset, name.c_str(), (name.length() + 1));
   memcpy((GetData() + offset + 32), &root_id, 4);
@@ -37,7 +45,7 @@ bool HeaderPage::DeleteRecord(const std::string &name) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
+  int offset = RECORDS_OFFSET + index * 36;
   memmove(GetData() + offset, GetData() + offset + 36,
           (record_num - index - 1) * 36);
 
@@ -53,7 +61,7 @@ bool HeaderPage::UpdateRecord(const std::string &name,
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = index * 36 + 4;
+  int offset = RECORDS_OFFSET + index * 36;
   // update record content, only root_id
   memcpy((GetData() + offset + 32), &root_id, 4);
 
@@ -67,12 +75,129 @@ bool HeaderPage::GetRootId(const std::string &name, page_id_t &root_id) {
   // record does not exsit
   if (index == -1)
     return false;
-  int offset = (index + 1) * 36;
+  int offset = RECORDS_OFFSET + index * 36 + 32;
   root_id = *reinterpret_cast<page_id_t *>(GetData() + offset);
 
   return true;
 }
 
+/**
+ * Records through the chain
+ */
+bool HeaderPage::InsertRecord(BufferPoolManager *buffer_pool_manager,
+                              const std::string &name,
+                              const page_id_t root_id) {
+  page_id_t old_root_id;
+  if (GetRootId(buffer_pool_manager, name, old_root_id))
+    return false;
+  if (VisitPages(buffer_pool_manager, [&](HeaderPage *page, bool &dirty) {
+        return dirty = page->InsertRecord(name, root_id);
+      }))
+    return true;
+  // every page is full, a new one goes at the end of the chain
+  IndexLog::Pause pause;
+  page_id_t page_id;
+  auto new_page =
+      static_cast<HeaderPage *>(buffer_pool_manager->NewPage(page_id));
+  if (new_page == nullptr)
+    return false;
+  new_page->Init();
+  new_page->InsertRecord(name, root_id);
+  buffer_pool_manager->UnpinPage(page_id, true);
+  return VisitPages(buffer_pool_manager, [&](HeaderPage *page, bool &dirty) {
+    if (page->GetNextPageId() > HEADER_PAGE_ID)
+      return false;
+    page->SetNextPageId(page_id);
+    return dirty = true;
+  });
+}
+
+bool HeaderPage::DeleteRecord(BufferPoolManager *buffer_pool_manager,
+                              const std::string &name) {
+  return VisitPages(buffer_pool_manager, [&](HeaderPage *page, bool &dirty) {
+    return dirty = page->GetRecordCount() > 0 && page->DeleteRecord(name);
+  });
+}
+
+bool HeaderPage::UpdateRecord(BufferPoolManager *buffer_pool_manager,
+                              const std::string &name,
+                              const page_id_t root_id) {
+  return VisitPages(buffer_pool_manager, [&](HeaderPage *page, bool &dirty) {
+    return dirty = page->UpdateRecord(name, root_id);
+  });
+}
+
+bool HeaderPage::GetRootId(BufferPoolManager *buffer_pool_manager,
+                           const std::string &name, page_id_t &root_id) {
+  return VisitPages(buffer_pool_manager, [&](HeaderPage *page, bool &dirty) {
+    return page->GetRootId(name, root_id);
+  });
+}
+
+/*
+ * The chained pages are logged by INDEXROOT along with the header page, a
+ * structure modification going on must not log them as its own
+ */
+bool HeaderPage::VisitPages(
+    BufferPoolManager *buffer_pool_manager,
+    const std::function<bool(HeaderPage *, bool &)> &visit) {
+  bool dirty = false;
+  if (visit(this, dirty))
+    return true;
+  IndexLog::Pause pause;
+  page_id_t page_id = GetNextPageId();
+  // a chained page never written reads back as zeros and ends the chain
+  while (page_id > HEADER_PAGE_ID) {
+    auto page =
+        static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(page_id));
+    if (page == nullptr)
+      return false;
+    dirty = false;
+    bool done = visit(page, dirty);
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager->UnpinPage(page_id, dirty);
+    if (done)
+      return true;
+    page_id = next_page_id;
+  }
+  return false;
+}
+
+/**
+ * Master record
+ */
+void HeaderPage::SetCheckpoint(lsn_t checkpoint_lsn, lsn_t start_lsn,
+                               int64_t start_offset) {
+  char *data = GetData() + MASTER_RECORD_OFFSET;
+  memcpy(data, &MASTER_RECORD_MAGIC, 4);
+  memcpy(data + 4, &checkpoint_lsn, 4);
+  memcpy(data + 8, &start_lsn, 4);
+  memcpy(data + 16, &start_offset, 8);
+}
+
+bool HeaderPage::GetCheckpoint(lsn_t &checkpoint_lsn, lsn_t &start_lsn,
+                               int64_t &start_offset) {
+  char *data = GetData() + MASTER_RECORD_OFFSET;
+  uint32_t magic;
+  memcpy(&magic, data, 4);
+  if (magic != MASTER_RECORD_MAGIC)
+    return false;
+  memcpy(&checkpoint_lsn, data + 4, 4);
+  memcpy(&start_lsn, data + 8, 4);
+  memcpy(&start_offset, data + 16, 8);
+  return true;
+}
+
+void HeaderPage::SetFormatVersion(uint32_t version) {
+  memcpy(GetData() + MASTER_RECORD_OFFSET + 12, &version, 4);
+}
+
+uint32_t HeaderPage::GetFormatVersion() {
+  uint32_t version;
+  memcpy(&version, GetData() + MASTER_RECORD_OFFSET + 12, 4);
+  return version;
+}
+
 /**
  * helper functions
  */
@@ -83,11 +208,21 @@ void HeaderPage::SetRecordCount(int record_count) {
   memcpy(GetData(), &record_count, 4);
 }
 
+// next page of the chain
+page_id_t HeaderPage::GetNextPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData() + 8);
+}
+
+void HeaderPage::SetNextPageId(page_id_t next_page_id) {
+  memcpy(GetData() + 8, &next_page_id, 4);
+}
+
 int HeaderPage::FindRecord(const std::string &name) {
   int record_num = GetRecordCount();
 
   for (int i = 0; i < record_num; i++) {
-    char *raw_name = reinterpret_cast<char *>(GetData() + (4 + i * 36));
+    char *raw_name =
+        reinterpret_cast<char *>(GetData() + RECORDS_OFFSET + i * 36);
     if (strcmp(raw_name, name.c_str()) == 0)
       return i;
   }
@@ -0,0 +1,111 @@
+/**
+ * posting_page.cpp
+ */
+
+#include <cassert>
+
+#include "page/posting_page.h"
+
+namespace cmudb {
+/**
+ * Header related
+ */
+void PostingPage::Init(page_id_t page_id, page_id_t prev_page_id) {
+  memcpy(GetData(), &page_id, 4); // set page_id
+  SetPrevPageId(prev_page_id);
+  SetNextPageId(INVALID_PAGE_ID);
+  SetCount(0);
+}
+
+page_id_t PostingPage::GetPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData());
+}
+
+page_id_t PostingPage::GetPrevPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData() + 8);
+}
+
+page_id_t PostingPage::GetNextPageId() {
+  return *reinterpret_cast<page_id_t *>(GetData() + 12);
+}
+
+void PostingPage::SetPrevPageId(page_id_t prev_page_id) {
+  memcpy(GetData() + 8, &prev_page_id, 4);
+}
+
+void PostingPage::SetNextPageId(page_id_t next_page_id) {
+  memcpy(GetData() + 12, &next_page_id, 4);
+}
+
+int PostingPage::GetCount() {
+  return *reinterpret_cast<int *>(GetData() + 16);
+}
+
+void PostingPage::SetCount(int count) { memcpy(GetData() + 16, &count, 4); }
+
+int PostingPage::GetMaxCount() {
+  return (PAGE_USABLE_SIZE - HEADER_SIZE) / sizeof(int64_t);
+}
+
+int64_t *PostingPage::Array() {
+  return reinterpret_cast<int64_t *>(GetData() + HEADER_SIZE);
+}
+
+RID PostingPage::GetRID(int index) {
+  assert(0 <= index && index < GetCount());
+  return RID(Array()[index]);
+}
+
+/**
+ * RID related
+ */
+int PostingPage::RIDIndex(const RID &rid) {
+  int low = 0, high = GetCount();
+  int64_t *array = Array();
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (array[mid] < rid.Get())
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+bool PostingPage::Insert(const RID &rid) {
+  int count = GetCount();
+  if (count == GetMaxCount())
+    return false;
+  int index = RIDIndex(rid);
+  int64_t *array = Array();
+  if (index < count && array[index] == rid.Get())
+    return false;
+  memmove(array + index + 1, array + index,
+          (count - index) * sizeof(int64_t));
+  array[index] = rid.Get();
+  SetCount(count + 1);
+  return true;
+}
+
+bool PostingPage::Remove(const RID &rid) {
+  int count = GetCount();
+  int index = RIDIndex(rid);
+  int64_t *array = Array();
+  if (index == count || array[index] != rid.Get())
+    return false;
+  memmove(array + index, array + index + 1,
+          (count - index - 1) * sizeof(int64_t));
+  SetCount(count - 1);
+  return true;
+}
+
+void PostingPage::MoveHalfTo(PostingPage *recipient) {
+  assert(recipient->GetCount() == 0);
+  int count = GetCount();
+  int half = count / 2;
+  memcpy(recipient->Array(), Array() + count - half, half * sizeof(int64_t));
+  recipient->SetCount(half);
+  SetCount(count - half);
+}
+
+} // namespace cmudb
@@ -3,6 +3,7 @@
  */
 
 #include <cassert>
+#include <cstdlib>
 
 #include "page/table_page.h"
 
@@ -15,7 +16,11 @@ void TablePage::Init(page_id_t page_id, size_t page_size,
                      Transaction *txn) {
   memcpy(GetData(), &page_id, 4); // set page_id
   if (ENABLE_LOGGING) {
-    // TODO: add your logging logic here
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::NEWPAGE, prev_page_id, page_id);
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
   }
   SetPrevPageId(prev_page_id);
   SetNextPageId(INVALID_PAGE_ID);
@@ -87,7 +92,11 @@ bool TablePage::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
   if (ENABLE_LOGGING) {
     // acquire the exclusive lock
     assert(lock_manager->LockExclusive(txn, rid.Get()));
-    // TODO: add your logging logic here
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::INSERT, rid, tuple);
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
   }
   // LOG_DEBUG("Tuple inserted");
   return true;
@@ -128,7 +137,13 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn,
                !lock_manager->LockExclusive(txn, rid)) { // no shared lock
       return false;
     }
-    // TODO: add your logging logic here
+    Tuple delete_tuple;
+    CopyTuple(slot_num, rid, delete_tuple);
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::MARKDELETE, rid, delete_tuple);
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
   }
 
   // set tuple size to negative value
@@ -182,7 +197,11 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple &old_tuple,
                !lock_manager->LockExclusive(txn, rid)) { // no shared lock
       return false;
     }
-    // TODO: add your logging logic here
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
   }
 
   // update
@@ -222,19 +241,16 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn,
     tuple_size = -tuple_size;
   } // else: rollback insert op
 
-  // copy out delete value, for undo purpose
-  Tuple delete_tuple;
-  delete_tuple.size_ = tuple_size;
-  delete_tuple.data_ = new char[delete_tuple.size_];
-  memcpy(delete_tuple.data_, GetData() + tuple_offset, delete_tuple.size_);
-  delete_tuple.rid_ = rid;
-  delete_tuple.allocated_ = true;
-
   if (ENABLE_LOGGING) {
     // must already grab the exclusive lock
     assert(txn->GetExclusiveLockSet()->find(rid) !=
            txn->GetExclusiveLockSet()->end());
-    // TODO: add your logging logic here
+    // the tuple is not logged, undo rebuilds it from earlier records
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::APPLYDELETE, rid, Tuple());
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
   }
 
   int32_t free_space_pointer =
@@ -265,19 +281,52 @@ void TablePage::RollbackDelete(const RID &rid, Transaction *txn,
     // must have already grab the exclusive lock
     assert(txn->GetExclusiveLockSet()->find(rid) !=
            txn->GetExclusiveLockSet()->end());
-
-    // TODO: add your logging logic here
   }
 
   int slot_num = rid.GetSlotNum();
   assert(slot_num < GetTupleCount());
   int32_t tuple_size = GetTupleSize(slot_num);
+  if (ENABLE_LOGGING) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(),
+                         LogRecordType::ROLLBACKDELETE, rid, Tuple());
+    lsn_t lsn = log_manager->AppendLogRecord(log_record);
+    txn->SetPrevLSN(lsn);
+    SetLSN(lsn);
+  }
 
   // set tuple size to positive value
   if (tuple_size < 0)
     SetTupleSize(slot_num, -tuple_size);
 }
 
+/*
+ * Redo of an insert and undo of an applied delete need the tuple in the slot
+ * it was logged with, not the first free one. Slots between the tuple count
+ * and the slot are created empty. Nothing is logged
+ */
+bool TablePage::InsertTupleAt(const Tuple &tuple, const RID &rid) {
+  assert(tuple.size_ > 0);
+  int slot_num = rid.GetSlotNum();
+  int32_t tuple_count = GetTupleCount();
+  if (slot_num < tuple_count && GetTupleSize(slot_num) != 0)
+    return false; // slot taken
+  int32_t new_slots = slot_num < tuple_count ? 0 : slot_num + 1 - tuple_count;
+  if (GetFreeSpaceSize() < tuple.size_ + 8 * new_slots)
+    return false; // not enough space
+
+  for (int i = tuple_count; i < slot_num; ++i) {
+    SetTupleOffset(i, 0);
+    SetTupleSize(i, 0);
+  }
+  SetFreeSpacePointer(GetFreeSpacePointer() - tuple.size_);
+  memcpy(GetData() + GetFreeSpacePointer(), tuple.data_, tuple.size_);
+  SetTupleOffset(slot_num, GetFreeSpacePointer());
+  SetTupleSize(slot_num, tuple.size_);
+  if (new_slots > 0)
+    SetTupleCount(slot_num + 1);
+  return true;
+}
+
 bool TablePage::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
                          LockManager *lock_manager) {
   int slot_num = rid.GetSlotNum();
@@ -314,6 +363,19 @@ bool TablePage::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
   return true;
 }
 
+/*
+ * Copy of the tuple in a slot, also while it is marked deleted, for the log
+ */
+void TablePage::CopyTuple(int slot_num, const RID &rid, Tuple &tuple) {
+  tuple.size_ = std::abs(GetTupleSize(slot_num));
+  if (tuple.allocated_)
+    delete[] tuple.data_;
+  tuple.data_ = new char[tuple.size_];
+  memcpy(tuple.data_, GetData() + GetTupleOffset(slot_num), tuple.size_);
+  tuple.rid_ = rid;
+  tuple.allocated_ = true;
+}
+
 /**
  * Tuple iterator
  */
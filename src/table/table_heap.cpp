@@ -19,22 +19,24 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
 // create table
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
                      LockManager *lock_manager, LogManager *log_manager,
-                     Transaction *txn)
+                     Transaction *txn, page_id_t hint)
     : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager),
       log_manager_(log_manager) {
-  auto first_page =
-      static_cast<TablePage *>(buffer_pool_manager_->NewPage(first_page_id_));
+  auto first_page = static_cast<TablePage *>(
+      buffer_pool_manager_->NewPage(first_page_id_, hint));
   assert(first_page != nullptr); // todo: abort table creation?
   first_page->WLatch();
   LOG_DEBUG("new table page created %d", first_page_id_);
 
-  first_page->Init(first_page_id_, PAGE_SIZE, INVALID_LSN, log_manager_, txn);
+  first_page->Init(first_page_id_, PAGE_USABLE_SIZE, INVALID_LSN, log_manager_,
+                   txn);
   first_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(first_page_id_, true);
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
-  if (tuple.size_ + 32 > PAGE_SIZE) { // larger than one page size
+  if (tuple.size_ + 32 > PAGE_USABLE_SIZE || // larger than one page size
+      buffer_pool_manager_->IsReadOnly()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
@@ -59,7 +61,8 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
       cur_page->WLatch();
     } else { // create new page
       auto new_page =
-          static_cast<TablePage *>(buffer_pool_manager_->NewPage(next_page_id));
+          static_cast<TablePage *>(buffer_pool_manager_->NewPage(
+              next_page_id, cur_page->GetPageId()));
       if (new_page == nullptr) {
         cur_page->WUnlatch();
         buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), false);
@@ -70,7 +73,7 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
       // std::cout << "new table page " << next_page_id << " created" <<
       // std::endl;
       cur_page->SetNextPageId(next_page_id);
-      new_page->Init(next_page_id, PAGE_SIZE, cur_page->GetPageId(),
+      new_page->Init(next_page_id, PAGE_USABLE_SIZE, cur_page->GetPageId(),
                      log_manager_, txn);
       cur_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
@@ -85,6 +88,10 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
   // todo: remove empty page
+  if (buffer_pool_manager_->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
@@ -101,6 +108,10 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
 
 bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid,
                             Transaction *txn) {
+  if (buffer_pool_manager_->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
@@ -154,8 +165,22 @@ bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
   return res;
 }
 
+/*
+ * Free every page of the heap, walking the page chain from the first page.
+ * Return false if a page could not be fetched or is still pinned
+ */
 bool TableHeap::DeleteTableHeap() {
-  // todo: real delete
+  while (first_page_id_ != INVALID_PAGE_ID) {
+    auto page = static_cast<TablePage *>(
+        buffer_pool_manager_->FetchPage(first_page_id_));
+    if (page == nullptr)
+      return false;
+    page_id_t next_page_id = page->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(first_page_id_, false);
+    if (!buffer_pool_manager_->DeletePage(first_page_id_))
+      return false;
+    first_page_id_ = next_page_id;
+  }
   return true;
 }
 
@@ -0,0 +1,595 @@
+/**
+ * log_inspect.cpp
+ * Reads the log of a database and reports where its volume comes from:
+ * records and bytes per record type, per transaction and per page, the bytes
+ * written along the log, and the largest records. The database and its log
+ * are only read.
+ *
+ * usage: log_inspect [options] <db file>
+ *   --offset <n>   start at log offset n, a record boundary
+ *   --all          start at the oldest log kept
+ *   --top <n>      rows of the transaction, page and largest record tables
+ *   --slices <n>   parts of the log in the volume table
+ *   --dump         print every record
+ *   --replay       time the redo of the log into a scratch copy
+ *   --threads <n>  redo workers of --replay
+ *
+ * By default the log is read from the checkpoint recovery would start at, or
+ * from offset 0 without one. Records carry no time: the volume table cuts the
+ * log by offset, and counts the commits of each part, so bytes per commit
+ * show how the load changed along the log. Reading stops at the first record
+ * recovery would stop at.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "disk/disk_manager.h"
+#include "logging/log_recovery.h"
+#include "page/header_page.h"
+
+using namespace cmudb;
+
+namespace {
+
+// bytes of log read at once, room for the longest record
+const int READ_SIZE = 64 * 1024;
+const int NUM_TYPES = static_cast<int>(LogRecordType::INDEXEND) + 1;
+
+struct Options {
+  std::string db_file;
+  int64_t offset = -1;
+  bool all = false;
+  size_t top = 10;
+  int slices = 10;
+  bool dump = false;
+  bool replay = false;
+  int threads = 0;
+};
+
+struct Tally {
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  int32_t largest = 0;
+
+  void Add(int32_t size) {
+    records++;
+    bytes += size;
+    largest = std::max(largest, size);
+  }
+};
+
+struct TxnTally {
+  Tally tally;
+  lsn_t first_lsn = INVALID_LSN;
+  lsn_t last_lsn = INVALID_LSN;
+  const char *outcome = "running";
+};
+
+// what is kept of each record for the tables built after the scan
+struct RecordInfo {
+  int64_t offset;
+  lsn_t lsn;
+  txn_id_t txn_id;
+  page_id_t page_id;
+  int32_t size;
+  LogRecordType type;
+};
+
+/*
+ * The log of a database as DiskManager::ReadLog sees it, read through the
+ * segment files directly so nothing is created or opened for writing
+ */
+class LogReader {
+public:
+  explicit LogReader(const std::string &db_file)
+      : log_name_(DiskManager::GetLogName(db_file)), segment_(-1),
+        segment_fd_(-1) {}
+
+  ~LogReader() {
+    if (segment_fd_ >= 0)
+      close(segment_fd_);
+  }
+
+  // first segment in use, -1 without a log
+  int64_t FirstSegment() {
+    int fd = open(log_name_.c_str(), O_RDONLY);
+    if (fd < 0)
+      return -1;
+    int64_t first = DiskManager::ReadLogControl(fd);
+    close(fd);
+    return first;
+  }
+
+  // bytes read at offset, fewer at the end of the last segment
+  int Read(char *data, int size, int64_t offset) {
+    int read_count = 0;
+    while (read_count < size) {
+      int64_t position = offset + read_count;
+      if (position / LOG_SEGMENT_SIZE != segment_) {
+        if (segment_fd_ >= 0)
+          close(segment_fd_);
+        segment_ = position / LOG_SEGMENT_SIZE;
+        segment_fd_ = open(
+            DiskManager::GetLogSegmentName(log_name_, segment_).c_str(),
+            O_RDONLY);
+        if (segment_fd_ < 0) {
+          segment_ = -1;
+          break;
+        }
+      }
+      ssize_t rc = pread(segment_fd_, data + read_count,
+                         std::min<int64_t>(size - read_count,
+                                           LOG_SEGMENT_SIZE -
+                                               position % LOG_SEGMENT_SIZE),
+                         position % LOG_SEGMENT_SIZE);
+      if (rc <= 0)
+        break;
+      read_count += rc;
+    }
+    return read_count;
+  }
+
+  inline const std::string &GetLogName() const { return log_name_; }
+
+private:
+  std::string log_name_;
+  int64_t segment_;
+  int segment_fd_;
+};
+
+void Usage() {
+  fprintf(stderr,
+          "usage: log_inspect [options] <db file>\n"
+          "  --offset <n>   start at log offset n, a record boundary\n"
+          "  --all          start at the oldest log kept\n"
+          "  --top <n>      rows of the per transaction, per page and largest\n"
+          "                 record tables (default 10)\n"
+          "  --slices <n>   parts of the log in the volume table (default 10)\n"
+          "  --dump         print every record\n"
+          "  --replay       time the redo of the log into a scratch copy\n"
+          "  --threads <n>  redo workers of --replay\n");
+}
+
+bool ParseNumber(const char *text, int64_t &number) {
+  char *end;
+  errno = 0;
+  number = strtoll(text, &end, 10);
+  return errno == 0 && end != text && *end == '\0' && number >= 0;
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    int64_t number = 0;
+    bool has_value = arg == "--offset" || arg == "--top" ||
+                     arg == "--slices" || arg == "--threads";
+    if (has_value && (i + 1 == argc || !ParseNumber(argv[++i], number)))
+      return false;
+    if (arg == "--offset")
+      options.offset = number;
+    else if (arg == "--top")
+      options.top = number;
+    else if (arg == "--slices")
+      options.slices = std::max<int64_t>(number, 1);
+    else if (arg == "--threads")
+      options.threads = number;
+    else if (arg == "--all")
+      options.all = true;
+    else if (arg == "--dump")
+      options.dump = true;
+    else if (arg == "--replay")
+      options.replay = true;
+    else if (arg.compare(0, 2, "--") == 0 || !options.db_file.empty())
+      return false;
+    else
+      options.db_file = arg;
+  }
+  return !options.db_file.empty();
+}
+
+/*
+ * Where recovery starts, from the master record in the header page
+ */
+bool ReadCheckpoint(const std::string &db_file, int64_t &offset, lsn_t &lsn) {
+  DiskManager disk_manager(db_file, IOMode::MMAP_READ_ONLY);
+  BufferPoolManager buffer_pool_manager(1, &disk_manager);
+  auto header_page = static_cast<HeaderPage *>(
+      buffer_pool_manager.FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr)
+    return false;
+  lsn_t checkpoint_lsn;
+  bool found = header_page->GetCheckpoint(checkpoint_lsn, lsn, offset) &&
+               offset >= 0;
+  buffer_pool_manager.UnpinPage(HEADER_PAGE_ID, false);
+  return found;
+}
+
+// page a record changes, INVALID_PAGE_ID for none
+page_id_t RecordPageId(LogRecord &log_record) {
+  switch (log_record.GetLogRecordType()) {
+  case LogRecordType::INSERT:
+    return log_record.GetInsertRID().GetPageId();
+  case LogRecordType::MARKDELETE:
+  case LogRecordType::APPLYDELETE:
+  case LogRecordType::ROLLBACKDELETE:
+    return log_record.GetDeleteRID().GetPageId();
+  case LogRecordType::UPDATE:
+    return log_record.GetUpdateRID().GetPageId();
+  case LogRecordType::NEWPAGE:
+  case LogRecordType::INDEXINSERT:
+  case LogRecordType::INDEXDELETE:
+  case LogRecordType::INDEXPAGE:
+  case LogRecordType::INDEXNEWPAGE:
+    return log_record.GetPageId();
+  case LogRecordType::INDEXROOT:
+    return HEADER_PAGE_ID;
+  default:
+    return INVALID_PAGE_ID;
+  }
+}
+
+/*
+ * The record at pos of data, false if there is none: a torn or stale record,
+ * or the zeros past the end of the log
+ */
+bool ParseRecord(LogRecovery &decoder, const char *data, int available,
+                 LogRecord &log_record) {
+  const char *cursor = data;
+  uint64_t size;
+  return GetVarint(cursor, data + available, size) &&
+         size <= static_cast<uint64_t>(available) &&
+         decoder.DeserializeLogRecord(data, log_record);
+}
+
+/*
+ * The oldest segment kept may begin inside a record: the first boundary is
+ * where two records follow each other
+ * @return: bytes to skip, -1 if no boundary is found
+ */
+int FindBoundary(LogRecovery &decoder, const char *data, int available) {
+  for (int skip = 0; skip < std::min(available, LOG_BUFFER_SIZE); skip++) {
+    LogRecord first, second;
+    if (!ParseRecord(decoder, data + skip, available - skip, first))
+      continue;
+    int next = skip + first.GetSize();
+    if (ParseRecord(decoder, data + next, available - next, second) &&
+        second.GetLSN() == first.GetLSN() + 1)
+      return skip;
+  }
+  return -1;
+}
+
+std::string PageName(page_id_t page_id) {
+  if (page_id == INVALID_PAGE_ID)
+    return "-";
+  if (page_id == HEADER_PAGE_ID)
+    return "0 (header)";
+  return std::to_string(page_id);
+}
+
+std::string TxnName(txn_id_t txn_id) {
+  return txn_id == INVALID_TXN_ID ? "-" : std::to_string(txn_id);
+}
+
+double Percent(uint64_t part, uint64_t total) {
+  return total == 0 ? 0 : 100.0 * part / total;
+}
+
+template <typename Key, typename Value, typename Bytes>
+std::vector<std::pair<Key, Value>>
+Largest(const std::unordered_map<Key, Value> &map, size_t top, Bytes bytes) {
+  std::vector<std::pair<Key, Value>> rows(map.begin(), map.end());
+  size_t count = std::min(top, rows.size());
+  std::partial_sort(rows.begin(), rows.begin() + count, rows.end(),
+                    [&](const std::pair<Key, Value> &a,
+                        const std::pair<Key, Value> &b) {
+                      return bytes(a.second) > bytes(b.second);
+                    });
+  rows.resize(count);
+  return rows;
+}
+
+/*
+ * Redo and undo of the log on copies of the database and log files, removed
+ * afterwards. Data files added to the database are not copied
+ */
+void Replay(const Options &options, LogReader &reader,
+            const std::vector<RecordInfo> &infos, int64_t start_offset) {
+  std::string stem = options.db_file.substr(0, options.db_file.find("."));
+  if (access((stem + ".files").c_str(), F_OK) == 0) {
+    printf("\nreplay: a database with added data files is not copied\n");
+    return;
+  }
+  std::string copy_file = stem + "-replay.db";
+  std::string copy_log = DiskManager::GetLogName(copy_file);
+  auto copy = [](const std::string &from, const std::string &to) {
+    std::ifstream in(from, std::ios::binary);
+    if (!in)
+      return false;
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    return true;
+  };
+  std::vector<std::string> copies{copy_file, copy_log};
+  copy(options.db_file, copy_file);
+  copy(reader.GetLogName(), copy_log);
+  for (int64_t segment = std::max<int64_t>(reader.FirstSegment(), 0);;
+       segment++) {
+    copies.push_back(DiskManager::GetLogSegmentName(copy_log, segment));
+    if (!copy(DiskManager::GetLogSegmentName(reader.GetLogName(), segment),
+              copies.back()))
+      break;
+  }
+
+  ENABLE_LOGGING = false;
+  auto *disk_manager = new DiskManager(copy_file);
+  auto *log_manager = new LogManager(disk_manager);
+  auto *buffer_pool_manager =
+      new BufferPoolManager(BUFFER_POOL_SIZE, disk_manager, log_manager);
+  auto *log_recovery =
+      new LogRecovery(disk_manager, buffer_pool_manager, log_manager);
+  if (options.threads > 0)
+    log_recovery->SetRedoThreads(options.threads);
+  auto start = std::chrono::steady_clock::now();
+  auto redone = start, undone = start;
+  std::string error;
+  try {
+    log_recovery->Redo();
+    redone = std::chrono::steady_clock::now();
+    log_recovery->Undo();
+    undone = std::chrono::steady_clock::now();
+  } catch (Exception &e) {
+    error = e.what();
+  }
+  delete log_recovery;
+  delete buffer_pool_manager;
+  delete log_manager;
+  delete disk_manager;
+  for (auto &file : copies)
+    remove(file.c_str());
+  if (!error.empty()) {
+    printf("\nreplay failed: %s\n", error.c_str());
+    return;
+  }
+
+  double redo_seconds = std::chrono::duration<double>(redone - start).count();
+  double undo_seconds = std::chrono::duration<double>(undone - redone).count();
+  // redo reads from the checkpoint, rates need the scan to cover it
+  int64_t checkpoint_offset = 0;
+  lsn_t checkpoint_lsn;
+  if (!ReadCheckpoint(options.db_file, checkpoint_offset, checkpoint_lsn))
+    checkpoint_offset = 0;
+  printf("\nreplay from offset %lld\n",
+         static_cast<long long>(checkpoint_offset));
+  if (start_offset <= checkpoint_offset) {
+    Tally tally;
+    for (auto &info : infos) {
+      if (info.offset >= checkpoint_offset)
+        tally.Add(info.size);
+    }
+    printf("  redo %10.3f s %12.0f records/s %10.1f MB/s\n", redo_seconds,
+           tally.records / std::max(redo_seconds, 1e-9),
+           tally.bytes / 1e6 / std::max(redo_seconds, 1e-9));
+  } else {
+    printf("  redo %10.3f s\n", redo_seconds);
+  }
+  printf("  undo %10.3f s\n", undo_seconds);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    Usage();
+    return 1;
+  }
+  if (access(options.db_file.c_str(), R_OK) != 0) {
+    fprintf(stderr, "can't read %s\n", options.db_file.c_str());
+    return 1;
+  }
+  LogReader reader(options.db_file);
+  int64_t first_segment = reader.FirstSegment();
+  if (first_segment < 0) {
+    fprintf(stderr, "no log for %s\n", options.db_file.c_str());
+    return 1;
+  }
+
+  int64_t offset = 0;
+  lsn_t expected_lsn = INVALID_LSN;
+  bool resync = false;
+  if (options.offset >= 0) {
+    offset = options.offset;
+  } else if (options.all) {
+    offset = first_segment * LOG_SEGMENT_SIZE;
+    resync = offset > 0;
+  } else if (!ReadCheckpoint(options.db_file, offset, expected_lsn)) {
+    offset = 0;
+  }
+  if (offset < first_segment * LOG_SEGMENT_SIZE) {
+    fprintf(stderr, "offset %lld is discarded, the log starts at %lld\n",
+            static_cast<long long>(offset),
+            static_cast<long long>(first_segment * LOG_SEGMENT_SIZE));
+    return 1;
+  }
+  int64_t start_offset = offset;
+
+  LogRecovery decoder(nullptr, nullptr, nullptr);
+  std::vector<char> buffer(READ_SIZE);
+  std::vector<RecordInfo> infos;
+  Tally types[NUM_TYPES], total;
+  std::unordered_map<txn_id_t, TxnTally> txns;
+  std::unordered_map<page_id_t, Tally> pages;
+  auto start = std::chrono::steady_clock::now();
+  while (true) {
+    int available = reader.Read(buffer.data(), buffer.size(), offset);
+    if (resync) {
+      int skip = FindBoundary(decoder, buffer.data(), available);
+      if (skip < 0) {
+        fprintf(stderr, "no record found at offset %lld\n",
+                static_cast<long long>(offset));
+        return 1;
+      }
+      offset += skip;
+      start_offset = offset;
+      resync = false;
+      continue;
+    }
+    int pos = 0;
+    LogRecord log_record;
+    while (ParseRecord(decoder, buffer.data() + pos, available - pos,
+                       log_record) &&
+           (expected_lsn == INVALID_LSN ||
+            log_record.GetLSN() == expected_lsn)) {
+      LogRecordType type = log_record.GetLogRecordType();
+      int32_t size = log_record.GetSize();
+      page_id_t page_id = RecordPageId(log_record);
+      txn_id_t txn_id = log_record.GetTxnId();
+      infos.push_back({offset + pos, log_record.GetLSN(), txn_id, page_id,
+                       size, type});
+      total.Add(size);
+      types[static_cast<int>(type)].Add(size);
+      TxnTally &txn = txns[txn_id];
+      txn.tally.Add(size);
+      if (txn.first_lsn == INVALID_LSN)
+        txn.first_lsn = log_record.GetLSN();
+      txn.last_lsn = log_record.GetLSN();
+      if (type == LogRecordType::COMMIT)
+        txn.outcome = "commit";
+      else if (type == LogRecordType::ABORT)
+        txn.outcome = "abort";
+      if (page_id != INVALID_PAGE_ID)
+        pages[page_id].Add(size);
+      if (options.dump)
+        printf("%12lld %s page %s\n", static_cast<long long>(offset + pos),
+               log_record.ToString().c_str(), PageName(page_id).c_str());
+      expected_lsn = log_record.GetLSN() + 1;
+      pos += size;
+    }
+    if (pos == 0)
+      break;
+    offset += pos;
+  }
+  double scan_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  auto count = [](const Tally &tally) {
+    return static_cast<unsigned long long>(tally.records);
+  };
+  auto bytes = [](const Tally &tally) {
+    return static_cast<unsigned long long>(tally.bytes);
+  };
+
+  printf("log %s\n", reader.GetLogName().c_str());
+  printf("  offsets %lld to %lld, %llu records, %llu bytes\n",
+         static_cast<long long>(start_offset), static_cast<long long>(offset),
+         count(total), bytes(total));
+  if (!infos.empty())
+    printf("  LSNs %d to %d\n", infos.front().lsn, infos.back().lsn);
+  printf("  read and decoded in %.3f s, %.0f records/s, %.1f MB/s\n",
+         scan_seconds, total.records / std::max(scan_seconds, 1e-9),
+         total.bytes / 1e6 / std::max(scan_seconds, 1e-9));
+  if (infos.empty()) {
+    printf("  no record at offset %lld\n",
+           static_cast<long long>(start_offset));
+    return 0;
+  }
+
+  printf("\n%-18s %10s %12s %7s %8s %8s\n", "type", "records", "bytes", "%",
+         "avg", "max");
+  for (int i = 0; i < NUM_TYPES; i++) {
+    if (types[i].records == 0)
+      continue;
+    printf("%-18s %10llu %12llu %6.1f%% %8.1f %8d\n",
+           LogRecordTypeName(static_cast<LogRecordType>(i)), count(types[i]),
+           bytes(types[i]), Percent(types[i].bytes, total.bytes),
+           static_cast<double>(types[i].bytes) / types[i].records,
+           types[i].largest);
+  }
+
+  size_t committed = 0, aborted = 0;
+  for (auto &txn : txns) {
+    committed += strcmp(txn.second.outcome, "commit") == 0;
+    aborted += strcmp(txn.second.outcome, "abort") == 0;
+  }
+  printf("\ntransactions: %zu, %zu committed, %zu aborted (- holds records "
+         "of no transaction)\n",
+         txns.size(), committed, aborted);
+  printf("%-12s %10s %12s %7s %10s %10s %-8s\n", "txn", "records", "bytes",
+         "%", "first LSN", "last LSN", "outcome");
+  for (auto &row : Largest(txns, options.top, [](const TxnTally &txn) {
+         return txn.tally.bytes;
+       })) {
+    printf("%-12s %10llu %12llu %6.1f%% %10d %10d %-8s\n",
+           TxnName(row.first).c_str(), count(row.second.tally),
+           bytes(row.second.tally), Percent(row.second.tally.bytes, total.bytes),
+           row.second.first_lsn, row.second.last_lsn,
+           row.first == INVALID_TXN_ID ? "-" : row.second.outcome);
+  }
+
+  printf("\npages: %zu\n", pages.size());
+  printf("%-12s %10s %12s %7s %8s\n", "page", "records", "bytes", "%", "max");
+  for (auto &row : Largest(pages, options.top,
+                           [](const Tally &tally) { return tally.bytes; })) {
+    printf("%-12s %10llu %12llu %6.1f%% %8d\n", PageName(row.first).c_str(),
+           count(row.second), bytes(row.second),
+           Percent(row.second.bytes, total.bytes), row.second.largest);
+  }
+
+  // the log cut into parts of equal size, commits stand in for time
+  int64_t span = std::max<int64_t>(offset - start_offset, 1);
+  int64_t slice_size = (span + options.slices - 1) / options.slices;
+  printf("\n%-12s %-12s %-19s %10s %12s %8s %12s\n", "offset", "to", "LSNs",
+         "records", "bytes", "commits", "bytes/commit");
+  for (size_t i = 0; i < infos.size();) {
+    int64_t slice = (infos[i].offset - start_offset) / slice_size;
+    int64_t slice_end = start_offset + (slice + 1) * slice_size;
+    Tally tally;
+    uint64_t commits = 0;
+    size_t first = i;
+    for (; i < infos.size() && infos[i].offset < slice_end; i++) {
+      tally.Add(infos[i].size);
+      commits += infos[i].type == LogRecordType::COMMIT;
+    }
+    std::string lsns = std::to_string(infos[first].lsn) + "-" +
+                       std::to_string(infos[i - 1].lsn);
+    printf("%-12lld %-12lld %-19s %10llu %12llu %8llu %12s\n",
+           static_cast<long long>(infos[first].offset),
+           static_cast<long long>(std::min(slice_end, offset)), lsns.c_str(),
+           count(tally), bytes(tally), static_cast<unsigned long long>(commits),
+           commits == 0 ? "-"
+                        : std::to_string(tally.bytes / commits).c_str());
+  }
+
+  std::vector<RecordInfo> largest(std::min(options.top, infos.size()));
+  std::partial_sort_copy(infos.begin(), infos.end(), largest.begin(),
+                         largest.end(),
+                         [](const RecordInfo &a, const RecordInfo &b) {
+                           return a.size > b.size;
+                         });
+  printf("\nlargest records\n");
+  printf("%-10s %-12s %-18s %-12s %-12s %8s\n", "LSN", "offset", "type", "txn",
+         "page", "bytes");
+  for (auto &info : largest) {
+    printf("%-10d %-12lld %-18s %-12s %-12s %8d\n", info.lsn,
+           static_cast<long long>(info.offset), LogRecordTypeName(info.type),
+           TxnName(info.txn_id).c_str(), PageName(info.page_id).c_str(),
+           info.size);
+  }
+
+  if (options.replay)
+    Replay(options, reader, infos, start_offset);
+  return 0;
+}
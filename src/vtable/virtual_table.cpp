@@ -2,6 +2,7 @@
  * virtual_table.cpp
  */
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <sys/stat.h>
@@ -10,6 +11,7 @@
 #include "common/exception.h"
 #include "common/logger.h"
 #include "common/string_utility.h"
+#include "logging/log_recovery.h"
 #include "page/header_page.h"
 #include "vtable/virtual_table.h"
 
@@ -17,9 +19,227 @@ namespace cmudb {
 
 SQLITE_EXTENSION_INIT1
 
+/*
+ * The storage engine is shared by every table of the process. It starts when
+ * the extension is loaded, and again for a table connected after the last
+ * one disconnected: sqlite disconnects all tables of a connection when its
+ * schema is reset, after a failed CREATE VIRTUAL TABLE among others
+ */
+static int connected_tables_ = 0;
+
+static int StartStorageEngine(char **pzErr) {
+  std::string db_file_name = "vtable.db";
+  struct stat buffer;
+  bool is_file_exist = (stat(db_file_name.c_str(), &buffer) == 0);
+  // a standby of the database named by VTABLE_PRIMARY, see logging/standby.h
+  const char *primary_db_file = getenv("VTABLE_PRIMARY");
+  bool is_standby = primary_db_file != nullptr && primary_db_file[0] != '\0';
+  if (is_standby && !is_file_exist) {
+    *pzErr = sqlite3_mprintf("a standby starts from a copy of %s",
+                             primary_db_file);
+    return SQLITE_ERROR;
+  }
+  // VTABLE_READ_ONLY=1 maps a cleanly shut down database read-only, see
+  // IOMode::MMAP_READ_ONLY. Nothing is recovered or logged
+  const char *read_only = getenv("VTABLE_READ_ONLY");
+  bool is_read_only = read_only != nullptr && read_only[0] != '\0' &&
+                      strcmp(read_only, "0") != 0;
+  if (is_read_only && (is_standby || !is_file_exist)) {
+    *pzErr = sqlite3_mprintf("a read-only database must exist and can't be a "
+                             "standby");
+    return SQLITE_ERROR;
+  }
+
+  // init storage engine
+  storage_engine_ = new StorageEngine(
+      db_file_name, is_read_only ? IOMode::MMAP_READ_ONLY : IOMode::BUFFERED);
+  if (is_file_exist) {
+    // the layouts of older files are not readable, don't recover or use them
+    uint32_t version = 0;
+    try {
+      auto *header_page = static_cast<HeaderPage *>(
+          storage_engine_->buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+      if (header_page != nullptr) {
+        version = header_page->GetFormatVersion();
+        storage_engine_->buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID,
+                                                         false);
+      }
+    } catch (Exception &e) {
+      // files older than the page checksums fail here
+      delete storage_engine_;
+      storage_engine_ = nullptr;
+      *pzErr = sqlite3_mprintf("can't read the header page of %s, it may be "
+                               "of an older on-disk format: %s",
+                               db_file_name.c_str(), e.what());
+      return SQLITE_NOTADB;
+    }
+    if (version != FORMAT_VERSION) {
+      delete storage_engine_;
+      storage_engine_ = nullptr;
+      *pzErr = sqlite3_mprintf("%s has on-disk format %u, this build reads "
+                               "format %d only",
+                               db_file_name.c_str(), version, FORMAT_VERSION);
+      return SQLITE_NOTADB;
+    }
+  }
+  if (is_read_only) {
+    return SQLITE_OK;
+  }
+  if (is_standby) {
+    storage_engine_->standby_ = new Standby(
+        primary_db_file, storage_engine_->disk_manager_,
+        storage_engine_->buffer_pool_manager_, storage_engine_->log_manager_);
+    storage_engine_->standby_->RunReplayThread(STANDBY_POLL_INTERVAL);
+  } else if (is_file_exist) {
+    // bring the tables back to their state at the end of the log, the
+    // database may not have been shut down cleanly
+    LogRecovery log_recovery(storage_engine_->disk_manager_,
+                             storage_engine_->buffer_pool_manager_,
+                             storage_engine_->log_manager_);
+    try {
+      log_recovery.Redo();
+      log_recovery.Undo();
+    } catch (Exception &e) {
+      delete storage_engine_;
+      storage_engine_ = nullptr;
+      *pzErr = sqlite3_mprintf("can't recover the database: %s", e.what());
+      return SQLITE_CORRUPT;
+    }
+  }
+  // a standby writes no log of its own
+  if (!is_standby) {
+    // start the logging
+    storage_engine_->log_manager_->RunFlushThread();
+    // create header page from BufferPoolManager if necessary
+    if (!is_file_exist) {
+      page_id_t header_page_id;
+      auto *header_page = static_cast<HeaderPage *>(
+          storage_engine_->buffer_pool_manager_->NewPage(header_page_id));
+
+      assert(header_page_id == HEADER_PAGE_ID);
+      header_page->SetFormatVersion(FORMAT_VERSION);
+      storage_engine_->buffer_pool_manager_->UnpinPage(header_page_id, true);
+      // the header page isn't logged, the file is known by its format once
+      // it is written
+      storage_engine_->buffer_pool_manager_->FlushPage(header_page_id);
+    }
+    storage_engine_->checkpoint_manager_->RunCheckpointThread(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            CHECKPOINT_TIMEOUT));
+  }
+
+  return SQLITE_OK;
+}
+
+/*
+ * Take a trailing 'in <file>' off a definition, return the file name or an
+ * empty string without one
+ */
+static std::string ParseDataFile(std::string &sql) {
+  std::string lower = " " + sql;
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  std::string::size_type n = lower.rfind(" in ");
+  if (n == std::string::npos)
+    return "";
+  std::string data_file = sql.substr(std::min(n + 3, sql.size()));
+  StringUtility::Trim(data_file);
+  if (data_file.empty() || data_file.find(' ') != std::string::npos)
+    throw Exception(EXCEPTION_TYPE_INDEX, "format error, expected in <file>");
+  sql = sql.substr(0, n == 0 ? 0 : n - 1);
+  return data_file;
+}
+
+/*
+ * A data file named by a table or an index, its first page is placed there.
+ * -1 if the file can't be opened
+ */
+static int OpenDataFile(const std::string &data_file, page_id_t &hint) {
+  hint = INVALID_PAGE_ID;
+  if (data_file.empty())
+    return 0;
+  int number = storage_engine_->disk_manager_->AddDataFile(data_file);
+  if (number >= 0)
+    hint = DiskManager::MakePageId(number, 0);
+  return number;
+}
+
+/*
+ * Parse the table schema in argv[3] and the index definitions in argv[4..].
+ * An argument 'in <file>' puts the table in that data file.
+ * A malformed definition fails the statement with its message in pzErr, the
+ * exception must not unwind through sqlite
+ */
+static bool ParseArguments(int argc, const char *const *argv,
+                           std::string &schema_string, Schema *&schema,
+                           std::vector<IndexMetadata *> &metadatas,
+                           std::string &data_file, char **pzErr) {
+  // the first three parameter:(1) module name (2) database name (3)table name
+  assert(argc >= 4);
+  schema_string = argv[3];
+  // remove the very first and last character
+  schema_string = schema_string.substr(1, (schema_string.size() - 2));
+  schema = nullptr;
+  try {
+    schema = ParseCreateStatement(schema_string);
+    for (int i = 4; i < argc; i++) {
+      std::string index_string(argv[i]);
+      index_string = index_string.substr(1, (index_string.size() - 2));
+      StringUtility::Trim(index_string);
+      std::string rest = index_string;
+      std::string table_file = ParseDataFile(rest);
+      if (!table_file.empty() && rest.empty()) {
+        data_file = table_file;
+        continue;
+      }
+      metadatas.push_back(
+          ParseIndexStatement(index_string, std::string(argv[2]), schema));
+    }
+  } catch (Exception &e) {
+    for (auto metadata : metadatas)
+      delete metadata;
+    metadatas.clear();
+    delete schema;
+    *pzErr = sqlite3_mprintf("%s", e.what());
+    return false;
+  }
+  return true;
+}
+
 /* API implementation */
 int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                sqlite3_vtab **ppVtab, char **pzErr) {
+  if (storage_engine_ == nullptr && StartStorageEngine(pzErr) != SQLITE_OK)
+    return SQLITE_ERROR;
+  if (storage_engine_->IsReadOnly()) {
+    *pzErr = sqlite3_mprintf("the database is read-only");
+    return SQLITE_READONLY;
+  }
+  std::string schema_string;
+  Schema *schema;
+  std::vector<IndexMetadata *> metadatas;
+  std::string data_file;
+  if (!ParseArguments(argc, argv, schema_string, schema, metadatas, data_file,
+                      pzErr))
+    return SQLITE_ERROR;
+  // open the data files named by the table and its indexes
+  page_id_t table_hint;
+  std::vector<page_id_t> index_hints(metadatas.size());
+  std::string missing_file;
+  if (OpenDataFile(data_file, table_hint) < 0)
+    missing_file = data_file;
+  for (size_t i = 0; i < metadatas.size(); i++) {
+    if (OpenDataFile(metadatas[i]->GetDataFile(), index_hints[i]) < 0)
+      missing_file = metadatas[i]->GetDataFile();
+  }
+  if (!missing_file.empty()) {
+    for (auto metadata : metadatas)
+      delete metadata;
+    delete schema;
+    *pzErr = sqlite3_mprintf("can't open data file %s", missing_file.c_str());
+    return SQLITE_ERROR;
+  }
+  connected_tables_++;
+
   BufferPoolManager *buffer_pool_manager =
       storage_engine_->buffer_pool_manager_;
   LockManager *lock_manager = storage_engine_->lock_manager_;
@@ -29,30 +249,35 @@ int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   HeaderPage *header_page =
       static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
 
-  // the first three parameter:(1) module name (2) database name (3)table name
-  assert(argc >= 4);
-  // parse arg[3](string that defines table schema)
-  std::string schema_string(argv[3]);
-  schema_string = schema_string.substr(1, (schema_string.size() - 2));
-  Schema *schema = ParseCreateStatement(schema_string);
-
-  // parse arg[4](string that defines table index)
-  Index *index = nullptr;
-  if (argc > 4) {
-    std::string index_string(argv[4]);
-    index_string = index_string.substr(1, (index_string.size() - 2));
-    // create index object, allocate memory space
-    IndexMetadata *index_metadata =
-        ParseIndexStatement(index_string, std::string(argv[2]), schema);
-    index = ConstructIndex(index_metadata, buffer_pool_manager);
-  }
+  // create index objects, allocate memory space
+  std::vector<Index *> indexes;
+  for (size_t i = 0; i < metadatas.size(); i++)
+    indexes.push_back(ConstructIndex(metadatas[i], buffer_pool_manager,
+                                     INVALID_PAGE_ID, log_manager,
+                                     index_hints[i]));
   // create table object, allocate memory space
-  VirtualTable *table = new VirtualTable(schema, buffer_pool_manager,
-                                         lock_manager, log_manager, index);
-
-  // insert table root page info into header page
-  header_page->InsertRecord(std::string(argv[2]), table->GetFirstPageId());
+  VirtualTable *table =
+      new VirtualTable(schema, buffer_pool_manager, lock_manager, log_manager,
+                       indexes, INVALID_PAGE_ID, table_hint);
+  table->SetOptions(static_cast<ConnectionOptions *>(pAux));
+
+  // insert table root page info into header page, a table dropped before
+  // under the same name still has its record
+  header_page->WLatch();
+  bool recorded =
+      header_page->InsertRecord(buffer_pool_manager, std::string(argv[2]),
+                                table->GetFirstPageId()) ||
+      header_page->UpdateRecord(buffer_pool_manager, std::string(argv[2]),
+                                table->GetFirstPageId());
+  header_page->WUnlatch();
   buffer_pool_manager->UnpinPage(HEADER_PAGE_ID, true);
+  if (!recorded) {
+    table->GetTableHeap()->DeleteTableHeap();
+    VtabDisconnect(reinterpret_cast<sqlite3_vtab *>(table));
+    *pzErr = sqlite3_mprintf("can't record table %s in the header page",
+                             argv[2]);
+    return SQLITE_ERROR;
+  }
 
   // register virtual table within sqlite system
   schema_string = "CREATE TABLE X(" + schema_string + ");";
@@ -64,12 +289,20 @@ int VtabCreate(sqlite3 *db, void *pAux, int argc, const char *const *argv,
 
 int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                 sqlite3_vtab **ppVtab, char **pzErr) {
-  assert(argc >= 4);
-  std::string schema_string(argv[3]);
-  // remove the very first and last character
-  schema_string = schema_string.substr(1, (schema_string.size() - 2));
-  // new virtual table object, allocate memory space
-  Schema *schema = ParseCreateStatement(schema_string);
+  std::string schema_string;
+  Schema *schema;
+  std::vector<IndexMetadata *> metadatas;
+  std::string data_file;
+  if (!ParseArguments(argc, argv, schema_string, schema, metadatas, data_file,
+                      pzErr))
+    return SQLITE_ERROR;
+  if (storage_engine_ == nullptr && StartStorageEngine(pzErr) != SQLITE_OK) {
+    for (auto metadata : metadatas)
+      delete metadata;
+    delete schema;
+    return SQLITE_ERROR;
+  }
+  connected_tables_++;
 
   BufferPoolManager *buffer_pool_manager =
       storage_engine_->buffer_pool_manager_;
@@ -79,24 +312,29 @@ int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   // Retrieve table root page info from header page
   HeaderPage *header_page =
       static_cast<HeaderPage *>(buffer_pool_manager->FetchPage(HEADER_PAGE_ID));
+  header_page->RLatch();
   page_id_t table_root_id;
-  header_page->GetRootId(std::string(argv[2]), table_root_id);
-  // parse arg[4](string that defines table index)
-  Index *index = nullptr;
-  if (argc > 4) {
-    std::string index_string(argv[4]);
-    index_string = index_string.substr(1, (index_string.size() - 2));
-    // create index object, allocate memory space
-    IndexMetadata *index_metadata =
-        ParseIndexStatement(index_string, std::string(argv[2]), schema);
-    // Retrieve index root page info from header page
-    page_id_t index_root_id;
-    header_page->GetRootId(index_metadata->GetName(), index_root_id);
-    index = ConstructIndex(index_metadata, buffer_pool_manager, index_root_id);
+  header_page->GetRootId(buffer_pool_manager, std::string(argv[2]),
+                         table_root_id);
+  std::vector<Index *> indexes;
+  for (auto index_metadata : metadatas) {
+    // Retrieve index root page info from header page, an index that never
+    // held an entry has no record yet
+    page_id_t index_root_id = INVALID_PAGE_ID;
+    header_page->GetRootId(buffer_pool_manager, index_metadata->GetName(),
+                           index_root_id);
+    // its first leaf still goes to its data file
+    page_id_t index_hint;
+    OpenDataFile(index_metadata->GetDataFile(), index_hint);
+    indexes.push_back(
+        ConstructIndex(index_metadata, buffer_pool_manager, index_root_id,
+                       log_manager, index_hint));
   }
+  header_page->RUnlatch();
   VirtualTable *table =
       new VirtualTable(schema, buffer_pool_manager, lock_manager, log_manager,
-                       index, table_root_id);
+                       indexes, table_root_id);
+  table->SetOptions(static_cast<ConnectionOptions *>(pAux));
 
   // register virtual table within sqlite system
   schema_string = "CREATE TABLE X(" + schema_string + ");";
@@ -108,51 +346,140 @@ int VtabConnect(sqlite3 *db, void *pAux, int argc, const char *const *argv,
 }
 
 /*
- * we only support
- * (1) equlity check. e.g select * from foo where a = 1
- * (2) indexed column == predicated column
+ * idxNum handed from VtabBestIndex to VtabFilter: the low bits pick the scan
+ * (1 point scan, 2/3 ordered scan asc/desc), COVERING_SCAN is or-ed in when
+ * every column the query reads is stored in the index entry, and the bits
+ * from INDEX_ID_SHIFT on tell which index of the table to scan
+ */
+static const int COVERING_SCAN = 0x100;
+static const int INDEX_ID_SHIFT = 16;
+
+/*
+ * Rough cost model, no statistics are kept: a table is assumed to hold
+ * TABLE_ROWS rows and a non-unique key to match NONUNIQUE_ROWS of them.
+ * Reading a row through an index plus the table heap costs twice as much as
+ * a sequential or covering read, and a plan that leaves ORDER BY to sqlite
+ * pays for sorting its rows.
+ */
+static const double TABLE_ROWS = 1000000;
+static const double NONUNIQUE_ROWS = 100;
+static const double INDEX_PROBE_COST = 20;
+
+static double SortCost(double rows) { return rows * std::log2(rows + 1); }
+
+/*
+ * we support, on any index of the table
+ * (1) equlity check on every indexed column. e.g select * from foo where a = 1
+ * (2) order by the leading indexed column, asc or desc. e.g select * from foo
+ * order by a desc limit 10
+ * any of them is a covering scan when the query only reads key and included
+ * columns, e.g select b from foo where a = 1 with index 'foo_pk a include b'.
+ * Each index is costed for both shapes and the cheapest plan wins, a
+ * sequential scan is the fallback.
  */
 int VtabBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
   // LOG_DEBUG("VtabBestIndex");
   VirtualTable *table = reinterpret_cast<VirtualTable *>(tab);
-  if (table->GetIndex() == nullptr)
-    return SQLITE_OK;
-  const std::vector<int> key_attrs = table->GetIndex()->GetKeyAttrs();
-  // make sure indexed column == predicate column
-  // e.g select * from foo where a = 1 and b =2; indexed column must be {a,b}
-  if (pIdxInfo->nConstraint != (int)(key_attrs.size()))
-    return SQLITE_OK;
-
-  int counter = 0;
-  bool is_index_scan = true;
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    if (pIdxInfo->aConstraint[i].usable == 0)
-      continue;
-    int item = pIdxInfo->aConstraint[i].iColumn;
-    // if predicate column is part of indexed column
-    if (std::find(key_attrs.begin(), key_attrs.end(), item) !=
-        key_attrs.end()) {
-      // equlity check
-      if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
-        is_index_scan = false;
+  bool has_order_by = pIdxInfo->nOrderBy > 0;
+
+  // sequential scan
+  int best_idx_num = 0;
+  double best_cost = TABLE_ROWS, best_rows = TABLE_ROWS;
+  double best_rank = best_cost + (has_order_by ? SortCost(best_rows) : 0);
+  bool best_order_by = false;
+  std::vector<int> best_argv;
+
+  // an index caches its root and takes no latch against replay, a standby
+  // scans the table
+  int index_count =
+      storage_engine_->standby_ == nullptr ? table->GetIndexCount() : 0;
+  for (int index_id = 0; index_id < index_count; index_id++) {
+    Index *index = table->GetIndex(index_id);
+    const std::vector<int> &key_attrs = index->GetKeyAttrs();
+    const std::vector<int> &entry_attrs = index->GetEntryAttrs();
+    // colUsed has bit i set when column i is read, bit 63 stands for all the
+    // columns from 63 on
+    int covering = COVERING_SCAN;
+    for (int i = 0; i < table->GetSchema()->GetColumnCount(); i++) {
+      if ((pIdxInfo->colUsed & ((sqlite3_uint64)1 << std::min(i, 63))) &&
+          std::find(entry_attrs.begin(), entry_attrs.end(), i) ==
+              entry_attrs.end()) {
+        covering = 0;
         break;
       }
-      pIdxInfo->aConstraintUsage[i].argvIndex = (i + 1);
-      counter++;
     }
-  }
+    double row_cost = covering ? 1 : 2;
+    int idx_num = index_id << INDEX_ID_SHIFT | covering;
+
+    // point scan: every key column needs a usable equality constraint, its
+    // value is passed to VtabFilter at the column's position in the key
+    std::vector<int> argv(key_attrs.size(), -1);
+    bool is_point_scan = true;
+    for (size_t k = 0; k < key_attrs.size() && is_point_scan; k++) {
+      for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+        if (pIdxInfo->aConstraint[i].usable &&
+            pIdxInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ &&
+            pIdxInfo->aConstraint[i].iColumn == key_attrs[k]) {
+          argv[k] = i;
+          break;
+        }
+      }
+      is_point_scan = argv[k] != -1;
+    }
+    if (is_point_scan) {
+      double rows = index->IsUnique() ? 1 : NONUNIQUE_ROWS;
+      double cost = INDEX_PROBE_COST + rows * row_cost;
+      double rank = cost + (has_order_by ? SortCost(rows) : 0);
+      if (rank < best_rank) {
+        best_idx_num = idx_num | 1;
+        best_cost = cost;
+        best_rows = rows;
+        best_rank = rank;
+        best_order_by = false;
+        best_argv = argv;
+      }
+    }
 
-  if (counter == (int)key_attrs.size() && is_index_scan) {
-    pIdxInfo->idxNum = 1;
+    // ordered scan: leaves are chained both ways, so the index can hand out
+    // rows already sorted on its leading column and sqlite can stop after
+    // LIMIT rows. Constraints are left to sqlite
+    if (pIdxInfo->nOrderBy == 1 &&
+        pIdxInfo->aOrderBy[0].iColumn == key_attrs[0]) {
+      double cost = TABLE_ROWS * row_cost;
+      if (cost < best_rank) {
+        best_idx_num = idx_num | (pIdxInfo->aOrderBy[0].desc ? 3 : 2);
+        best_cost = cost;
+        best_rows = TABLE_ROWS;
+        best_rank = cost;
+        best_order_by = true;
+        best_argv.clear();
+      }
+    }
   }
+
+  for (size_t k = 0; k < best_argv.size(); k++)
+    pIdxInfo->aConstraintUsage[best_argv[k]].argvIndex = k + 1;
+  pIdxInfo->idxNum = best_idx_num;
+  pIdxInfo->orderByConsumed = best_order_by;
+  pIdxInfo->estimatedCost = best_cost;
+  pIdxInfo->estimatedRows = best_rows;
   return SQLITE_OK;
 }
 
 int VtabDisconnect(sqlite3_vtab *pVtab) {
   VirtualTable *virtual_table = reinterpret_cast<VirtualTable *>(pVtab);
+  if (!virtual_table->ApplyIndexEntries()) {
+    LOG_DEBUG("index entries of a taken key lost at disconnect");
+  }
   delete virtual_table;
-  // delete all the global managers
-  delete storage_engine_;
+  // dirty pages, index roots in the header page included, must reach disk
+  // before the buffer pool goes away
+  storage_engine_->buffer_pool_manager_->FlushAllPages();
+  // delete all the global managers with the last table
+  if (--connected_tables_ == 0) {
+    delete storage_engine_;
+    storage_engine_ = nullptr;
+  }
   return SQLITE_OK;
 }
 
@@ -172,10 +499,12 @@ int VtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
 int VtabClose(sqlite3_vtab_cursor *cur) {
   // LOG_DEBUG("VtabClose");
   Cursor *cursor = reinterpret_cast<Cursor *>(cur);
+  // statement end, changes queued while the cursor was open go to the index
+  bool applied = cursor->GetVirtualTable()->ApplyIndexEntries();
   // if read operation, commit transaction here
   VtabCommit(nullptr);
   delete cursor;
-  return SQLITE_OK;
+  return applied ? SQLITE_OK : SQLITE_CONSTRAINT;
 }
 
 /*
@@ -189,13 +518,32 @@ int VtabFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum, const char *idxStr,
   // LOG_DEBUG("VtabFilter");
   Cursor *cursor = reinterpret_cast<Cursor *>(pVtabCursor);
   Schema *key_schema;
+  int scan = idxNum & (COVERING_SCAN - 1);
+  // index changes of earlier statements in this transaction are still queued
+  if (!cursor->GetVirtualTable()->ApplyIndexEntries()) {
+    pVtabCursor->pVtab->zErrMsg =
+        sqlite3_mprintf("UNIQUE constraint failed");
+    return SQLITE_CONSTRAINT;
+  }
+  if (scan != 0)
+    cursor->SetIndex(idxNum >> INDEX_ID_SHIFT);
   // if indexed scan
-  if (idxNum == 1) {
+  if (scan == 1) {
     cursor->SetScanFlag(true);
+    cursor->SetCovering(idxNum & COVERING_SCAN);
     // Construct the tuple for point query
     key_schema = cursor->GetKeySchema();
     Tuple scan_tuple = ConstructTuple(key_schema, argv);
-    cursor->ScanKey(scan_tuple);
+    // a value wider than its column can't be in the index
+    if (cursor->GetVirtualTable()->FitsColumns(scan_tuple, key_schema))
+      cursor->ScanKey(scan_tuple);
+    else
+      cursor->ScanNothing();
+  } else if (scan == 2 || scan == 3) {
+    // ordered index scan, 3 means descending
+    cursor->SetScanFlag(true);
+    cursor->SetCovering(idxNum & COVERING_SCAN);
+    cursor->ScanOrdered(scan == 3);
   }
   return SQLITE_OK;
 }
@@ -257,6 +605,8 @@ int VtabRowid(sqlite3_vtab_cursor *cur, sqlite3_int64 *pRowid) {
 int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
                sqlite_int64 *pRowid) {
   // LOG_DEBUG("VtabUpdate");
+  if (storage_engine_->IsReadOnly())
+    return SQLITE_READONLY;
   VirtualTable *table = reinterpret_cast<VirtualTable *>(pVTab);
   // The single row with rowid equal to argv[0] is deleted
   if (argc == 1) {
@@ -272,6 +622,14 @@ int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
   else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
     Schema *schema = table->GetSchema();
     Tuple tuple = ConstructTuple(schema, (argv + 2));
+    if (!table->FitsIndexes(tuple)) {
+      pVTab->zErrMsg = sqlite3_mprintf("value wider than an indexed column");
+      return SQLITE_CONSTRAINT;
+    }
+    if (!table->IsKeyFree(tuple, RID())) {
+      pVTab->zErrMsg = sqlite3_mprintf("UNIQUE constraint failed");
+      return SQLITE_CONSTRAINT;
+    }
     // insert into table heap
     RID rid;
     table->InsertTuple(tuple, rid);
@@ -283,18 +641,29 @@ int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
   else if (argc > 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
     Schema *schema = table->GetSchema();
     Tuple tuple = ConstructTuple(schema, (argv + 2));
+    if (!table->FitsIndexes(tuple)) {
+      pVTab->zErrMsg = sqlite3_mprintf("value wider than an indexed column");
+      return SQLITE_CONSTRAINT;
+    }
     RID rid(sqlite3_value_int64(argv[0]));
-    // for update, index always delete and insert
-    // because you have no clue key has been updated or not
-    table->DeleteEntry(rid);
+    // the row keeps its own keys
+    if (!table->IsKeyFree(tuple, rid)) {
+      pVTab->zErrMsg = sqlite3_mprintf("UNIQUE constraint failed");
+      return SQLITE_CONSTRAINT;
+    }
+    // keep the old image, indexes compare it with the new one to skip
+    // entries whose columns did not change
+    Tuple old_tuple(rid);
+    table->GetTuple(rid, old_tuple);
+    RID new_rid = rid;
     // if true, then update succeed, rid keep the same
     // else, delete & insert
     if (table->UpdateTuple(tuple, rid) == false) {
       table->DeleteTuple(rid);
       // rid should be different
-      table->InsertTuple(tuple, rid);
+      table->InsertTuple(tuple, new_rid);
     }
-    table->InsertEntry(tuple, rid);
+    table->UpdateEntry(old_tuple, rid, tuple, new_rid);
   }
   return SQLITE_OK;
 }
@@ -302,24 +671,55 @@ int VtabUpdate(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
 int VtabBegin(sqlite3_vtab *pVTab) {
   // LOG_DEBUG("VtabBegin");
   // create new transaction(write operation will call this method)
+  if (storage_engine_->IsReadOnly())
+    return SQLITE_READONLY;
   global_transaction_ = storage_engine_->transaction_manager_->Begin();
+  // the commit mode is chosen per connection
+  auto options = reinterpret_cast<VirtualTable *>(pVTab)->GetOptions();
+  if (options != nullptr)
+    global_transaction_->SetAsyncCommit(options->async_commit);
   return SQLITE_OK;
 }
 
 int VtabCommit(sqlite3_vtab *pVTab) {
   // LOG_DEBUG("VtabCommit");
+  bool applied = pVTab == nullptr ||
+                 reinterpret_cast<VirtualTable *>(pVTab)->ApplyIndexEntries();
   auto transaction = GetTransaction();
   if (transaction == nullptr)
-    return SQLITE_OK;
+    return applied ? SQLITE_OK : SQLITE_CONSTRAINT;
   // get global txn manager
   auto transaction_manager = storage_engine_->transaction_manager_;
-  // invoke transaction manager to commit(this txn can't fail)
-  transaction_manager->Commit(transaction);
+  // invoke transaction manager to commit, only writing the log can fail
+  bool durable = transaction_manager->Commit(transaction);
   // when commit, delete transaction pointer and set to null
   delete transaction;
   global_transaction_ = nullptr;
 
-  return SQLITE_OK;
+  if (!durable)
+    return SQLITE_IOERR;
+  return applied ? SQLITE_OK : SQLITE_CONSTRAINT;
+}
+
+/*
+ * Asynchronous commits return before their commit record is durable, see
+ * TransactionManager::Commit. Only the calling connection is affected
+ */
+void AsyncCommitFunction(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  auto options = static_cast<ConnectionOptions *>(sqlite3_user_data(ctx));
+  options->async_commit = sqlite3_value_int(argv[0]) != 0;
+  sqlite3_result_null(ctx);
+}
+
+static void DeleteOptions(void *options) {
+  delete static_cast<ConnectionOptions *>(options);
+}
+
+void ReplayLSNFunction(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  if (storage_engine_ == nullptr || storage_engine_->standby_ == nullptr)
+    sqlite3_result_null(ctx);
+  else
+    sqlite3_result_int64(ctx, storage_engine_->standby_->GetReplayLSN());
 }
 
 sqlite3_module VtableModule = {
@@ -354,24 +754,20 @@ __declspec(dllexport)
     extern "C" int sqlite3_vtable_init(sqlite3 *db, char **pzErrMsg,
                                        const sqlite3_api_routines *pApi) {
   SQLITE_EXTENSION_INIT2(pApi);
-  std::string db_file_name = "vtable.db";
-  struct stat buffer;
-  bool is_file_exist = (stat(db_file_name.c_str(), &buffer) == 0);
-
-  // init storage engine
-  storage_engine_ = new StorageEngine(db_file_name);
-  // start the logging
-  storage_engine_->log_manager_->RunFlushThread();
-  // create header page from BufferPoolManager if necessary
-  if (!is_file_exist) {
-    page_id_t header_page_id;
-    storage_engine_->buffer_pool_manager_->NewPage(header_page_id);
-
-    assert(header_page_id == HEADER_PAGE_ID);
-    storage_engine_->buffer_pool_manager_->UnpinPage(header_page_id, true);
-  }
+  if (storage_engine_ == nullptr && StartStorageEngine(pzErrMsg) != SQLITE_OK)
+    return SQLITE_ERROR;
 
-  int rc = sqlite3_create_module(db, "vtable", &VtableModule, nullptr);
+  // the module owns the options, sqlite deletes them with the connection
+  auto options = new ConnectionOptions();
+  int rc = sqlite3_create_module_v2(db, "vtable", &VtableModule, options,
+                                    DeleteOptions);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_async_commit", 1, SQLITE_UTF8,
+                                 options, AsyncCommitFunction, nullptr,
+                                 nullptr);
+  if (rc == SQLITE_OK)
+    rc = sqlite3_create_function(db, "vtable_replay_lsn", 0, SQLITE_UTF8,
+                                 nullptr, ReplayLSNFunction, nullptr, nullptr);
   return rc;
 }
 
@@ -436,13 +832,32 @@ Schema *ParseCreateStatement(const std::string &sql_base) {
   return schema;
 }
 
+// widest GenericKey an index is built on
+static const int MAX_KEY_SIZE = 64;
+
+// worst case size of an index entry, varchars take their declared width plus
+// the length prefix and the terminating zero
+static int MaxEntrySize(const Schema *entry_schema) {
+  int size = entry_schema->GetLength();
+  for (int i = 0; i < entry_schema->GetColumnCount(); i++) {
+    if (!entry_schema->IsInlined(i))
+      size += sizeof(uint32_t) + entry_schema->GetColumn(i).GetLength() + 1;
+  }
+  return size;
+}
+
 IndexMetadata *ParseIndexStatement(std::string &sql,
                                    const std::string &table_name,
                                    Schema *schema) {
   std::string::size_type n;
   std::string index_name;
   std::vector<int> key_attrs;
+  std::vector<int> include_attrs;
+  bool unique = true;
   int column_id = -1;
+  // optional data file last, e.g 'foo_pk a in foo_index.db', its name is
+  // kept as written
+  std::string data_file = ParseDataFile(sql);
   // prepocess, transform sql string into lower case
   std::transform(sql.begin(), sql.end(), sql.begin(), ::tolower);
   n = sql.find_first_of(' ');
@@ -451,6 +866,25 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   index_name = sql.substr(0, n);
   sql = sql.substr(n + 1);
 
+  // optional trailing keyword for indexes on low-cardinality columns, e.g
+  // 'foo_status status nonunique'
+  static const std::string nonunique = " nonunique";
+  StringUtility::Trim(sql);
+  if (sql.size() > nonunique.size() &&
+      sql.compare(sql.size() - nonunique.size(), nonunique.size(),
+                  nonunique) == 0) {
+    unique = false;
+    sql = sql.substr(0, sql.size() - nonunique.size());
+  }
+
+  // optional covering columns, e.g 'foo_pk a, b include c, d'
+  std::string include_sql;
+  n = sql.find(" include ");
+  if (n != std::string::npos) {
+    include_sql = sql.substr(n + 9);
+    sql = sql.substr(0, n);
+  }
+
   std::vector<std::string> tok = StringUtility::Split(sql, ',');
   // iterate through returned result
   for (std::string &t : tok) {
@@ -462,8 +896,33 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   if ((int)key_attrs.size() > schema->GetColumnCount())
     throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
 
+  tok = StringUtility::Split(include_sql, ',');
+  for (std::string &t : tok) {
+    StringUtility::Trim(t);
+    column_id = schema->GetColumnID(t);
+    if (column_id != -1 &&
+        std::find(key_attrs.begin(), key_attrs.end(), column_id) ==
+            key_attrs.end() &&
+        std::find(include_attrs.begin(), include_attrs.end(), column_id) ==
+            include_attrs.end())
+      include_attrs.emplace_back(column_id);
+  }
+
+  // duplicates share one leaf entry, which can't hold their included columns
+  if (!unique && !include_attrs.empty())
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "can't create index, nonunique index can't include columns");
+
   IndexMetadata *metadata =
-      new IndexMetadata(index_name, table_name, schema, key_attrs);
+      new IndexMetadata(index_name, table_name, schema, key_attrs,
+                        include_attrs, unique, data_file);
+  // key and included columns are stored together in one GenericKey
+  if (MaxEntrySize(metadata->GetEntrySchema()) > MAX_KEY_SIZE) {
+    delete metadata;
+    throw Exception(EXCEPTION_TYPE_INDEX,
+                    "can't create index, key and included columns exceed " +
+                        std::to_string(MAX_KEY_SIZE) + " bytes");
+  }
 
   // LOG_DEBUG("%s", metadata->ToString().c_str());
   return metadata;
@@ -507,28 +966,26 @@ Tuple ConstructTuple(Schema *schema, sqlite3_value **argv) {
 // serve the functionality of index factory
 Index *ConstructIndex(IndexMetadata *metadata,
                       BufferPoolManager *buffer_pool_manager,
-                      page_id_t root_id) {
-  // The size of the key in bytes
-  Schema *key_schema = metadata->GetKeySchema();
-  int key_size = key_schema->GetLength();
-  // for each varchar attribute, we assume the largest size is 16 bytes
-  key_size += 16 * key_schema->GetUnlinedColumnCount();
+                      page_id_t root_id, LogManager *log_manager,
+                      page_id_t file_hint) {
+  // The size of the key in bytes, included columns are stored inline with it
+  int key_size = MaxEntrySize(metadata->GetEntrySchema());
 
   if (key_size <= 4) {
     return new BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, log_manager, file_hint);
   } else if (key_size <= 8) {
     return new BPlusTreeIndex<GenericKey<8>, RID, GenericComparator<8>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, log_manager, file_hint);
   } else if (key_size <= 16) {
     return new BPlusTreeIndex<GenericKey<16>, RID, GenericComparator<16>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, log_manager, file_hint);
   } else if (key_size <= 32) {
     return new BPlusTreeIndex<GenericKey<32>, RID, GenericComparator<32>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, log_manager, file_hint);
   } else {
     return new BPlusTreeIndex<GenericKey<64>, RID, GenericComparator<64>>(
-        metadata, buffer_pool_manager, root_id);
+        metadata, buffer_pool_manager, root_id, log_manager, file_hint);
   }
 }
 
@@ -3,8 +3,10 @@
  */
 
 #include <cstdio>
+#include <unistd.h>
 
 #include "buffer/buffer_pool_manager.h"
+#include "logging/log_manager.h"
 #include "gtest/gtest.h"
 
 namespace cmudb {
@@ -48,4 +50,175 @@ TEST(BufferPoolManagerTest, SampleTest) {
   remove("test.db");
 }
 
+TEST(BufferPoolManagerTest, PrefetchTest) {
+  page_id_t temp_page_id;
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+
+  // write 20 pages, only the last ones stay in the pool
+  for (int i = 0; i < 20; ++i) {
+    auto page = bpm->NewPage(temp_page_id);
+    ASSERT_NE(nullptr, page);
+    sprintf(page->GetData(), "page %d", i);
+    EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, true));
+  }
+
+  // read ahead the first pages, then fetch them
+  std::vector<page_id_t> page_ids;
+  for (int i = 0; i < 8; ++i)
+    page_ids.push_back(i);
+  bpm->PrefetchPages(page_ids);
+  char expected[PAGE_SIZE];
+  for (int i = 0; i < 8; ++i) {
+    auto page = bpm->FetchPage(i);
+    ASSERT_NE(nullptr, page);
+    sprintf(expected, "page %d", i);
+    EXPECT_EQ(0, strcmp(page->GetData(), expected));
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+  }
+
+  // prefetched pages that are evicted before use are simply dropped
+  bpm->PrefetchPages({8, 9, 10});
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_NE(nullptr, bpm->NewPage(temp_page_id));
+    EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, false));
+  }
+  auto page = bpm->FetchPage(9);
+  EXPECT_EQ(0, strcmp(page->GetData(), "page 9"));
+  EXPECT_EQ(true, bpm->UnpinPage(9, false));
+
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(BufferPoolManagerTest, DeletePageTest) {
+  page_id_t temp_page_id;
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_NE(nullptr, bpm->NewPage(temp_page_id));
+    EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, true));
+  }
+  // a pinned page can not go, resident and evicted pages can
+  bpm->FetchPage(15);
+  EXPECT_EQ(false, bpm->DeletePage(15));
+  EXPECT_EQ(true, bpm->UnpinPage(15, false));
+  EXPECT_EQ(true, bpm->DeletePage(15));
+  EXPECT_EQ(true, bpm->DeletePage(3));
+
+  // deleted pages are handed out again before the file grows
+  EXPECT_NE(nullptr, bpm->NewPage(temp_page_id, 2));
+  EXPECT_EQ(3, temp_page_id);
+  EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, false));
+  EXPECT_NE(nullptr, bpm->NewPage(temp_page_id));
+  EXPECT_EQ(15, temp_page_id);
+  EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, false));
+  EXPECT_NE(nullptr, bpm->NewPage(temp_page_id));
+  EXPECT_EQ(20, temp_page_id);
+  EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, false));
+
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * A page whose write fails stays dirty, and the flush reports the failure
+ */
+TEST(BufferPoolManagerTest, WriteFailureTest) {
+  page_id_t temp_page_id;
+  remove("test.db");
+  remove("test.files");
+  remove("test_full.db");
+  // the device takes no data
+  ASSERT_EQ(0, symlink("/dev/full", "test_full.db"));
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  // tracks the recLSN of dirty pages
+  LogManager *log_manager = new LogManager(disk_manager);
+  BufferPoolManager *bpm =
+      new BufferPoolManager(10, disk_manager, log_manager);
+  ASSERT_EQ(1, disk_manager->AddDataFile("test_full.db"));
+  ASSERT_NE(nullptr, bpm->NewPage(temp_page_id));
+  EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, true));
+  page_id_t full_page_id;
+  ASSERT_NE(nullptr,
+            bpm->NewPage(full_page_id, DiskManager::MakePageId(1, 0)));
+  EXPECT_EQ(1, DiskManager::GetFileNumber(full_page_id));
+  EXPECT_EQ(true, bpm->UnpinPage(full_page_id, true));
+
+  EXPECT_FALSE(bpm->FlushAllPages());
+  auto dirty_pages = bpm->GetDirtyPageTable();
+  ASSERT_EQ(1u, dirty_pages.size());
+  EXPECT_EQ(full_page_id, dirty_pages[0].first);
+  EXPECT_FALSE(bpm->FlushPage(full_page_id));
+  // the pages written since are not known to be durable either
+  EXPECT_FALSE(disk_manager->Sync());
+
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+  remove("test.files");
+  remove("test_full.db");
+}
+
+TEST(BufferPoolManagerTest, MmapTest) {
+  page_id_t temp_page_id;
+  remove("test.db");
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+  for (int i = 0; i < 20; ++i) {
+    auto page = bpm->NewPage(temp_page_id);
+    ASSERT_NE(nullptr, page);
+    sprintf(page->GetData(), "page %d", i);
+    EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, true));
+  }
+  bpm->FlushAllPages();
+  delete bpm;
+  delete disk_manager;
+
+  disk_manager = new DiskManager("test.db", IOMode::MMAP_READ_ONLY);
+  bpm = new BufferPoolManager(10, disk_manager);
+  EXPECT_EQ(true, disk_manager->IsReadOnly());
+  bpm->PrefetchPages({0, 1, 2, 3});
+
+  // more pages than frames stay pinned at once: nothing is replaced
+  char expected[PAGE_SIZE];
+  for (int i = 0; i < 20; ++i) {
+    auto page = bpm->FetchPage(i);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(disk_manager->GetMappedPage(i), page->GetData());
+    sprintf(expected, "page %d", i);
+    EXPECT_EQ(0, strcmp(page->GetData(), expected));
+  }
+  EXPECT_EQ(bpm->FetchPage(5), bpm->FetchPage(5));
+  EXPECT_EQ(true, bpm->UnpinPage(5, false));
+  EXPECT_EQ(true, bpm->UnpinPage(5, false));
+  EXPECT_EQ(nullptr, bpm->FetchPage(5000));
+
+  // modifications are rejected
+  EXPECT_EQ(nullptr, bpm->NewPage(temp_page_id));
+  EXPECT_EQ(false, bpm->UnpinPage(0, true));
+  EXPECT_EQ(false, bpm->DeletePage(1));
+  EXPECT_EQ(INVALID_PAGE_ID, disk_manager->AllocatePage());
+  // the rejected unpin above still released page 0
+  EXPECT_EQ(false, bpm->UnpinPage(0, false));
+  for (int i = 1; i < 20; ++i)
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
 } // namespace cmudb
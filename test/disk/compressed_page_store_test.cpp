@@ -0,0 +1,241 @@
+/**
+ * compressed_page_store_test.cpp
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/lz.h"
+#include "concurrency/lock_manager.h"
+#include "disk/disk_manager.h"
+#include "table/table_heap.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static int64_t FileSize(const char *file_name) {
+  struct stat stat_buf;
+  return stat(file_name, &stat_buf) == 0 ? stat_buf.st_size : -1;
+}
+
+static void RemoveFiles() {
+  remove("test.db");
+  remove("test.log");
+  remove("test.ptab");
+  remove("crash.db");
+  remove("crash.log");
+  remove("crash.ptab");
+}
+
+// the file as a crash would leave it
+static void CopyFile(const char *from, const char *to) {
+  std::ifstream in(from, std::ios::binary);
+  std::ofstream out(to, std::ios::binary | std::ios::trunc);
+  out << in.rdbuf();
+}
+
+TEST(CompressedPageStoreTest, LzTest) {
+  std::mt19937 random(15445);
+  char page[PAGE_SIZE], image[2 * PAGE_SIZE], back[PAGE_SIZE];
+
+  // runs, repeated phrases and noise all come back as they were
+  for (int round = 0; round < 200; round++) {
+    int noise = round % 4 == 0 ? 256 : round % 16;
+    for (int i = 0; i < PAGE_SIZE; i++)
+      page[i] = static_cast<char>(i % 37 < 20 ? i % 7 : random() % noise);
+    int length = LzCompress(page, PAGE_SIZE, image, sizeof(image));
+    ASSERT_GT(length, 0);
+    EXPECT_EQ(PAGE_SIZE, LzDecompress(image, length, back, PAGE_SIZE));
+    EXPECT_EQ(0, memcmp(page, back, PAGE_SIZE));
+  }
+
+  memset(page, 0, PAGE_SIZE);
+  int length = LzCompress(page, PAGE_SIZE, image, sizeof(image));
+  EXPECT_LT(length, 16);
+  // too small an output buffer is reported, not overrun
+  EXPECT_EQ(0, LzCompress(page, PAGE_SIZE, image, 4));
+  EXPECT_EQ(-1, LzDecompress(image, length, back, PAGE_SIZE / 2));
+  // a match reaching before the start of the output is rejected
+  char bad[] = {0x10, 'a', 0x05, 0x00};
+  EXPECT_EQ(-1, LzDecompress(bad, sizeof(bad), back, PAGE_SIZE));
+}
+
+TEST(CompressedPageStoreTest, ReadWriteTest) {
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  RemoveFiles();
+  DiskManager *disk_manager = new DiskManager("test.db", IOMode::COMPRESSED);
+  for (int i = 0; i < 100; i++) {
+    memset(data, 0, PAGE_SIZE);
+    sprintf(data, "page %d", i);
+    disk_manager->WritePage(i, data);
+  }
+  // mostly zeros, each page fits in one chunk
+  EXPECT_GE(100 * COMPRESSED_CHUNK_SIZE, FileSize("test.db"));
+  EXPECT_LT(disk_manager->GetNumBytesWritten(), 100 * COMPRESSED_CHUNK_SIZE);
+
+  // growing past its chunks moves a page, pages that do not compress are
+  // stored raw
+  std::mt19937 random(15445);
+  for (int i = 0; i < PAGE_SIZE; i++)
+    data[i] = static_cast<char>(random());
+  disk_manager->WritePage(10, data);
+  disk_manager->ReadPage(10, buffer);
+  EXPECT_EQ(0, memcmp(data, buffer, PAGE_USABLE_SIZE));
+  disk_manager->ReadPage(11, buffer);
+  EXPECT_EQ(0, strcmp("page 11", buffer));
+  // the hole before a page reads as zeros
+  disk_manager->WritePage(150, data);
+  disk_manager->ReadPage(120, buffer);
+  for (int i = 0; i < PAGE_SIZE; i++)
+    EXPECT_EQ(0, buffer[i]);
+  disk_manager->Sync();
+  delete disk_manager;
+
+  // the table is found again, and freed chunks are reused
+  disk_manager = new DiskManager("test.db", IOMode::COMPRESSED);
+  for (int i = 0; i < 100; i++) {
+    if (i == 10)
+      continue;
+    disk_manager->ReadPage(i, buffer);
+    sprintf(data, "page %d", i);
+    EXPECT_EQ(0, strcmp(data, buffer));
+  }
+  // the raw run page 10 leaves is free once the table is synced
+  memset(data, 0, PAGE_SIZE);
+  disk_manager->WritePage(10, data);
+  disk_manager->Sync();
+  int64_t size = FileSize("test.db");
+  disk_manager->WritePage(20, data);
+  disk_manager->WritePage(160, data);
+  EXPECT_EQ(size, FileSize("test.db"));
+  delete disk_manager;
+
+  RemoveFiles();
+}
+
+/*
+ * The runs the table on disk points to are not written over before the next
+ * Sync, so the files a crash leaves read back as of the last one
+ */
+TEST(CompressedPageStoreTest, CrashTest) {
+  const int num_pages = 20;
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  RemoveFiles();
+  std::mt19937 random(15445);
+  std::vector<std::vector<char>> synced;
+  DiskManager *disk_manager = new DiskManager("test.db", IOMode::COMPRESSED);
+  for (int i = 0; i < num_pages; i++) {
+    // stored raw
+    for (int j = 0; j < PAGE_SIZE; j++)
+      data[j] = static_cast<char>(random());
+    disk_manager->WritePage(i, data);
+    synced.emplace_back(data, data + PAGE_SIZE);
+  }
+  disk_manager->Sync();
+
+  // one chunk each, it would have fit into the raw runs
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < num_pages; i++) {
+      memset(data, 0, PAGE_SIZE);
+      sprintf(data, "page %d round %d", i, round);
+      disk_manager->WritePage(i, data);
+    }
+  }
+  disk_manager->ReadPage(3, buffer);
+  EXPECT_EQ(0, strcmp("page 3 round 1", buffer));
+  CopyFile("test.db", "crash.db");
+  CopyFile("test.ptab", "crash.ptab");
+  delete disk_manager;
+
+  disk_manager = new DiskManager("crash.db", IOMode::COMPRESSED);
+  for (int i = 0; i < num_pages; i++) {
+    disk_manager->ReadPage(i, buffer);
+    EXPECT_EQ(0, memcmp(synced[i].data(), buffer, PAGE_USABLE_SIZE));
+  }
+  delete disk_manager;
+
+  // the table written on close has the new runs, the raw ones are free
+  // again and taken by the next rewrite
+  disk_manager = new DiskManager("test.db", IOMode::COMPRESSED);
+  for (int i = 0; i < num_pages; i++) {
+    disk_manager->ReadPage(i, buffer);
+    sprintf(data, "page %d round 1", i);
+    EXPECT_EQ(0, strcmp(data, buffer));
+    disk_manager->WritePage(i, data);
+  }
+  disk_manager->Sync();
+  EXPECT_GT(2 * num_pages * COMPRESSED_CHUNK_SIZE, FileSize("test.db"));
+  delete disk_manager;
+
+  RemoveFiles();
+}
+
+/*
+ * Scan one table heap through a small buffer pool, stored raw and compressed:
+ * the compressed file is smaller and the scans read fewer bytes from it
+ */
+TEST(CompressedPageStoreTest, ScanVolumeTest) {
+  const int num_tuples = 3000;
+  const int num_scans = 20;
+  Schema *schema =
+      ParseCreateStatement("a varchar(40), b bigint, c integer, d varchar(8)");
+  const char *cities[] = {"Pittsburgh", "Philadelphia", "Harrisburg"};
+  std::vector<Tuple> tuples;
+  for (int i = 0; i < num_tuples; i++) {
+    std::string name = "customer " + std::to_string(i % 500) + " of " +
+                       cities[i % 3];
+    std::vector<Value> values = {
+        Value(TypeId::VARCHAR, name), Value(TypeId::BIGINT, (int64_t)i),
+        Value(TypeId::INTEGER, (int32_t)(i % 10)),
+        Value(TypeId::VARCHAR, std::string(i % 2 ? "open" : "closed"))};
+    tuples.emplace_back(values, schema);
+  }
+
+  uint64_t bytes_read[2];
+  int64_t file_size[2];
+  for (int compressed = 0; compressed < 2; compressed++) {
+    RemoveFiles();
+    IOMode io_mode = compressed ? IOMode::COMPRESSED : IOMode::BUFFERED;
+    DiskManager *disk_manager = new DiskManager("test.db", io_mode);
+    BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+    LockManager *lock_manager = new LockManager(true);
+    Transaction *txn = new Transaction(0);
+    TableHeap *table = new TableHeap(bpm, lock_manager, nullptr, txn);
+    RID rid;
+    for (auto &tuple : tuples)
+      ASSERT_TRUE(table->InsertTuple(tuple, rid, txn));
+    bpm->FlushAllPages();
+
+    uint64_t read_before = disk_manager->GetNumBytesRead();
+    int count = 0;
+    for (int scan = 0; scan < num_scans; scan++) {
+      for (auto itr = table->begin(txn); itr != table->end(); ++itr)
+        count++;
+    }
+    EXPECT_EQ(num_tuples * num_scans, count);
+    bytes_read[compressed] = disk_manager->GetNumBytesRead() - read_before;
+
+    bpm->FlushAllPages();
+    file_size[compressed] = FileSize("test.db");
+    delete table;
+    delete txn;
+    delete lock_manager;
+    delete bpm;
+    delete disk_manager;
+  }
+  // the rows repeat their text, about 60% of the raw volume is left
+  EXPECT_LT(bytes_read[1] * 3, bytes_read[0] * 2);
+  EXPECT_LT(file_size[1] * 3, file_size[0] * 2);
+
+  delete schema;
+  RemoveFiles();
+}
+
+} // namespace cmudb
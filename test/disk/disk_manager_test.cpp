@@ -0,0 +1,628 @@
+/**
+ * disk_manager_test.cpp
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/exception.h"
+#include "disk/async_io.h"
+#include "disk/disk_manager.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(DiskManagerTest, ReadWriteTest) {
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  // start from an empty file, a crashed run may have left one behind
+  remove("test.db");
+  DiskManager *disk_manager = new DiskManager("test.db");
+
+  // reading past the end leaves an untouched buffer
+  memset(buffer, 'x', PAGE_SIZE);
+  disk_manager->ReadPage(5, buffer);
+  EXPECT_EQ('x', buffer[0]);
+
+  memset(data, 0, PAGE_SIZE);
+  strcpy(data, "A test string.");
+  disk_manager->WritePage(5, data);
+  disk_manager->ReadPage(5, buffer);
+  EXPECT_EQ(0, memcmp(buffer, data, PAGE_USABLE_SIZE));
+
+  // the hole before page 5 reads as zeros
+  disk_manager->ReadPage(2, buffer);
+  for (int i = 0; i < PAGE_SIZE; i++)
+    EXPECT_EQ(0, buffer[i]);
+  delete disk_manager;
+
+  // a reopened file hands out page ids after its existing pages
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(6, disk_manager->AllocatePage());
+  disk_manager->ReadPage(5, buffer);
+  EXPECT_EQ(0, memcmp(buffer, data, PAGE_USABLE_SIZE));
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, ConcurrentTest) {
+  const int num_threads = 8;
+  const int pages_per_thread = 64;
+  DiskManager *disk_manager = new DiskManager("test.db");
+
+  // each thread writes its own pages, interleaved with the others
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([disk_manager, tid] {
+      char data[PAGE_SIZE];
+      for (int i = 0; i < pages_per_thread; i++) {
+        page_id_t page_id = i * num_threads + tid;
+        memset(data, page_id % 128, PAGE_SIZE);
+        disk_manager->WritePage(page_id, data);
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  threads.clear();
+
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([disk_manager, tid] {
+      char buffer[PAGE_SIZE];
+      for (int i = pages_per_thread - 1; i >= 0; i--) {
+        page_id_t page_id = i * num_threads + tid;
+        disk_manager->ReadPage(page_id, buffer);
+        EXPECT_EQ(page_id % 128, buffer[0]);
+        EXPECT_EQ(page_id % 128, buffer[PAGE_USABLE_SIZE - 1]);
+      }
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, AsyncTest) {
+  const int num_pages = 100;
+  DiskManager *disk_manager = new DiskManager("test.db");
+
+  // more pages than ASYNC_IO_DEPTH, so submission has to wait for slots
+  std::vector<std::vector<char>> pages(num_pages, std::vector<char>(PAGE_SIZE));
+  std::vector<page_id_t> page_ids;
+  std::vector<const char *> write_datas;
+  for (int i = 0; i < num_pages; i++) {
+    memset(pages[i].data(), 'a' + i % 26, PAGE_SIZE);
+    page_ids.push_back(i);
+    write_datas.push_back(pages[i].data());
+  }
+  for (auto &done : disk_manager->WritePagesAsync(page_ids, write_datas))
+    done.wait();
+
+  std::vector<std::vector<char>> buffers(num_pages,
+                                         std::vector<char>(PAGE_SIZE));
+  std::vector<char *> read_datas;
+  for (int i = 0; i < num_pages; i++)
+    read_datas.push_back(buffers[i].data());
+  for (auto &done : disk_manager->ReadPagesAsync(page_ids, read_datas))
+    done.wait();
+  for (int i = 0; i < num_pages; i++)
+    EXPECT_EQ(0, memcmp(pages[i].data(), buffers[i].data(), PAGE_USABLE_SIZE));
+
+  // past the end of file the buffer is left alone, as with ReadPage
+  char buffer[PAGE_SIZE];
+  memset(buffer, 'x', PAGE_SIZE);
+  disk_manager->ReadPageAsync(num_pages + 10, buffer).wait();
+  EXPECT_EQ('x', buffer[0]);
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, ThreadPoolTest) {
+  int fd = open("test.db", O_RDWR | O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  AsyncIO *async_io = AsyncIO::Create(8, false);
+
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  memset(data, 'z', PAGE_SIZE);
+  std::promise<ssize_t> written, read;
+  std::vector<IORequest> requests;
+  requests.push_back({true, fd, PAGE_SIZE, {{data, PAGE_SIZE}},
+                      [&written](ssize_t rc) { written.set_value(rc); }});
+  async_io->Submit(requests);
+  EXPECT_EQ(PAGE_SIZE, written.get_future().get());
+
+  requests.clear();
+  requests.push_back({false, fd, PAGE_SIZE, {{buffer, PAGE_SIZE}},
+                      [&read](ssize_t rc) { read.set_value(rc); }});
+  async_io->Submit(requests);
+  EXPECT_EQ(PAGE_SIZE, read.get_future().get());
+  EXPECT_EQ(0, memcmp(data, buffer, PAGE_SIZE));
+  delete async_io;
+  close(fd);
+
+  remove("test.db");
+}
+
+TEST(DiskManagerTest, SyncTest) {
+  const int num_threads = 8;
+  DiskManager *disk_manager = new DiskManager("test.db");
+
+  // nothing written, nothing to sync
+  disk_manager->Sync();
+  EXPECT_EQ(0, disk_manager->GetNumSyncs());
+
+  char data[PAGE_SIZE];
+  memset(data, 's', PAGE_SIZE);
+  disk_manager->WritePage(0, data);
+  disk_manager->WritePage(1, data);
+  disk_manager->Sync();
+  EXPECT_EQ(1, disk_manager->GetNumSyncs());
+  disk_manager->Sync();
+  EXPECT_EQ(1, disk_manager->GetNumSyncs());
+
+  // writers syncing together share syncs
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([disk_manager, tid] {
+      char data[PAGE_SIZE];
+      memset(data, tid, PAGE_SIZE);
+      disk_manager->WritePage(tid + 2, data);
+      disk_manager->Sync();
+    }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  EXPECT_LE(disk_manager->GetNumSyncs(), 1 + num_threads);
+  int num_syncs = disk_manager->GetNumSyncs();
+  disk_manager->Sync();
+  EXPECT_EQ(num_syncs, disk_manager->GetNumSyncs());
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * A data file that can't be synced fails the sync, and every later one: the
+ * writes it lost are not known to be durable
+ */
+TEST(DiskManagerTest, SyncFailureTest) {
+  remove("test.db");
+  remove("test.files");
+  remove("test_null.db");
+  // the device accepts writes but rejects syncs
+  ASSERT_EQ(0, symlink("/dev/null", "test_null.db"));
+  DiskManager *disk_manager = new DiskManager("test.db");
+  char data[PAGE_SIZE];
+  memset(data, 's', PAGE_SIZE);
+  disk_manager->WritePage(0, data);
+  EXPECT_TRUE(disk_manager->Sync());
+
+  ASSERT_EQ(1, disk_manager->AddDataFile("test_null.db"));
+  disk_manager->WritePage(DiskManager::MakePageId(1, 0), data);
+  EXPECT_FALSE(disk_manager->Sync());
+  disk_manager->WritePage(1, data);
+  EXPECT_FALSE(disk_manager->Sync());
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+  remove("test.files");
+  remove("test_null.db");
+}
+
+TEST(DiskManagerTest, FreeSpaceMapTest) {
+  DiskManager *disk_manager = new DiskManager("test.db");
+  for (page_id_t i = 0; i < 100; i++)
+    EXPECT_EQ(i, disk_manager->AllocatePage());
+
+  // freed pages are reused, the closest to the hint first
+  disk_manager->DeallocatePage(10);
+  disk_manager->DeallocatePage(50);
+  disk_manager->DeallocatePage(51);
+  EXPECT_EQ(50, disk_manager->AllocatePage(48));
+  EXPECT_EQ(10, disk_manager->AllocatePage(20));
+  EXPECT_EQ(51, disk_manager->AllocatePage(0));
+  EXPECT_EQ(100, disk_manager->AllocatePage());
+
+  // freeing twice, or a page never allocated, has no effect
+  disk_manager->DeallocatePage(30);
+  disk_manager->DeallocatePage(30);
+  disk_manager->DeallocatePage(500);
+  EXPECT_EQ(30, disk_manager->AllocatePage(31));
+  EXPECT_EQ(101, disk_manager->AllocatePage());
+  disk_manager->DeallocatePage(70);
+  delete disk_manager;
+
+  // the map survives reopening
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(70, disk_manager->AllocatePage());
+  EXPECT_EQ(102, disk_manager->AllocatePage());
+
+  // the map page at the end of the first range is never handed out
+  page_id_t map_page_id = FreeSpaceMap::PAGES_PER_MAP - 1;
+  page_id_t page_id = 0;
+  while (page_id < map_page_id + 10) {
+    page_id = disk_manager->AllocatePage();
+    EXPECT_NE(map_page_id, page_id);
+  }
+  disk_manager->DeallocatePage(map_page_id);
+  disk_manager->DeallocatePage(map_page_id + 5);
+  delete disk_manager;
+
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(map_page_id + 5, disk_manager->AllocatePage());
+  EXPECT_EQ(map_page_id + 11, disk_manager->AllocatePage());
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, ExtentTest) {
+  DiskManager *disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(0, disk_manager->AllocatePage());
+
+  // two owners growing in turn share the first extent, then each gets its
+  // own extents
+  std::vector<page_id_t> owners[2];
+  for (int i = 0; i < 200; i++) {
+    for (auto &pages : owners) {
+      page_id_t hint = pages.empty() ? INVALID_PAGE_ID : pages.back();
+      pages.push_back(disk_manager->AllocatePage(hint));
+    }
+  }
+  for (auto &pages : owners) {
+    int jumps = 0;
+    for (size_t i = 1; i < pages.size(); i++) {
+      if (pages[i - 1] >= EXTENT_SIZE && pages[i] != pages[i - 1] + 1) {
+        jumps++;
+        // a jump only happens when an extent is full
+        EXPECT_EQ(0, pages[i] % EXTENT_SIZE);
+        EXPECT_EQ(EXTENT_SIZE - 1, pages[i - 1] % EXTENT_SIZE);
+      }
+    }
+    EXPECT_LE(jumps, 200 / EXTENT_SIZE);
+  }
+
+  // an emptied extent is handed to the next owner that needs one
+  page_id_t extent = owners[1][100] / EXTENT_SIZE;
+  for (auto &page_id : owners[1]) {
+    if (page_id / EXTENT_SIZE == extent)
+      disk_manager->DeallocatePage(page_id);
+  }
+  page_id_t page_id = owners[0].back();
+  while ((page_id + 1) % EXTENT_SIZE != 0)
+    page_id = disk_manager->AllocatePage(page_id);
+  EXPECT_EQ(extent * EXTENT_SIZE, disk_manager->AllocatePage(page_id));
+
+  // contiguous pages go out as one vectored transfer and come back intact
+  std::vector<std::vector<char>> pages(10, std::vector<char>(PAGE_SIZE));
+  std::vector<page_id_t> page_ids;
+  std::vector<const char *> write_datas;
+  std::vector<char *> read_datas;
+  std::vector<std::vector<char>> buffers(10, std::vector<char>(PAGE_SIZE));
+  for (int i = 0; i < 10; i++) {
+    memset(pages[i].data(), 'A' + i, PAGE_SIZE);
+    // out of order, with a gap
+    page_ids.push_back(i < 5 ? 104 - i : 110 + i);
+    write_datas.push_back(pages[i].data());
+    read_datas.push_back(buffers[i].data());
+  }
+  for (auto &done : disk_manager->WritePagesAsync(page_ids, write_datas))
+    done.wait();
+  for (auto &done : disk_manager->ReadPagesAsync(page_ids, read_datas))
+    done.wait();
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(0, memcmp(pages[i].data(), buffers[i].data(), PAGE_USABLE_SIZE));
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, ChecksumTest) {
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  remove("test.db");
+  DiskManager *disk_manager = new DiskManager("test.db");
+  for (int i = 0; i < 4; i++) {
+    memset(data, 'a' + i, PAGE_SIZE);
+    disk_manager->WritePage(i, data);
+  }
+  disk_manager->ReadPage(1, buffer);
+  EXPECT_EQ(1, disk_manager->GetNumChecksumsVerified());
+  EXPECT_EQ(0, disk_manager->GetNumChecksumFailures());
+
+  // flip one byte of page 2 behind the disk manager's back
+  int fd = open("test.db", O_RDWR);
+  ASSERT_GE(fd, 0);
+  char byte = 'z';
+  ASSERT_EQ(1, pwrite(fd, &byte, 1, 2 * PAGE_SIZE + 100));
+  close(fd);
+  EXPECT_THROW(disk_manager->ReadPage(2, buffer), Exception);
+  EXPECT_THROW(disk_manager->ReadPageAsync(2, buffer).get(), Exception);
+  disk_manager->ReadPageAsync(3, buffer).get();
+  EXPECT_EQ(2, disk_manager->GetNumChecksumFailures());
+
+  // sampled verification checks one read in CHECKSUM_SAMPLE_RATE
+  disk_manager->SetChecksumMode(ChecksumMode::SAMPLED);
+  uint64_t verified = disk_manager->GetNumChecksumsVerified();
+  for (int i = 0; i < CHECKSUM_SAMPLE_RATE * 2; i++)
+    disk_manager->ReadPage(1, buffer);
+  EXPECT_EQ(verified + 2, disk_manager->GetNumChecksumsVerified());
+  disk_manager->SetChecksumMode(ChecksumMode::OFF);
+  disk_manager->ReadPage(2, buffer);
+  EXPECT_EQ('z', buffer[100]);
+  disk_manager->SetChecksumMode(ChecksumMode::ALWAYS);
+
+  // the buffer pool hands the frame back and stays usable
+  BufferPoolManager *bpm = new BufferPoolManager(2, disk_manager);
+  EXPECT_THROW(bpm->FetchPage(2), Exception);
+  bpm->PrefetchPages({2});
+  EXPECT_THROW(bpm->FetchPage(2), Exception);
+  Page *pages[2];
+  for (int i = 0; i < 2; i++) {
+    pages[i] = bpm->FetchPage(i);
+    ASSERT_NE(nullptr, pages[i]);
+    EXPECT_EQ('a' + i, pages[i]->GetData()[0]);
+  }
+  EXPECT_EQ(true, bpm->UnpinPage(0, false));
+  EXPECT_EQ(true, bpm->UnpinPage(1, false));
+  delete bpm;
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, DirectIOTest) {
+  page_id_t temp_page_id;
+  DiskManager *disk_manager =
+      new DiskManager("test.db", IOMode::DIRECT, SyncPolicy::FDATASYNC);
+  BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+
+  // frames are aligned, so they are written without a bounce copy
+  for (int i = 0; i < 20; ++i) {
+    auto page = bpm->NewPage(temp_page_id);
+    ASSERT_NE(nullptr, page);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(page->GetData()) %
+                     DIRECT_IO_ALIGN);
+    sprintf(page->GetData(), "page %d", i);
+    EXPECT_EQ(true, bpm->UnpinPage(temp_page_id, true));
+  }
+  char expected[PAGE_SIZE];
+  for (int i = 0; i < 20; ++i) {
+    auto page = bpm->FetchPage(i);
+    ASSERT_NE(nullptr, page);
+    sprintf(expected, "page %d", i);
+    EXPECT_EQ(0, strcmp(page->GetData(), expected));
+    EXPECT_EQ(true, bpm->UnpinPage(i, false));
+  }
+
+  // unaligned buffers still work, through the synchronous and async paths
+  char data[PAGE_SIZE + 1], buffer[PAGE_SIZE + 1];
+  memset(data, 'd', PAGE_SIZE + 1);
+  disk_manager->WritePage(30, data + 1);
+  disk_manager->ReadPage(30, buffer + 1);
+  EXPECT_EQ(0, memcmp(data + 1, buffer + 1, PAGE_USABLE_SIZE));
+  memset(data, 'e', PAGE_SIZE + 1);
+  disk_manager->WritePageAsync(31, data + 1).wait();
+  disk_manager->ReadPageAsync(31, buffer + 1).wait();
+  EXPECT_EQ(0, memcmp(data + 1, buffer + 1, PAGE_USABLE_SIZE));
+
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(DiskManagerTest, MultiFileTest) {
+  char data[PAGE_SIZE], buffer[PAGE_SIZE];
+  remove("test.db");
+  remove("test.files");
+  remove("test_index.db");
+  DiskManager *disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(1, disk_manager->GetNumDataFiles());
+  EXPECT_EQ(1, disk_manager->AddDataFile("test_index.db"));
+  // adding a file twice gives back its number
+  EXPECT_EQ(1, disk_manager->AddDataFile("test_index.db"));
+  EXPECT_EQ(2, disk_manager->GetNumDataFiles());
+
+  // the first file keeps its page ids, a hint in the second file places the
+  // page there, and its neighbours follow it
+  EXPECT_EQ(0, disk_manager->AllocatePage());
+  page_id_t index_page_id =
+      disk_manager->AllocatePage(DiskManager::MakePageId(1, 0));
+  EXPECT_EQ(DiskManager::MakePageId(1, 0), index_page_id);
+  page_id_t next_page_id = disk_manager->AllocatePage(index_page_id);
+  EXPECT_EQ(1, DiskManager::GetFileNumber(next_page_id));
+  EXPECT_EQ(1, DiskManager::GetLocalPageId(next_page_id));
+  EXPECT_EQ(1, disk_manager->AllocatePage());
+  // a hint in a file never added falls back to the first file
+  EXPECT_EQ(2, disk_manager->AllocatePage(DiskManager::MakePageId(9, 0)));
+
+  // pages with the same local id are distinct
+  std::strncpy(data, "table page", sizeof(data));
+  disk_manager->WritePage(1, data);
+  std::strncpy(data, "index page", sizeof(data));
+  disk_manager->WritePage(next_page_id, data);
+  std::vector<char> buffers(2 * PAGE_SIZE);
+  auto futures = disk_manager->ReadPagesAsync(
+      {1, next_page_id}, {buffers.data(), buffers.data() + PAGE_SIZE});
+  for (auto &future : futures)
+    future.get();
+  EXPECT_STREQ("table page", buffers.data());
+  EXPECT_STREQ("index page", buffers.data() + PAGE_SIZE);
+  disk_manager->Sync();
+  delete disk_manager;
+
+  // the second file is opened with the database
+  struct stat stat_buf;
+  ASSERT_EQ(0, stat("test_index.db", &stat_buf));
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(2, disk_manager->GetNumDataFiles());
+  disk_manager->ReadPage(next_page_id, buffer);
+  EXPECT_STREQ("index page", buffer);
+  EXPECT_EQ(DiskManager::MakePageId(1, 2),
+            disk_manager->AllocatePage(next_page_id));
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+  remove("test.files");
+  remove("test_index.db");
+}
+
+/*
+ * A data file ends where its local page ids run out, allocation in it fails
+ * instead of handing out ids of the next file
+ */
+TEST(DiskManagerTest, DataFileLimitTest) {
+  remove("test.db");
+  remove("test.files");
+  remove("test_full.db");
+  // a sparse file holding every page a data file can address but the last
+  int fd = open("test_full.db", O_RDWR | O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(0, ftruncate(fd, static_cast<off_t>((1 << PAGE_FILE_SHIFT) - 1) *
+                                 PAGE_SIZE));
+  close(fd);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  int number = disk_manager->AddDataFile("test_full.db");
+  ASSERT_EQ(1, number);
+  page_id_t last_page_id = DiskManager::MakePageId(
+      number, (1 << PAGE_FILE_SHIFT) - 1);
+  EXPECT_EQ(last_page_id, disk_manager->AllocatePage(last_page_id - 1));
+  EXPECT_EQ(INVALID_PAGE_ID, disk_manager->AllocatePage(last_page_id));
+  EXPECT_EQ(INVALID_PAGE_ID,
+            disk_manager->AllocatePage(DiskManager::MakePageId(number, 0)));
+  // a freed page is still handed out
+  disk_manager->DeallocatePage(DiskManager::MakePageId(number, 7));
+  EXPECT_EQ(DiskManager::MakePageId(number, 7),
+            disk_manager->AllocatePage(DiskManager::MakePageId(number, 0)));
+  // the first file is not affected
+  EXPECT_EQ(0, disk_manager->AllocatePage());
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+  remove("test.files");
+  remove("test_full.db");
+}
+
+/*
+ * The log spans segments, reads cross their boundaries, discarded segments
+ * come back as the next ones and a reopened log ends where recovery says
+ */
+TEST(DiskManagerTest, SegmentedLogTest) {
+  remove("test.db");
+  remove("test.log");
+  auto byte_at = [](int64_t offset) {
+    return static_cast<char>(offset * 7 + offset / 4096);
+  };
+  auto segment_exists = [](int64_t segment) {
+    struct stat stat_buf;
+    return stat(("test.log." + std::to_string(segment)).c_str(), &stat_buf) ==
+           0;
+  };
+  DiskManager *disk_manager =
+      new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  EXPECT_EQ(0, disk_manager->GetLogSize());
+  // the log manager alternates between two buffers
+  std::vector<char> buffers[2];
+  int i = 0;
+  int64_t end = 0;
+  auto write_log = [&](int64_t size) {
+    for (; size > 0; i = 1 - i) {
+      int chunk = std::min<int64_t>(size, 300000);
+      buffers[i].resize(chunk);
+      for (int j = 0; j < chunk; j++)
+        buffers[i][j] = byte_at(end + j);
+      disk_manager->WriteLog(buffers[i].data(), chunk);
+      end += chunk;
+      size -= chunk;
+    }
+  };
+  auto check_log = [&](int64_t offset, int size) {
+    std::vector<char> buffer(size);
+    EXPECT_TRUE(disk_manager->ReadLog(buffer.data(), size, offset));
+    for (int j = 0; j < size && offset + j < end; j++) {
+      if (buffer[j] != byte_at(offset + j)) {
+        ADD_FAILURE() << "log differs at " << offset + j;
+        return;
+      }
+    }
+  };
+
+  write_log(3 * LOG_SEGMENT_SIZE + LOG_SEGMENT_SIZE / 2);
+  EXPECT_EQ(end, disk_manager->GetLogSize());
+  EXPECT_EQ(4, disk_manager->GetNumLogSegments());
+  check_log(LOG_SEGMENT_SIZE - 5000, 10000);
+  check_log(end - 100, 1000);
+  char byte;
+  EXPECT_FALSE(disk_manager->ReadLog(&byte, 1, end));
+
+  // two segments hold records before the offset only, they become spares
+  disk_manager->DiscardLog(2 * LOG_SEGMENT_SIZE + 100);
+  EXPECT_EQ(2 * LOG_SEGMENT_SIZE, disk_manager->GetLogStart());
+  EXPECT_FALSE(disk_manager->ReadLog(&byte, 1, 0));
+  EXPECT_FALSE(segment_exists(0));
+  EXPECT_TRUE(segment_exists(4));
+  EXPECT_TRUE(segment_exists(5));
+  check_log(2 * LOG_SEGMENT_SIZE, 1000);
+  write_log(LOG_SEGMENT_SIZE);
+  EXPECT_EQ(4, disk_manager->GetNumLogSegments());
+  check_log(4 * LOG_SEGMENT_SIZE - 5000, 10000);
+  delete disk_manager;
+
+  // reopened, the log ends with its last segment until truncated
+  disk_manager = new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  EXPECT_EQ(2 * LOG_SEGMENT_SIZE, disk_manager->GetLogStart());
+  EXPECT_EQ(6 * LOG_SEGMENT_SIZE, disk_manager->GetLogSize());
+  disk_manager->TruncateLog(end);
+  EXPECT_EQ(end, disk_manager->GetLogSize());
+  EXPECT_EQ(3, disk_manager->GetNumLogSegments());
+  EXPECT_FALSE(segment_exists(5));
+  check_log(3 * LOG_SEGMENT_SIZE - 5000, 10000);
+  EXPECT_FALSE(disk_manager->ReadLog(&byte, 1, end));
+  delete disk_manager;
+
+  // without its control file the log is new, old segments are removed
+  remove("test.log");
+  disk_manager = new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  EXPECT_EQ(0, disk_manager->GetLogSize());
+  EXPECT_FALSE(segment_exists(2));
+  EXPECT_FALSE(segment_exists(4));
+  delete disk_manager;
+
+  // a new database does not take over the log left under its name
+  disk_manager = new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  end = 0;
+  write_log(LOG_SEGMENT_SIZE + 100);
+  delete disk_manager;
+  remove("test.db");
+  disk_manager = new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  EXPECT_EQ(0, disk_manager->GetLogStart());
+  EXPECT_EQ(0, disk_manager->GetLogSize());
+  EXPECT_FALSE(segment_exists(0));
+  EXPECT_FALSE(segment_exists(1));
+  delete disk_manager;
+
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
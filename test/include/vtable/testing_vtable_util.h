@@ -27,6 +27,15 @@ int ExecCallback(void *NotUsed, int argc, char **argv, char **azColName) {
   return 0;
 }
 
+// the database of the extension with its log, see DiskManager
+void RemoveVtableDatabase() {
+  std::remove("vtable.db");
+  std::remove("vtable.log");
+  std::remove("vtable.files");
+  for (int segment = 0; segment < 16; segment++)
+    std::remove(("vtable.log." + std::to_string(segment)).c_str());
+}
+
 bool ExecSQL(sqlite3 *db, std::string sql) {
   char *zErrMsg = 0;
   int rc = sqlite3_exec(db, sql.c_str(), ExecCallback, 0, &zErrMsg);
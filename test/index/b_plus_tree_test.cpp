@@ -390,4 +390,257 @@ TEST(BPlusTreeTests, ScaleTest) {
   remove("test.db");
   remove("test.log");
 }
+TEST(BPlusTreeTests, ReverseIteratorTest) {
+  // create KeyComparator and index schema
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(30, disk_manager);
+  // create b+ tree
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  // create transaction
+  Transaction *transaction = new Transaction(0);
+  // create and fetch header_page
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // only even keys, so RBegin(key) has to step back for odd keys
+  int64_t scale = 2000;
+  for (int64_t key = 2; key <= scale; key += 2) {
+    rid.Set(0, key);
+    index_key.SetFromInteger(key);
+    tree.Insert(index_key, rid, transaction);
+  }
+
+  // full descending scan walks the prev-leaf chain
+  int64_t current_key = scale;
+  for (auto iterator = tree.RBegin(); iterator.isEnd() == false;
+       --iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key - 2;
+  }
+  EXPECT_EQ(current_key, 0);
+
+  // descending scan from a key that is not present
+  current_key = 1000;
+  index_key.SetFromInteger(1001);
+  for (auto iterator = tree.RBegin(index_key); iterator.isEnd() == false;
+       --iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key - 2;
+  }
+  EXPECT_EQ(current_key, 0);
+
+  // leaves merged by removal must keep both links consistent
+  for (int64_t key = 2; key <= scale; key += 4) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key, transaction);
+  }
+  current_key = scale;
+  for (auto iterator = tree.RBegin(); iterator.isEnd() == false;
+       --iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key - 4;
+  }
+  EXPECT_EQ(current_key, 0);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete transaction;
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(BPlusTreeTests, NonUniqueTest) {
+  // create KeyComparator and index schema
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(30, disk_manager);
+  // create non-unique b+ tree
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree(
+      "foo_idx", bpm, comparator, INVALID_PAGE_ID, false);
+  GenericKey<8> index_key;
+  RID rid;
+  // create transaction
+  Transaction *transaction = new Transaction(0);
+  // create and fetch header_page
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // a few keys with enough rids each to overflow several posting pages,
+  // rids inserted out of order so that pages split in the middle
+  int64_t key_count = 20, dup_count = 300;
+  std::vector<int64_t> slots;
+  for (int64_t slot = 0; slot < dup_count; slot++)
+    slots.push_back(slot);
+  std::random_shuffle(slots.begin(), slots.end());
+  for (int64_t slot : slots) {
+    for (int64_t key = 1; key <= key_count; key++) {
+      rid.Set(key, slot);
+      index_key.SetFromInteger(key);
+      EXPECT_TRUE(tree.Insert(index_key, rid, transaction));
+    }
+  }
+  // the same key-value pair is rejected
+  rid.Set(1, 0);
+  index_key.SetFromInteger(1);
+  EXPECT_FALSE(tree.Insert(index_key, rid, transaction));
+
+  std::vector<RID> rids;
+  for (int64_t key = 1; key <= key_count; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.GetValue(index_key, rids));
+    EXPECT_EQ(rids.size(), (size_t)dup_count);
+    for (int64_t slot = 0; slot < (int64_t)rids.size(); slot++) {
+      EXPECT_EQ(rids[slot].GetPageId(), key);
+      EXPECT_EQ(rids[slot].GetSlotNum(), slot);
+    }
+  }
+
+  // iterators expand posting lists in both directions
+  int64_t count = 0;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_EQ((*iterator).second.GetPageId(), count / dup_count + 1);
+    EXPECT_EQ((*iterator).second.GetSlotNum(), count % dup_count);
+    count++;
+  }
+  EXPECT_EQ(count, key_count * dup_count);
+  for (auto iterator = tree.RBegin(); iterator.isEnd() == false;
+       --iterator) {
+    count--;
+    EXPECT_EQ((*iterator).second.GetPageId(), count / dup_count + 1);
+    EXPECT_EQ((*iterator).second.GetSlotNum(), count % dup_count);
+  }
+  EXPECT_EQ(count, 0);
+
+  // odd keys lose every rid, even keys keep a single one
+  for (int64_t key = 1; key <= key_count; key++) {
+    index_key.SetFromInteger(key);
+    for (int64_t slot : slots) {
+      if (key % 2 == 0 && slot == 7)
+        continue;
+      rid.Set(key, slot);
+      tree.Remove(index_key, rid, transaction);
+    }
+  }
+  for (int64_t key = 1; key <= key_count; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_EQ(tree.GetValue(index_key, rids), key % 2 == 0);
+    if (key % 2 == 0) {
+      EXPECT_EQ(rids.size(), 1u);
+      EXPECT_EQ(rids[0].GetSlotNum(), 7);
+    }
+  }
+  count = 0;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), 7);
+    count++;
+  }
+  EXPECT_EQ(count, key_count / 2);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete transaction;
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(BPlusTreeTests, BatchTest) {
+  // create KeyComparator and index schema
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(30, disk_manager);
+  // create b+ tree
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm,
+                                                           comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  // create transaction
+  Transaction *transaction = new Transaction(0);
+  // create and fetch header_page
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(page_id);
+  (void)header_page;
+
+  // odd keys one by one, even keys as sorted batches that fall between them
+  int64_t scale = 2000;
+  for (int64_t key = 1; key <= scale; key += 2) {
+    rid.Set(0, key);
+    index_key.SetFromInteger(key);
+    tree.Insert(index_key, rid, transaction);
+  }
+  std::vector<std::pair<GenericKey<8>, RID>> entries;
+  for (int64_t key = 2; key <= scale; key += 2) {
+    rid.Set(0, key);
+    index_key.SetFromInteger(key);
+    entries.emplace_back(index_key, rid);
+    if (entries.size() == 100) {
+      EXPECT_TRUE(tree.InsertBatch(entries, transaction));
+      entries.clear();
+    }
+  }
+  // a key already in the unique tree is reported and left alone
+  entries.clear();
+  index_key.SetFromInteger(4);
+  entries.emplace_back(index_key, RID(0, 9999));
+  EXPECT_FALSE(tree.InsertBatch(entries, transaction));
+  std::vector<RID> rids;
+  EXPECT_TRUE(tree.GetValue(index_key, rids));
+  ASSERT_EQ(1u, rids.size());
+  EXPECT_EQ(4, rids[0].GetSlotNum());
+
+  int64_t current_key = 1;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key + 1;
+  }
+  EXPECT_EQ(current_key, scale + 1);
+
+  // remove every key not a multiple of 3 in one batch, leaves underflow and
+  // merge along the way
+  entries.clear();
+  for (int64_t key = 1; key <= scale; key++) {
+    if (key % 3 == 0)
+      continue;
+    rid.Set(0, key);
+    index_key.SetFromInteger(key);
+    entries.emplace_back(index_key, rid);
+  }
+  tree.RemoveBatch(entries, transaction);
+
+  current_key = 3;
+  for (auto iterator = tree.Begin(); iterator.isEnd() == false; ++iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key + 3;
+  }
+  EXPECT_EQ(current_key, scale / 3 * 3 + 3);
+  current_key = scale / 3 * 3;
+  for (auto iterator = tree.RBegin(); iterator.isEnd() == false;
+       --iterator) {
+    EXPECT_EQ((*iterator).second.GetSlotNum(), current_key);
+    current_key = current_key - 3;
+  }
+  EXPECT_EQ(current_key, 0);
+
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete transaction;
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  remove("test.log");
+}
 } // namespace cmudb
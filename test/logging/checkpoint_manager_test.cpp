@@ -0,0 +1,195 @@
+/**
+ * checkpoint_manager_test.cpp
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "logging/common.h"
+#include "logging/log_recovery.h"
+#include "page/header_page.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+// every record of the log file, from offset on
+static std::vector<LogRecord> ReadLogRecords(StorageEngine *storage_engine,
+                                             int64_t offset) {
+  LogRecovery log_recovery(storage_engine->disk_manager_,
+                           storage_engine->buffer_pool_manager_,
+                           storage_engine->log_manager_);
+  int64_t log_size = storage_engine->disk_manager_->GetLogSize();
+  std::vector<char> log(log_size - offset);
+  storage_engine->disk_manager_->ReadLog(log.data(), log.size(), offset);
+  std::vector<LogRecord> log_records;
+  for (size_t pos = 0; pos < log.size();) {
+    LogRecord log_record;
+    EXPECT_TRUE(log_recovery.DeserializeLogRecord(log.data() + pos, log_record));
+    if (log_record.GetSize() <= 0)
+      break;
+    pos += log_record.GetSize();
+    log_records.push_back(log_record);
+  }
+  return log_records;
+}
+
+// header page first, tables only after it
+static void CreateHeaderPage(StorageEngine *storage_engine) {
+  page_id_t header_page_id;
+  auto header_page = static_cast<HeaderPage *>(
+      storage_engine->buffer_pool_manager_->NewPage(header_page_id));
+  EXPECT_EQ(HEADER_PAGE_ID, header_page_id);
+  header_page->Init();
+  storage_engine->buffer_pool_manager_->UnpinPage(header_page_id, true);
+}
+
+/*
+ * The end record lists the running transaction and the pages it dirtied, and
+ * recovery has to start at the first record of that transaction
+ */
+TEST(CheckpointManagerTest, CheckpointRecordsTest) {
+  remove("test.db");
+  remove("test.log");
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  EXPECT_EQ(INVALID_LSN, storage_engine->checkpoint_manager_->Checkpoint());
+  storage_engine->log_manager_->RunFlushThread();
+  CreateHeaderPage(storage_engine);
+
+  Schema *schema = ParseCreateStatement("a varchar, b smallint, c bigint");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  lsn_t first_lsn = txn->GetPrevLSN();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+
+  lsn_t start_lsn = storage_engine->checkpoint_manager_->Checkpoint();
+  EXPECT_EQ(first_lsn, start_lsn);
+
+  // master record
+  auto header_page = static_cast<HeaderPage *>(
+      storage_engine->buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  lsn_t checkpoint_lsn, master_start_lsn;
+  int64_t start_offset;
+  EXPECT_TRUE(header_page->GetCheckpoint(checkpoint_lsn, master_start_lsn,
+                                         start_offset));
+  storage_engine->buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  EXPECT_EQ(start_lsn, master_start_lsn);
+  EXPECT_EQ(0, start_offset);
+
+  std::vector<LogRecord> log_records = ReadLogRecords(storage_engine, 0);
+  ASSERT_GE(log_records.size(), 2u);
+  LogRecord &begin_record = log_records[log_records.size() - 2];
+  LogRecord &end_record = log_records.back();
+  EXPECT_EQ(LogRecordType::CHECKPOINT_BEGIN, begin_record.GetLogRecordType());
+  EXPECT_EQ(checkpoint_lsn, begin_record.GetLSN());
+  EXPECT_EQ(LogRecordType::CHECKPOINT_END, end_record.GetLogRecordType());
+  EXPECT_EQ(checkpoint_lsn, end_record.GetPrevLSN());
+  ASSERT_EQ(1u, end_record.GetActiveTxns().size());
+  EXPECT_EQ(txn->GetTransactionId(), end_record.GetActiveTxns()[0].first);
+  EXPECT_EQ(txn->GetPrevLSN(), end_record.GetActiveTxns()[0].second);
+  bool found = false;
+  for (auto &page : end_record.GetDirtyPages()) {
+    if (page.first == rid.GetPageId()) {
+      found = true;
+      EXPECT_LE(page.second, first_lsn + 2);
+    }
+  }
+  EXPECT_TRUE(found);
+
+  // nothing is active or dirty, recovery starts at the checkpoint
+  storage_engine->transaction_manager_->Commit(txn);
+  storage_engine->buffer_pool_manager_->FlushAllPages();
+  start_lsn = storage_engine->checkpoint_manager_->Checkpoint();
+  EXPECT_EQ(storage_engine->log_manager_->GetNextLSN() - 2, start_lsn);
+  EXPECT_TRUE(storage_engine->transaction_manager_->GetActiveTransactions()
+                  .empty());
+
+  delete txn;
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * After a checkpoint recovery reads the log from its start only: the log
+ * before it is gone, yet committed updates are redone and the loser undone
+ */
+TEST(CheckpointManagerTest, RecoveryFromCheckpointTest) {
+  remove("test.db");
+  remove("test.log");
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  CreateHeaderPage(storage_engine);
+
+  // fixed size tuples, an update always fits in place
+  Schema *schema = ParseCreateStatement("b smallint, c bigint");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  std::vector<RID> rids(200);
+  std::vector<Tuple> tuples;
+  for (auto &rid : rids) {
+    txn = storage_engine->transaction_manager_->Begin();
+    tuples.push_back(ConstructTuple(schema));
+    EXPECT_TRUE(test_table->InsertTuple(tuples.back(), rid, txn));
+    storage_engine->transaction_manager_->Commit(txn);
+    delete txn;
+  }
+  storage_engine->buffer_pool_manager_->FlushAllPages();
+  lsn_t start_lsn = storage_engine->checkpoint_manager_->Checkpoint();
+  EXPECT_NE(INVALID_LSN, start_lsn);
+  int64_t start_offset = storage_engine->log_manager_->GetLogOffset(start_lsn);
+  EXPECT_GT(start_offset, 0);
+
+  // after the checkpoint: committed updates and a loser, pages not written
+  txn = storage_engine->transaction_manager_->Begin();
+  for (int i = 0; i < 10; i++) {
+    tuples[i] = ConstructTuple(schema);
+    EXPECT_TRUE(test_table->UpdateTuple(tuples[i], rids[i], txn));
+  }
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  Transaction *loser = storage_engine->transaction_manager_->Begin();
+  EXPECT_TRUE(test_table->MarkDelete(rids[10], loser));
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), rids[11], loser));
+  delete test_table;
+  delete storage_engine;
+  delete loser;
+
+  storage_engine = new StorageEngine("test.db");
+  LogRecovery log_recovery(storage_engine->disk_manager_,
+                           storage_engine->buffer_pool_manager_,
+                           storage_engine->log_manager_);
+  log_recovery.Redo();
+  log_recovery.Undo();
+  EXPECT_EQ(start_lsn, ReadLogRecords(storage_engine, start_offset)[0].GetLSN());
+
+  txn = storage_engine->transaction_manager_->Begin();
+  test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                             storage_engine->lock_manager_,
+                             storage_engine->log_manager_, first_page_id);
+  for (size_t i = 0; i < rids.size(); i++) {
+    Tuple tuple;
+    EXPECT_TRUE(test_table->GetTuple(rids[i], tuple, txn));
+    EXPECT_EQ(1, tuple.GetValue(schema, 0).CompareEquals(
+                     tuples[i].GetValue(schema, 0)));
+  }
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
@@ -0,0 +1,317 @@
+/**
+ * index_log_test.cpp
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "index/b_plus_tree.h"
+#include "logging/index_log.h"
+#include "logging/log_recovery.h"
+#include "page/header_page.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+typedef BPlusTree<GenericKey<8>, RID, GenericComparator<8>> Tree;
+
+static std::vector<std::string> DatabaseFiles(const std::string &name) {
+  std::string log_name = DiskManager::GetLogName(name + ".db");
+  std::vector<std::string> files{name + ".db", log_name};
+  for (int segment = 0; segment < 4; segment++)
+    files.push_back(DiskManager::GetLogSegmentName(log_name, segment));
+  return files;
+}
+
+static void RemoveDatabase(const std::string &name) {
+  for (auto &file : DatabaseFiles(name))
+    remove(file.c_str());
+}
+
+// the files as a crash would leave them
+static void CopyDatabase(const std::string &from, const std::string &to) {
+  auto from_files = DatabaseFiles(from), to_files = DatabaseFiles(to);
+  for (size_t i = 0; i < from_files.size(); i++) {
+    std::ifstream in(from_files[i], std::ios::binary);
+    if (!in)
+      continue;
+    std::ofstream out(to_files[i], std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+  }
+}
+
+static StorageEngine *StartEngine() {
+  StorageEngine *engine = new StorageEngine("test.db");
+  LogRecovery log_recovery(engine->disk_manager_,
+                           engine->buffer_pool_manager_, engine->log_manager_);
+  log_recovery.Redo();
+  log_recovery.Undo();
+  engine->log_manager_->RunFlushThread();
+  return engine;
+}
+
+static page_id_t ReadRoot(StorageEngine *engine) {
+  auto header_page = static_cast<HeaderPage *>(
+      engine->buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  page_id_t root_page_id = INVALID_PAGE_ID;
+  header_page->GetRootId("foo_pk", root_page_id);
+  engine->buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+  return root_page_id;
+}
+
+static RID ValueOf(int64_t key) { return RID(key, key % 7); }
+
+/*
+ * Splits, merges, redistributions and posting lists are redone from the log
+ * alone: the pages the buffer pool did not write are lost in the crash
+ */
+TEST(IndexLogTest, RedoTest) {
+  RemoveDatabase("test");
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  StorageEngine *engine = new StorageEngine("test.db");
+  page_id_t header_page_id;
+  engine->buffer_pool_manager_->NewPage(header_page_id);
+  engine->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  engine->buffer_pool_manager_->FlushAllPages();
+  engine->log_manager_->RunFlushThread();
+
+  Tree tree("foo_pk", engine->buffer_pool_manager_, comparator,
+            INVALID_PAGE_ID, false, engine->log_manager_);
+  GenericKey<8> index_key;
+  for (int64_t key = 1; key <= 2000; key++) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, ValueOf(key)));
+  }
+  for (int64_t key = 2; key < 1000; key += 2) {
+    index_key.SetFromInteger(key);
+    tree.Remove(index_key);
+  }
+  for (int64_t key = 1001; key <= 2000; key += 100) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, RID(0, 0)));
+  }
+  // crash: the log is flushed on the way out, the pages are not
+  delete engine;
+
+  engine = StartEngine();
+  Tree recovered("foo_pk", engine->buffer_pool_manager_, comparator,
+                 ReadRoot(engine), false, engine->log_manager_);
+  std::vector<RID> rids;
+  for (int64_t key = 1; key <= 2000; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    bool removed = key < 1000 && key % 2 == 0;
+    EXPECT_EQ(!removed, recovered.GetValue(index_key, rids));
+    if (removed)
+      continue;
+    EXPECT_EQ(key > 1000 && key % 100 == 1 ? 2u : 1u, rids.size());
+    EXPECT_TRUE(std::find(rids.begin(), rids.end(), ValueOf(key)) !=
+                rids.end());
+  }
+  // the leaves are linked in key order, posting lists walked in place
+  int count = 0;
+  int64_t last = 0;
+  for (auto it = recovered.Begin(); !it.isEnd(); ++it, count++) {
+    EXPECT_LE(last, (*it).first.ToValue(key_schema, 0).GetAs<int64_t>());
+    last = (*it).first.ToValue(key_schema, 0).GetAs<int64_t>();
+  }
+  EXPECT_EQ(1501 + 10, count);
+
+  delete engine;
+  delete key_schema;
+  RemoveDatabase("test");
+}
+
+/*
+ * A structure modification cut short by a crash is reversed, even with its
+ * pages written; recovering again finds it ended
+ */
+TEST(IndexLogTest, UndoTest) {
+  RemoveDatabase("test");
+  RemoveDatabase("crash");
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  StorageEngine *engine = new StorageEngine("test.db");
+  page_id_t header_page_id;
+  engine->buffer_pool_manager_->NewPage(header_page_id);
+  engine->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  engine->log_manager_->RunFlushThread();
+  Tree tree("foo_pk", engine->buffer_pool_manager_, comparator,
+            INVALID_PAGE_ID, true, engine->log_manager_);
+  GenericKey<8> index_key;
+  for (int64_t key = 1; key <= 100; key++) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(tree.Insert(index_key, ValueOf(key)));
+  }
+  engine->buffer_pool_manager_->FlushAllPages();
+
+  {
+    IndexLog log(engine->log_manager_);
+    index_key.SetFromInteger(50);
+    auto *leaf = tree.FindLeafPage(index_key);
+    leaf->SetValueAt(leaf->KeyIndex(index_key, comparator), RID(7, 7));
+    engine->buffer_pool_manager_->UnpinPage(leaf->GetPageId(), true);
+    engine->log_manager_->WaitForFlush(engine->log_manager_->GetNextLSN() - 1);
+    engine->buffer_pool_manager_->FlushAllPages();
+    CopyDatabase("test", "crash");
+  }
+  delete engine;
+  RemoveDatabase("test");
+  CopyDatabase("crash", "test");
+
+  for (int restart = 0; restart < 2; restart++) {
+    engine = StartEngine();
+    Tree recovered("foo_pk", engine->buffer_pool_manager_, comparator,
+                   ReadRoot(engine), true, engine->log_manager_);
+    std::vector<RID> rids;
+    index_key.SetFromInteger(50);
+    EXPECT_TRUE(recovered.GetValue(index_key, rids));
+    ASSERT_EQ(1u, rids.size());
+    EXPECT_EQ(ValueOf(50), rids[0]);
+    delete engine;
+  }
+
+  delete key_schema;
+  RemoveDatabase("test");
+  RemoveDatabase("crash");
+}
+
+/*
+ * The index entries of a transaction left without commit are undone with
+ * its rows, the ones that split and merged leaves as well
+ */
+TEST(IndexLogTest, TransactionUndoTest) {
+  RemoveDatabase("test");
+  RemoveDatabase("crash");
+  Schema *schema = ParseCreateStatement("a bigint, b int");
+  // the index owns its metadata
+  auto open_index = [schema](StorageEngine *engine, page_id_t root_page_id) {
+    std::string index_sql = "foo_pk a";
+    return ConstructIndex(ParseIndexStatement(index_sql, "foo", schema),
+                          engine->buffer_pool_manager_, root_page_id,
+                          engine->log_manager_);
+  };
+
+  StorageEngine *engine = new StorageEngine("test.db");
+  page_id_t header_page_id;
+  engine->buffer_pool_manager_->NewPage(header_page_id);
+  engine->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  engine->log_manager_->RunFlushThread();
+  Index *index = open_index(engine, INVALID_PAGE_ID);
+  auto row = [schema](int64_t key) {
+    std::vector<Value> values{Value(TypeId::BIGINT, key),
+                              Value(TypeId::INTEGER, (int32_t)key)};
+    return Tuple(values, schema);
+  };
+
+  Transaction *txn = engine->transaction_manager_->Begin();
+  TableHeap heap(engine->buffer_pool_manager_, engine->lock_manager_,
+                 engine->log_manager_, txn);
+  std::vector<RID> rids(401);
+  for (int64_t key = 1; key <= 100; key++) {
+    EXPECT_TRUE(heap.InsertTuple(row(key), rids[key], txn));
+    index->QueueInsertEntry(row(key), schema, rids[key], txn);
+  }
+  EXPECT_TRUE(index->ApplyQueuedEntries(txn));
+  engine->transaction_manager_->Commit(txn);
+
+  // the loser inserts rows that split leaves and deletes rows that merge them
+  txn = engine->transaction_manager_->Begin();
+  for (int64_t key = 101; key <= 400; key++) {
+    EXPECT_TRUE(heap.InsertTuple(row(key), rids[key], txn));
+    index->QueueInsertEntry(row(key), schema, rids[key], txn);
+  }
+  for (int64_t key = 1; key <= 50; key++) {
+    EXPECT_TRUE(heap.MarkDelete(rids[key], txn));
+    index->QueueDeleteEntry(row(key), schema, rids[key], txn);
+  }
+  EXPECT_TRUE(index->ApplyQueuedEntries(txn));
+  engine->log_manager_->WaitForFlush(engine->log_manager_->GetNextLSN() - 1);
+  engine->buffer_pool_manager_->FlushAllPages();
+  CopyDatabase("test", "crash");
+  page_id_t first_page_id = heap.GetFirstPageId();
+  delete index;
+  delete engine;
+  RemoveDatabase("test");
+  CopyDatabase("crash", "test");
+
+  for (int restart = 0; restart < 2; restart++) {
+    engine = StartEngine();
+    index = open_index(engine, ReadRoot(engine));
+    txn = engine->transaction_manager_->Begin();
+    for (int64_t key = 1; key <= 400; key++) {
+      std::vector<Value> values{Value(TypeId::BIGINT, key)};
+      std::vector<RID> result;
+      index->ScanKey(Tuple(values, index->GetKeySchema()), result, txn);
+      if (key > 100) {
+        EXPECT_TRUE(result.empty());
+      } else {
+        ASSERT_EQ(1u, result.size());
+        EXPECT_EQ(rids[key], result[0]);
+      }
+    }
+    TableHeap recovered(engine->buffer_pool_manager_, engine->lock_manager_,
+                        engine->log_manager_, first_page_id);
+    int count = 0;
+    for (auto it = recovered.begin(txn); it != recovered.end(); ++it)
+      count++;
+    EXPECT_EQ(100, count);
+    engine->transaction_manager_->Commit(txn);
+    delete index;
+    delete engine;
+  }
+
+  delete schema;
+  RemoveDatabase("test");
+  RemoveDatabase("crash");
+}
+
+/*
+ * A page deleted by a structure modification is released once the end record
+ * is durable, a page the operation created and never logged right away
+ */
+TEST(IndexLogTest, DeletePageTest) {
+  RemoveDatabase("test");
+  StorageEngine *engine = new StorageEngine("test.db");
+  BufferPoolManager *buffer_pool_manager = engine->buffer_pool_manager_;
+  page_id_t header_page_id, page_id, fresh_page_id, reused_page_id;
+  buffer_pool_manager->NewPage(header_page_id);
+  buffer_pool_manager->UnpinPage(header_page_id, true);
+  buffer_pool_manager->NewPage(page_id);
+  buffer_pool_manager->UnpinPage(page_id, true);
+  buffer_pool_manager->FlushAllPages();
+  engine->log_manager_->RunFlushThread();
+
+  {
+    IndexLog log(engine->log_manager_);
+    char *data = buffer_pool_manager->FetchPage(page_id)->GetData();
+    std::strncpy(data + 8, "logged", 7);
+    buffer_pool_manager->UnpinPage(page_id, true);
+    EXPECT_TRUE(buffer_pool_manager->DeletePage(page_id));
+
+    buffer_pool_manager->NewPage(fresh_page_id, page_id);
+    EXPECT_NE(page_id, fresh_page_id);
+    buffer_pool_manager->UnpinPage(fresh_page_id, false);
+    EXPECT_TRUE(buffer_pool_manager->DeletePage(fresh_page_id));
+    buffer_pool_manager->NewPage(reused_page_id, page_id);
+    EXPECT_EQ(fresh_page_id, reused_page_id);
+    buffer_pool_manager->UnpinPage(reused_page_id, false);
+  }
+  EXPECT_EQ(engine->log_manager_->GetNextLSN() - 1,
+            engine->log_manager_->GetPersistentLSN());
+  buffer_pool_manager->NewPage(reused_page_id, page_id);
+  EXPECT_EQ(page_id, reused_page_id);
+  buffer_pool_manager->UnpinPage(reused_page_id, false);
+
+  delete engine;
+  RemoveDatabase("test");
+}
+} // namespace cmudb
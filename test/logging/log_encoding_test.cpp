@@ -0,0 +1,95 @@
+/**
+ * log_encoding_test.cpp
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "logging/common.h"
+#include "logging/log_record.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(LogEncodingTest, VarintTest) {
+  char buffer[2 * MAX_VARINT32_SIZE];
+  for (int64_t value : {0l, 1l, 127l, 128l, 16383l, 16384l, 2147483647l}) {
+    char *end = PutVarint(buffer, value);
+    EXPECT_EQ(VarintSize(value), end - buffer);
+    const char *pos = buffer;
+    uint64_t result;
+    EXPECT_TRUE(GetVarint(pos, end, result));
+    EXPECT_EQ(static_cast<uint64_t>(value), result);
+    EXPECT_EQ(end, pos);
+    // a varint cut short is not read
+    pos = buffer;
+    EXPECT_FALSE(GetVarint(pos, end - 1, result));
+  }
+  for (int64_t value : {0l, -1l, 1l, -2147483648l, 2147483647l})
+    EXPECT_EQ(value, ZigZagDecode(ZigZagEncode(value)));
+  EXPECT_EQ(1, VarintSize(ZigZagEncode(INVALID_PAGE_ID)));
+}
+
+/*
+ * A delta turns either image into the other, and only from the image it was
+ * made for
+ */
+TEST(LogEncodingTest, TupleDeltaTest) {
+  std::vector<std::pair<std::string, std::string>> images = {
+      {"abcdefghijklmnop", "abcdefghijklmnop"},
+      {"abcdefghijklmnop", "abXdefghijklmnoY"},
+      {"abcdefghijklmnop", "abXYefghijklZnop"},
+      {"abcdefghijklmnop", "abcdefgh"},
+      {"abcdefgh", "abcdXXXXXXXXefgh"},
+      {"abcdefgh", "ijklmnopqrs"},
+  };
+  for (auto &image : images) {
+    std::string &old_image = image.first, &new_image = image.second;
+    std::vector<char> delta, result;
+    MakeTupleDelta(old_image.data(), old_image.size(), new_image.data(),
+                   new_image.size(), delta);
+    EXPECT_TRUE(ApplyTupleDelta(delta.data(), delta.size(), old_image.data(),
+                                old_image.size(), true, result));
+    EXPECT_EQ(new_image, std::string(result.begin(), result.end()));
+    EXPECT_TRUE(ApplyTupleDelta(delta.data(), delta.size(), new_image.data(),
+                                new_image.size(), false, result));
+    EXPECT_EQ(old_image, std::string(result.begin(), result.end()));
+    if (old_image != new_image) {
+      EXPECT_FALSE(ApplyTupleDelta(delta.data(), delta.size(),
+                                   new_image.data(), new_image.size(), true,
+                                   result));
+    }
+  }
+}
+
+/*
+ * An update of one column logs a few bytes, not both images of the tuple
+ */
+TEST(LogEncodingTest, UpdateRecordSizeTest) {
+  Schema *schema = ParseCreateStatement("a bigint, b bigint, c bigint, d int, "
+                                        "e int, f smallint, g varchar(32)");
+  Tuple old_tuple = ConstructTuple(schema);
+  std::vector<Value> values;
+  for (int i = 0; i < schema->GetColumnCount(); i++)
+    values.push_back(old_tuple.GetValue(schema, i));
+  values[1] = Value(TypeId::BIGINT, values[1].GetAs<int64_t>() + 1);
+  Tuple new_tuple(values, schema);
+
+  LogRecord log_record(0, INVALID_LSN, LogRecordType::UPDATE, RID(1, 2),
+                       old_tuple, new_tuple);
+  int full_size = 2 * (sizeof(int32_t) + old_tuple.GetLength());
+  std::cout << "update record: " << log_record.GetMaxSize()
+            << " bytes at most, images alone: " << full_size << " bytes"
+            << std::endl;
+  EXPECT_LT(log_record.GetMaxSize(), full_size / 2);
+
+  std::vector<char> result;
+  auto &delta = log_record.GetUpdateDelta();
+  EXPECT_TRUE(ApplyTupleDelta(delta.data(), delta.size(), old_tuple.GetData(),
+                              old_tuple.GetLength(), true, result));
+  EXPECT_EQ(0, memcmp(new_tuple.GetData(), result.data(), result.size()));
+  delete schema;
+}
+
+} // namespace cmudb
@@ -1,6 +1,10 @@
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "logging/common.h"
 #include "logging/log_recovery.h"
@@ -41,14 +45,17 @@ TEST(LogManagerTest, BasicLogging) {
   LOG_DEBUG("Turning off flushing thread");
 
   // some basic manually checking here
-  char buffer[PAGE_SIZE];
-  storage_engine->disk_manager_->ReadLog(buffer, PAGE_SIZE, 0);
-  int32_t size = *reinterpret_cast<int32_t *>(buffer);
-  LOG_DEBUG("size  = %d", size);
-  size = *reinterpret_cast<int32_t *>(buffer + 20);
-  LOG_DEBUG("size  = %d", size);
-  size = *reinterpret_cast<int32_t *>(buffer + 44);
-  LOG_DEBUG("size  = %d", size);
+  LogRecovery log_recovery(storage_engine->disk_manager_,
+                           storage_engine->buffer_pool_manager_,
+                           storage_engine->log_manager_);
+  char buffer[LOG_BUFFER_SIZE];
+  storage_engine->disk_manager_->ReadLog(buffer, LOG_BUFFER_SIZE, 0);
+  for (int i = 0, pos = 0; i < 3; i++) {
+    LogRecord log_record;
+    EXPECT_TRUE(log_recovery.DeserializeLogRecord(buffer + pos, log_record));
+    LOG_DEBUG("size  = %d", log_record.GetSize());
+    pos += log_record.GetSize();
+  }
 
   delete txn;
   delete storage_engine;
@@ -101,7 +108,8 @@ TEST(LogManagerTest, RedoTestWithOneTxn) {
   // restart system
   storage_engine = new StorageEngine("test.db");
   LogRecovery *log_recovery = new LogRecovery(
-      storage_engine->disk_manager_, storage_engine->buffer_pool_manager_);
+      storage_engine->disk_manager_, storage_engine->buffer_pool_manager_,
+      storage_engine->log_manager_);
 
   log_recovery->Redo();
   log_recovery->Undo();
@@ -124,4 +132,541 @@ TEST(LogManagerTest, RedoTestWithOneTxn) {
   remove("test.log");
 }
 
+/*
+ * A transaction left running at the crash is rolled back by undo, a committed
+ * one stays. Undo logs its work and ends the loser with an abort record, so
+ * recovering again after a second crash gives the same tables
+ */
+TEST(LogManagerTest, UndoTestWithLoserTxn) {
+  remove("test.db");
+  remove("test.log");
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+
+  Schema *schema =
+      ParseCreateStatement("a varchar, b smallint, c bigint, d bool, e "
+                           "varchar(16)");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  std::vector<Tuple> tuples;
+  std::vector<RID> rids(3);
+  for (int i = 0; i < 3; i++) {
+    tuples.push_back(ConstructTuple(schema));
+    EXPECT_TRUE(test_table->InsertTuple(tuples[i], rids[i], txn));
+  }
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // the loser inserts, deletes and updates
+  Transaction *loser = storage_engine->transaction_manager_->Begin();
+  RID loser_rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), loser_rid, loser));
+  EXPECT_TRUE(test_table->MarkDelete(rids[0], loser));
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), rids[1], loser));
+  delete test_table;
+  // crash: the log is flushed on the way out, the pages are not
+  delete storage_engine;
+  delete loser;
+
+  for (int restart = 0; restart < 2; restart++) {
+    storage_engine = new StorageEngine("test.db");
+    LogRecovery log_recovery(storage_engine->disk_manager_,
+                             storage_engine->buffer_pool_manager_,
+                             storage_engine->log_manager_);
+    log_recovery.Redo();
+    log_recovery.Undo();
+
+    txn = storage_engine->transaction_manager_->Begin();
+    test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                               storage_engine->lock_manager_,
+                               storage_engine->log_manager_, first_page_id);
+    for (int i = 0; i < 3; i++) {
+      Tuple tuple;
+      EXPECT_TRUE(test_table->GetTuple(rids[i], tuple, txn));
+      EXPECT_EQ(tuple.GetValue(schema, 4).CompareEquals(
+                    tuples[i].GetValue(schema, 4)),
+                1);
+    }
+    Tuple tuple;
+    EXPECT_FALSE(test_table->GetTuple(loser_rid, tuple, txn));
+    storage_engine->transaction_manager_->Commit(txn);
+    delete txn;
+    delete test_table;
+    delete storage_engine;
+  }
+
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * An applied delete does not log its tuple: undo has to rebuild it from the
+ * loser's insert or markdelete of the rid and the updates after it
+ */
+TEST(LogManagerTest, UndoAppliedDeleteTest) {
+  remove("test.db");
+  remove("test.log");
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+
+  Schema *schema = ParseCreateStatement("b smallint, c bigint");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  Tuple tuple = ConstructTuple(schema);
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(tuple, rid, txn));
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // the loser's commit or abort applies the deletes, then it crashes
+  Transaction *loser = storage_engine->transaction_manager_->Begin();
+  RID loser_rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), loser_rid, loser));
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), loser_rid, loser));
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), loser_rid, loser));
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), rid, loser));
+  EXPECT_TRUE(test_table->MarkDelete(rid, loser));
+  test_table->ApplyDelete(loser_rid, loser);
+  test_table->ApplyDelete(rid, loser);
+  delete test_table;
+  delete storage_engine;
+  delete loser;
+
+  for (int restart = 0; restart < 2; restart++) {
+    storage_engine = new StorageEngine("test.db");
+    LogRecovery log_recovery(storage_engine->disk_manager_,
+                             storage_engine->buffer_pool_manager_,
+                             storage_engine->log_manager_);
+    log_recovery.Redo();
+    log_recovery.Undo();
+
+    txn = storage_engine->transaction_manager_->Begin();
+    test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                               storage_engine->lock_manager_,
+                               storage_engine->log_manager_, first_page_id);
+    Tuple recovered;
+    EXPECT_TRUE(test_table->GetTuple(rid, recovered, txn));
+    EXPECT_EQ(tuple.GetLength(), recovered.GetLength());
+    EXPECT_EQ(0, memcmp(tuple.GetData(), recovered.GetData(),
+                        tuple.GetLength()));
+    EXPECT_FALSE(test_table->GetTuple(loser_rid, recovered, txn));
+    storage_engine->transaction_manager_->Commit(txn);
+    delete txn;
+    delete test_table;
+    delete storage_engine;
+  }
+
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * A record that does not match its page stops recovery: the page lost the
+ * tuple an update record was logged for, without a record of its own
+ */
+TEST(LogManagerTest, CorruptionTest) {
+  remove("test.db");
+  remove("test.log");
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+
+  Schema *schema = ParseCreateStatement("b smallint, c bigint");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  EXPECT_TRUE(storage_engine->buffer_pool_manager_->FlushAllPages());
+  txn = storage_engine->transaction_manager_->Begin();
+  EXPECT_TRUE(test_table->UpdateTuple(ConstructTuple(schema), rid, txn));
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  delete test_table;
+  delete storage_engine;
+
+  storage_engine = new StorageEngine("test.db");
+  auto page = static_cast<TablePage *>(
+      storage_engine->buffer_pool_manager_->FetchPage(first_page_id));
+  page->ApplyDelete(rid, nullptr, nullptr);
+  storage_engine->buffer_pool_manager_->UnpinPage(first_page_id, true);
+  EXPECT_TRUE(storage_engine->buffer_pool_manager_->FlushPage(first_page_id));
+  LogRecovery log_recovery(storage_engine->disk_manager_,
+                           storage_engine->buffer_pool_manager_,
+                           storage_engine->log_manager_);
+  EXPECT_THROW(log_recovery.Redo(), Exception);
+  delete storage_engine;
+
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * Time to recover from a log of updates with 1 and 4 redo workers. The log is
+ * log_mb megabytes, a few thousand gives a multi-GB log. Pages are never
+ * written, so every run replays the whole log onto empty pages and must end
+ * with the last value written to each tuple
+ */
+TEST(LogManagerTest, RecoveryBenchmarkTest) {
+  remove("test.db");
+  remove("test.log");
+  const int64_t log_mb = 8;
+  const int pool_size = 256;
+  const int num_tuples = 2000;
+  Schema *schema = ParseCreateStatement("b smallint, c bigint");
+  auto make_tuple = [schema](int64_t value) {
+    std::vector<Value> values{Value(TypeId::SMALLINT, (int16_t)(value % 1000)),
+                              Value(TypeId::BIGINT, value)};
+    return Tuple(values, schema);
+  };
+
+  DiskManager *disk_manager =
+      new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  LogManager *log_manager = new LogManager(disk_manager);
+  BufferPoolManager *bpm =
+      new BufferPoolManager(pool_size, disk_manager, log_manager);
+  LockManager *lock_manager = new LockManager(true);
+  TransactionManager *txn_manager =
+      new TransactionManager(lock_manager, log_manager);
+  log_manager->RunFlushThread();
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *table = new TableHeap(bpm, lock_manager, log_manager, txn);
+  page_id_t first_page_id = table->GetFirstPageId();
+  std::vector<RID> rids(num_tuples);
+  std::vector<int64_t> values(num_tuples);
+  for (int i = 0; i < num_tuples; i++) {
+    values[i] = i;
+    EXPECT_TRUE(table->InsertTuple(make_tuple(i), rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  for (int64_t k = num_tuples; disk_manager->GetLogSize() < (log_mb << 20);) {
+    txn = txn_manager->Begin();
+    for (int j = 0; j < 100; j++, k++) {
+      values[k % num_tuples] = k;
+      EXPECT_TRUE(table->UpdateTuple(make_tuple(k), rids[k % num_tuples], txn));
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+  }
+  log_manager->StopFlushThread();
+  int64_t log_size = disk_manager->GetLogSize();
+  // crash, no page is written
+  delete table;
+  delete txn_manager;
+  delete lock_manager;
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+
+  for (int num_threads : {1, 4}) {
+    disk_manager = new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+    log_manager = new LogManager(disk_manager);
+    bpm = new BufferPoolManager(pool_size, disk_manager, log_manager);
+    lock_manager = new LockManager(true);
+    txn_manager = new TransactionManager(lock_manager, log_manager);
+    LogRecovery log_recovery(disk_manager, bpm, log_manager);
+    log_recovery.SetRedoThreads(num_threads);
+    auto start = std::chrono::steady_clock::now();
+    log_recovery.Redo();
+    log_recovery.Undo();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << num_threads << " redo threads: " << elapsed.count() << " s, "
+              << log_size / elapsed.count() / (1 << 20) << " MB/s of log"
+              << std::endl;
+    EXPECT_EQ(log_size, disk_manager->GetLogSize());
+
+    txn = txn_manager->Begin();
+    table = new TableHeap(bpm, lock_manager, log_manager, first_page_id);
+    for (int i = 0; i < num_tuples; i++) {
+      Tuple tuple;
+      EXPECT_TRUE(table->GetTuple(rids[i], tuple, txn));
+      EXPECT_EQ(values[i], tuple.GetValue(schema, 1).GetAs<int64_t>());
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+    delete table;
+    delete txn_manager;
+    delete lock_manager;
+    // pages are dropped again, the next run starts from the same crash
+    delete bpm;
+    delete log_manager;
+    delete disk_manager;
+  }
+
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * Commits per second with 1 and 8 committing threads. Every commit waits for
+ * its record to be durable; with more threads, commits arriving during a flush
+ * share the next one, so there are fewer log writes than commits
+ */
+TEST(LogManagerTest, GroupCommitBenchmarkTest) {
+  remove("test.db");
+  remove("test.log");
+  DiskManager *disk_manager = new DiskManager("test.db");
+  LogManager *log_manager = new LogManager(disk_manager);
+  BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager, log_manager);
+  LockManager *lock_manager = new LockManager(true);
+  TransactionManager *txn_manager =
+      new TransactionManager(lock_manager, log_manager);
+  log_manager->RunFlushThread();
+  log_manager->SetFlushThreshold(LOG_BUFFER_SIZE / 2);
+
+  Schema *schema = ParseCreateStatement("a varchar, b smallint, c bigint");
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *table = new TableHeap(bpm, lock_manager, log_manager, txn);
+  txn_manager->Commit(txn);
+  delete txn;
+  Tuple tuple = ConstructTuple(schema);
+
+  const int commits_per_thread = 100;
+  int total_commits = 1;
+  for (int num_threads : {1, 8}) {
+    int flushes_before = disk_manager->GetNumFlushes();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread([&] {
+        for (int j = 0; j < commits_per_thread; j++) {
+          Transaction *txn = txn_manager->Begin();
+          RID rid;
+          EXPECT_TRUE(table->InsertTuple(tuple, rid, txn));
+          txn_manager->Commit(txn);
+          // durable on return
+          EXPECT_LE(txn->GetPrevLSN(), log_manager->GetPersistentLSN());
+          delete txn;
+        }
+      }));
+    }
+    for (auto &thread : threads)
+      thread.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    int commits = num_threads * commits_per_thread;
+    int flushes = disk_manager->GetNumFlushes() - flushes_before;
+    total_commits += commits;
+    std::cout << num_threads << " threads: " << commits / elapsed.count()
+              << " commits/s, " << static_cast<double>(commits) / flushes
+              << " commits per log flush" << std::endl;
+    if (num_threads > 1) {
+      EXPECT_LT(flushes, commits);
+    }
+  }
+  log_manager->StopFlushThread();
+
+  // every record made it to the log, in LSN order
+  // records starting in the first half are whole
+  LogRecovery log_recovery(disk_manager, bpm, log_manager);
+  std::vector<char> log(2 * LOG_BUFFER_SIZE);
+  int offset = 0, num_commits = 0;
+  lsn_t prev_lsn = INVALID_LSN;
+  while (disk_manager->ReadLog(log.data(), log.size(), offset)) {
+    int pos = 0;
+    LogRecord log_record;
+    while (pos < LOG_BUFFER_SIZE &&
+           log_recovery.DeserializeLogRecord(log.data() + pos, log_record)) {
+      EXPECT_EQ(prev_lsn + 1, log_record.GetLSN());
+      prev_lsn = log_record.GetLSN();
+      if (log_record.GetLogRecordType() == LogRecordType::COMMIT)
+        num_commits++;
+      pos += log_record.GetSize();
+      log_record = LogRecord();
+    }
+    offset += pos;
+  }
+  EXPECT_EQ(total_commits, num_commits);
+
+  delete table;
+  delete schema;
+  delete txn_manager;
+  delete lock_manager;
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * An asynchronous commit returns before its record is durable, and the record
+ * is flushed within the max lag without anyone waiting for it. Commits in a
+ * row share flushes
+ */
+TEST(LogManagerTest, AsyncCommitTest) {
+  remove("test.db");
+  remove("test.log");
+  DiskManager *disk_manager = new DiskManager("test.db");
+  LogManager *log_manager = new LogManager(disk_manager);
+  LockManager *lock_manager = new LockManager(true);
+  TransactionManager *txn_manager =
+      new TransactionManager(lock_manager, log_manager);
+  const auto max_lag = std::chrono::milliseconds(200);
+  log_manager->SetMaxCommitLag(max_lag);
+  log_manager->SetFlushInterval(std::chrono::seconds(60));
+  log_manager->RunFlushThread();
+
+  Transaction *txn = txn_manager->Begin();
+  txn->SetAsyncCommit(true);
+  txn_manager->Commit(txn);
+  lsn_t commit_lsn = txn->GetPrevLSN();
+  EXPECT_LT(log_manager->GetPersistentLSN(), commit_lsn);
+  log_manager->WaitForFlush(commit_lsn);
+  EXPECT_GE(log_manager->GetPersistentLSN(), commit_lsn);
+  delete txn;
+
+  // nobody waits, the deadline flushes
+  txn_manager->SetAsyncCommit(true);
+  const int num_commits = 100;
+  int flushes_before = disk_manager->GetNumFlushes();
+  for (int i = 0; i < num_commits; i++) {
+    txn = txn_manager->Begin();
+    EXPECT_TRUE(txn->IsAsyncCommit());
+    txn_manager->Commit(txn);
+    commit_lsn = txn->GetPrevLSN();
+    delete txn;
+  }
+  std::this_thread::sleep_for(2 * max_lag);
+  EXPECT_GE(log_manager->GetPersistentLSN(), commit_lsn);
+  EXPECT_LT(disk_manager->GetNumFlushes() - flushes_before, num_commits / 2);
+
+  log_manager->StopFlushThread();
+  delete txn_manager;
+  delete lock_manager;
+  delete log_manager;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * A failed log write leaves persistent_lsn_ and the end of the log where they
+ * were and fails the commit waiting for it. Later records follow a hole, they
+ * are not written either
+ */
+TEST(LogManagerTest, LogWriteFailureTest) {
+  remove("test.db");
+  remove("test.log");
+  DiskManager *disk_manager =
+      new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  // the first log segment can't be created
+  ASSERT_EQ(0, mkdir("test.log.0", 0755));
+  LogManager *log_manager = new LogManager(disk_manager);
+  LockManager *lock_manager = new LockManager(true);
+  TransactionManager *txn_manager =
+      new TransactionManager(lock_manager, log_manager);
+  log_manager->RunFlushThread();
+
+  Transaction *txn = txn_manager->Begin();
+  EXPECT_FALSE(txn_manager->Commit(txn));
+  EXPECT_EQ(INVALID_LSN, log_manager->GetPersistentLSN());
+  EXPECT_EQ(0, disk_manager->GetLogSize());
+  delete txn;
+
+  rmdir("test.log.0");
+  txn = txn_manager->Begin();
+  EXPECT_FALSE(txn_manager->Commit(txn));
+  EXPECT_FALSE(log_manager->WaitForFlush(txn->GetPrevLSN()));
+  EXPECT_EQ(INVALID_LSN, log_manager->GetPersistentLSN());
+  EXPECT_EQ(0, disk_manager->GetLogSize());
+  delete txn;
+
+  log_manager->StopFlushThread();
+  delete txn_manager;
+  delete lock_manager;
+  delete log_manager;
+  delete disk_manager;
+  rmdir("test.log.0");
+  remove("test.db");
+  remove("test.log");
+}
+
+/*
+ * Records appended per second by 1 to 8 threads, without syncs so the append
+ * path is measured. Appenders only meet on the reservation word and, once
+ * the buffer is full, on the swap. Every LSN must reach the log once
+ */
+TEST(LogManagerTest, ConcurrentAppendBenchmarkTest) {
+  remove("test.db");
+  remove("test.log");
+  DiskManager *disk_manager =
+      new DiskManager("test.db", IOMode::BUFFERED, SyncPolicy::NONE);
+  LogManager *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+
+  Schema *schema = ParseCreateStatement("a varchar, b smallint, c bigint");
+  Tuple old_tuple = ConstructTuple(schema);
+  Tuple new_tuple = ConstructTuple(schema);
+  const int records_per_thread = 20000;
+  int total_records = 0;
+  for (int num_threads : {1, 2, 4, 8}) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread([&, i] {
+        lsn_t prev_lsn = INVALID_LSN;
+        for (int j = 0; j < records_per_thread; j++) {
+          LogRecord log_record(i, prev_lsn, LogRecordType::UPDATE, RID(i, j),
+                               old_tuple, new_tuple);
+          lsn_t lsn = log_manager->AppendLogRecord(log_record);
+          EXPECT_LT(prev_lsn, lsn);
+          prev_lsn = lsn;
+        }
+      }));
+    }
+    for (auto &thread : threads)
+      thread.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    total_records += num_threads * records_per_thread;
+    std::cout << num_threads << " threads: "
+              << num_threads * records_per_thread / elapsed.count()
+              << " records/s" << std::endl;
+  }
+  log_manager->StopFlushThread();
+  EXPECT_EQ(total_records - 1, log_manager->GetPersistentLSN());
+
+  // the log holds every LSN once and in order, each record whole
+  LogRecovery log_recovery(disk_manager, nullptr, log_manager);
+  std::vector<char> log(2 * LOG_BUFFER_SIZE);
+  int offset = 0, num_records = 0;
+  while (disk_manager->ReadLog(log.data(), log.size(), offset)) {
+    int pos = 0;
+    LogRecord log_record;
+    while (pos < LOG_BUFFER_SIZE &&
+           log_recovery.DeserializeLogRecord(log.data() + pos, log_record)) {
+      EXPECT_EQ(num_records, log_record.GetLSN());
+      EXPECT_EQ(LogRecordType::UPDATE, log_record.GetLogRecordType());
+      num_records++;
+      pos += log_record.GetSize();
+      log_record = LogRecord();
+    }
+    offset += pos;
+  }
+  EXPECT_EQ(total_records, num_records);
+
+  delete schema;
+  delete log_manager;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
 } // namespace cmudb
@@ -0,0 +1,304 @@
+/**
+ * standby_test.cpp
+ */
+
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "logging/standby.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+static void RemoveDatabase(const std::string &name) {
+  remove((name + ".db").c_str());
+  remove((name + ".log").c_str());
+  for (int segment = 0; segment < 16; segment++)
+    remove((name + ".log." + std::to_string(segment)).c_str());
+}
+
+// the base copy of the standby, taken while the primary is idle
+static void CopyDatabase(const std::string &from, const std::string &to) {
+  std::ifstream in(from + ".db", std::ios::binary);
+  std::ofstream out(to + ".db", std::ios::binary | std::ios::trunc);
+  out << in.rdbuf();
+}
+
+static Tuple MakeTuple(Schema *schema, int key, int length) {
+  std::string text(length, 'a' + key % 26);
+  std::vector<Value> values{
+      Value(TypeId::INTEGER, key),
+      Value(TypeId::VARCHAR, text.c_str(), text.size() + 1, true)};
+  return Tuple(values, schema);
+}
+
+// key of the tuple at rid on the standby, -1 if there is none
+static int ReadKey(StorageEngine *engine, TableHeap *table, Schema *schema,
+                   const RID &rid) {
+  Transaction *txn = engine->transaction_manager_->Begin();
+  Tuple tuple;
+  int key = -1;
+  if (table->GetTuple(rid, tuple, txn))
+    key = tuple.GetValue(schema, 0).GetAs<int32_t>();
+  engine->transaction_manager_->Commit(txn);
+  delete txn;
+  return key;
+}
+
+/*
+ * A standby started from a copy catches up with the changes made since, then
+ * keeps up with the primary. Changes of a running transaction are seen, a
+ * restarted standby resumes after its restart point. ENABLE_LOGGING is global:
+ * the standby replays while the primary's flush thread is stopped, as in a
+ * process of its own
+ */
+TEST(StandbyTest, ReplayTest) {
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+  Schema *schema = ParseCreateStatement("a int, b varchar(200)");
+
+  StorageEngine *primary = new StorageEngine("primary.db");
+  page_id_t header_page_id;
+  primary->buffer_pool_manager_->NewPage(header_page_id);
+  primary->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  primary->log_manager_->RunFlushThread();
+
+  Transaction *txn = primary->transaction_manager_->Begin();
+  TableHeap *table = new TableHeap(primary->buffer_pool_manager_,
+                                   primary->lock_manager_,
+                                   primary->log_manager_, txn);
+  page_id_t first_page_id = table->GetFirstPageId();
+  std::vector<RID> rids(10);
+  for (int i = 0; i < 10; i++)
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 10), rids[i], txn));
+  primary->transaction_manager_->Commit(txn);
+  delete txn;
+  primary->buffer_pool_manager_->FlushAllPages();
+  primary->checkpoint_manager_->Checkpoint();
+
+  primary->log_manager_->StopFlushThread();
+  CopyDatabase("primary", "standby");
+  StorageEngine *standby = new StorageEngine("standby.db");
+  primary->log_manager_->RunFlushThread();
+
+  // committed changes after the copy, new pages included
+  txn = primary->transaction_manager_->Begin();
+  for (int i = 10; i < 100; i++) {
+    rids.emplace_back();
+    EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, i, 100), rids[i], txn));
+  }
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 1000, 10), rids[0], txn));
+  primary->transaction_manager_->Commit(txn);
+  delete txn;
+  // a transaction still running
+  Transaction *running = primary->transaction_manager_->Begin();
+  rids.emplace_back();
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 100, 10), rids[100],
+                                 running));
+  EXPECT_TRUE(table->MarkDelete(rids[1], running));
+  primary->log_manager_->StopFlushThread();
+
+  Standby *replica =
+      new Standby("primary.db", standby->disk_manager_,
+                  standby->buffer_pool_manager_, standby->log_manager_);
+  EXPECT_GT(replica->Replay(), 0);
+  EXPECT_EQ(primary->log_manager_->GetNextLSN() - 1, replica->GetReplayLSN());
+  EXPECT_EQ(0, replica->Replay());
+  TableHeap *standby_table = new TableHeap(
+      standby->buffer_pool_manager_, standby->lock_manager_,
+      standby->log_manager_, first_page_id);
+  EXPECT_EQ(1000, ReadKey(standby, standby_table, schema, rids[0]));
+  EXPECT_EQ(-1, ReadKey(standby, standby_table, schema, rids[1]));
+  for (int i = 2; i <= 100; i++)
+    EXPECT_EQ(i, ReadKey(standby, standby_table, schema, rids[i]));
+
+  // restarted, replay goes on after the restart point
+  replica->Restartpoint();
+  lsn_t replay_lsn = replica->GetReplayLSN();
+  delete replica;
+  replica = new Standby("primary.db", standby->disk_manager_,
+                        standby->buffer_pool_manager_, standby->log_manager_);
+  EXPECT_EQ(replay_lsn, replica->GetReplayLSN());
+  EXPECT_EQ(0, replica->Replay());
+
+  primary->log_manager_->RunFlushThread();
+  EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, 2000, 10), rids[100],
+                                 running));
+  primary->transaction_manager_->Commit(running);
+  delete running;
+  primary->log_manager_->StopFlushThread();
+  EXPECT_GT(replica->Replay(), 0);
+  EXPECT_EQ(primary->log_manager_->GetNextLSN() - 1, replica->GetReplayLSN());
+  EXPECT_EQ(2000, ReadKey(standby, standby_table, schema, rids[100]));
+  EXPECT_EQ(-1, ReadKey(standby, standby_table, schema, rids[1]));
+
+  delete replica;
+  delete standby_table;
+  delete table;
+  delete primary;
+  delete standby;
+  delete schema;
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+}
+
+/*
+ * Once the primary discards the log the standby is to read next, the standby
+ * stops replaying
+ */
+TEST(StandbyTest, FallBehindTest) {
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+  Schema *schema = ParseCreateStatement("a int, b varchar(200)");
+
+  StorageEngine *primary = new StorageEngine("primary.db");
+  page_id_t header_page_id;
+  primary->buffer_pool_manager_->NewPage(header_page_id);
+  primary->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  primary->buffer_pool_manager_->FlushAllPages();
+  CopyDatabase("primary", "standby");
+  StorageEngine *standby = new StorageEngine("standby.db");
+  Standby *replica =
+      new Standby("primary.db", standby->disk_manager_,
+                  standby->buffer_pool_manager_, standby->log_manager_);
+  // nothing to read before the primary creates its log
+  primary->log_manager_->RunFlushThread();
+
+  Transaction *txn = primary->transaction_manager_->Begin();
+  TableHeap *table = new TableHeap(primary->buffer_pool_manager_,
+                                   primary->lock_manager_,
+                                   primary->log_manager_, txn);
+  RID rid;
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 0, 200), rid, txn));
+  primary->transaction_manager_->Commit(txn);
+  delete txn;
+  primary->log_manager_->StopFlushThread();
+  EXPECT_GT(replica->Replay(), 0);
+  primary->log_manager_->RunFlushThread();
+
+  // two segments of log, the first one discarded by the checkpoint. Every
+  // byte of the tuple changes, an update logs about twice its size
+  for (int i = 1; primary->disk_manager_->GetLogSize() < 2 * LOG_SEGMENT_SIZE;
+       i++) {
+    txn = primary->transaction_manager_->Begin();
+    EXPECT_TRUE(table->UpdateTuple(MakeTuple(schema, i, 200), rid, txn));
+    primary->transaction_manager_->Commit(txn);
+    delete txn;
+  }
+  primary->buffer_pool_manager_->FlushAllPages();
+  primary->checkpoint_manager_->Checkpoint();
+  primary->log_manager_->StopFlushThread();
+  EXPECT_LT(0, primary->disk_manager_->GetLogStart());
+  EXPECT_EQ(-1, replica->Replay());
+  EXPECT_EQ(-1, replica->Replay());
+
+  delete replica;
+  delete table;
+  delete primary;
+  delete standby;
+  delete schema;
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+}
+
+// the durable end the primary published, set to end if not -1
+static int64_t PublishedEnd(int64_t end = -1) {
+  int fd = open("primary.log", O_RDWR);
+  int64_t durable_end = -1;
+  DiskManager::ReadLogControl(fd, durable_end);
+  if (end != -1) {
+    EXPECT_EQ(8, pwrite(fd, &end, 8, 16));
+  }
+  close(fd);
+  return durable_end;
+}
+
+// flips a byte of the primary's log at offset
+static void FlipLogByte(int64_t offset) {
+  int fd = open(DiskManager::GetLogSegmentName("primary.log",
+                                               offset / LOG_SEGMENT_SIZE)
+                    .c_str(),
+                O_RDWR);
+  char byte;
+  EXPECT_EQ(1, pread(fd, &byte, 1, offset % LOG_SEGMENT_SIZE));
+  byte ^= 0x10;
+  EXPECT_EQ(1, pwrite(fd, &byte, 1, offset % LOG_SEGMENT_SIZE));
+  close(fd);
+}
+
+/*
+ * Bytes past the durable end the primary published are not replayed, nor is
+ * a record whose checksum does not match
+ */
+TEST(StandbyTest, DurableEndTest) {
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+  Schema *schema = ParseCreateStatement("a int, b varchar(200)");
+
+  StorageEngine *primary = new StorageEngine("primary.db");
+  page_id_t header_page_id;
+  primary->buffer_pool_manager_->NewPage(header_page_id);
+  primary->buffer_pool_manager_->UnpinPage(header_page_id, true);
+  primary->buffer_pool_manager_->FlushAllPages();
+  CopyDatabase("primary", "standby");
+  StorageEngine *standby = new StorageEngine("standby.db");
+  Standby *replica =
+      new Standby("primary.db", standby->disk_manager_,
+                  standby->buffer_pool_manager_, standby->log_manager_);
+  primary->log_manager_->RunFlushThread();
+
+  Transaction *txn = primary->transaction_manager_->Begin();
+  TableHeap *table = new TableHeap(primary->buffer_pool_manager_,
+                                   primary->lock_manager_,
+                                   primary->log_manager_, txn);
+  RID rids[2];
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 0, 10), rids[0], txn));
+  primary->transaction_manager_->Commit(txn);
+  delete txn;
+  primary->log_manager_->StopFlushThread();
+  int64_t first_end = PublishedEnd();
+  EXPECT_EQ(primary->disk_manager_->GetLogSize(), first_end);
+  primary->log_manager_->RunFlushThread();
+  txn = primary->transaction_manager_->Begin();
+  EXPECT_TRUE(table->InsertTuple(MakeTuple(schema, 1, 10), rids[1], txn));
+  primary->transaction_manager_->Commit(txn);
+  delete txn;
+  primary->log_manager_->StopFlushThread();
+  int64_t second_end = PublishedEnd();
+  EXPECT_LT(first_end, second_end);
+
+  // the second transaction as if it was written but not synced yet
+  PublishedEnd(first_end);
+  EXPECT_GT(replica->Replay(), 0);
+  lsn_t replay_lsn = replica->GetReplayLSN();
+  TableHeap *standby_table = new TableHeap(
+      standby->buffer_pool_manager_, standby->lock_manager_,
+      standby->log_manager_, table->GetFirstPageId());
+  EXPECT_EQ(0, ReadKey(standby, standby_table, schema, rids[0]));
+  EXPECT_EQ(-1, ReadKey(standby, standby_table, schema, rids[1]));
+
+  PublishedEnd(second_end);
+  FlipLogByte(first_end + 3);
+  EXPECT_EQ(0, replica->Replay());
+  EXPECT_EQ(replay_lsn, replica->GetReplayLSN());
+  FlipLogByte(first_end + 3);
+  EXPECT_GT(replica->Replay(), 0);
+  EXPECT_EQ(primary->log_manager_->GetNextLSN() - 1, replica->GetReplayLSN());
+  EXPECT_EQ(1, ReadKey(standby, standby_table, schema, rids[1]));
+
+  delete replica;
+  delete standby_table;
+  delete table;
+  delete primary;
+  delete standby;
+  delete schema;
+  RemoveDatabase("primary");
+  RemoveDatabase("standby");
+}
+
+} // namespace cmudb
@@ -5,8 +5,8 @@
 #include "page/header_page.h"
 #include "gtest/gtest.h"
 
-// NOTE: when you running this test, make sure page size(config.h) is at least
-// 4096
+// NOTE: 27 records fit in the header page alone only if page size(config.h)
+// is at least 4096, with smaller pages they go on in chained pages
 namespace cmudb {
 
 TEST(HeaderPageTest, UnitTest) {
@@ -21,35 +21,48 @@ TEST(HeaderPageTest, UnitTest) {
 
   for (int i = 1; i < 28; i++) {
     std::string name = std::to_string(i);
-    EXPECT_EQ(page->InsertRecord(name, i), true);
+    EXPECT_EQ(page->InsertRecord(buffer_pool_manager, name, i), true);
   }
+  EXPECT_EQ(page->InsertRecord(buffer_pool_manager, "1", 1), false);
 
   for (int i = 27; i >= 1; i--) {
     std::string name = std::to_string(i);
     page_id_t root_id;
-    EXPECT_EQ(page->GetRootId(name, root_id), true);
-    // std::cout << "root page id is " << root_id << '\n';
+    EXPECT_EQ(page->GetRootId(buffer_pool_manager, name, root_id), true);
+    EXPECT_EQ(i, root_id);
   }
 
   for (int i = 1; i < 28; i++) {
     std::string name = std::to_string(i);
-    EXPECT_EQ(page->UpdateRecord(name, i + 10), true);
+    EXPECT_EQ(page->UpdateRecord(buffer_pool_manager, name, i + 10), true);
   }
 
   for (int i = 27; i >= 1; i--) {
     std::string name = std::to_string(i);
     page_id_t root_id;
-    EXPECT_EQ(page->GetRootId(name, root_id), true);
-    // std::cout << "root page id is " << root_id << '\n';
+    EXPECT_EQ(page->GetRootId(buffer_pool_manager, name, root_id), true);
+    EXPECT_EQ(i + 10, root_id);
   }
 
   for (int i = 1; i < 28; i++) {
     std::string name = std::to_string(i);
-    EXPECT_EQ(page->DeleteRecord(name), true);
+    EXPECT_EQ(page->DeleteRecord(buffer_pool_manager, name), true);
   }
-
+  page_id_t root_id;
+  EXPECT_EQ(page->GetRootId(buffer_pool_manager, "1", root_id), false);
   EXPECT_EQ(page->GetRecordCount(), 0);
 
+  // the chained pages are reused, not chained again
+  for (int i = 1; i < 28; i++) {
+    std::string name = std::to_string(i);
+    EXPECT_EQ(page->InsertRecord(buffer_pool_manager, name, i), true);
+  }
+  page_id_t next_page_id;
+  EXPECT_NE(nullptr, buffer_pool_manager->NewPage(next_page_id));
+  EXPECT_EQ(true, buffer_pool_manager->UnpinPage(next_page_id, false));
+  EXPECT_GT(28 * 36 / PAGE_USABLE_SIZE + 3, next_page_id);
+
+  buffer_pool_manager->UnpinPage(header_page_id, true);
   delete buffer_pool_manager;
   delete disk_manager;
   remove("test.db");
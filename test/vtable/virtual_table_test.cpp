@@ -1,6 +1,11 @@
 /**
  * virtual_table_test.cpp
  */
+#include <cstring>
+#include <sys/stat.h>
+
+#include "buffer/buffer_pool_manager.h"
+#include "page/header_page.h"
 #include "vtable/testing_vtable_util.h"
 
 namespace cmudb {
@@ -11,7 +16,7 @@ TEST(VtableTest, CreateTest) {
   EXPECT_TRUE(sqlite3_threadsafe());
   std::string db_file = "sqlite.db";
   remove(db_file.c_str());
-  remove("vtable.db");
+  RemoveVtableDatabase();
   sqlite3 *db;
   int rc;
   rc = sqlite3_open(db_file.c_str(), &db);
@@ -30,6 +35,8 @@ TEST(VtableTest, CreateTest) {
       db, "CREATE VIRTUAL TABLE foo1 USING vtable ('a INT, b "
           "int, c smallint, d varchar, e bigint, f bool', 'foo1_pk b')"));
   EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo1 VALUES(1, 2, 3, 'hello', 2,1)"));
+  // the commits below do not wait for the log
+  EXPECT_TRUE(ExecSQL(db, "SELECT vtable_async_commit(1)"));
   EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo1 VALUES(3, 4, 5, 'Nihao',4, 1)"));
   EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo1 VALUES(2, 3, 4, 'world',3, 1)"));
   EXPECT_TRUE(ExecSQL(db, "SELECT * FROM foo1"));
@@ -41,7 +48,641 @@ TEST(VtableTest, CreateTest) {
   EXPECT_EQ(rc, SQLITE_OK);
 
   remove(db_file.c_str());
-  remove("vtable.db");
+  RemoveVtableDatabase();
   return;
 }
+/** ORDER BY on the indexed column is answered by walking the index leaves,
+ *  in either direction
+ */
+TEST(VtableTest, OrderByTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo2 USING vtable ('a INT, "
+                          "b varchar', 'foo2_pk a')"));
+  std::vector<int> keys = {5, 1, 4, 2, 3};
+  for (auto key : keys) {
+    std::string sql = "INSERT INTO foo2 VALUES(" + std::to_string(key) +
+                      ", 'row" + std::to_string(key) + "')";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+
+  sqlite3_stmt *stmt;
+  // ascending
+  rc = sqlite3_prepare_v2(db, "SELECT a FROM foo2 ORDER BY a", -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  int expected = 1;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), expected);
+    expected++;
+  }
+  EXPECT_EQ(expected, 6);
+  sqlite3_finalize(stmt);
+
+  // descending with limit, "latest N rows by key"
+  rc = sqlite3_prepare_v2(db, "SELECT a, b FROM foo2 ORDER BY a DESC LIMIT 2",
+                          -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  expected = 5;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), expected);
+    EXPECT_EQ(std::string(reinterpret_cast<const char *>(
+                  sqlite3_column_text(stmt, 1))),
+              "row" + std::to_string(expected));
+    expected--;
+  }
+  EXPECT_EQ(expected, 3);
+  sqlite3_finalize(stmt);
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo2"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+// idxNum of the plan sqlite picked for a query, see VtabBestIndex
+static int PlanIndexNumber(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  int idx_num = -1;
+  std::string plan_sql = "EXPLAIN QUERY PLAN " + sql;
+  if (sqlite3_prepare_v2(db, plan_sql.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    return idx_num;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    std::string detail(
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3)));
+    std::string::size_type n = detail.find("VIRTUAL TABLE INDEX ");
+    if (n != std::string::npos)
+      idx_num = std::stoi(detail.substr(n + 20));
+  }
+  sqlite3_finalize(stmt);
+  return idx_num;
+}
+
+static int QueryCount(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  int count = 0;
+  if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK)
+    return -1;
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+    count++;
+  sqlite3_finalize(stmt);
+  return count;
+}
+
+/** Queries reading only key and included columns are answered from the
+ *  index entries
+ */
+TEST(VtableTest, CoveringIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo3 USING vtable ('a INT, "
+                          "b bigint, c varchar', 'foo3_pk a include b')"));
+  for (int key = 1; key <= 5; key++) {
+    std::string sql = "INSERT INTO foo3 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key * 100) + ", 'row" +
+                      std::to_string(key) + "')";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+
+  // 0x100 is the covering bit of idxNum, the heap is not read
+  EXPECT_TRUE(PlanIndexNumber(db, "SELECT b FROM foo3 WHERE a = 3") & 0x100);
+  EXPECT_TRUE(PlanIndexNumber(db, "SELECT a, b FROM foo3 ORDER BY a DESC") &
+              0x100);
+  EXPECT_FALSE(PlanIndexNumber(db, "SELECT b, c FROM foo3 WHERE a = 2") &
+               0x100);
+
+  sqlite3_stmt *stmt;
+  // included column straight from the index
+  rc = sqlite3_prepare_v2(db, "SELECT b FROM foo3 WHERE a = 3", -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(sqlite3_column_int64(stmt, 0), 300);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+  sqlite3_finalize(stmt);
+
+  rc = sqlite3_prepare_v2(db, "SELECT a, b FROM foo3 ORDER BY a DESC", -1,
+                          &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  int expected = 5;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    EXPECT_EQ(sqlite3_column_int(stmt, 0), expected);
+    EXPECT_EQ(sqlite3_column_int64(stmt, 1), expected * 100);
+    expected--;
+  }
+  EXPECT_EQ(expected, 0);
+  sqlite3_finalize(stmt);
+
+  // c is not in the index, it has to come from the heap
+  rc = sqlite3_prepare_v2(db, "SELECT b, c FROM foo3 WHERE a = 2", -1, &stmt,
+                          0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(sqlite3_column_int64(stmt, 0), 200);
+  EXPECT_EQ(std::string(reinterpret_cast<const char *>(
+                sqlite3_column_text(stmt, 1))),
+            "row2");
+  sqlite3_finalize(stmt);
+
+  // the index entry follows updates of included columns
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo3 SET b = 7 WHERE a = 4"));
+  rc = sqlite3_prepare_v2(db, "SELECT b FROM foo3 WHERE a = 4", -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(sqlite3_column_int64(stmt, 0), 7);
+  sqlite3_finalize(stmt);
+
+  // key and included columns must fit the widest index key
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE foo3b USING vtable ('a INT, "
+                           "b varchar(60), c varchar(60)', "
+                           "'foo3b_pk a include b, c')"));
+  // indexed varchars keep to their declared width
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo3c USING vtable ('a INT, "
+                          "b varchar(8)', 'foo3c_pk b include a')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo3c VALUES(1, 'eight ch')"));
+  EXPECT_FALSE(ExecSQL(db, "INSERT INTO foo3c VALUES(2, 'nine char')"));
+  EXPECT_FALSE(ExecSQL(db, "UPDATE foo3c SET b = 'nine char' WHERE a = 1"));
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo3c"), 1);
+  EXPECT_EQ(QueryCount(db, "SELECT a FROM foo3c WHERE b = 'eight ch'"), 1);
+  EXPECT_EQ(QueryCount(db, "SELECT a FROM foo3c WHERE b = 'nine char'"), 0);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo3c"));
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo3"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+TEST(VtableTest, NonUniqueIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // low-cardinality column, every status value is shared by many rows
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo4 USING vtable ('a INT, "
+                          "status INT', 'foo4_status status nonunique')"));
+  int row_count = 300;
+  for (int key = 0; key < row_count; key++) {
+    std::string sql = "INSERT INTO foo4 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key % 3) + ")";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+
+  sqlite3_stmt *stmt;
+  rc = sqlite3_prepare_v2(db, "SELECT a FROM foo4 WHERE status = 1", -1,
+                          &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  int count = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    EXPECT_EQ(sqlite3_column_int(stmt, 0) % 3, 1);
+    count++;
+  }
+  EXPECT_EQ(count, row_count / 3);
+  sqlite3_finalize(stmt);
+
+  // deleting some rows of a key keeps the others reachable
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo4 WHERE status = 1 AND a < 150"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo4 SET status = 1 WHERE a = 3"));
+  rc = sqlite3_prepare_v2(db, "SELECT count(*) FROM foo4 WHERE status = 1",
+                          -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(sqlite3_column_int(stmt, 0), 51);
+  sqlite3_finalize(stmt);
+  rc = sqlite3_prepare_v2(db, "SELECT count(*) FROM foo4 WHERE status = 0",
+                          -1, &stmt, 0);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(sqlite3_column_int(stmt, 0), row_count / 3 - 1);
+  sqlite3_finalize(stmt);
+
+  // a nonunique index can't include columns, the statement fails
+  EXPECT_FALSE(ExecSQL(db, "CREATE VIRTUAL TABLE foo4b USING vtable ('a INT, "
+                           "b INT', 'foo4b_b b include a nonunique')"));
+  EXPECT_FALSE(ExecSQL(db, "SELECT * FROM foo4b"));
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo4"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** Every index of a table is maintained, and each query shape is answered
+ *  by the index that suits it
+ */
+TEST(VtableTest, MultiIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo5 USING vtable ('a INT, "
+                          "b INT, c varchar', 'foo5_pk a', "
+                          "'foo5_b b nonunique')"));
+  for (int key = 1; key <= 100; key++) {
+    std::string sql = "INSERT INTO foo5 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key % 10) + ", 'row" +
+                      std::to_string(key) + "')";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+
+  // the low 8 bits are the scan, the bits from 16 on the index
+  EXPECT_EQ(PlanIndexNumber(db, "SELECT * FROM foo5 WHERE a = 5"), 1);
+  EXPECT_EQ(PlanIndexNumber(db, "SELECT * FROM foo5 WHERE b = 5"),
+            1 << 16 | 1);
+  // the unique index is cheaper when both apply
+  EXPECT_EQ(PlanIndexNumber(db, "SELECT * FROM foo5 WHERE b = 5 AND a = 5"),
+            1);
+  EXPECT_EQ(PlanIndexNumber(db, "SELECT * FROM foo5 ORDER BY b DESC"),
+            1 << 16 | 3);
+  EXPECT_EQ(PlanIndexNumber(db, "SELECT * FROM foo5 WHERE c = 'row5'"), 0);
+
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE b = 5"), 10);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE b = 5 AND a = 15"), 1);
+
+  // both indexes follow deletes and updates
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo5 WHERE a = 25"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo5 SET b = 0 WHERE a = 35"));
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE b = 5"), 8);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE a = 25"), 0);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE b = 0"), 11);
+
+  // index roots survive a reconnect through the header page
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE b = 5"), 8);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo5 WHERE a = 35"), 1);
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo5"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** Index changes of a transaction are queued and applied in key order, reads
+ *  inside the transaction still see them
+ */
+TEST(VtableTest, BatchIndexTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo6 USING vtable ('a INT, "
+                          "b INT, c INT', 'foo6_pk a', "
+                          "'foo6_b b nonunique')"));
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  for (int key = 50; key >= 1; key--) {
+    std::string sql = "INSERT INTO foo6 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key % 5) + ", 0)";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 WHERE b = 3"), 10);
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo6 SELECT a + 100, b, c FROM foo6"));
+  // c is in no index, b moves between keys
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo6 SET c = 1 WHERE b = 3"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo6 SET b = 3 WHERE b = 4"));
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo6 WHERE a > 140"));
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 WHERE a = 103"), 1);
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 WHERE b = 3"), 36);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 WHERE b = 4"), 0);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 WHERE a = 145"), 0);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo6 ORDER BY a DESC"), 90);
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo6"));
+
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** A row whose key a unique index holds is rejected, queued entries
+ *  included, and the rows before it stay
+ */
+TEST(VtableTest, UniqueKeyTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo11 USING vtable ('a INT, "
+                          "b INT', 'foo11_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo11 VALUES(1, 1)"));
+  EXPECT_EQ(sqlite3_exec(db, "INSERT INTO foo11 VALUES(1, 2)", nullptr,
+                         nullptr, nullptr),
+            SQLITE_CONSTRAINT);
+  EXPECT_TRUE(ExecSQL(db, "BEGIN"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo11 VALUES(2, 2)"));
+  // the entry of key 2 is still queued
+  EXPECT_EQ(sqlite3_exec(db, "INSERT INTO foo11 VALUES(2, 3)", nullptr,
+                         nullptr, nullptr),
+            SQLITE_CONSTRAINT);
+  EXPECT_EQ(sqlite3_exec(db, "UPDATE foo11 SET a = 1 WHERE b = 2", nullptr,
+                         nullptr, nullptr),
+            SQLITE_CONSTRAINT);
+  // a key freed in the transaction may be taken again
+  EXPECT_TRUE(ExecSQL(db, "DELETE FROM foo11 WHERE a = 1"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo11 SET a = 1 WHERE b = 2"));
+  EXPECT_TRUE(ExecSQL(db, "UPDATE foo11 SET b = 4 WHERE a = 1"));
+  EXPECT_TRUE(ExecSQL(db, "COMMIT"));
+
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo11"), 1);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo11 WHERE a = 1"), 1);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo11 WHERE a = 2"), 0);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo11 WHERE b = 4"), 1);
+
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo11"));
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** A database opened with VTABLE_READ_ONLY is read from its mapping, every
+ *  write fails with SQLITE_READONLY and leaves the tables as they were
+ */
+TEST(VtableTest, ReadOnlyTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo7 USING vtable ('a INT, "
+                          "b INT', 'foo7_pk a')"));
+  for (int key = 1; key <= 100; key++) {
+    std::string sql = "INSERT INTO foo7 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key % 10) + ")";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  setenv("VTABLE_READ_ONLY", "1", 1);
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo7"), 100);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo7 WHERE a = 50"), 1);
+
+  EXPECT_EQ(sqlite3_exec(db, "INSERT INTO foo7 VALUES(101, 1)", nullptr,
+                         nullptr, nullptr),
+            SQLITE_READONLY);
+  EXPECT_EQ(sqlite3_exec(db, "UPDATE foo7 SET b = 0 WHERE a = 5", nullptr,
+                         nullptr, nullptr),
+            SQLITE_READONLY);
+  EXPECT_EQ(sqlite3_exec(db, "DELETE FROM foo7 WHERE a < 10", nullptr,
+                         nullptr, nullptr),
+            SQLITE_READONLY);
+  EXPECT_NE(sqlite3_exec(db, "CREATE VIRTUAL TABLE foo8 USING vtable ('a "
+                             "INT', 'foo8_pk a')",
+                         nullptr, nullptr, nullptr),
+            SQLITE_OK);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo7"), 100);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo7 WHERE a = 101"), 0);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo7 WHERE b = 0"), 10);
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  unsetenv("VTABLE_READ_ONLY");
+
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo7"));
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** The header page carries the on-disk format of the file, a file of another
+ *  format is refused before anything is recovered from it
+ */
+static void SetFormatVersion(uint32_t version) {
+  DiskManager disk_manager("vtable.db");
+  BufferPoolManager bpm(BUFFER_POOL_SIZE, &disk_manager);
+  auto *header_page = static_cast<HeaderPage *>(bpm.FetchPage(HEADER_PAGE_ID));
+  ASSERT_NE(nullptr, header_page);
+  header_page->SetFormatVersion(version);
+  bpm.UnpinPage(HEADER_PAGE_ID, true);
+  EXPECT_TRUE(bpm.FlushPage(HEADER_PAGE_ID));
+}
+
+TEST(VtableTest, FormatVersionTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo12 USING vtable ('a INT, "
+                          "b INT', 'foo12_pk a')"));
+  EXPECT_TRUE(ExecSQL(db, "INSERT INTO foo12 VALUES(1, 2)"));
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // a file of an older format
+  SetFormatVersion(0);
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_NE(rc, SQLITE_OK);
+  ASSERT_NE(nullptr, zErrMsg);
+  EXPECT_NE(nullptr, strstr(zErrMsg, "on-disk format 0"));
+  sqlite3_free(zErrMsg);
+  zErrMsg = 0;
+  EXPECT_NE(sqlite3_exec(db, "SELECT * FROM foo12", nullptr, nullptr,
+                         nullptr),
+            SQLITE_OK);
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  SetFormatVersion(FORMAT_VERSION);
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo12"), 1);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo12"));
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  RemoveVtableDatabase();
+}
+
+/** 'in <file>' places a table or an index in a data file of its own, the
+ *  files are opened again with the database
+ */
+TEST(VtableTest, DataFileTest) {
+  std::string db_file = "sqlite.db";
+  remove(db_file.c_str());
+  remove("foo9_data.db");
+  remove("foo9_index.db");
+  RemoveVtableDatabase();
+  sqlite3 *db;
+  int rc;
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  char *zErrMsg = 0;
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  EXPECT_NE(sqlite3_exec(db, "CREATE VIRTUAL TABLE foo10 USING vtable ('a "
+                             "INT', 'foo10_pk a in two files')",
+                         nullptr, nullptr, nullptr),
+            SQLITE_OK);
+  EXPECT_TRUE(ExecSQL(db, "CREATE VIRTUAL TABLE foo9 USING vtable ('a INT, "
+                          "b INT', 'in foo9_data.db', 'foo9_pk a IN "
+                          "foo9_index.db', 'foo9_b b nonunique')"));
+  for (int key = 1; key <= 200; key++) {
+    std::string sql = "INSERT INTO foo9 VALUES(" + std::to_string(key) + ", " +
+                      std::to_string(key % 10) + ")";
+    EXPECT_TRUE(ExecSQL(db, sql));
+  }
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  // the table and its first index are out of the database file
+  struct stat stat_buf;
+  ASSERT_EQ(0, stat("foo9_data.db", &stat_buf));
+  EXPECT_GT(stat_buf.st_size, 0);
+  ASSERT_EQ(0, stat("foo9_index.db", &stat_buf));
+  EXPECT_GT(stat_buf.st_size, 0);
+
+  rc = sqlite3_open(db_file.c_str(), &db);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_enable_load_extension(db, 1);
+  EXPECT_EQ(rc, SQLITE_OK);
+  rc = sqlite3_load_extension(db, "libvtable", 0, &zErrMsg);
+  EXPECT_EQ(rc, SQLITE_OK);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo9"), 200);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo9 WHERE a = 150"), 1);
+  EXPECT_EQ(QueryCount(db, "SELECT * FROM foo9 WHERE b = 3"), 20);
+  EXPECT_TRUE(ExecSQL(db, "DROP TABLE foo9"));
+  rc = sqlite3_close(db);
+  EXPECT_EQ(rc, SQLITE_OK);
+
+  remove(db_file.c_str());
+  remove("foo9_data.db");
+  remove("foo9_index.db");
+  RemoveVtableDatabase();
+}
 } // namespace cmudb